@@ -0,0 +1,558 @@
+/*
+ * PDU - PostgreSQL Data Unloader
+ * Copyright (c) 2024-2025 ZhangChen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * async_io.c - Asynchronous positional reads (io_uring or pread threads)
+ *
+ * A queue keeps up to depth reads in flight. io_uring is driven through
+ * the raw syscalls so no liburing is needed; where the kernel or a
+ * container policy refuses io_uring_setup, a small pool of threads doing
+ * pread() takes over with the same interface.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "async_io.h"
+#include "basic.h"
+
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>) && defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+#define HAVE_IO_URING 1
+#endif
+#endif
+
+struct aioQueue
+{
+	int backend;
+	int depth;
+	int inFlight;
+	pid_t owner;
+
+	/* completed requests not yet returned by aioWaitAny */
+	aioRequest **done;
+	int doneHead;
+	int doneCount;
+
+	/* AIO_BACKEND_THREADS */
+	pthread_t threads[AIO_MAX_THREADS];
+	int nThreads;
+	aioRequest **todo;
+	int todoHead;
+	int todoCount;
+	int stopping;
+	pthread_mutex_t lock;
+	pthread_cond_t todoCond;
+	pthread_cond_t doneCond;
+
+#ifdef HAVE_IO_URING
+	int ringFd;
+	unsigned int toSubmit;
+	void *sqRing;
+	size_t sqRingLen;
+	void *cqRing;
+	size_t cqRingLen;
+	struct io_uring_sqe *sqes;
+	size_t sqesLen;
+	unsigned int *sqHead;
+	unsigned int *sqTail;
+	unsigned int *sqMask;
+	unsigned int *sqArray;
+	unsigned int *cqHead;
+	unsigned int *cqTail;
+	unsigned int *cqMask;
+	struct io_uring_cqe *cqes;
+#endif
+};
+
+static ssize_t aioPread(aioRequest *req)
+{
+	size_t total = 0;
+
+	while (total < req->len) {
+		ssize_t got = pread(req->fd, req->buf + total, req->len - total, req->offset + total);
+		if (got < 0) {
+			if (errno == EINTR)
+				continue;
+			return total > 0 ? (ssize_t)total : -errno;
+		}
+		if (got == 0)
+			break;
+		total += got;
+	}
+	return total;
+}
+
+static void aioPushDone(aioQueue *q,aioRequest *req)
+{
+	q->done[(q->doneHead + q->doneCount) % q->depth] = req;
+	q->doneCount++;
+}
+
+static aioRequest *aioPopDone(aioQueue *q)
+{
+	aioRequest *req = q->done[q->doneHead];
+
+	q->doneHead = (q->doneHead + 1) % q->depth;
+	q->doneCount--;
+	q->inFlight--;
+	return req;
+}
+
+#ifdef HAVE_IO_URING
+
+static int aioUringSetup(aioQueue *q)
+{
+	struct io_uring_params p;
+	unsigned char *sq;
+	unsigned char *cq;
+
+	memset(&p, 0, sizeof(p));
+	q->ringFd = syscall(__NR_io_uring_setup, q->depth, &p);
+	if (q->ringFd < 0)
+		return FAILURE_RET;
+
+	q->sqRingLen = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	q->cqRingLen = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if ((p.features & IORING_FEAT_SINGLE_MMAP) && q->cqRingLen > q->sqRingLen)
+		q->sqRingLen = q->cqRingLen;
+
+	q->sqRing = mmap(NULL, q->sqRingLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+					 q->ringFd, IORING_OFF_SQ_RING);
+	if (q->sqRing == MAP_FAILED)
+		goto fail_ring;
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		q->cqRing = q->sqRing;
+		q->cqRingLen = 0;
+	}
+	else {
+		q->cqRing = mmap(NULL, q->cqRingLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+						 q->ringFd, IORING_OFF_CQ_RING);
+		if (q->cqRing == MAP_FAILED)
+			goto fail_sq;
+	}
+	q->sqesLen = p.sq_entries * sizeof(struct io_uring_sqe);
+	q->sqes = mmap(NULL, q->sqesLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+				   q->ringFd, IORING_OFF_SQES);
+	if (q->sqes == MAP_FAILED)
+		goto fail_cq;
+
+	sq = q->sqRing;
+	cq = q->cqRing;
+	q->sqHead = (unsigned int *)(sq + p.sq_off.head);
+	q->sqTail = (unsigned int *)(sq + p.sq_off.tail);
+	q->sqMask = (unsigned int *)(sq + p.sq_off.ring_mask);
+	q->sqArray = (unsigned int *)(sq + p.sq_off.array);
+	q->cqHead = (unsigned int *)(cq + p.cq_off.head);
+	q->cqTail = (unsigned int *)(cq + p.cq_off.tail);
+	q->cqMask = (unsigned int *)(cq + p.cq_off.ring_mask);
+	q->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+	q->toSubmit = 0;
+	return SUCCESS_RET;
+
+fail_cq:
+	if (q->cqRingLen > 0)
+		munmap(q->cqRing, q->cqRingLen);
+fail_sq:
+	munmap(q->sqRing, q->sqRingLen);
+fail_ring:
+	close(q->ringFd);
+	return FAILURE_RET;
+}
+
+static void aioUringRelease(aioQueue *q)
+{
+	munmap(q->sqes, q->sqesLen);
+	if (q->cqRingLen > 0)
+		munmap(q->cqRing, q->cqRingLen);
+	munmap(q->sqRing, q->sqRingLen);
+	close(q->ringFd);
+}
+
+static void aioUringQueue(aioQueue *q,aioRequest *req)
+{
+	unsigned int tail = *q->sqTail;
+	unsigned int idx = tail & *q->sqMask;
+	struct io_uring_sqe *sqe = &q->sqes[idx];
+
+	req->iov.iov_base = req->buf;
+	req->iov.iov_len = req->len;
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = IORING_OP_READV;
+	sqe->fd = req->fd;
+	sqe->off = req->offset;
+	sqe->addr = (unsigned long)&req->iov;
+	sqe->len = 1;
+	sqe->user_data = (uint64_t)(uintptr_t)req;
+	q->sqArray[idx] = idx;
+	__atomic_store_n(q->sqTail, tail + 1, __ATOMIC_RELEASE);
+	q->toSubmit++;
+}
+
+/* Move finished CQEs to the done list; returns how many were reaped */
+static int aioUringReap(aioQueue *q)
+{
+	unsigned int head = *q->cqHead;
+	int n = 0;
+
+	while (head != __atomic_load_n(q->cqTail, __ATOMIC_ACQUIRE)) {
+		struct io_uring_cqe *cqe = &q->cqes[head & *q->cqMask];
+		aioRequest *req = (aioRequest *)(uintptr_t)cqe->user_data;
+
+		req->result = cqe->res;
+		/* a short read that is not EOF gets finished synchronously */
+		if (req->result > 0 && (size_t)req->result < req->len) {
+			aioRequest rest = *req;
+			ssize_t more;
+
+			rest.buf += req->result;
+			rest.offset += req->result;
+			rest.len -= req->result;
+			more = aioPread(&rest);
+			if (more > 0)
+				req->result += more;
+		}
+		req->done = 1;
+		aioPushDone(q, req);
+		head++;
+		n++;
+	}
+	__atomic_store_n(q->cqHead, head, __ATOMIC_RELEASE);
+	return n;
+}
+
+static int aioUringEnter(aioQueue *q,unsigned int minComplete)
+{
+	int ret;
+
+	do {
+		ret = syscall(__NR_io_uring_enter, q->ringFd, q->toSubmit, minComplete,
+					  minComplete > 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+	} while (ret < 0 && errno == EINTR);
+	if (ret > 0)
+		q->toSubmit -= ret;
+	return ret;
+}
+
+#endif /* HAVE_IO_URING */
+
+static void *aioThreadMain(void *arg)
+{
+	aioQueue *q = (aioQueue *)arg;
+
+	pthread_mutex_lock(&q->lock);
+	for (;;) {
+		aioRequest *req;
+
+		while (q->todoCount == 0 && !q->stopping)
+			pthread_cond_wait(&q->todoCond, &q->lock);
+		if (q->todoCount == 0 && q->stopping)
+			break;
+		req = q->todo[q->todoHead];
+		q->todoHead = (q->todoHead + 1) % q->depth;
+		q->todoCount--;
+		pthread_mutex_unlock(&q->lock);
+
+		req->result = aioPread(req);
+
+		pthread_mutex_lock(&q->lock);
+		req->done = 1;
+		aioPushDone(q, req);
+		pthread_cond_signal(&q->doneCond);
+	}
+	pthread_mutex_unlock(&q->lock);
+	return NULL;
+}
+
+static int aioThreadsSetup(aioQueue *q)
+{
+	int want = q->depth < AIO_MAX_THREADS ? q->depth : AIO_MAX_THREADS;
+
+	q->todo = (aioRequest **)calloc(q->depth, sizeof(aioRequest *));
+	if (q->todo == NULL)
+		return FAILURE_RET;
+	pthread_mutex_init(&q->lock, NULL);
+	pthread_cond_init(&q->todoCond, NULL);
+	pthread_cond_init(&q->doneCond, NULL);
+	for (q->nThreads = 0; q->nThreads < want; q->nThreads++) {
+		if (pthread_create(&q->threads[q->nThreads], NULL, aioThreadMain, q) != 0)
+			break;
+	}
+	if (q->nThreads == 0) {
+		free(q->todo);
+		q->todo = NULL;
+		return FAILURE_RET;
+	}
+	return SUCCESS_RET;
+}
+
+/*
+ * A queue inherited across fork() must not be driven from the child: the
+ * io_uring rings are shared with the parent and the pool threads do not
+ * exist there. Drop to synchronous reads instead.
+ */
+static void aioCheckOwner(aioQueue *q)
+{
+	if (q->owner == getpid())
+		return;
+#ifdef HAVE_IO_URING
+	if (q->backend == AIO_BACKEND_URING)
+		aioUringRelease(q);
+#endif
+	q->backend = AIO_BACKEND_SYNC;
+	q->nThreads = 0;
+	q->inFlight = 0;
+	q->doneCount = 0;
+	q->owner = getpid();
+}
+
+/**
+ * aioQueueNew - Create a read queue
+ *
+ * @depth: Maximum reads in flight, clamped to 1..AIO_MAX_DEPTH
+ *
+ * Tries io_uring first, then a pread thread pool, then plain synchronous
+ * reads, so callers always get a working queue.
+ *
+ * Returns: New queue or NULL on allocation failure
+ */
+aioQueue *aioQueueNew(int depth)
+{
+	aioQueue *q = (aioQueue *)calloc(1, sizeof(aioQueue));
+
+	if (q == NULL)
+		return NULL;
+	if (depth < 1)
+		depth = 1;
+	if (depth > AIO_MAX_DEPTH)
+		depth = AIO_MAX_DEPTH;
+	q->depth = depth;
+	q->owner = getpid();
+	q->done = (aioRequest **)calloc(depth, sizeof(aioRequest *));
+	if (q->done == NULL) {
+		free(q);
+		return NULL;
+	}
+
+	q->backend = AIO_BACKEND_SYNC;
+#ifdef HAVE_IO_URING
+	if (aioUringSetup(q) == SUCCESS_RET)
+		q->backend = AIO_BACKEND_URING;
+#endif
+	if (q->backend == AIO_BACKEND_SYNC && depth > 1 && aioThreadsSetup(q) == SUCCESS_RET)
+		q->backend = AIO_BACKEND_THREADS;
+	return q;
+}
+
+/**
+ * aioQueueFree - Wait for outstanding reads and release the queue
+ *
+ * @q: Queue (may be NULL)
+ */
+void aioQueueFree(aioQueue *q)
+{
+	if (q == NULL)
+		return;
+	aioCheckOwner(q);
+	aioWaitAll(q);
+#ifdef HAVE_IO_URING
+	if (q->backend == AIO_BACKEND_URING)
+		aioUringRelease(q);
+#endif
+	if (q->backend == AIO_BACKEND_THREADS) {
+		pthread_mutex_lock(&q->lock);
+		q->stopping = 1;
+		pthread_cond_broadcast(&q->todoCond);
+		pthread_mutex_unlock(&q->lock);
+		for (int i = 0; i < q->nThreads; i++)
+			pthread_join(q->threads[i], NULL);
+		pthread_mutex_destroy(&q->lock);
+		pthread_cond_destroy(&q->todoCond);
+		pthread_cond_destroy(&q->doneCond);
+	}
+	free(q->todo);
+	free(q->done);
+	free(q);
+}
+
+int aioQueueBackend(aioQueue *q)
+{
+	return q ? q->backend : AIO_BACKEND_SYNC;
+}
+
+int aioQueueDepth(aioQueue *q)
+{
+	return q ? q->depth : 1;
+}
+
+int aioInFlight(aioQueue *q)
+{
+	return q ? q->inFlight : 0;
+}
+
+/**
+ * aioSubmit - Start a read
+ *
+ * @q:   Queue
+ * @req: Request with fd, offset, len and buf filled in; must stay valid
+ *       until it is returned by aioWaitAny
+ *
+ * Returns: SUCCESS_RET, or FAILURE_RET if depth reads are already in flight
+ */
+int aioSubmit(aioQueue *q,aioRequest *req)
+{
+	aioCheckOwner(q);
+	if (q->inFlight >= q->depth)
+		return FAILURE_RET;
+
+	req->done = 0;
+	req->result = 0;
+	q->inFlight++;
+	switch (q->backend) {
+#ifdef HAVE_IO_URING
+		case AIO_BACKEND_URING:
+			aioUringQueue(q, req);
+			/* let the device start on a batch before the consumer asks */
+			if (q->toSubmit >= (unsigned int)(q->depth + 3) / 4)
+				aioUringEnter(q, 0);
+			break;
+#endif
+		case AIO_BACKEND_THREADS:
+			pthread_mutex_lock(&q->lock);
+			q->todo[(q->todoHead + q->todoCount) % q->depth] = req;
+			q->todoCount++;
+			pthread_cond_signal(&q->todoCond);
+			pthread_mutex_unlock(&q->lock);
+			break;
+		default:
+			req->result = aioPread(req);
+			req->done = 1;
+			aioPushDone(q, req);
+			break;
+	}
+	return SUCCESS_RET;
+}
+
+/**
+ * aioWaitAny - Wait for one read to finish
+ *
+ * @q: Queue
+ *
+ * Completion order is not submission order; check req->arg or compare
+ * pointers to tell requests apart.
+ *
+ * Returns: A finished request, or NULL if nothing is in flight
+ */
+aioRequest *aioWaitAny(aioQueue *q)
+{
+	aioRequest *req = NULL;
+
+	aioCheckOwner(q);
+	if (q->inFlight == 0)
+		return NULL;
+
+	switch (q->backend) {
+#ifdef HAVE_IO_URING
+		case AIO_BACKEND_URING:
+			while (q->doneCount == 0) {
+				if (aioUringReap(q) > 0)
+					break;
+				/* ring unusable: callers finish leftovers with pread */
+				if (aioUringEnter(q, 1) < 0 && errno != EAGAIN && errno != EBUSY)
+					return NULL;
+			}
+			req = aioPopDone(q);
+			break;
+#endif
+		case AIO_BACKEND_THREADS:
+			pthread_mutex_lock(&q->lock);
+			while (q->doneCount == 0)
+				pthread_cond_wait(&q->doneCond, &q->lock);
+			req = aioPopDone(q);
+			pthread_mutex_unlock(&q->lock);
+			break;
+		default:
+			req = aioPopDone(q);
+			break;
+	}
+	return req;
+}
+
+/**
+ * aioWaitAll - Wait until nothing is in flight
+ *
+ * @q: Queue
+ */
+void aioWaitAll(aioQueue *q)
+{
+	while (q->inFlight > 0) {
+		if (aioWaitAny(q) == NULL)
+			break;
+	}
+}
+
+/**
+ * aioReadBatch - Read a set of ranges, keeping the queue full
+ *
+ * @q:    Queue, or NULL for plain synchronous preads
+ * @reqs: Requests to run
+ * @n:    Number of requests
+ *
+ * Returns: Number of requests that failed or came back short
+ */
+int aioReadBatch(aioQueue *q,aioRequest *reqs,int n)
+{
+	int next = 0;
+	int failed = 0;
+
+	if (q == NULL) {
+		for (int i = 0; i < n; i++) {
+			reqs[i].result = aioPread(&reqs[i]);
+			reqs[i].done = 1;
+			if (reqs[i].result != (ssize_t)reqs[i].len)
+				failed++;
+		}
+		return failed;
+	}
+
+	while (next < n || aioInFlight(q) > 0) {
+		aioRequest *req;
+
+		while (next < n && aioSubmit(q, &reqs[next]) == SUCCESS_RET)
+			next++;
+		req = aioWaitAny(q);
+		if (req == NULL)
+			break;
+		if (req->result != (ssize_t)req->len)
+			failed++;
+	}
+	/* anything left (broken ring) is read synchronously */
+	for (int i = 0; i < n; i++) {
+		if (!reqs[i].done) {
+			reqs[i].result = aioPread(&reqs[i]);
+			reqs[i].done = 1;
+			if (reqs[i].result != (ssize_t)reqs[i].len)
+				failed++;
+		}
+	}
+	return failed;
+}
@@ -0,0 +1,68 @@
+/*
+ * PDU - PostgreSQL Data Unloader
+ * Copyright (c) 2024-2025 ZhangChen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * async_io.h - Asynchronous positional reads (io_uring or pread threads)
+ */
+
+#ifndef ASYNC_IO_H
+#define ASYNC_IO_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#define AIO_BACKEND_SYNC    0
+#define AIO_BACKEND_URING   1
+#define AIO_BACKEND_THREADS 2
+
+#define AIO_DEFAULT_DEPTH 32
+#define AIO_MAX_DEPTH 128
+#define AIO_MAX_THREADS 16
+
+/* One read of len bytes at offset of fd into buf */
+typedef struct aioRequest
+{
+	int fd;
+	off_t offset;
+	size_t len;
+	char *buf;
+	ssize_t result;		/* bytes read or -errno, valid once done */
+	int done;
+	void *arg;			/* caller cookie, untouched by the queue */
+	struct iovec iov;	/* private to the io_uring backend */
+} aioRequest;
+
+typedef struct aioQueue aioQueue;
+
+aioQueue *aioQueueNew(int depth);
+
+void aioQueueFree(aioQueue *q);
+
+int aioQueueBackend(aioQueue *q);
+
+int aioQueueDepth(aioQueue *q);
+
+int aioInFlight(aioQueue *q);
+
+int aioSubmit(aioQueue *q,aioRequest *req);
+
+aioRequest *aioWaitAny(aioQueue *q);
+
+void aioWaitAll(aioQueue *q);
+
+int aioReadBatch(aioQueue *q,aioRequest *reqs,int n);
+
+#endif /* ASYNC_IO_H */
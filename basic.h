@@ -44,6 +44,18 @@
 
 #define NUM_THREADS 1
 #define MIN_SIZE_FOR_THREADING (10 * 1024 * 1024)
+#define MAX_UNLOAD_WORKERS 64
+#define PARALLEL_UNIT_SIZE (128 * 1024 * 1024)
+#define DEFAULT_READ_CHUNK_MB 8
+#define MAX_READ_CHUNK_MB 256
+#define READ_BUF_ALIGN 4096
+#define DEFAULT_FPW_CACHE_MB 256
+#define MAX_FPW_CACHE_MB (64 * 1024)
+#define WAL_INFLATE_CACHE_SEGS 8
+#define WAL_INFLATE_CACHE_MB 256
+#define IOMODE_BUFFERED 0
+#define IOMODE_MMAP 1
+#define IOMODE_ASYNC 2
 #define CKEXIST 1
 
 
@@ -18,6 +18,15 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <math.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#endif
 #include "decode.h"
 
 #define UUID_LEN 16
@@ -41,28 +50,27 @@ typedef enum {
 #define VFMT_LONG_COMP   0x04
 #define VFMT_EXTERNAL    0x08
 
-static int serializeInt8(const char *src, unsigned int avail, unsigned int *used);
-static int serializeInt16(const char *src, unsigned int avail, unsigned int *used);
-static int serializeInt32(const char *src, unsigned int avail, unsigned int *used);
-static int serializeInt64(const char *src, unsigned int avail, unsigned int *used);
+static int serializeInt8(decodeContext *ctx, const char *src, unsigned int avail, unsigned int *used);
+static int serializeInt16(decodeContext *ctx, const char *src, unsigned int avail, unsigned int *used);
+static int serializeInt32(decodeContext *ctx, const char *src, unsigned int avail, unsigned int *used);
+static int serializeInt64(decodeContext *ctx, const char *src, unsigned int avail, unsigned int *used);
 
-static int serializeFloat32(const char *src, unsigned int avail, unsigned int *used);
-static int serializeFloat64(const char *src, unsigned int avail, unsigned int *used);
+static int serializeFloat32(decodeContext *ctx, const char *src, unsigned int avail, unsigned int *used);
+static int serializeFloat64(decodeContext *ctx, const char *src, unsigned int avail, unsigned int *used);
 
-static int char_output(const char *src, unsigned int avail, unsigned int *used);
-static int get_str_from_numeric(const char *buffer, int num_size);
-static int emitEncodedValue(const char *str, int orig_len);
-int decode_numeric_value(const char *input_buffer, unsigned int buffer_size, unsigned int *bytes_processed);
-int numeric_outputds(const char *raw_input, unsigned int buf_len, unsigned int *bytes_read);
+static int char_output(decodeContext *ctx, const char *src, unsigned int avail, unsigned int *used);
+static int get_str_from_numeric(decodeContext *ctx, const char *buffer, int num_size);
+static int emitEncodedValue(decodeContext *ctx, const char *str, int orig_len);
+int decode_numeric_value(decodeContext *ctx, const char *input_buffer, unsigned int buffer_size, unsigned int *bytes_processed);
+int numeric_outputds(decodeContext *ctx, const char *raw_input, unsigned int buf_len, unsigned int *bytes_read);
 
-static int date_output(const char *src, unsigned int avail, unsigned int *used);
-static int time_output(const char *src, unsigned int avail, unsigned int *used);
-static int timetz_output(const char *src, unsigned int avail, unsigned int *used);
-static int timestamp_output(const char *src, unsigned int avail, unsigned int *used);
-static int timestamptz_output(const char *src, unsigned int avail, unsigned int *used);
+static int date_output(decodeContext *ctx, const char *src, unsigned int avail, unsigned int *used);
+static int time_output(decodeContext *ctx, const char *src, unsigned int avail, unsigned int *used);
+static int timetz_output(decodeContext *ctx, const char *src, unsigned int avail, unsigned int *used);
+static int timestamp_output(decodeContext *ctx, const char *src, unsigned int avail, unsigned int *used);
+static int timestamptz_output(decodeContext *ctx, const char *src, unsigned int avail, unsigned int *used);
 
 int go=0;
-int global_curr_att;
 
 typedef struct {
 	const char *typeName;
@@ -105,71 +113,130 @@ static const ColumnTypeHandler typeHandlerRegistry[] = {
 	{NULL,           NULL,                   0,   0}
 };
 
-char CURDBPathforDB[1024]="";
-char CURDBPath[1024]="";
-char toastId[50]="";
-
 int loglevel_decode;
 
-typedef struct {
-	StringInfoData storage;
-	int fieldCount;
-	bool ready;
-} ResultAccumulator;
+/*
+ * Context used by the classic single-threaded entry points (xmanDecode,
+ * xmanDecodeDrop, xmandecodeSys) and filled by the init/set helpers below.
+ * Workers that decode concurrently take their own copy via decodeContextNew.
+ */
+static decodeContext defaultDecodeCtx;
+
+static void toastReaderClose(toastReader *rd);
+
 
-static ResultAccumulator g_resultBuf = {{0}, 0, false};
+static void initNewParrayCtx(decodeContext *ctx){
+	ctx->newParray = parray_new();
+	ctx->newParrayInitDown = true;
+}
 
-static parray *xmanNewParray = NULL;
-static bool xmanNewParrayInitDown = false;
-static bool xmanNewParrayReturn = false;
+static void initOldParrayCtx(decodeContext *ctx){
+	ctx->oldParray = parray_new();
+	ctx->oldParrayInitDown = true;
+}
 
-static parray *xmanOldParray = NULL;
-static bool xmanOldParrayInitDown = false;
-static bool xmanOldParrayReturn = false;
+static void freeNewParrayCtx(decodeContext *ctx){
+	parray_free(ctx->newParray);
+	ctx->newParrayInitDown = false;
+	ctx->newParrayReturn = false;
+}
 
+static void freeOldParrayCtx(decodeContext *ctx){
+	parray_free(ctx->oldParray);
+	ctx->oldParrayInitDown = false;
+	ctx->oldParrayReturn = false;
+}
 
 void initNewParray(){
-	xmanNewParray = parray_new();
-	xmanNewParrayInitDown = true;
+	initNewParrayCtx(&defaultDecodeCtx);
 }
 
 void initOldParray(){
-	xmanOldParray = parray_new();
-	xmanOldParrayInitDown = true;
+	initOldParrayCtx(&defaultDecodeCtx);
 }
 
 void freeNewParray(){
-	parray_free(xmanNewParray);
-	xmanNewParrayInitDown = false;
-	xmanNewParrayReturn = false;
+	freeNewParrayCtx(&defaultDecodeCtx);
 }
 
 void freeOldParray(){
-	parray_free(xmanOldParray);
-	xmanOldParrayInitDown = false;
-	xmanOldParrayReturn = false;
+	freeOldParrayCtx(&defaultDecodeCtx);
 }
 
-static inline void prepareResultBuffer(void)
+/**
+ * decodeContextDefault - Get the shared decode context
+ *
+ * Returns: Context used by xmanDecode/xmanDecodeDrop/xmandecodeSys
+ */
+decodeContext *decodeContextDefault(void)
 {
-	if (g_resultBuf.ready)
-		return;
-	initStringInfo(&g_resultBuf.storage);
-	g_resultBuf.fieldCount = 0;
-	g_resultBuf.ready = true;
+	return &defaultDecodeCtx;
 }
 
-int addNum=0;
+/**
+ * decodeContextNew - Create a private decode context for a worker
+ *
+ * Copies the current TOAST and path configuration of the default context
+ * (set through initCURDBPath, initToastId, setToastIndex, ...) and the
+ * current column layout, but owns its own result buffer, parrays and
+ * decompression scratch space, so it can be used concurrently with
+ * other contexts.
+ *
+ * Returns: New context, or NULL on allocation failure
+ */
+decodeContext *decodeContextNew(void)
+{
+	decodeContext *ctx = (decodeContext *)malloc(sizeof(decodeContext));
+
+	if (ctx == NULL)
+		return NULL;
+	memset(ctx, 0, sizeof(decodeContext));
+	ctx->addNum = defaultDecodeCtx.addNum;
+	ctx->toastIdx = defaultDecodeCtx.toastIdx;
+	ctx->isToastDecoded = defaultDecodeCtx.isToastDecoded;
+	ctx->dc = defaultDecodeCtx.dc;
+	memcpy(ctx->toastId, defaultDecodeCtx.toastId, sizeof(ctx->toastId));
+	memcpy(ctx->CURDBPath, defaultDecodeCtx.CURDBPath, sizeof(ctx->CURDBPath));
+	memcpy(ctx->CURDBPathforDB, defaultDecodeCtx.CURDBPathforDB, sizeof(ctx->CURDBPathforDB));
+	return ctx;
+}
+
+/**
+ * decodeContextFree - Release a context from decodeContextNew
+ *
+ * @ctx: Context to free (may be NULL)
+ *
+ * The TOAST index is shared with the default context and is not freed.
+ */
+void decodeContextFree(decodeContext *ctx)
+{
+	if (ctx == NULL || ctx == &defaultDecodeCtx)
+		return;
+	if (ctx->resultReady)
+		free(ctx->resultBuf.data);
+	if (ctx->oldParrayInitDown)
+		freeOldParrayCtx(ctx);
+	if (ctx->newParrayInitDown)
+		freeNewParrayCtx(ctx);
+	aioQueueFree(ctx->aio);
+	toastReaderClose(ctx->toastRd);
+	free(ctx->plan.cols);
+	free(ctx);
+}
 
-static char decompression_storage[64 * 1024];
+static inline void prepareResultBuffer(decodeContext *ctx)
+{
+	if (ctx->resultReady)
+		return;
+	initStringInfo(&ctx->resultBuf);
+	ctx->fieldCount = 0;
+	ctx->resultReady = true;
+}
 
 char *tmpChunk=NULL;
 int tmpChunkSize=0;
 int tmpChunkFLag=0;
 
-int isToastDecoded = 0;
-dropContext *dc = NULL;
-harray *toastHash_decode = NULL;
 
 Oid ErrToastIdNoths = 0;
 
@@ -201,6 +268,348 @@ void setlogLevel(int setting){
 	loglevel_decode = setting;
 }
 
+int ioMode_decode = IOMODE_BUFFERED;
+int ioDepth_decode = AIO_DEFAULT_DEPTH;
+
+/**
+ * setIoMode_decode - Set how TOAST pages are read
+ *
+ * @mode:  IOMODE_* value of param iomode
+ * @depth: Reads in flight for IOMODE_ASYNC
+ *
+ * Only IOMODE_ASYNC changes TOAST reads; contexts drop their queue so the
+ * next fetch picks up the new depth.
+ */
+void setIoMode_decode(int mode,int depth){
+	ioMode_decode = mode;
+	ioDepth_decode = depth;
+	aioQueueFree(defaultDecodeCtx.aio);
+	defaultDecodeCtx.aio = NULL;
+}
+
+/**
+ * decodeContextAio - Get the context's TOAST read queue
+ *
+ * @ctx: Decode context
+ *
+ * Returns: Queue created on first use, or NULL for synchronous preads
+ */
+static aioQueue *decodeContextAio(decodeContext *ctx)
+{
+	if (ioMode_decode != IOMODE_ASYNC)
+		return NULL;
+	/* a queue inherited from the parent of a forked unload worker is stale */
+	if (ctx->aio != NULL && ctx->aioPid != getpid()) {
+		aioQueueFree(ctx->aio);
+		ctx->aio = NULL;
+	}
+	if (ctx->aio == NULL) {
+		ctx->aio = aioQueueNew(ioDepth_decode);
+		ctx->aioPid = getpid();
+	}
+	return ctx->aio;
+}
+
+/**
+ * toastReaderClose - Close every segment of a TOAST reader
+ *
+ * @rd: Reader, may be NULL
+ */
+static void toastReaderClose(toastReader *rd)
+{
+	if (rd == NULL)
+		return;
+	for (int i = 0; i < rd->nSegs; i++) {
+		if (rd->segs[i].map != NULL)
+			munmap(rd->segs[i].map, rd->segs[i].mapLen);
+		if (rd->segs[i].fd >= 0)
+			close(rd->segs[i].fd);
+	}
+	free(rd->segs);
+	free(rd->page);
+	free(rd);
+}
+
+/**
+ * toastReaderSegment - Get an open segment of a TOAST relation
+ *
+ * @rd:  Reader
+ * @seg: Segment number, 0 for the base file
+ *
+ * Opens (and in iomode mmap, maps) the segment on first use.
+ *
+ * Returns: Segment, or NULL if it does not exist
+ */
+static toastSegment *toastReaderSegment(toastReader *rd,int seg)
+{
+	toastSegment *ts;
+
+	if (seg < 0)
+		return NULL;
+	if (seg >= rd->nSegs) {
+		int n = seg + 1;
+		toastSegment *segs = realloc(rd->segs, sizeof(toastSegment) * n);
+		if (segs == NULL)
+			return NULL;
+		for (int i = rd->nSegs; i < n; i++) {
+			segs[i].fd = -1;
+			segs[i].map = NULL;
+			segs[i].mapLen = 0;
+		}
+		rd->segs = segs;
+		rd->nSegs = n;
+	}
+	ts = &rd->segs[seg];
+	if (ts->fd < 0) {
+		char segPath[1200];
+		struct stat st;
+
+		if (seg == 0)
+			snprintf(segPath, sizeof(segPath), "%s", rd->path);
+		else
+			snprintf(segPath, sizeof(segPath), "%s.%d", rd->path, seg);
+		ts->fd = open(segPath, O_RDONLY);
+		if (ts->fd < 0)
+			return NULL;
+		if (ioMode_decode == IOMODE_MMAP && fstat(ts->fd, &st) == 0 && st.st_size > 0) {
+			char *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, ts->fd, 0);
+			if (map != MAP_FAILED) {
+				madvise(map, st.st_size, MADV_RANDOM);
+				ts->map = map;
+				ts->mapLen = st.st_size;
+			}
+		}
+	}
+	return ts;
+}
+
+/**
+ * toastReaderOpen - Open a TOAST relation for chunk reads
+ *
+ * @path: Base segment of the relation
+ *
+ * Returns: Reader, or NULL if the base segment cannot be read
+ */
+static toastReader *toastReaderOpen(const char *path)
+{
+	toastReader *rd;
+	toastSegment *ts;
+	PageHeaderData headerSample;
+
+	rd = (toastReader *)malloc(sizeof(toastReader));
+	if (rd == NULL)
+		return NULL;
+	memset(rd, 0, sizeof(toastReader));
+	snprintf(rd->path, sizeof(rd->path), "%s", path);
+	rd->pageSeg = -1;
+
+	ts = toastReaderSegment(rd, 0);
+	if (ts == NULL ||
+		pread(ts->fd, &headerSample, sizeof(PageHeaderData), 0) != sizeof(PageHeaderData) ||
+		(rd->blockSize = (int) PageGetPageSize((Page)&headerSample)) <= 0 ||
+		(rd->page = (char *)malloc(rd->blockSize)) == NULL) {
+		toastReaderClose(rd);
+		return NULL;
+	}
+	return rd;
+}
+
+/**
+ * toastReaderPage - Get one page of a TOAST relation
+ *
+ * @rd:  Reader
+ * @seg: Segment number
+ * @blk: Block within the segment
+ *
+ * Consecutive chunks on the same block reuse the page already read.
+ *
+ * Returns: Page, or NULL if it cannot be read
+ */
+static char *toastReaderPage(toastReader *rd,int seg,BlockNumber blk)
+{
+	toastSegment *ts;
+	off_t off = (off_t)blk * rd->blockSize;
+
+	if (seg == rd->pageSeg && blk == rd->pageBlk)
+		return rd->page;
+	ts = toastReaderSegment(rd, seg);
+	if (ts == NULL)
+		return NULL;
+	if (ts->map != NULL)
+		return off + rd->blockSize <= (off_t)ts->mapLen ? ts->map + off : NULL;
+	if (pread(ts->fd, rd->page, rd->blockSize, off) != rd->blockSize) {
+		rd->pageSeg = -1;
+		return NULL;
+	}
+	rd->pageSeg = seg;
+	rd->pageBlk = blk;
+	return rd->page;
+}
+
+/**
+ * decodeContextToastReader - Get the context's reader for a TOAST relation
+ *
+ * @ctx:  Decode context
+ * @path: Base segment of the relation
+ *
+ * Keeps the reader of the previous call if it is for the same path.
+ *
+ * Returns: Reader, or NULL if the relation cannot be read
+ */
+static toastReader *decodeContextToastReader(decodeContext *ctx,const char *path)
+{
+	if (ctx->toastRd != NULL) {
+		if (strcmp(ctx->toastRd->path, path) == 0)
+			return ctx->toastRd;
+		toastReaderClose(ctx->toastRd);
+	}
+	ctx->toastRd = toastReaderOpen(path);
+	return ctx->toastRd;
+}
+
+static int compareToastBlock(const void *a, const void *b)
+{
+	uint64 ka = *(const uint64 *)a;
+	uint64 kb = *(const uint64 *)b;
+
+	if (ka < kb) return -1;
+	if (ka > kb) return 1;
+	return 0;
+}
+
+/**
+ * prefetchToastRun - Ask the kernel to read one run of TOAST blocks
+ *
+ * @rd:    TOAST reader
+ * @seg:   Segment number
+ * @first: First block of the run
+ * @n:     Number of consecutive blocks
+ */
+static void prefetchToastRun(toastReader *rd,int seg,BlockNumber first,uint64 n)
+{
+	toastSegment *ts = toastReaderSegment(rd, seg);
+	off_t off = (off_t)first * rd->blockSize;
+	off_t len = (off_t)n * rd->blockSize;
+
+	if (ts == NULL)
+		return;
+	if (ts->map != NULL) {
+		if (off >= (off_t)ts->mapLen)
+			return;
+		if (off + len > (off_t)ts->mapLen)
+			len = ts->mapLen - off;
+		/* off is a multiple of the block size and so page aligned */
+		madvise(ts->map + off, len, MADV_WILLNEED);
+	}
+	else
+		posix_fadvise(ts->fd, off, len, POSIX_FADV_WILLNEED);
+}
+
+/**
+ * prefetchToastPage - Prefetch the TOAST chunks referenced by a heap page
+ *
+ * @allDesc: Attribute descriptors of the table
+ * @nDesc:   Number of entries in allDesc
+ * @block:   Heap page about to be decoded
+ *
+ * Walks every tuple of the page for external on-disk datums before any of
+ * them is detoasted, looks their chunks up in the TOAST index, and issues
+ * one readahead per run of adjacent TOAST blocks in file order. The
+ * detoast reads that follow then mostly hit the page cache instead of
+ * seeking once per value.
+ */
+void prefetchToastPage(pg_attributeDesc *allDesc,int nDesc,const char *block)
+{
+	decodeContext *ctx = &defaultDecodeCtx;
+	toastIndex *idx = ctx->toastIdx;
+	Page page = (Page) block;
+	char toastPath[1100];
+	uint64 *blocks;
+	int nBlocks = 0;
+	int maxOffset;
+	toastReader *rd;
+
+	if (idx == NULL || allDesc == NULL || nDesc <= 0 ||
+		ctx->toastId[0] == '\0' || strcmp(ctx->toastId,"TOASTNODE") == 0)
+		return;
+	maxOffset = PageGetMaxOffsetNumber(page);
+	if (maxOffset == 0)
+		return;
+
+	blocks = (uint64 *)malloc(sizeof(uint64) * TOAST_PREFETCH_MAX_BLOCKS);
+	if (blocks == NULL)
+		return;
+
+	for (int x = 1; x <= maxOffset && nBlocks < TOAST_PREFETCH_MAX_BLOCKS; x++) {
+		ItemId itemId = PageGetItemId(page, x);
+		unsigned int itemSize = (unsigned int) ItemIdGetLength(itemId);
+		unsigned int itemOffset = (unsigned int) ItemIdGetOffset(itemId);
+		HeapTupleHeader header;
+		const char *data;
+		unsigned int size;
+		uint32 off = 0;
+		int nAttr;
+
+		if (ItemIdGetFlags(itemId) != LP_NORMAL ||
+			itemOffset + itemSize > BLCKSZ || itemSize < SizeofHeapTupleHeader)
+			continue;
+		header = (HeapTupleHeader) &block[itemOffset];
+		if (header->t_hoff >= itemSize)
+			continue;
+		data = (const char *) header + header->t_hoff;
+		size = itemSize - header->t_hoff;
+		nAttr = Min(HeapTupleHeaderGetNatts(header), nDesc);
+
+		for (int i = 0; i < nAttr && off < size; i++) {
+			pg_attributeDesc *oneDesc = &allDesc[i];
+			int attlen = atoi(oneDesc->attlen);
+
+			if ((header->t_infomask & HEAP_HASNULL) && att_isnull(i, header->t_bits))
+				continue;
+			off = att_align_pointer(off, oneDesc->attalign[0], attlen, data + off);
+			if (off >= size)
+				break;
+			if (attlen == -1 && VARATT_IS_EXTERNAL_ONDISK(data + off)) {
+				varatt_external toast_ptr;
+				uint64 nEntries;
+				uint64 first;
+
+				VARATT_EXTERNAL_GET_POINTER(toast_ptr, data + off);
+				first = toastIndexFind(idx, toast_ptr.va_valueid, &nEntries);
+				for (uint64 e = 0; e < nEntries && nBlocks < TOAST_PREFETCH_MAX_BLOCKS; e++) {
+					const toastIndexEntry *ent = &idx->entries[first + e];
+					uint64 key = ((uint64)ent->suffix << 32) | ent->blk;
+					if (nBlocks == 0 || blocks[nBlocks - 1] != key)
+						blocks[nBlocks++] = key;
+				}
+			}
+			off = att_addlength_pointer(off, attlen, data + off);
+		}
+	}
+
+	if (nBlocks == 0) {
+		free(blocks);
+		return;
+	}
+
+	snprintf(toastPath, sizeof(toastPath), "%s/%s", ctx->CURDBPath, ctx->toastId);
+	rd = decodeContextToastReader(ctx, toastPath);
+	if (rd != NULL) {
+		int runStart = 0;
+
+		qsort(blocks, nBlocks, sizeof(uint64), compareToastBlock);
+		for (int i = 1; i <= nBlocks; i++) {
+			/* extend the run over duplicates and the next adjacent block */
+			if (i < nBlocks && (blocks[i] == blocks[i - 1] || blocks[i] == blocks[i - 1] + 1))
+				continue;
+			prefetchToastRun(rd, (int)(blocks[runStart] >> 32), (BlockNumber)blocks[runStart],
+							 blocks[i - 1] - blocks[runStart] + 1);
+			runStart = i;
+		}
+	}
+	free(blocks);
+}
+
 /**
  * setIsToastDecoded - Set TOAST decode flag
  *
@@ -209,7 +618,7 @@ void setlogLevel(int setting){
  * Indicates whether TOAST data should be decoded.
  */
 void setIsToastDecoded(int setting){
-	isToastDecoded = setting;
+	defaultDecodeCtx.isToastDecoded = setting;
 }
 
 /**
@@ -220,18 +629,21 @@ void setIsToastDecoded(int setting){
  * Sets the context for dropped table recovery operations.
  */
 void setDropContext(dropContext *setting){
-	dc = setting;
+	defaultDecodeCtx.dc = setting;
 }
 
 /**
- * setToastHash - Set TOAST hash array
+ * setToastIndex - Set TOAST chunk index
  *
- * @setting: Hash array pointer
+ * @setting: Index opened by initToastIndex, or NULL
  *
- * Sets the hash array for TOAST chunk lookup.
+ * Sets the index used for TOAST chunk lookup. TOAST files opened for
+ * the previous index are closed, as they may since have been rewritten.
  */
-void setToastHash(harray *setting){
-	toastHash_decode = setting;
+void setToastIndex(toastIndex *setting){
+	defaultDecodeCtx.toastIdx = setting;
+	toastReaderClose(defaultDecodeCtx.toastRd);
+	defaultDecodeCtx.toastRd = NULL;
 }
 
 int resTyp_decode = DELETEtyp;
@@ -336,8 +748,8 @@ void decodeLogPrint(FILE *logErr,char *content,int flag,int curr_att,int size)
  * Sets the global current database path variable.
  */
 void initCURDBPath(char *filepath){
-	memset(CURDBPath,0,1024);
-	strcpy(CURDBPath,filepath);
+	memset(defaultDecodeCtx.CURDBPath,0,1024);
+	strcpy(defaultDecodeCtx.CURDBPath,filepath);
 }
 
 /**
@@ -348,8 +760,8 @@ void initCURDBPath(char *filepath){
  * Sets the database-specific path variable.
  */
 void initCURDBPathforDB(char *filepath){
-	memset(CURDBPathforDB,0,1024);
-	strcpy(CURDBPathforDB,filepath);
+	memset(defaultDecodeCtx.CURDBPathforDB,0,1024);
+	strcpy(defaultDecodeCtx.CURDBPathforDB,filepath);
 }
 
 /**
@@ -360,189 +772,139 @@ void initCURDBPathforDB(char *filepath){
  * Sets the current TOAST table ID for chunk assembly.
  */
 void initToastId(char *toastnode){
-	memset(toastId,0,50);
-	strcpy(toastId,toastnode);
+	memset(defaultDecodeCtx.toastId,0,50);
+	strcpy(defaultDecodeCtx.toastId,toastnode);
 }
 
+/**
+ * emitFieldValueLen - Emit one field of known length
+ *
+ * @ctx: Decode context
+ * @val: Field text, NULL only prepares the output
+ * @len: Length of val
+ *
+ * DELETE output appends the field to resultBuf after the delimiter;
+ * UPDATE output keeps a copy in the old or new tuple's parray.
+ */
 static void
-emitFieldValue(const char *val)
+emitFieldValueLen(decodeContext *ctx, const char *val, int len)
 {
 	if (resTyp_decode == DELETEtyp) {
-		prepareResultBuffer();
+		prepareResultBuffer(ctx);
 		if (val == NULL)
 			return;
 
-		if (g_resultBuf.fieldCount > 0) {
+		if (ctx->fieldCount > 0) {
 			char delimiter = (ExportMode_decode == SQLform) ? ',' : '\t';
-			if (global_curr_att != 0){
-				appendStringInfoChar(&g_resultBuf.storage, delimiter);
+			if (ctx->currAtt != 0){
+				appendStringInfoChar(&ctx->resultBuf, delimiter);
 			}
 		}
-		appendStringInfoString(&g_resultBuf.storage, val);
-		g_resultBuf.fieldCount++;
+		appendBinaryStringInfo(&ctx->resultBuf, val, len);
+		ctx->fieldCount++;
 	}
 	else if (resTyp_decode == UPDATEtyp) {
-		if (!xmanOldParrayInitDown) {
-			initOldParray();	
+		if (!ctx->oldParrayInitDown) {
+			initOldParrayCtx(ctx);	
 		}
-		else if (!xmanNewParrayInitDown && xmanOldParrayReturn) {
-			initNewParray();
+		else if (!ctx->newParrayInitDown && ctx->oldParrayReturn) {
+			initNewParrayCtx(ctx);
 		}
 		if (val == NULL)
 			return;
 
-		char *duplicated = strdup(val);
-		if (!xmanOldParrayReturn)
-			parray_append(xmanOldParray, duplicated);
+		char *duplicated = malloc(len + 1);
+		memcpy(duplicated, val, len);
+		duplicated[len] = '\0';
+		if (!ctx->oldParrayReturn)
+			parray_append(ctx->oldParray, duplicated);
 		else
-			parray_append(xmanNewParray, duplicated);
+			parray_append(ctx->newParray, duplicated);
 	}
 }
 
 static void
-emitArrayElement(const char *elem)
+emitFieldValue(decodeContext *ctx, const char *val)
 {
-	prepareResultBuffer();
-	if (elem == NULL)
-		return;
-
-	int len = strlen(g_resultBuf.storage.data);
-	char trailing = (len > 0) ? g_resultBuf.storage.data[len - 1] : '\0';
-
-	bool needComma = (g_resultBuf.storage.data[0] != '\0' &&
-					  *elem != '{' && strcmp(elem, "\"") != 0 &&
-					  *elem != '}' && strcmp(g_resultBuf.storage.data, "{") != 0 &&
-					  trailing != '{' && trailing != '"');
-
-	if (strcmp(elem, "\"") == 0 && trailing == '"')
-		needComma = true;
-
-	if (needComma)
-		appendStringInfoChar(&g_resultBuf.storage, ',');
-
-	if (*elem == '{' && global_curr_att != 0)
-		appendStringInfoChar(&g_resultBuf.storage, '\t');
-
-	appendStringInfoString(&g_resultBuf.storage, elem);
+	emitFieldValueLen(ctx, val, val != NULL ? (int) strlen(val) : 0);
 }
 
-static void
-dispatchFieldOutput(bool arrayMode, const char *content)
+/**
+ * emitFieldBegin - Reserve room for a field directly in resultBuf
+ *
+ * @ctx:    Decode context
+ * @maxLen: Most bytes the field can take, its NUL included
+ *
+ * Writes the delimiter; the caller formats the field at the returned
+ * position and finishes it with emitFieldEnd. UPDATE output has no
+ * shared buffer to write into.
+ *
+ * Returns: Where the field goes, NULL for UPDATE output
+ */
+static inline char *
+emitFieldBegin(decodeContext *ctx, int maxLen)
 {
-	if (content == NULL)
-		return;
-	if (arrayMode)
-		emitArrayElement(content);
-	else
-		emitFieldValue(content);
+	if (resTyp_decode != DELETEtyp)
+		return NULL;
+
+	prepareResultBuffer(ctx);
+	enlargeStringInfo(&ctx->resultBuf, maxLen + 1);
+	if (ctx->fieldCount > 0 && ctx->currAtt != 0)
+		ctx->resultBuf.data[ctx->resultBuf.len++] = (ExportMode_decode == SQLform) ? ',' : '\t';
+	return ctx->resultBuf.data + ctx->resultBuf.len;
 }
 
-static void
-formatAndEmitCore(bool to_array, const char *fmt, va_list ap)
+/**
+ * emitFieldEnd - Finish a field written after emitFieldBegin
+ *
+ * @ctx: Decode context
+ * @len: Bytes written, NUL excluded
+ */
+static inline void
+emitFieldEnd(decodeContext *ctx, int len)
 {
-	char		small[128];
-	char	   *buf = small;
-	size_t		cap = sizeof(small);
-
-	small[0] = '\0';
-
-	for (;;)
-	{
-		va_list trial;
-		int			written;
-
-		va_copy(trial, ap);
-		written = vsnprintf(buf, cap, fmt, trial);
-		va_end(trial);
-
-		if (written >= 0 && (size_t) written < cap)
-			break;
-
-		if (written < 0)
-		{
-			dispatchFieldOutput(to_array, "");
-			if (buf != small)
-				free(buf);
-			return;
-		}
-
-		cap = (size_t) written + 1;
-
-		if (buf == small)
-		{
-			buf = (char *) malloc(cap);
-			if (buf == NULL)
-			{
-				dispatchFieldOutput(to_array, small);
-				return;
-			}
-		}
-		else
-		{
-			char *grown = (char *) realloc(buf, cap);
-
-			if (grown == NULL)
-			{
-				free(buf);
-				dispatchFieldOutput(to_array, small);
-				return;
-			}
-			buf = grown;
-		}
-	}
-
-	dispatchFieldOutput(to_array, buf);
-
-	if (buf != small)
-		free(buf);
+	ctx->resultBuf.len += len;
+	ctx->resultBuf.data[ctx->resultBuf.len] = '\0';
+	ctx->fieldCount++;
 }
 
 static void
-clean_out(void)
+clean_out(decodeContext *ctx)
 {
 	if(resTyp_decode == UPDATEtyp){
-		if(xmanOldParrayReturn && xmanNewParrayReturn){
-			freeOldParray();
-			freeNewParray();
+		if(ctx->oldParrayReturn && ctx->newParrayReturn){
+			freeOldParrayCtx(ctx);
+			freeNewParrayCtx(ctx);
 		}
 	}
 	else if(resTyp_decode == DELETEtyp)
 	{
-		emitFieldValue(NULL);
-		resetStringInfo(&g_resultBuf.storage);
+		emitFieldValue(ctx, NULL);
+		resetStringInfo(&ctx->resultBuf);
 	}
 
 }
 
 void
-*return_out(void)
+*return_out(decodeContext *ctx)
 {
 	if(resTyp_decode == DELETEtyp){
-		emitFieldValue(NULL);
-		return g_resultBuf.storage.data;
+		emitFieldValue(ctx, NULL);
+		return ctx->resultBuf.data;
 	}
 	else{
-		if(!xmanOldParrayReturn){
-			xmanOldParrayReturn = true;
-			return xmanOldParray;
+		if(!ctx->oldParrayReturn){
+			ctx->oldParrayReturn = true;
+			return ctx->oldParray;
 		}
-		else if(!xmanNewParrayReturn){
-			xmanNewParrayReturn = true;
-			return xmanNewParray;
+		else if(!ctx->newParrayReturn){
+			ctx->newParrayReturn = true;
+			return ctx->newParray;
 		}
 	}
 	return NULL;
 }
 
-static void emitFormattedValue(const char *fmt, ...)
-{
-	va_list ap;
-
-	va_start(ap, fmt);
-	formatAndEmitCore(false, fmt, ap);
-	va_end(ap);
-}
-
 /* Digit lookup table - derived from PostgreSQL numutils.c */
 static const char DIGIT_TABLE[200] =
 "00" "01" "02" "03" "04" "05" "06" "07" "08" "09"
@@ -771,6 +1133,73 @@ pg_ultostr_zeropad(char *str, uint32 value, int32 minwidth)
 	return str + minwidth;
 }
 
+/**
+ * emitFieldInt32 - Emit a 32-bit integer formatted in place
+ *
+ * @ctx:   Decode context
+ * @value: Value to emit
+ */
+static void
+emitFieldInt32(decodeContext *ctx, int32 value)
+{
+	char		local[12];
+	char	   *out = emitFieldBegin(ctx, sizeof(local));
+	int			len = pg_ltoa(value, out != NULL ? out : local);
+
+	if (out != NULL)
+		emitFieldEnd(ctx, len);
+	else
+		emitFieldValueLen(ctx, local, len);
+}
+
+/**
+ * emitFieldInt64 - Emit a 64-bit integer formatted in place
+ *
+ * @ctx:   Decode context
+ * @value: Value to emit
+ */
+static void
+emitFieldInt64(decodeContext *ctx, int64 value)
+{
+	char		local[24];
+	char	   *out = emitFieldBegin(ctx, sizeof(local));
+	int			len = pg_lltoa(value, out != NULL ? out : local);
+
+	if (out != NULL)
+		emitFieldEnd(ctx, len);
+	else
+		emitFieldValueLen(ctx, local, len);
+}
+
+/**
+ * emitFieldFloat - Emit a float4/float8 value as %g formats it
+ *
+ * @ctx:   Decode context
+ * @value: Value to emit
+ *
+ * Whole numbers below 1e6, which %g prints as plain digits, go through
+ * the digit table; other values still need snprintf.
+ */
+static void
+emitFieldFloat(decodeContext *ctx, double value)
+{
+	char		local[32];
+	char	   *out = emitFieldBegin(ctx, sizeof(local));
+	char	   *dst = out != NULL ? out : local;
+	int			len;
+
+	if (value > -1e6 && value < 1e6 && value == (double) (int32) value &&
+		!(value == 0 && signbit(value)))
+		len = pg_ltoa((int32) value, dst);
+	else
+		len = snprintf(dst, sizeof(local), "%g", value);
+
+	if (out != NULL)
+		emitFieldEnd(ctx, len);
+	else
+		emitFieldValueLen(ctx, local, len);
+}
+
 /**
  * serializeInt32 - Decode int32 value from buffer
  *
@@ -778,22 +1207,17 @@ pg_ultostr_zeropad(char *str, uint32 value, int32 minwidth)
  * @avail: Available buffer size
  * @used:  Output parameter for bytes consumed
  *
- * Decodes a 32-bit integer from the buffer and converts it to string.
- * Uses divide-and-conquer optimization to reduce division operations.
+ * Decodes a 32-bit integer from the buffer and formats it in place.
  *
  * Returns: PARSE_OK on success, negative ParseResultCode on error
  */
 static int
-serializeInt32(const char *src, unsigned int avail, unsigned int *used)
+serializeInt32(decodeContext *ctx, const char *src, unsigned int avail, unsigned int *used)
 {
 	uintptr_t location = (uintptr_t) src;
 	unsigned int gap = (unsigned int)(((location + 3) & ~3UL) - location);
 	const char *dataStart;
 	int32 rawValue;
-	char repr[16];
-	char *cursor;
-	uint32 magnitude;
-	bool signBit;
 
 	if (avail < gap)
 		return PARSE_ERR_ALIGNMENT;
@@ -805,34 +1229,7 @@ serializeInt32(const char *src, unsigned int avail, unsigned int *used)
 		return PARSE_ERR_INSUFFICIENT;
 
 	rawValue = *(int32 *) dataStart;
-
-	cursor = repr + sizeof(repr) - 1;
-	*cursor = '\0';
-
-	signBit = (rawValue < 0);
-	magnitude = signBit ? (uint32)(-(int64)rawValue) : (uint32)rawValue;
-
-	if (magnitude == 0) {
-		*--cursor = '0';
-	} else {
-		while (magnitude >= 100) {
-			uint32 twoDigits = magnitude % 100;
-			magnitude /= 100;
-			*--cursor = '0' + (twoDigits % 10);
-			*--cursor = '0' + (twoDigits / 10);
-		}
-		if (magnitude >= 10) {
-			*--cursor = '0' + (magnitude % 10);
-			*--cursor = '0' + (magnitude / 10);
-		} else {
-			*--cursor = '0' + magnitude;
-		}
-	}
-
-	if (signBit)
-		*--cursor = '-';
-
-	emitFieldValue(cursor);
+	emitFieldInt32(ctx, rawValue);
 	*used = sizeof(int32) + gap;
 	return PARSE_OK;
 }
@@ -849,12 +1246,11 @@ serializeInt32(const char *src, unsigned int avail, unsigned int *used)
  * Returns: PARSE_OK on success, negative ParseResultCode on error
  */
 static int
-serializeInt8(const char *src, unsigned int avail, unsigned int *used)
+serializeInt8(decodeContext *ctx, const char *src, unsigned int avail, unsigned int *used)
 {
 	const char *aligned = (const char *) TINYALIGN(src);
 	unsigned int offset = (unsigned int) ((uintptr_t) aligned - (uintptr_t) src);
 	int8 val;
-	char textBuf[8];
 
 	if (avail < offset)
 		return PARSE_ERR_ALIGNMENT;
@@ -865,8 +1261,7 @@ serializeInt8(const char *src, unsigned int avail, unsigned int *used)
 		return PARSE_ERR_INSUFFICIENT;
 
 	val = *(int8 *) aligned;
-	pg_ltoa((int32) val, textBuf);
-	emitFieldValue(textBuf);
+	emitFieldInt32(ctx, val);
 
 	*used = sizeof(int8) + offset;
 	return PARSE_OK;
@@ -885,17 +1280,13 @@ serializeInt8(const char *src, unsigned int avail, unsigned int *used)
  * Returns: PARSE_OK on success, negative ParseResultCode on error
  */
 static int
-serializeInt16(const char *src, unsigned int avail, unsigned int *used)
+serializeInt16(decodeContext *ctx, const char *src, unsigned int avail, unsigned int *used)
 {
 	uintptr_t baseAddr = (uintptr_t) src;
 	uintptr_t mask = sizeof(int16) - 1;
 	unsigned int skip = (unsigned int)((baseAddr & mask) ? (sizeof(int16) - (baseAddr & mask)) : 0);
 	const char *start;
 	int16 num;
-	char buffer[8];
-	char *pos;
-	int16 absVal;
-	bool negative;
 
 	if (avail < skip)
 		return PARSE_ERR_ALIGNMENT;
@@ -907,22 +1298,7 @@ serializeInt16(const char *src, unsigned int avail, unsigned int *used)
 		return PARSE_ERR_INSUFFICIENT;
 
 	num = *(int16 *) start;
-
-	pos = buffer + sizeof(buffer) - 1;
-	*pos = '\0';
-
-	negative = (num < 0);
-	absVal = negative ? -num : num;
-
-	do {
-		*--pos = '0' + (absVal % 10);
-		absVal /= 10;
-	} while (absVal > 0);
-
-	if (negative)
-		*--pos = '-';
-
-	emitFieldValue(pos);
+	emitFieldInt32(ctx, num);
 	*used = sizeof(int16) + skip;
 	return PARSE_OK;
 }
@@ -934,22 +1310,17 @@ serializeInt16(const char *src, unsigned int avail, unsigned int *used)
  * @avail: Available buffer size
  * @used:  Output parameter for bytes consumed
  *
- * Decodes a 64-bit integer from the buffer and converts it to string.
- * Uses segmented optimization algorithm to process large numbers efficiently.
+ * Decodes a 64-bit integer from the buffer and formats it in place.
  *
  * Returns: PARSE_OK on success, negative ParseResultCode on error
  */
 static int
-serializeInt64(const char *src, unsigned int avail, unsigned int *used)
+serializeInt64(decodeContext *ctx, const char *src, unsigned int avail, unsigned int *used)
 {
 	uintptr_t addr = (uintptr_t) src;
 	unsigned int padding = (unsigned int)(((addr + 7) & ~7UL) - addr);
 	const char *dataPtr;
 	int64 value;
-	char output[32];
-	char *writePos;
-	uint64 absValue;
-	bool isNegative;
 
 	if (avail < padding)
 		return PARSE_ERR_ALIGNMENT;
@@ -961,49 +1332,17 @@ serializeInt64(const char *src, unsigned int avail, unsigned int *used)
 		return PARSE_ERR_INSUFFICIENT;
 
 	value = *(int64 *) dataPtr;
-
-	writePos = output + sizeof(output) - 1;
-	*writePos = '\0';
-
-	isNegative = (value < 0);
-	absValue = isNegative ? (uint64)(~value) + 1 : (uint64)value;
-
-	if (absValue == 0) {
-		*--writePos = '0';
-	} else {
-		while (absValue >= 10000) {
-			uint64 segment = absValue % 10000;
-			absValue /= 10000;
-
-			*--writePos = '0' + (segment % 10);
-			segment /= 10;
-			*--writePos = '0' + (segment % 10);
-			segment /= 10;
-			*--writePos = '0' + (segment % 10);
-			*--writePos = '0' + (segment / 10);
-		}
-
-		while (absValue > 0) {
-			*--writePos = '0' + (absValue % 10);
-			absValue /= 10;
-		}
-	}
-
-	if (isNegative)
-		*--writePos = '-';
-
-	emitFieldValue(writePos);
+	emitFieldInt64(ctx, value);
 	*used = sizeof(int64) + padding;
 	return PARSE_OK;
 }
 
 static int
-serializeFloat32(const char *src, unsigned int avail, unsigned int *used)
+serializeFloat32(decodeContext *ctx, const char *src, unsigned int avail, unsigned int *used)
 {
 	const char *alignedSrc = (const char *) INTALIGN(src);
 	unsigned int offset = (unsigned int) ((uintptr_t) alignedSrc - (uintptr_t) src);
 	float floatVal;
-	char textRepr[32];
 
 	if (avail < offset)
 		return PARSE_ERR_ALIGNMENT;
@@ -1014,20 +1353,17 @@ serializeFloat32(const char *src, unsigned int avail, unsigned int *used)
 		return PARSE_ERR_INSUFFICIENT;
 
 	floatVal = *(float *) alignedSrc;
-	sprintf(textRepr, "%g", (double) floatVal);
-
-	emitFieldValue(textRepr);
+	emitFieldFloat(ctx, (double) floatVal);
 	*used = sizeof(float) + offset;
 	return PARSE_OK;
 }
 
 static int
-serializeFloat64(const char *src, unsigned int avail, unsigned int *used)
+serializeFloat64(decodeContext *ctx, const char *src, unsigned int avail, unsigned int *used)
 {
 	const char *alignedSrc = (const char *) DOUBLEALIGN(src);
 	unsigned int offset = (unsigned int) ((uintptr_t) alignedSrc - (uintptr_t) src);
 	double dblVal;
-	char textRepr[32];
 
 	if (avail < offset)
 		return PARSE_ERR_ALIGNMENT;
@@ -1038,9 +1374,7 @@ serializeFloat64(const char *src, unsigned int avail, unsigned int *used)
 		return PARSE_ERR_INSUFFICIENT;
 
 	dblVal = *(double *) alignedSrc;
-	sprintf(textRepr, "%g", dblVal);
-
-	emitFieldValue(textRepr);
+	emitFieldFloat(ctx, dblVal);
 	*used = sizeof(double) + offset;
 	return PARSE_OK;
 }
@@ -1062,7 +1396,7 @@ serializeFloat64(const char *src, unsigned int avail, unsigned int *used)
  *   0 on success, -1 on failure (insufficient data or parse error)
  */
 int
-decode_numeric_value(const char *input_buffer,
+decode_numeric_value(decodeContext *ctx, const char *input_buffer,
                      unsigned int buffer_size,
                      unsigned int *bytes_processed)
 {
@@ -1142,7 +1476,7 @@ decode_numeric_value(const char *input_buffer,
             if (toast_size > bytes_left)
                 break;
 
-            parse_result = DeToast(input_buffer, bytes_left, bytes_processed, &get_str_from_numeric);
+            parse_result = DeToast(ctx, input_buffer, bytes_left, bytes_processed, &get_str_from_numeric);
             *bytes_processed = skip_bytes + toast_size;
         }
         break;
@@ -1173,13 +1507,13 @@ decode_numeric_value(const char *input_buffer,
 
             if (NUMERIC_IS_SPECIAL(num_header)) {
                 if (NUMERIC_IS_NINF(num_header)) {
-                    emitFieldValue("-Infinity");
+                    emitFieldValue(ctx, "-Infinity");
                     parse_result = 0;
                 } else if (NUMERIC_IS_PINF(num_header)) {
-                    emitFieldValue("Infinity");
+                    emitFieldValue(ctx, "Infinity");
                     parse_result = 0;
                 } else if (NUMERIC_IS_NAN(num_header)) {
-                    emitFieldValue("NaN");
+                    emitFieldValue(ctx, "NaN");
                     parse_result = 0;
                 } else {
                     parse_result = -2;
@@ -1194,7 +1528,7 @@ decode_numeric_value(const char *input_buffer,
             scale_val = NUMERIC_DSCALE(num_header);
 
             if (num_size == NUMERIC_HEADER_SIZE(num_header)) {
-                emitFormattedValue("%d", 0);
+                emitFieldValueLen(ctx, "0", 1);
                 free(num_header);
                 parse_result = 0;
                 *bytes_processed = skip_bytes + short_size;
@@ -1269,7 +1603,7 @@ print_tens_short:
             }
 
             *write_ptr = '\0';
-            emitFieldValue(output_buf);
+            emitFieldValueLen(ctx, output_buf, write_ptr - output_buf);
             free(num_header);
             parse_result = 0;
             *bytes_processed = skip_bytes + short_size;
@@ -1302,13 +1636,13 @@ print_tens_short:
 
             if (NUMERIC_IS_SPECIAL(num_header)) {
                 if (NUMERIC_IS_NINF(num_header)) {
-                    emitFieldValue("-Infinity");
+                    emitFieldValue(ctx, "-Infinity");
                     parse_result = 0;
                 } else if (NUMERIC_IS_PINF(num_header)) {
-                    emitFieldValue("Infinity");
+                    emitFieldValue(ctx, "Infinity");
                     parse_result = 0;
                 } else if (NUMERIC_IS_NAN(num_header)) {
-                    emitFieldValue("NaN");
+                    emitFieldValue(ctx, "NaN");
                     parse_result = 0;
                 } else {
                     parse_result = -2;
@@ -1323,7 +1657,7 @@ print_tens_short:
             scale_val = NUMERIC_DSCALE(num_header);
 
             if (num_size == NUMERIC_HEADER_SIZE(num_header)) {
-                emitFormattedValue("%d", 0);
+                emitFieldValueLen(ctx, "0", 1);
                 free(num_header);
                 parse_result = 0;
                 *bytes_processed = skip_bytes + normal_size;
@@ -1398,7 +1732,7 @@ print_tens_normal:
             }
 
             *write_ptr = '\0';
-            emitFieldValue(output_buf);
+            emitFieldValueLen(ctx, output_buf, write_ptr - output_buf);
             free(num_header);
             parse_result = 0;
             *bytes_processed = skip_bytes + normal_size;
@@ -1424,8 +1758,8 @@ print_tens_normal:
 
             uncompressed_size = VARDATA_COMPRESSED_GET_EXTSIZE(input_buffer);
 
-            if (uncompressed_size > sizeof(decompression_storage)) {
-                printf("uncompressed_size is %d BYTES, Can not get into decompression_storage\n",
+            if (uncompressed_size > sizeof(ctx->decompressionStorage)) {
+                printf("uncompressed_size is %d BYTES, Can not get into ctx->decompressionStorage\n",
                        uncompressed_size);
                 *bytes_processed = skip_bytes + compressed_size;
                 parse_result = 0;
@@ -1436,11 +1770,11 @@ print_tens_normal:
             if (compression_algo == TOAST_PGLZ_COMPRESSION_ID) {
                 decomp_status = pglz_decompress(VARDATA_4B_C(input_buffer),
                                                 compressed_size - 2 * sizeof(uint32),
-                                                decompression_storage,
+                                                ctx->decompressionStorage,
                                                 uncompressed_size, true);
             } else if (compression_algo == TOAST_LZ4_COMPRESSION_ID) {
                 decomp_status = LZ4_decompress_safe(VARDATA_4B_C(input_buffer),
-                                                    decompression_storage,
+                                                    ctx->decompressionStorage,
                                                     compressed_size - 2 * sizeof(uint32),
                                                     uncompressed_size);
             } else {
@@ -1463,17 +1797,17 @@ print_tens_normal:
                 break;
             }
 
-            memcpy((char *) num_header, decompression_storage, num_size);
+            memcpy((char *) num_header, ctx->decompressionStorage, num_size);
 
             if (NUMERIC_IS_SPECIAL(num_header)) {
                 if (NUMERIC_IS_NINF(num_header)) {
-                    emitFieldValue("-Infinity");
+                    emitFieldValue(ctx, "-Infinity");
                     parse_result = 0;
                 } else if (NUMERIC_IS_PINF(num_header)) {
-                    emitFieldValue("Infinity");
+                    emitFieldValue(ctx, "Infinity");
                     parse_result = 0;
                 } else if (NUMERIC_IS_NAN(num_header)) {
-                    emitFieldValue("NaN");
+                    emitFieldValue(ctx, "NaN");
                     parse_result = 0;
                 } else {
                     parse_result = -2;
@@ -1488,7 +1822,7 @@ print_tens_normal:
             scale_val = NUMERIC_DSCALE(num_header);
 
             if (num_size == NUMERIC_HEADER_SIZE(num_header)) {
-                emitFormattedValue("%d", 0);
+                emitFieldValueLen(ctx, "0", 1);
                 free(num_header);
                 parse_result = 0;
                 *bytes_processed = skip_bytes + compressed_size;
@@ -1563,7 +1897,7 @@ print_tens_compressed:
             }
 
             *write_ptr = '\0';
-            emitFieldValue(output_buf);
+            emitFieldValueLen(ctx, output_buf, write_ptr - output_buf);
             free(num_header);
             parse_result = 0;
             *bytes_processed = skip_bytes + compressed_size;
@@ -1579,36 +1913,32 @@ print_tens_compressed:
     return parse_result;
 }
 
-int numeric_outputds(const char *raw_input, unsigned int buf_len, unsigned int *bytes_read)
+int numeric_outputds(decodeContext *ctx, const char *raw_input, unsigned int buf_len, unsigned int *bytes_read)
 {
-       return dissectVarlenaText(raw_input, buf_len, bytes_read, &get_str_from_numeric);
+       return dissectVarlenaText(ctx, raw_input, buf_len, bytes_read, &get_str_from_numeric);
 }
 
 static int
-bool_output(const char *input_data, unsigned int data_length, unsigned int *consumed_bytes)
+bool_output(decodeContext *ctx, const char *input_data, unsigned int data_length, unsigned int *consumed_bytes)
 {
 	if (data_length < sizeof(bool))
 		return -1;
 
 	bool b = *(const bool *) input_data;
-	char result[2];
-
-	result[0] = (b) ? 't' : 'f';
-	result[1] = '\0';
 
 	if (ExportMode_decode == SQLform)
-		addQuotesToString(result);
-
-	emitFormattedValue(result);
+		emitFieldValueLen(ctx, b ? "'t'" : "'f'", 3);
+	else
+		emitFieldValueLen(ctx, b ? "t" : "f", 1);
 	*consumed_bytes = sizeof(bool);
 	return 0;
 }
 
 static int
-uuid_output(const char *input_data, unsigned int data_length, unsigned int *consumed_bytes)
+uuid_output(decodeContext *ctx, const char *input_data, unsigned int data_length, unsigned int *consumed_bytes)
 {
 	static const char hex_chars[] = "0123456789abcdef";
-	char buf[2 * UUID_LEN + 5];
+	char buf[2 * UUID_LEN + 7];
 	char *p = buf;
 	int i;
 	const unsigned char *uuid = (const unsigned char *) input_data;
@@ -1616,6 +1946,8 @@ uuid_output(const char *input_data, unsigned int data_length, unsigned int *cons
 	if (data_length < UUID_LEN)
 		return -1;
 
+	if (ExportMode_decode == SQLform)
+		*p++ = '\'';
 	for (i = 0; i < UUID_LEN; i++)
 	{
 		int			hi;
@@ -1630,40 +1962,45 @@ uuid_output(const char *input_data, unsigned int data_length, unsigned int *cons
 		*p++ = hex_chars[hi];
 		*p++ = hex_chars[lo];
 	}
-	*p = '\0';
-
 	if (ExportMode_decode == SQLform)
-		addQuotesToString(buf);
+		*p++ = '\'';
 
 	*consumed_bytes = UUID_LEN;
-	emitFormattedValue(buf);
+	emitFieldValueLen(ctx, buf, p - buf);
 	return 0;
 }
 
 static int
-decode_macaddr(const char *input_data, unsigned int data_length, unsigned int *consumed_bytes)
+decode_macaddr(decodeContext *ctx, const char *input_data, unsigned int data_length, unsigned int *consumed_bytes)
 {
-	char result[32];
+	static const char hex_chars[] = "0123456789abcdef";
+	char result[20];
+	char *p = result;
 
 	if (data_length < 6)
 		return -1;
 
-	snprintf(result, sizeof(result), "%02x:%02x:%02x:%02x:%02x:%02x",
-			 (unsigned char) input_data[0], (unsigned char) input_data[1], (unsigned char) input_data[2],
-			 (unsigned char) input_data[3], (unsigned char) input_data[4], (unsigned char) input_data[5]);
-
 	if (ExportMode_decode == SQLform)
-		addQuotesToString(result);
+		*p++ = '\'';
+	for (int i = 0; i < 6; i++)
+	{
+		if (i > 0)
+			*p++ = ':';
+		*p++ = hex_chars[(unsigned char) input_data[i] >> 4];
+		*p++ = hex_chars[(unsigned char) input_data[i] & 0x0F];
+	}
+	if (ExportMode_decode == SQLform)
+		*p++ = '\'';
 
-	emitFormattedValue(result);
+	emitFieldValueLen(ctx, result, p - result);
 	*consumed_bytes = 6;
 	return 0;
 }
 
-int parse_text_field(const char *raw_data, unsigned int buf_capacity, unsigned int *bytes_consumed)
+int parse_text_field(decodeContext *ctx, const char *raw_data, unsigned int buf_capacity, unsigned int *bytes_consumed)
 {
        int parse_status;
-       int (*encoder_callback)(const char *, int);
+       int (*encoder_callback)(decodeContext *, const char *, int);
 
        encoder_callback = &emitEncodedValue;
 
@@ -1671,7 +2008,7 @@ int parse_text_field(const char *raw_data, unsigned int buf_capacity, unsigned i
               return -1;
        }
 
-       parse_status = dissectVarlena(raw_data, buf_capacity, bytes_consumed, encoder_callback);
+       parse_status = dissectVarlena(ctx, raw_data, buf_capacity, bytes_consumed, encoder_callback);
 
        return parse_status;
 }
@@ -1685,7 +2022,7 @@ int parse_text_field(const char *raw_data, unsigned int buf_capacity, unsigned i
  * 3. 0x80..0xFF are represented as \ooo (backslash and 3 octal digits).
  */
 static int
-char_output(const char *src_data, unsigned int capacity, unsigned int *consumed_bytes)
+char_output(decodeContext *ctx, const char *src_data, unsigned int capacity, unsigned int *consumed_bytes)
 {
 	char ch;
 	char result[5];
@@ -1709,13 +2046,13 @@ char_output(const char *src_data, unsigned int capacity, unsigned int *consumed_
 		result[1] = '\0';
 	}
 
-	emitFieldValue(result);
+	emitFieldValue(ctx, result);
 	*consumed_bytes = sizeof(char);
 	return 0;
 }
 
 static int
-name_output(const char *input_data, unsigned int data_length, unsigned int *consumed_bytes)
+name_output(decodeContext *ctx, const char *input_data, unsigned int data_length, unsigned int *consumed_bytes)
 {
 	size_t		len;
 
@@ -1724,14 +2061,16 @@ name_output(const char *input_data, unsigned int data_length, unsigned int *cons
 
 	len = strnlen(input_data, NAMEDATALEN);
 
-	char result[NAMEDATALEN + 1];
-	memcpy(result, input_data, len);
-	result[len] = '\0';
-
 	if (ExportMode_decode == SQLform)
-		addQuotesToString(result);
-
-	emitFormattedValue(result);
+	{
+		char result[NAMEDATALEN + 2];
+		result[0] = '\'';
+		memcpy(result + 1, input_data, len);
+		result[len + 1] = '\'';
+		emitFieldValueLen(ctx, result, len + 2);
+	}
+	else
+		emitFieldValueLen(ctx, input_data, len);
 	*consumed_bytes = NAMEDATALEN;
 	return 0;
 }
@@ -1754,7 +2093,7 @@ name_output(const char *input_data, unsigned int data_length, unsigned int *cons
  * Returns: 0 on success, negative value on error
  */
 static int
-dissectVarlena(const char *input_data, unsigned int data_length, unsigned int *consumed_bytes, int (*xman)(const char *, int))
+dissectVarlena(decodeContext *ctx, const char *input_data, unsigned int data_length, unsigned int *consumed_bytes, int (*xman)(decodeContext *, const char *, int))
 {
 	typedef enum {
 		VTYPE_TOAST_PTR = 1,
@@ -1821,7 +2160,7 @@ dissectVarlena(const char *input_data, unsigned int data_length, unsigned int *c
 			if (toast_size > bytes_left)
 				break;
 
-			parse_result = DeToast(current_pos, bytes_left, consumed_bytes, xman);
+			parse_result = DeToast(ctx, current_pos, bytes_left, consumed_bytes, xman);
 			*consumed_bytes = skip_bytes + toast_size;
 		}
 		break;
@@ -1833,7 +2172,7 @@ dissectVarlena(const char *input_data, unsigned int data_length, unsigned int *c
 			if (short_size > bytes_left)
 				break;
 
-			parse_result = xman(current_pos + 1, short_size - 1);
+			parse_result = xman(ctx, current_pos + 1, short_size - 1);
 			*consumed_bytes = skip_bytes + short_size;
 		}
 		break;
@@ -1845,7 +2184,7 @@ dissectVarlena(const char *input_data, unsigned int data_length, unsigned int *c
 			if (normal_size > bytes_left)
 				break;
 
-			parse_result = xman(current_pos + 4, normal_size - 4);
+			parse_result = xman(ctx, current_pos + 4, normal_size - 4);
 			*consumed_bytes = skip_bytes + normal_size;
 		}
 		break;
@@ -1862,8 +2201,8 @@ dissectVarlena(const char *input_data, unsigned int data_length, unsigned int *c
 
 			uncompressed_size = VARDATA_COMPRESSED_GET_EXTSIZE(current_pos);
 
-			if (uncompressed_size > sizeof(decompression_storage)) {
-                printf("uncompressed_size is %d BYTES, Can not get into decompression_storage\n",
+			if (uncompressed_size > sizeof(ctx->decompressionStorage)) {
+                printf("uncompressed_size is %d BYTES, Can not get into ctx->decompressionStorage\n",
 					   uncompressed_size);
 				*consumed_bytes = skip_bytes + compressed_size;
 				parse_result = 0;
@@ -1874,11 +2213,11 @@ dissectVarlena(const char *input_data, unsigned int data_length, unsigned int *c
 			if (compression_algo == TOAST_PGLZ_COMPRESSION_ID) {
 				decomp_status = pglz_decompress(VARDATA_4B_C(current_pos),
 												compressed_size - 2 * sizeof(uint32),
-												decompression_storage,
+												ctx->decompressionStorage,
 												uncompressed_size, true);
 			} else if (compression_algo == TOAST_LZ4_COMPRESSION_ID) {
 				decomp_status = LZ4_decompress_safe(VARDATA_4B_C(current_pos),
-													decompression_storage,
+													ctx->decompressionStorage,
 													compressed_size - 2 * sizeof(uint32),
 													uncompressed_size);
 			} else {
@@ -1892,7 +2231,7 @@ dissectVarlena(const char *input_data, unsigned int data_length, unsigned int *c
 				break;
 			}
 
-			parse_result = xman(decompression_storage, uncompressed_size);
+			parse_result = xman(ctx, ctx->decompressionStorage, uncompressed_size);
 			*consumed_bytes = skip_bytes + compressed_size;
 		}
 		break;
@@ -1907,7 +2246,7 @@ dissectVarlena(const char *input_data, unsigned int data_length, unsigned int *c
 }
 
 static int
-dissectVarlenaText(const char *input_data, unsigned int data_length, unsigned int *consumed_bytes, int (*xman)(const char *, int))
+dissectVarlenaText(decodeContext *ctx, const char *input_data, unsigned int data_length, unsigned int *consumed_bytes, int (*xman)(decodeContext *, const char *, int))
 {
 	enum
 	{
@@ -1973,7 +2312,7 @@ dissectVarlenaText(const char *input_data, unsigned int data_length, unsigned in
 				break;
 			}
 
-			result = extractToastedPayloadDs(current_pos, remaining, consumed_bytes, xman);
+			result = extractToastedPayloadDs(ctx, current_pos, remaining, consumed_bytes, xman);
 
 			*consumed_bytes = padding + total;
 			break;
@@ -1989,7 +2328,7 @@ dissectVarlenaText(const char *input_data, unsigned int data_length, unsigned in
 				break;
 			}
 
-			result = xman(current_pos + 1, total - 1);
+			result = xman(ctx, current_pos + 1, total - 1);
 			*consumed_bytes = padding + total;
 			break;
 		}
@@ -2004,7 +2343,7 @@ dissectVarlenaText(const char *input_data, unsigned int data_length, unsigned in
 				break;
 			}
 
-			result = xman(current_pos + 4, total - 4);
+			result = xman(ctx, current_pos + 4, total - 4);
 			*consumed_bytes = padding + total;
 			break;
 		}
@@ -2026,7 +2365,7 @@ dissectVarlenaText(const char *input_data, unsigned int data_length, unsigned in
 
 			decompressed_len = VARDATA_COMPRESSED_GET_EXTSIZE(current_pos);
 
-			if (decompressed_len > sizeof(decompression_storage))
+			if (decompressed_len > sizeof(ctx->decompressionStorage))
 			{
 				*consumed_bytes = padding + total;
 				result = 0;
@@ -2038,10 +2377,10 @@ dissectVarlenaText(const char *input_data, unsigned int data_length, unsigned in
 			{
 				case TOAST_PGLZ_COMPRESSION_ID:
 					decompress_ret = pglz_decompress(VARDATA_4B_C(current_pos), total - 2 * sizeof(uint32),
-													decompression_storage, decompressed_len, true);
+													ctx->decompressionStorage, decompressed_len, true);
 					break;
 				case TOAST_LZ4_COMPRESSION_ID:
-					decompress_ret = LZ4_decompress_safe(VARDATA_4B_C(current_pos), decompression_storage,
+					decompress_ret = LZ4_decompress_safe(VARDATA_4B_C(current_pos), ctx->decompressionStorage,
 														 total - 2 * sizeof(uint32), decompressed_len);
 					break;
 				default:
@@ -2056,7 +2395,7 @@ dissectVarlenaText(const char *input_data, unsigned int data_length, unsigned in
 				break;
 			}
 
-			result = xman(decompression_storage, decompressed_len);
+			result = xman(ctx, ctx->decompressionStorage, decompressed_len);
 			*consumed_bytes = padding + total;
 			break;
 		}
@@ -2115,37 +2454,187 @@ static void append_escaped_char(char ch, char *buf, int *idx, bool escape_csv)
 	buf[(*idx)++] = ch;
 }
 
-static int
-emitEncodedValue(const char *str, int orig_len)
+/* Bytes append_escaped_char rewrites in CSV mode */
+static const char escapeNeedlesCSV[5] = {'\0', '\r', '\n', '\t', '\\'};
+/* Bytes that end (NUL) or need quoting (') in SQL mode, padded to five */
+static const char escapeNeedlesSQL[5] = {'\0', '\'', '\'', '\'', '\''};
+
+/**
+ * escapeScanScalar - Find the first byte of a needle set, byte by byte
+ *
+ * @s:       Text to scan
+ * @len:     Length of s
+ * @needles: Five bytes to look for
+ *
+ * Returns: Offset of the first needle, len when there is none
+ */
+static size_t escapeScanScalar(const char *s, size_t len, const char *needles)
 {
+	for (size_t i = 0; i < len; i++)
+	{
+		char ch = s[i];
+		if (ch == needles[0] || ch == needles[1] || ch == needles[2] ||
+			ch == needles[3] || ch == needles[4])
+			return i;
+	}
+	return len;
+}
 
-	int			curr_offset = 0;
-	int			len = orig_len;
-    char *tmp_buff = malloc(2 * orig_len + 1);
+#if defined(__SSE2__)
+/**
+ * escapeScanSse2 - escapeScanScalar, sixteen bytes per step
+ */
+static size_t escapeScanSse2(const char *s, size_t len, const char *needles)
+{
+	const __m128i n0 = _mm_set1_epi8(needles[0]);
+	const __m128i n1 = _mm_set1_epi8(needles[1]);
+	const __m128i n2 = _mm_set1_epi8(needles[2]);
+	const __m128i n3 = _mm_set1_epi8(needles[3]);
+	const __m128i n4 = _mm_set1_epi8(needles[4]);
+	size_t i = 0;
+
+	for (; i + 16 <= len; i += 16)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *) (s + i));
+		__m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, n0), _mm_cmpeq_epi8(v, n1)),
+								   _mm_or_si128(_mm_cmpeq_epi8(v, n2), _mm_cmpeq_epi8(v, n3)));
+		int mask = _mm_movemask_epi8(_mm_or_si128(hit, _mm_cmpeq_epi8(v, n4)));
 
-	if (tmp_buff == NULL)
+		if (mask)
+			return i + __builtin_ctz(mask);
+	}
+	return i + escapeScanScalar(s + i, len - i, needles);
+}
+#endif
+
+#if defined(__x86_64__) && defined(__GNUC__)
+/**
+ * escapeScanAvx2 - escapeScanScalar, thirty-two bytes per step
+ */
+__attribute__((target("avx2")))
+static size_t escapeScanAvx2(const char *s, size_t len, const char *needles)
+{
+	const __m256i n0 = _mm256_set1_epi8(needles[0]);
+	const __m256i n1 = _mm256_set1_epi8(needles[1]);
+	const __m256i n2 = _mm256_set1_epi8(needles[2]);
+	const __m256i n3 = _mm256_set1_epi8(needles[3]);
+	const __m256i n4 = _mm256_set1_epi8(needles[4]);
+	size_t i = 0;
+
+	for (; i + 32 <= len; i += 32)
 	{
-		perror("malloc");
-		exit(1);
+		__m256i v = _mm256_loadu_si256((const __m256i *) (s + i));
+		__m256i hit = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, n0), _mm256_cmpeq_epi8(v, n1)),
+									  _mm256_or_si256(_mm256_cmpeq_epi8(v, n2), _mm256_cmpeq_epi8(v, n3)));
+		uint32 mask = (uint32) _mm256_movemask_epi8(_mm256_or_si256(hit, _mm256_cmpeq_epi8(v, n4)));
+
+		if (mask)
+			return i + __builtin_ctz(mask);
 	}
+	return i + escapeScanScalar(s + i, len - i, needles);
+}
+#endif
 
+static size_t (*escapeScan)(const char *s, size_t len, const char *needles) = escapeScanScalar;
+static pthread_once_t escapeScanOnce = PTHREAD_ONCE_INIT;
+
+/**
+ * escapeScanInit - Pick the widest scan the CPU runs
+ */
+static void escapeScanInit(void)
+{
+#if defined(__SSE2__)
+	escapeScan = escapeScanSse2;
+#endif
+#if defined(__x86_64__) && defined(__GNUC__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		escapeScan = escapeScanAvx2;
+#endif
+}
 
-	while (len > 0)
+/**
+ * emitEncodedValue - Escape a text value and emit it as one field
+ *
+ * @ctx:      Decode context
+ * @str:      Text, not NUL-terminated
+ * @orig_len: Length of str
+ *
+ * CSV mode copies the runs between bytes append_escaped_char rewrites in
+ * bulk. SQL mode keeps the text up to its first NUL, doubles inner quotes
+ * only when it has any, and wraps it in quotes.
+ *
+ * Returns: 0
+ */
+static int
+emitEncodedValue(decodeContext *ctx, const char *str, int orig_len)
+{
+	char		small[512];
+	char	   *tmp_buff = small;
+	int			curr_offset = 0;
+	size_t		len = orig_len > 0 ? orig_len : 0;
+	size_t		pos = 0;
+
+	if (2 * len + 3 > sizeof(small))
 	{
-		append_escaped_char(*str, tmp_buff, &curr_offset, ExportMode_decode == CSVform);
-		str++;
-		len--;
+		tmp_buff = malloc(2 * len + 3);
+		if (tmp_buff == NULL)
+		{
+			perror("malloc");
+			exit(1);
+		}
 	}
+	pthread_once(&escapeScanOnce, escapeScanInit);
 
-	tmp_buff[curr_offset] = '\0';
+	if (ExportMode_decode == CSVform)
+	{
+		while (pos < len)
+		{
+			size_t run = escapeScan(str + pos, len - pos, escapeNeedlesCSV);
 
-	if(ExportMode_decode == SQLform){
-		replace_improper_symbols(tmp_buff);
-		addQuotesToString(tmp_buff);
+			memcpy(tmp_buff + curr_offset, str + pos, run);
+			curr_offset += run;
+			pos += run;
+			if (pos < len)
+				append_escaped_char(str[pos++], tmp_buff, &curr_offset, true);
+		}
+		tmp_buff[curr_offset] = '\0';
+	}
+	else
+	{
+		bool		quoted = false;
+
+		while (pos < len)
+		{
+			pos += escapeScan(str + pos, len - pos, escapeNeedlesSQL);
+			if (pos == len || str[pos] == '\0')
+				break;
+			quoted = true;
+			pos++;
+		}
+		curr_offset = 1 + pos;
+		memcpy(tmp_buff + 1, str, pos);
+		tmp_buff[curr_offset] = '\0';
+
+		if (ExportMode_decode == SQLform)
+		{
+			if (quoted)
+			{
+				replace_improper_symbols(tmp_buff + 1);
+				curr_offset = 1 + strlen(tmp_buff + 1);
+			}
+			tmp_buff[0] = '\'';
+			tmp_buff[curr_offset++] = '\'';
+			tmp_buff[curr_offset] = '\0';
+		}
 	}
 
-	emitFieldValue(tmp_buff);
-	free(tmp_buff);
+	if (ExportMode_decode == CSVform || ExportMode_decode == SQLform)
+		emitFieldValueLen(ctx, tmp_buff, curr_offset);
+	else
+		emitFieldValueLen(ctx, tmp_buff + 1, curr_offset - 1);
+	if (tmp_buff != small)
+		free(tmp_buff);
 	return 0;
 }
 
@@ -2160,7 +2649,7 @@ emitEncodedValue(const char *str, int orig_len)
  *
  * Returns: 0 on success, negative value on error
  */
-static int get_str_from_numeric(const char *buffer, int num_size)
+static int get_str_from_numeric(decodeContext *ctx, const char *buffer, int num_size)
 {
 	static const char digit_pairs[200] =
 		"00010203040506070809"
@@ -2190,13 +2679,13 @@ static int get_str_from_numeric(const char *buffer, int num_size)
 	if (NUMERIC_IS_SPECIAL(num_header)) {
 		int ret_code = -2;
 		if (NUMERIC_IS_NINF(num_header)) {
-			emitFieldValue("-Infinity");
+			emitFieldValue(ctx, "-Infinity");
 			ret_code = 0;
 		} else if (NUMERIC_IS_PINF(num_header)) {
-			emitFieldValue("Infinity");
+			emitFieldValue(ctx, "Infinity");
 			ret_code = 0;
 		} else if (NUMERIC_IS_NAN(num_header)) {
-			emitFieldValue("NaN");
+			emitFieldValue(ctx, "NaN");
 			ret_code = 0;
 		}
 		free(num_header);
@@ -2208,7 +2697,7 @@ static int get_str_from_numeric(const char *buffer, int num_size)
 	scale_val = NUMERIC_DSCALE(num_header);
 
 	if (num_size == NUMERIC_HEADER_SIZE(num_header)) {
-		emitFormattedValue("%d", 0);
+		emitFieldValueLen(ctx, "0", 1);
 		free(num_header);
 		return 0;
 	}
@@ -2279,12 +2768,12 @@ print_tens:
 	}
 
 	*write_ptr = '\0';
-	emitFieldValue(output_buf);
+	emitFieldValueLen(ctx, output_buf, write_ptr - output_buf);
 	free(num_header);
 	return 0;
 }
 
-static int DeToast(const char *buffer,unsigned int buff_size,unsigned int* out_size,int (*xman)(const char *, int))
+static int DeToast(decodeContext *ctx, const char *buffer,unsigned int buff_size,unsigned int* out_size,int (*xman)(decodeContext *, const char *, int))
 {
 	int		result = 0;
 
@@ -2296,7 +2785,7 @@ static int DeToast(const char *buffer,unsigned int buff_size,unsigned int* out_s
 		int32		toast_ext_size;
 		char	toast_relation_path[500];
 		char		toast_relation_filename[550];
-		FILE	   *toast_rel_fp;
+		toastReader *toast_rd;
 		unsigned int block_options = 0;
 		unsigned int control_options = 0;
 
@@ -2309,27 +2798,27 @@ static int DeToast(const char *buffer,unsigned int buff_size,unsigned int* out_s
 		#endif
 
 		#if MAINDEBUG == 1
-		sprintf(CURDBPath,"/home/11pg/data/base/16384/");
+		sprintf(ctx->CURDBPath,"/home/11pg/data/base/16384/");
 		#endif
 
-		strcpy(toast_relation_path,CURDBPath);
+		strcpy(toast_relation_path,ctx->CURDBPath);
 
-		if(strcmp(toastId,"TOASTNODE") == 0){
+		if(strcmp(ctx->toastId,"TOASTNODE") == 0){
 			char a[20];
 			sprintf(a,"%d",toast_ptr.va_toastrelid);
 			initToastId(a);
 		}
 
-		sprintf(toast_relation_filename, "%s/%s", toast_relation_path,toastId);
-		toast_rel_fp = fopen(toast_relation_filename, "rb");
-		if(toast_rel_fp == NULL){
+		sprintf(toast_relation_filename, "%s/%s", toast_relation_path,ctx->toastId);
+		toast_rd = decodeContextToastReader(ctx, toast_relation_filename);
+		if(toast_rd == NULL){
 			if( resTyp_decode == UPDATEtyp){
 				memset(toast_relation_path,0,500);
 				memset(toast_relation_filename,0,550);
-				strcpy(toast_relation_path,CURDBPathforDB);
-				sprintf(toast_relation_filename, "%s/%s", toast_relation_path,toastId);
-				toast_rel_fp = fopen(toast_relation_filename, "rb");
-				if(toast_rel_fp == NULL){
+				strcpy(toast_relation_path,ctx->CURDBPathforDB);
+				sprintf(toast_relation_filename, "%s/%s", toast_relation_path,ctx->toastId);
+				toast_rd = decodeContextToastReader(ctx, toast_relation_filename);
+				if(toast_rd == NULL){
 					return -1;
 				}
 			}
@@ -2338,34 +2827,31 @@ static int DeToast(const char *buffer,unsigned int buff_size,unsigned int* out_s
 			}
 		}
 
-		unsigned int toast_relation_block_size = determinePageDimension(toast_rel_fp);
-		fseek(toast_rel_fp, 0, SEEK_SET);
 		toast_data = malloc(toast_ptr.va_rawsize*2);
-		unsigned int	toastDataRead = 0;
 
-		result = assembleToastByIndex(
+		result = assembleToastByIndex(ctx,
 		toast_ptr.va_valueid,
 		toast_ext_size,
 		toast_data,
-		toastHash_decode,
-		toast_relation_filename);
+		NULL,
+		ctx->toastIdx,
+		toast_rd);
 
 		if (result == SUCCESS_RET)
 		{
 			if (VARATT_EXTERNAL_IS_COMPRESSED(toast_ptr)){
-				result = UnpackToastPayload(toast_data, toast_ext_size, xman);
+				result = UnpackToastPayload(ctx, toast_data, toast_ext_size, xman);
 				if(result == -1 && resTyp_decode == UPDATEtyp){
 				}
 			}
 			else{
-				result = xman(toast_data, toast_ext_size);
+				result = xman(ctx, toast_data, toast_ext_size);
 			}
 		}
 		else if(result == FAILURE_RET)
 		{
 		}
 		free(toast_data);
-		fclose(toast_rel_fp);
 	}
 	else
 	{
@@ -2375,112 +2861,204 @@ static int DeToast(const char *buffer,unsigned int buff_size,unsigned int* out_s
 	return result;
 }
 
-int assembleToastByIndex(Oid toastOid,unsigned int toastExternalSize,char *toastData,harray *toastHash,char *toastfilePath)
+/**
+ * copyToastChunk - Append one TOAST chunk to the value being assembled
+ *
+ * @page:              Page holding the chunk
+ * @elem:              Location of the chunk
+ * @toastExternalSize: Expected size of the reassembled value
+ * @toastData:         Destination buffer
+ * @toastRead:         Bytes already in toastData
+ *
+ * Returns: Number of bytes appended, 0 if the chunk does not fit
+ */
+static unsigned int copyToastChunk(char *page,chunkInfo *elem,unsigned int toastExternalSize,
+								   char *toastData,unsigned int toastRead)
 {
-    unsigned int bytesToFormat;
-	int blockSize;
-	FILE *fp=NULL;
-
-	int result = FAILURE_RET;
-    char *block = NULL;
+	char *tuple_data = &page[elem->toff];
+	HeapTupleHeader	header = (HeapTupleHeader)tuple_data;
+	char	   *data = tuple_data + header->t_hoff + 8;
+	unsigned int chunkSize = VARSIZE(data) - VARHDRSZ;
 
-	if(toastHash == NULL)
-		return FAILURE_RET;
-
-	parray *chunkInfosInner = parray_new();
+	if(chunkSize > toastExternalSize ||
+	   toastRead+chunkSize > toastExternalSize){
+		return 0;
+	}
+	memcpy(toastData + toastRead, VARDATA(data), chunkSize);
+	return chunkSize;
+}
 
-	char toastOidVal[20];
-	sprintf(toastOidVal,"%d",toastOid);
-	unsigned int index = hash(toastHash, toastOidVal, toastHash->allocated);
-	Node* node = toastHash->table[index];
-	while (node != NULL) {
-		chunkInfo *elem1 = (chunkInfo*)node->data;
-		if(elem1->toid == toastOid){
-			parray_append(chunkInfosInner,elem1);
+/**
+ * readToastGroup - Copy one group of TOAST chunks into toastData
+ *
+ * @ctx:               Decode context (owns the async read queue)
+ * @rd:                Open TOAST relation
+ * @chunkInfos:        Chunks of the value, in chunk_seq order
+ * @toastExternalSize: Expected size of the reassembled value
+ * @toastData:         Destination buffer
+ *
+ * Without an async queue every chunk is copied from toastReaderPage, which
+ * maps or caches the page. With one, the pages holding the chunks are read
+ * a window at a time, one request per distinct block, with the whole
+ * window in flight at once. Either way chunks are copied in order.
+ *
+ * Returns: Number of bytes copied into toastData
+ */
+static unsigned int readToastGroup(decodeContext *ctx,toastReader *rd,parray *chunkInfos,
+								   unsigned int toastExternalSize,char *toastData)
+{
+	aioQueue *aio = decodeContextAio(ctx);
+	int blockSize = rd->blockSize;
+	int nChunks = parray_num(chunkInfos);
+	unsigned int toastRead = 0;
+	int x = 0;
+
+	if (aio == NULL || aioQueueDepth(aio) <= 1) {
+		for (x = 0; x < nChunks && toastRead < toastExternalSize; x++) {
+			chunkInfo *elem = parray_get(chunkInfos, x);
+			char *page = toastReaderPage(rd, elem->suffix, elem->blk);
+
+			if (page == NULL) {
+				fprintf(stderr, "read failed for block %u\n", elem->blk);
+				continue;
+			}
+			toastRead += copyToastChunk(page, elem, toastExternalSize, toastData, toastRead);
 		}
-		node=node->next;
+		return toastRead;
 	}
-	if(parray_num(chunkInfosInner) == 0){
-		return FAILURE_RET;
+
+	int window = aioQueueDepth(aio);
+	aioRequest *reqs = (aioRequest *)calloc(window, sizeof(aioRequest));
+	int *chunkReq = (int *)malloc(sizeof(int) * nChunks);
+	char *blocks = (char *)malloc((size_t)window * blockSize);
+
+	if (reqs == NULL || chunkReq == NULL || blocks == NULL) {
+		printf("\nFAILED TO ALLOCATE SIZE OF <%d> BYTES \n",window * blockSize);
+		free(reqs);
+		free(chunkReq);
+		free(blocks);
+		return 0;
 	}
 
-	int num_groups;
-    parray **groups = group_chunks(chunkInfosInner, &num_groups);
+	while (x < nChunks && toastRead < toastExternalSize) {
+		int nReqs = 0;
+		int last = x;
 
-	int toastRead;
-	for (int g = 0; g < num_groups; g++) {
-		parray *chunkInfos = groups[g];
-		unsigned int	chunkSize = 0;
-		toastRead = 0;
-
-		fp = fopen(toastfilePath,"rb");
-		if(!fp){
-			parray_free(chunkInfos);
-			printf("can not open %s \n",toastfilePath);
-			return FAILURE_RET;
-		}
-		blockSize = determinePageDimension(fp);
-		block = (char *)malloc(blockSize);
-		if (!block)
-		{
-			parray_free(chunkInfos);
-			free(block);
-			printf("\nFAILED TO ALLOCATE SIZE OF <%d> BYTES \n",blockSize);
-			return FAILURE_RET;
-		}
-		for(int x=0;x<parray_num(chunkInfos);x++){
-			chunkInfo *elem = parray_get(chunkInfos,x);
-			uint64_t blkoff = (uint64_t)elem->blk * (uint64_t)blockSize;
-			if (toastRead >= toastExternalSize) {
-				break;
-			}
+		/* Gather chunks until window distinct blocks are needed */
+		while (last < nChunks) {
+			chunkInfo *elem = parray_get(chunkInfos, last);
+			toastSegment *ts = toastReaderSegment(rd, elem->suffix);
+			int fd = ts != NULL ? ts->fd : -1;
 
-			if (fseek(fp, blkoff, SEEK_SET) != 0) {
-				fprintf(stderr, "fseek failed for block %lu\n", elem->blk);
-				continue;
+			if (nReqs == 0 || reqs[nReqs - 1].fd != fd ||
+				reqs[nReqs - 1].offset != (off_t)elem->blk * blockSize) {
+				if (nReqs == window)
+					break;
+				memset(&reqs[nReqs], 0, sizeof(aioRequest));
+				reqs[nReqs].fd = fd;
+				reqs[nReqs].offset = (off_t)elem->blk * blockSize;
+				reqs[nReqs].len = blockSize;
+				reqs[nReqs].buf = blocks + (size_t)nReqs * blockSize;
+				nReqs++;
 			}
+			chunkReq[last] = nReqs - 1;
+			last++;
+		}
+		aioReadBatch(aio, reqs, nReqs);
 
-			fread(block, 1, blockSize, fp);
-
-			char *tuple_data = &block[elem->toff];
-			HeapTupleHeader	header = (HeapTupleHeader)tuple_data;
-			char	   *data = tuple_data + header->t_hoff + 8;
-			unsigned int	size = 0;
+		for (; x < last; x++) {
+			chunkInfo *elem = parray_get(chunkInfos, x);
+			aioRequest *req = &reqs[chunkReq[x]];
 
-			chunkSize = VARSIZE(data) - VARHDRSZ;
-			if(chunkSize > toastExternalSize ||
-			   toastRead+chunkSize > toastExternalSize){
+			if (toastRead >= toastExternalSize)
+				break;
+			if (req->result != (ssize_t)req->len) {
+				fprintf(stderr, "read failed for block %u\n", elem->blk);
 				continue;
 			}
-			memcpy(toastData + toastRead, VARDATA(data), chunkSize);
-			toastRead +=chunkSize;
+			toastRead += copyToastChunk(req->buf, elem, toastExternalSize, toastData, toastRead);
 		}
+	}
 
-		if(toastRead >= toastExternalSize){
-			for (int g = 0; g < num_groups; g++) {
-				parray *elem = groups[g];
-				parray_free(elem);
-			}
-			free(groups);
-			fclose(fp);
-			free(block);
-			return SUCCESS_RET;
-		}
+	free(reqs);
+	free(chunkReq);
+	free(blocks);
+	return toastRead;
+}
 
-		fclose(fp);
-		free(block);
+/**
+ * assembleToastByIndex - Reassemble one toasted value from its chunks
+ *
+ * @ctx:               Decode context
+ * @toastOid:          valueid of the toasted value
+ * @toastExternalSize: Size of the value on disk
+ * @toastData:         Receives the value
+ * @toastHash:         Chunk locations of dropscan, or NULL
+ * @toastIdx:          Chunk index of toastBootstrap, or NULL
+ * @rd:                Open TOAST relation
+ *
+ * Returns: SUCCESS_RET on success, FAILURE_RET on failure
+ */
+int assembleToastByIndex(decodeContext *ctx,Oid toastOid,unsigned int toastExternalSize,char *toastData,harray *toastHash,toastIndex *toastIdx,toastReader *rd)
+{
+	chunkInfo *idxChunks = NULL;
+
+	if((toastHash == NULL && toastIdx == NULL) || rd == NULL)
+		return FAILURE_RET;
+
+	parray *chunkInfosInner = parray_new();
+
+	if(toastIdx != NULL){
+		uint64 nEntries;
+		uint64 first = toastIndexFind(toastIdx, toastOid, &nEntries);
+
+		if(nEntries > 0)
+			idxChunks = malloc(sizeof(chunkInfo) * nEntries);
+		for (uint64 i = 0; i < nEntries; i++) {
+			const toastIndexEntry *e = &toastIdx->entries[first + i];
+			idxChunks[i].toid = e->valueid;
+			idxChunks[i].chunkid = e->chunkseq;
+			idxChunks[i].blk = e->blk;
+			idxChunks[i].toff = e->off;
+			idxChunks[i].suffix = e->suffix;
+			parray_append(chunkInfosInner,&idxChunks[i]);
+		}
+	}
+	else{
+		harrayIter it;
+		chunkInfo *elem1;
+		harray_iter_init(&it, toastHash, toastOid);
+		while ((elem1 = (chunkInfo*)harray_iter_next(&it)) != NULL) {
+			parray_append(chunkInfosInner,elem1);
+		}
+	}
+	if(parray_num(chunkInfosInner) == 0){
+		parray_free(chunkInfosInner);
 		return FAILURE_RET;
 	}
 
+	int num_groups;
+	int result = FAILURE_RET;
+    parray **groups = group_chunks(chunkInfosInner, &num_groups);
+
+	/* Only the first group is tried, as before */
+	if (num_groups > 0) {
+		unsigned int toastRead = readToastGroup(ctx, rd, groups[0], toastExternalSize, toastData);
+		if(toastRead >= toastExternalSize)
+			result = SUCCESS_RET;
+	}
+
     for (int g = 0; g < num_groups; g++) {
 		parray *elem = groups[g];
         parray_free(elem);
     }
     free(groups);
-    return FAILURE_RET;
+	parray_free(chunkInfosInner);
+	free(idxChunks);
+    return result;
 }
 
-static int extractToastedPayloadDs(const char *input, unsigned int input_len, unsigned int *consumed, int (*emit_value)(const char *, int))
+static int extractToastedPayloadDs(decodeContext *ctx, const char *input, unsigned int input_len, unsigned int *consumed, int (*emit_value)(decodeContext *, const char *, int))
 {
 	varatt_external meta;
 	int status = -1;
@@ -2499,7 +3077,7 @@ static int extractToastedPayloadDs(const char *input, unsigned int input_len, un
 	const int32 external_len = meta.va_extsize;
 #endif
 
-	if (!isToastDecoded)
+	if (!ctx->isToastDecoded)
 		return meta.va_valueid;
 
 	const size_t workspace_len = meta.va_rawsize * 2;
@@ -2511,19 +3089,20 @@ static int extractToastedPayloadDs(const char *input, unsigned int input_len, un
 	memset(payload, 0, workspace_len);
 
 	char toastfilePath[MAXPGPATH] = {0};
-	snprintf(toastfilePath, sizeof(toastfilePath), "%s/.toast/dbf", dc->csvPrefix);
+	snprintf(toastfilePath, sizeof(toastfilePath), "%s/.toast/dbf", ctx->dc->csvPrefix);
 
-	status = assembleToastByIndex(meta.va_valueid,
+	status = assembleToastByIndex(ctx,meta.va_valueid,
 									external_len,
 									payload,
-									dc->toastOids,
-									toastfilePath);
+									ctx->dc->toastOids,
+									NULL,
+									decodeContextToastReader(ctx, toastfilePath));
 
 	if (status == SUCCESS_RET)
 	{
 		status = VARATT_EXTERNAL_IS_COMPRESSED(meta)
-					 ? UnpackToastPayload(payload, external_len, emit_value)
-					 : emit_value(payload, external_len);
+					 ? UnpackToastPayload(ctx, payload, external_len, emit_value)
+					 : emit_value(ctx, payload, external_len);
 		if (status > 0)
 			status = 0;
 	}
@@ -2536,7 +3115,7 @@ static int extractToastedPayloadDs(const char *input, unsigned int input_len, un
 	return status;
 }
 
-static int UnpackToastPayload(const char *packed, int32 packed_len, int (*consumer)(const char *, int))
+static int UnpackToastPayload(decodeContext *ctx, const char *packed, int32 packed_len, int (*consumer)(decodeContext *, const char *, int))
 {
 	int			inflated = -1;
 	size_t		raw_target = TOAST_COMPRESS_RAWSIZE(packed);
@@ -2563,7 +3142,7 @@ static int UnpackToastPayload(const char *packed, int32 packed_len, int (*consum
 	}
 
 	if (inflated >= 0)
-		emitEncodedValue(scratch, inflated);
+		emitEncodedValue(ctx, scratch, inflated);
 
 	free(scratch);
 	return inflated;
@@ -2766,210 +3345,173 @@ static void j2date(int jd, int *year, int *month, int *day)
 }
 
 /**
- * date_output - Decode PostgreSQL date type to string
+ * formatYmd - Write a date as YYYY-MM-DD through the digit-pair table
  *
- * @input_data:    Pointer to source data buffer
- * @data_length: Available buffer size
- * @consumed_bytes:  Output parameter for bytes consumed
+ * @dst:   Output, at least 16 bytes
+ * @year:  Year, <= 0 for BC; the caller appends " BC"
+ * @month: Month, 1-12
+ * @day:   Day of month
  *
- * Decodes date value and converts to ISO format (YYYY-MM-DD).
- * Derived from PostgreSQL date_out.
- *
- * Returns: 0 on success, negative value on error
+ * Returns: Bytes written
  */
-static int date_output(const char *input_data, unsigned int data_length, unsigned int *consumed_bytes)
+static int formatYmd(char *dst, int year, int month, int day)
 {
-	const char *aligned_buf = (const char *) INTALIGN(input_data);
-	unsigned int padding = (unsigned int) ((uintptr_t) aligned_buf - (uintptr_t) input_data);
-	int32 date_val;
-	int32 jd, yr, mon, day;
-	char buf[32];
-	char *ptr;
+	char	   *p = pg_ultostr_zeropad(dst, (year > 0) ? year : -(year - 1), 4);
 
-	if (data_length < padding)
-		return -1;
+	*p++ = '-';
+	memcpy(p, DIGIT_TABLE + month * 2, 2);
+	p[2] = '-';
+	memcpy(p + 3, DIGIT_TABLE + day * 2, 2);
+	return (int) (p + 5 - dst);
+}
 
-	data_length -= padding;
+/**
+ * dayCacheLookup - Get the YYYY-MM-DD text of a Julian day
+ *
+ * @c:  Last day converted by this column type
+ * @jd: Julian day number
+ *
+ * Rows of one table tend to share a day, so j2date only runs when the day
+ * changes.
+ *
+ * Returns: c, holding jd
+ */
+static const dayCache *dayCacheLookup(dayCache *c, int32 jd)
+{
+	int			year, month, day;
 
-	if (data_length < sizeof(int32))
-		return -2;
+	if (c->valid && c->jd == jd)
+		return c;
 
-	*consumed_bytes = sizeof(int32) + padding;
-	date_val = *(int32 *) aligned_buf;
+	j2date(jd, &year, &month, &day);
+	c->len = formatYmd(c->text, year, month, day);
+	c->bc = (year <= 0);
+	c->jd = jd;
+	c->valid = true;
+	return c;
+}
 
-	if (date_val == PG_INT32_MIN) {
-		emitFieldValue("-infinity");
-		return 0;
-	}
-	if (date_val == PG_INT32_MAX) {
-		emitFieldValue("infinity");
-		return 0;
-	}
+/**
+ * formatHourMin - Write "HH:MM:" through the digit-pair table
+ *
+ * @p:      Output
+ * @hour:   Hour, 0-23
+ * @minute: Minute, 0-59
+ *
+ * Returns: Position after the second colon
+ */
+static inline char *formatHourMin(char *p, int hour, int minute)
+{
+	memcpy(p, DIGIT_TABLE + hour * 2, 2);
+	p[2] = ':';
+	memcpy(p + 3, DIGIT_TABLE + minute * 2, 2);
+	p[5] = ':';
+	return p + 6;
+}
 
-	jd = date_val + POSTGRES_EPOCH_JDATE;
-	j2date(jd, &yr, &mon, &day);
+/* Longest date/time field, quotes and NUL included */
+#define DATETIME_FIELD_MAX 64
 
-	/* Format date in PostgreSQL style (ISO format: YYYY-MM-DD) */
-	ptr = buf;
-	ptr = pg_ultostr_zeropad(ptr, (yr > 0) ? yr : -(yr - 1), 4);
-	*ptr++ = '-';
-	ptr = pg_ultostr_zeropad(ptr, mon, 2);
-	*ptr++ = '-';
-	ptr = pg_ultostr_zeropad(ptr, day, 2);
+/**
+ * emitDateTimeBegin - Start a date/time field, SQL quote opened
+ *
+ * @ctx:   Decode context
+ * @local: Fallback buffer of DATETIME_FIELD_MAX bytes for UPDATE output
+ * @out:   Output parameter, where the field starts
+ *
+ * Returns: Write position
+ */
+static inline char *emitDateTimeBegin(decodeContext *ctx, char *local, char **out)
+{
+	char	   *p = emitFieldBegin(ctx, DATETIME_FIELD_MAX);
 
-	if (yr <= 0) {
-		memcpy(ptr, " BC", 3);
-		ptr += 3;
-	}
-	*ptr = '\0';
+	*out = p;
+	if (p == NULL)
+		*out = p = local;
+	if (ExportMode_decode == SQLform)
+		*p++ = '\'';
+	return p;
+}
 
-	switch (ExportMode_decode) {
-		case SQLform:
-			addQuotesToString(buf);
-			emitFieldValue(buf);
-			break;
-		case CSVform:
-			emitFieldValue(buf);
-			break;
+/**
+ * emitDateTimeEnd - Close the SQL quote and commit a date/time field
+ *
+ * @ctx:   Decode context
+ * @local: Buffer given to emitDateTimeBegin
+ * @out:   Field start from emitDateTimeBegin
+ * @p:     Write position
+ */
+static inline void emitDateTimeEnd(decodeContext *ctx, char *local, char *out, char *p)
+{
+	if (ExportMode_decode == SQLform)
+		*p++ = '\'';
+	if (out == local)
+	{
+		*p = '\0';
+		emitFieldValueLen(ctx, local, (int) (p - local));
 	}
-	return 0;
+	else
+		emitFieldEnd(ctx, (int) (p - out));
 }
 
 /**
- * timestamp_internal_output - Decode PostgreSQL timestamp/timestamptz type
+ * date_output - Decode PostgreSQL date type to string
  *
- * @input_data:     Pointer to source data buffer
- * @data_length:  Available buffer size
- * @consumed_bytes:   Output parameter for bytes consumed
- * @include_tz: Whether to include timezone information
+ * @input_data:    Pointer to source data buffer
+ * @data_length: Available buffer size
+ * @consumed_bytes:  Output parameter for bytes consumed
  *
- * Independent implementation using pipeline time decomposition algorithm.
- * Derived from PostgreSQL timestamp_out/timestamptz_out.
+ * Decodes date value and converts to ISO format (YYYY-MM-DD).
+ * Derived from PostgreSQL date_out. The text of the last day seen is
+ * cached in ctx->dateDay.
  *
  * Returns: 0 on success, negative value on error
  */
-static int timestamp_internal_output(const char *input_data, unsigned int data_length, unsigned int *consumed_bytes, bool include_tz)
+static int date_output(decodeContext *ctx, const char *input_data, unsigned int data_length, unsigned int *consumed_bytes)
 {
-	#define FORMAT_FIXED_WIDTH(ptr, val, width) do { \
-		int _v = (val); \
-		int _w = (width); \
-		char *_p = (ptr) + _w; \
-		while (_w-- > 0) { \
-			*--_p = '0' + (_v % 10); \
-			_v /= 10; \
-		} \
-	} while(0)
-
-	uintptr_t addr = (uintptr_t) input_data;
-	unsigned int pad_bytes = (unsigned int)(((addr + 7) & ~7UL) - addr);
-	const char *data_src;
-	int64 timestamp_usec;
-	int32 days_since_epoch, julian_day;
-	int64 microseconds_in_day, total_seconds;
-	int32 year, month, day, hour, minute, second;
-	int64 microsecond;
-	char output_string[80];
-	char *write_cursor;
+	const char *aligned_buf = (const char *) INTALIGN(input_data);
+	unsigned int padding = (unsigned int) ((uintptr_t) aligned_buf - (uintptr_t) input_data);
+	int32 date_val;
+	const dayCache *dc;
+	char local[DATETIME_FIELD_MAX];
+	char *out, *ptr;
 
-	if (data_length < pad_bytes)
+	if (data_length < padding)
 		return -1;
 
-	data_src = input_data + pad_bytes;
-	data_length -= pad_bytes;
+	data_length -= padding;
 
-	if (data_length < sizeof(int64))
+	if (data_length < sizeof(int32))
 		return -2;
 
-	*consumed_bytes = sizeof(int64) + pad_bytes;
-	timestamp_usec = *(int64 *) data_src;
+	*consumed_bytes = sizeof(int32) + padding;
+	date_val = *(int32 *) aligned_buf;
 
-	if (timestamp_usec == DT_NOBEGIN) {
-		emitFieldValue("'-infinity'");
+	if (date_val == PG_INT32_MIN) {
+		emitFieldValue(ctx, "-infinity");
 		return 0;
 	}
-	if (timestamp_usec == DT_NOEND) {
-		emitFieldValue("'infinity'");
+	if (date_val == PG_INT32_MAX) {
+		emitFieldValue(ctx, "infinity");
 		return 0;
 	}
+	if (ExportMode_decode != SQLform && ExportMode_decode != CSVform)
+		return 0;
 
-	days_since_epoch = (int32)(timestamp_usec / USECS_PER_DAY);
-	microseconds_in_day = timestamp_usec - ((int64)days_since_epoch * USECS_PER_DAY);
-
-	if (microseconds_in_day < INT64CONST(0)) {
-		microseconds_in_day += USECS_PER_DAY;
-		days_since_epoch -= 1;
-	}
-
-	julian_day = days_since_epoch + POSTGRES_EPOCH_JDATE;
-	j2date(julian_day, &year, &month, &day);
-
-	microsecond = microseconds_in_day % USECS_PER_SEC;
-	total_seconds = microseconds_in_day / USECS_PER_SEC;
-
-	second = (int32)(total_seconds % 60);
-	total_seconds /= 60;
-	minute = (int32)(total_seconds % 60);
-	hour = (int32)(total_seconds / 60);
-
-	write_cursor = output_string;
-
-	int display_year = (year > 0) ? year : -(year - 1);
-	FORMAT_FIXED_WIDTH(write_cursor, display_year, 4);
-	write_cursor += 4;
-	*write_cursor++ = '-';
-
-	FORMAT_FIXED_WIDTH(write_cursor, month, 2);
-	write_cursor += 2;
-	*write_cursor++ = '-';
-
-	FORMAT_FIXED_WIDTH(write_cursor, day, 2);
-	write_cursor += 2;
-	*write_cursor++ = ' ';
-
-	FORMAT_FIXED_WIDTH(write_cursor, hour, 2);
-	write_cursor += 2;
-	*write_cursor++ = ':';
-
-	FORMAT_FIXED_WIDTH(write_cursor, minute, 2);
-	write_cursor += 2;
-	*write_cursor++ = ':';
-
-	FORMAT_FIXED_WIDTH(write_cursor, second, 2);
-	write_cursor += 2;
-	*write_cursor++ = '.';
-
-	FORMAT_FIXED_WIDTH(write_cursor, (uint32)microsecond, 6);
-	write_cursor += 6;
-
-	if (include_tz) {
-		*write_cursor++ = '+';
-		*write_cursor++ = '0';
-		*write_cursor++ = '0';
-	}
-
-	if (year <= 0) {
-		*write_cursor++ = ' ';
-		*write_cursor++ = 'B';
-		*write_cursor++ = 'C';
-	}
-
-	*write_cursor = '\0';
+	dc = dayCacheLookup(&ctx->dateDay, date_val + POSTGRES_EPOCH_JDATE);
 
-	switch (ExportMode_decode) {
-		case SQLform:
-			addQuotesToString(output_string);
-			emitFieldValue(output_string);
-			break;
-		case CSVform:
-			emitFieldValue(output_string);
-			break;
+	ptr = emitDateTimeBegin(ctx, local, &out);
+	memcpy(ptr, dc->text, dc->len);
+	ptr += dc->len;
+	if (dc->bc) {
+		memcpy(ptr, " BC", 3);
+		ptr += 3;
 	}
-
-	#undef FORMAT_FIXED_WIDTH
+	emitDateTimeEnd(ctx, local, out, ptr);
 	return 0;
 }
 
-static int time_output(const char *input_data, unsigned int data_length, unsigned int *consumed_bytes)
+static int time_output(decodeContext *ctx, const char *input_data, unsigned int data_length, unsigned int *consumed_bytes)
 {
 	const char *aligned_buf = (const char *) LONGALIGN(input_data);
 	unsigned int padding = (unsigned int) ((uintptr_t) aligned_buf - (uintptr_t) input_data);
@@ -3009,16 +3551,16 @@ static int time_output(const char *input_data, unsigned int data_length, unsigne
 	switch (ExportMode_decode) {
 		case SQLform:
 			addQuotesToString(buf);
-			emitFieldValue(buf);
+			emitFieldValue(ctx, buf);
 			break;
 		case CSVform:
-			emitFieldValue(buf);
+			emitFieldValue(ctx, buf);
 			break;
 	}
 	return 0;
 }
 
-static int timetz_output(const char *input_data, unsigned int data_length, unsigned int *consumed_bytes)
+static int timetz_output(decodeContext *ctx, const char *input_data, unsigned int data_length, unsigned int *consumed_bytes)
 {
 	const char *aligned_buf = (const char *) LONGALIGN(input_data);
 	unsigned int padding = (unsigned int) ((uintptr_t) aligned_buf - (uintptr_t) input_data);
@@ -3070,37 +3612,40 @@ static int timetz_output(const char *input_data, unsigned int data_length, unsig
 	switch (ExportMode_decode) {
 		case SQLform:
 			addQuotesToString(buf);
-			emitFieldValue(buf);
+			emitFieldValue(ctx, buf);
 			break;
 		case CSVform:
-			emitFieldValue(buf);
+			emitFieldValue(ctx, buf);
 			break;
 	}
 	return 0;
 }
 
-static int timestamp_output(const char *input_data, unsigned int data_length, unsigned int *consumed_bytes)
+/**
+ * timestamp_output - Decode PostgreSQL timestamp type to string
+ *
+ * @input_data:     Pointer to source data buffer
+ * @data_length:    Available buffer size
+ * @consumed_bytes: Output parameter for bytes consumed
+ *
+ * Writes "YYYY-MM-DD HH:MM:SS.ffffff", always six fraction digits. The
+ * date part comes from ctx->tsDay, so j2date only runs when the day
+ * changes between values.
+ *
+ * Returns: 0 on success, negative value on error
+ */
+static int timestamp_output(decodeContext *ctx, const char *input_data, unsigned int data_length, unsigned int *consumed_bytes)
 {
-	#define FORMAT_FIXED_WIDTH_TS(ptr, val, width) do { \
-		int _v = (val); \
-		int _w = (width); \
-		char *_p = (ptr) + _w; \
-		while (_w-- > 0) { \
-			*--_p = '0' + (_v % 10); \
-			_v /= 10; \
-		} \
-	} while(0)
-
 	uintptr_t addr = (uintptr_t) input_data;
 	unsigned int pad_bytes = (unsigned int)(((addr + 7) & ~7UL) - addr);
 	const char *data_src;
 	int64 timestamp_usec;
-	int32 days_since_epoch, julian_day;
+	int32 days_since_epoch;
 	int64 microseconds_in_day, total_seconds;
-	int32 year, month, day, hour, minute, second;
-	int64 microsecond;
-	char output_string[80];
-	char *write_cursor;
+	int32 hour, minute, second, microsecond;
+	const dayCache *dc;
+	char local[DATETIME_FIELD_MAX];
+	char *out, *write_cursor;
 
 	if (data_length < pad_bytes)
 		return -1;
@@ -3115,13 +3660,15 @@ static int timestamp_output(const char *input_data, unsigned int data_length, un
 	timestamp_usec = *(int64 *) data_src;
 
 	if (timestamp_usec == DT_NOBEGIN) {
-		emitFieldValue("'-infinity'");
+		emitFieldValue(ctx, "'-infinity'");
 		return 0;
 	}
 	if (timestamp_usec == DT_NOEND) {
-		emitFieldValue("'infinity'");
+		emitFieldValue(ctx, "'infinity'");
 		return 0;
 	}
+	if (ExportMode_decode != SQLform && ExportMode_decode != CSVform)
+		return 0;
 
 	days_since_epoch = (int32)(timestamp_usec / USECS_PER_DAY);
 	microseconds_in_day = timestamp_usec - ((int64)days_since_epoch * USECS_PER_DAY);
@@ -3131,66 +3678,32 @@ static int timestamp_output(const char *input_data, unsigned int data_length, un
 		days_since_epoch -= 1;
 	}
 
-	julian_day = days_since_epoch + POSTGRES_EPOCH_JDATE;
-	j2date(julian_day, &year, &month, &day);
+	dc = dayCacheLookup(&ctx->tsDay, days_since_epoch + POSTGRES_EPOCH_JDATE);
 
-	microsecond = microseconds_in_day % USECS_PER_SEC;
+	microsecond = (int32)(microseconds_in_day % USECS_PER_SEC);
 	total_seconds = microseconds_in_day / USECS_PER_SEC;
-
 	second = (int32)(total_seconds % 60);
 	total_seconds /= 60;
 	minute = (int32)(total_seconds % 60);
 	hour = (int32)(total_seconds / 60);
 
-	write_cursor = output_string;
-
-	int display_year = (year > 0) ? year : -(year - 1);
-	FORMAT_FIXED_WIDTH_TS(write_cursor, display_year, 4);
-	write_cursor += 4;
-	*write_cursor++ = '-';
-
-	FORMAT_FIXED_WIDTH_TS(write_cursor, month, 2);
-	write_cursor += 2;
-	*write_cursor++ = '-';
-
-	FORMAT_FIXED_WIDTH_TS(write_cursor, day, 2);
-	write_cursor += 2;
+	write_cursor = emitDateTimeBegin(ctx, local, &out);
+	memcpy(write_cursor, dc->text, dc->len);
+	write_cursor += dc->len;
 	*write_cursor++ = ' ';
-
-	FORMAT_FIXED_WIDTH_TS(write_cursor, hour, 2);
-	write_cursor += 2;
-	*write_cursor++ = ':';
-
-	FORMAT_FIXED_WIDTH_TS(write_cursor, minute, 2);
-	write_cursor += 2;
-	*write_cursor++ = ':';
-
-	FORMAT_FIXED_WIDTH_TS(write_cursor, second, 2);
-	write_cursor += 2;
-	*write_cursor++ = '.';
-
-	FORMAT_FIXED_WIDTH_TS(write_cursor, (uint32)microsecond, 6);
-	write_cursor += 6;
-
-	if (year <= 0) {
-		*write_cursor++ = ' ';
-		*write_cursor++ = 'B';
-		*write_cursor++ = 'C';
-	}
-
-	*write_cursor = '\0';
-
-	switch (ExportMode_decode) {
-		case SQLform:
-			addQuotesToString(output_string);
-			emitFieldValue(output_string);
-			break;
-		case CSVform:
-			emitFieldValue(output_string);
-			break;
+	write_cursor = formatHourMin(write_cursor, hour, minute);
+	memcpy(write_cursor, DIGIT_TABLE + second * 2, 2);
+	write_cursor[2] = '.';
+	memcpy(write_cursor + 3, DIGIT_TABLE + (microsecond / 10000) * 2, 2);
+	memcpy(write_cursor + 5, DIGIT_TABLE + (microsecond / 100 % 100) * 2, 2);
+	memcpy(write_cursor + 7, DIGIT_TABLE + (microsecond % 100) * 2, 2);
+	write_cursor += 9;
+
+	if (dc->bc) {
+		memcpy(write_cursor, " BC", 3);
+		write_cursor += 3;
 	}
-
-	#undef FORMAT_FIXED_WIDTH_TS
+	emitDateTimeEnd(ctx, local, out, write_cursor);
 	return 0;
 }
 
@@ -3276,27 +3789,81 @@ EncodeTimezone(char *str, int tz)
 	return str;
 }
 
-static int timestamptz_output(const char *input_data, unsigned int data_length, unsigned int *consumed_bytes)
+/**
+ * tzDayLookup - Find the local day of a timestamptz value
+ *
+ * @c:    Last local day of this context
+ * @usec: Timestamp, microseconds since 2000-01-01 UTC
+ * @tm:   Output parameter, local time of usec when c does not cover it
+ *
+ * The zone offset is resolved once per local day rather than per value:
+ * localtime_r only runs when usec leaves the cached day. A day whose
+ * offset changes (a DST switch) is not cached, its values keep going
+ * through localtime_r one by one.
+ *
+ * Returns: true when c covers usec, false when only tm is valid
+ */
+static bool tzDayLookup(tzDayCache *c, int64 usec, struct tm *tm)
 {
-	#define FORMAT_FIXED_WIDTH_TSTZ(ptr, val, width) do { \
-		int _v = (val); \
-		int _w = (width); \
-		char *_p = (ptr) + _w; \
-		while (_w-- > 0) { \
-			*--_p = '0' + (_v % 10); \
-			_v /= 10; \
-		} \
-	} while(0)
+	int64 secs;
+	time_t unix_time, first, last;
+	struct tm edge;
+
+	if (c->valid && usec >= c->start && usec < c->end)
+		return true;
+
+	secs = usec / USECS_PER_SEC;
+	if (usec % USECS_PER_SEC < 0)
+		secs--;
+	unix_time = (time_t)(secs + ((int64)(POSTGRES_EPOCH_JDATE - UNIX_EPOCH_JDATE) * SECS_PER_DAY));
+	localtime_r(&unix_time, tm);
+
+	c->valid = false;
+	first = unix_time - (tm->tm_hour * 3600 + tm->tm_min * 60 + tm->tm_sec);
+	last = first + SECS_PER_DAY - 1;
+	if (localtime_r(&first, &edge) == NULL || edge.tm_gmtoff != tm->tm_gmtoff ||
+		edge.tm_hour != 0 || edge.tm_min != 0 || edge.tm_sec != 0)
+		return false;
+	if (localtime_r(&last, &edge) == NULL || edge.tm_gmtoff != tm->tm_gmtoff ||
+		edge.tm_mday != tm->tm_mday)
+		return false;
+
+	c->start = (secs - (int64)(unix_time - first)) * USECS_PER_SEC;
+	c->end = c->start + USECS_PER_DAY;
+	c->tz = -(int)tm->tm_gmtoff;
+	c->day.len = formatYmd(c->day.text, tm->tm_year + 1900, tm->tm_mon + 1, tm->tm_mday);
+	c->day.bc = (tm->tm_year + 1900 <= 0);
+	c->valid = true;
+	return true;
+}
 
+/**
+ * timestamptz_output - Decode PostgreSQL timestamptz type to string
+ *
+ * @input_data:     Pointer to source data buffer
+ * @data_length:    Available buffer size
+ * @consumed_bytes: Output parameter for bytes consumed
+ *
+ * Writes the value in the local zone as "YYYY-MM-DD HH:MM:SS[.ffffff]+TZ",
+ * trailing zeros of the fraction dropped. Date and zone come from
+ * ctx->tstzDay while the value stays within its local day.
+ *
+ * Returns: 0 on success, negative value on error
+ */
+static int timestamptz_output(decodeContext *ctx, const char *input_data, unsigned int data_length, unsigned int *consumed_bytes)
+{
 	uintptr_t addr = (uintptr_t) input_data;
 	unsigned int pad_bytes = (unsigned int)(((addr + 7) & ~7UL) - addr);
 	const char *data_src;
 	int64 timestamp_usec;
-	int32 year, month, day, hour, minute, second;
-	int64 microsecond;
-	int tz = 0;
-	char output_string[80];
-	char *write_cursor;
+	int32 hour, minute, second;
+	int32 microsecond;
+	int tz;
+	bool cached;
+	tzDayCache *c = &ctx->tstzDay;
+	struct tm tm_local;
+	char local[DATETIME_FIELD_MAX];
+	char *out, *write_cursor;
 
 	if (data_length < pad_bytes)
 		return -1;
@@ -3311,89 +3878,59 @@ static int timestamptz_output(const char *input_data, unsigned int data_length,
 	timestamp_usec = *(int64 *) data_src;
 
 	if (timestamp_usec == DT_NOBEGIN) {
-		emitFieldValue("'-infinity'");
+		emitFieldValue(ctx, "'-infinity'");
 		return 0;
 	}
 	if (timestamp_usec == DT_NOEND) {
-		emitFieldValue("'infinity'");
+		emitFieldValue(ctx, "'infinity'");
 		return 0;
 	}
+	if (ExportMode_decode != SQLform && ExportMode_decode != CSVform)
+		return 0;
 
-	/* 将 PostgreSQL timestamp 转换为 Unix time_t */
-	time_t unix_time = (time_t)(timestamp_usec / USECS_PER_SEC +
-		((int64)(POSTGRES_EPOCH_JDATE - UNIX_EPOCH_JDATE) * SECS_PER_DAY));
-
-	struct tm tm_local;
-	localtime_r(&unix_time, &tm_local);
-
-	/* 获取本地时间的各个分量 */
-	year = tm_local.tm_year + 1900;
-	month = tm_local.tm_mon + 1;
-	day = tm_local.tm_mday;
-	hour = tm_local.tm_hour;
-	minute = tm_local.tm_min;
-	second = tm_local.tm_sec;
-
-	/* 获取微秒部分 */
-	microsecond = timestamp_usec % USECS_PER_SEC;
+	microsecond = (int32)(timestamp_usec % USECS_PER_SEC);
 	if (microsecond < 0)
 		microsecond += USECS_PER_SEC;
 
-	/* 获取时区偏移（秒），PostgreSQL 的 tz 符号与 tm_gmtoff 相反 */
-	tz = -(int)tm_local.tm_gmtoff;
-
-	write_cursor = output_string;
-
-	int display_year = (year > 0) ? year : -(year - 1);
-	FORMAT_FIXED_WIDTH_TSTZ(write_cursor, display_year, 4);
-	write_cursor += 4;
-	*write_cursor++ = '-';
-
-	FORMAT_FIXED_WIDTH_TSTZ(write_cursor, month, 2);
-	write_cursor += 2;
-	*write_cursor++ = '-';
-
-	FORMAT_FIXED_WIDTH_TSTZ(write_cursor, day, 2);
-	write_cursor += 2;
+	write_cursor = emitDateTimeBegin(ctx, local, &out);
+	cached = tzDayLookup(c, timestamp_usec, &tm_local);
+	if (cached)
+	{
+		int64 secs_in_day = (timestamp_usec - c->start) / USECS_PER_SEC;
+
+		hour = (int32)(secs_in_day / 3600);
+		minute = (int32)(secs_in_day / 60 % 60);
+		second = (int32)(secs_in_day % 60);
+		tz = c->tz;
+		memcpy(write_cursor, c->day.text, c->day.len);
+		write_cursor += c->day.len;
+	}
+	else
+	{
+		hour = tm_local.tm_hour;
+		minute = tm_local.tm_min;
+		second = tm_local.tm_sec;
+		/* PostgreSQL 的 tz 符号与 tm_gmtoff 相反 */
+		tz = -(int)tm_local.tm_gmtoff;
+		write_cursor += formatYmd(write_cursor, tm_local.tm_year + 1900,
+								  tm_local.tm_mon + 1, tm_local.tm_mday);
+	}
 	*write_cursor++ = ' ';
-
-	FORMAT_FIXED_WIDTH_TSTZ(write_cursor, hour, 2);
-	write_cursor += 2;
-	*write_cursor++ = ':';
-
-	FORMAT_FIXED_WIDTH_TSTZ(write_cursor, minute, 2);
-	write_cursor += 2;
-	*write_cursor++ = ':';
+	write_cursor = formatHourMin(write_cursor, hour, minute);
 
 	/* 使用 AppendTimestampSeconds 处理秒和微秒，自动去除尾部的零 */
-	write_cursor = AppendTimestampSeconds(write_cursor, second, (int)microsecond);
-
-	/* 时区输出 */
+	write_cursor = AppendTimestampSeconds(write_cursor, second, microsecond);
 	write_cursor = EncodeTimezone(write_cursor, tz);
 
-	if (year <= 0) {
-		*write_cursor++ = ' ';
-		*write_cursor++ = 'B';
-		*write_cursor++ = 'C';
+	if (cached ? c->day.bc : tm_local.tm_year + 1900 <= 0) {
+		memcpy(write_cursor, " BC", 3);
+		write_cursor += 3;
 	}
-
-	*write_cursor = '\0';
-
-	switch (ExportMode_decode) {
-		case SQLform:
-			addQuotesToString(output_string);
-			emitFieldValue(output_string);
-			break;
-		case CSVform:
-			emitFieldValue(output_string);
-			break;
-	}
-
-	#undef FORMAT_FIXED_WIDTH_TSTZ
+	emitDateTimeEnd(ctx, local, out, write_cursor);
 	return 0;
 }
 
-static int No_op(const char *unused_data, unsigned int remaining_bytes, unsigned int *skipped)
+static int No_op(decodeContext *ctx, const char *unused_data, unsigned int remaining_bytes, unsigned int *skipped)
 {
 	*skipped = remaining_bytes;
 	return 0;
@@ -3401,6 +3938,7 @@ static int No_op(const char *unused_data, unsigned int remaining_bytes, unsigned
 
 int AddList2Prcess(decodeFunc *array2Process,char *type,char *BOOTTYPE)
 {
+	decodeContext *ctx = &defaultDecodeCtx;
 	int pos = 0;
 	if (*type == '\0')
 		return 1;
@@ -3410,13 +3948,13 @@ int AddList2Prcess(decodeFunc *array2Process,char *type,char *BOOTTYPE)
 		if (strcmp(typeHandlerRegistry[pos].typeName, type) == 0)
 		{
 			if (strcmp(BOOTTYPE, TABLE_BOOTTYPE) == 0 && strcmp(type, "char") == 0) {
-				array2Process[addNum] = &parse_text_field;
-				addNum++;
+				array2Process[ctx->addNum] = &parse_text_field;
+				ctx->addNum++;
 				return 1;
 			}
 			else {
-				array2Process[addNum] = typeHandlerRegistry[pos].handler;
-				addNum++;
+				array2Process[ctx->addNum] = typeHandlerRegistry[pos].handler;
+				ctx->addNum++;
 				return 1;
 			}
 		}
@@ -3427,7 +3965,7 @@ int AddList2Prcess(decodeFunc *array2Process,char *type,char *BOOTTYPE)
 	return 0;
 }
 
-char *dropDecodeExtend(pg_attributeDesc *allDesc,decodeFunc *array2Process,const char *tupleData, unsigned int tupleSize,char *BOOTTYPE,FILE *logSucc,FILE *logErr)
+char *dropDecodeExtend(decodeContext *ctx,pg_attributeDesc *allDesc,decodeFunc *array2Process,const char *tupleData, unsigned int tupleSize,char *BOOTTYPE,FILE *logSucc,FILE *logErr)
 {
 	go=0;
 	HeapTupleHeader header = (HeapTupleHeader) tupleData;
@@ -3436,12 +3974,12 @@ char *dropDecodeExtend(pg_attributeDesc *allDesc,decodeFunc *array2Process,const
 	int			curr_attr=0;
 	int			curr_attrFake=0;
 	bool attrmiss = false;
-	clean_out();
+	clean_out(ctx);
 	uint32		off=0;			/* offset in tuple data */
 	bool		slow=false;			/* can we use/set attcacheoff? */
 	int nAttrInTuple = HeapTupleHeaderGetNatts(header);
-	int nAttr = Min(nAttrInTuple, addNum);
-	if(nAttrInTuple != addNum)
+	int nAttr = Min(nAttrInTuple, ctx->addNum);
+	if(nAttrInTuple != ctx->addNum)
 		attrmiss = true;
 	for (curr_attrFake = 0; curr_attrFake < nAttrInTuple; curr_attrFake++)
 	{
@@ -3459,9 +3997,9 @@ char *dropDecodeExtend(pg_attributeDesc *allDesc,decodeFunc *array2Process,const
 		{
 			if(!thisisDrop){
 				if(ExportMode_decode == CSVform)
-					emitFieldValue("\\N");
+					emitFieldValue(ctx, "\\N");
 				else if (ExportMode_decode == SQLform)
-					emitFieldValue("NULL");
+					emitFieldValue(ctx, "NULL");
 				curr_attr++;
 			}
 
@@ -3470,7 +4008,7 @@ char *dropDecodeExtend(pg_attributeDesc *allDesc,decodeFunc *array2Process,const
 
 		if (size <= 0)
 		{
-			decodeLogPrint(logErr,g_resultBuf.storage.data,sizeLtZero,curr_attrFake,size);
+			decodeLogPrint(logErr,ctx->resultBuf.data,sizeLtZero,curr_attrFake,size);
 			return "NoWayOut";
 		}
 
@@ -3478,12 +4016,12 @@ char *dropDecodeExtend(pg_attributeDesc *allDesc,decodeFunc *array2Process,const
 
 		if(!thisisDrop){
 			const char *xdata = data + off;
-			global_curr_att = curr_attr;
-			res = array2Process[curr_attr] (xdata, size, &AttrSize);
+			ctx->currAtt = curr_attr;
+			res = array2Process[curr_attr](ctx, xdata, size, &AttrSize);
 
 			if (res < 0)
 			{
-				decodeLogPrint(logErr,g_resultBuf.storage.data,resLtZero,curr_attrFake,size);
+				decodeLogPrint(logErr,ctx->resultBuf.data,resLtZero,curr_attrFake,size);
 				return "NoWayOut";
 			}
 
@@ -3492,33 +4030,286 @@ char *dropDecodeExtend(pg_attributeDesc *allDesc,decodeFunc *array2Process,const
 
 		off = att_addlength_pointer(off, atoi(oneDesc->attlen), data + off);
 
-		if (DEBUG &&strcmp(g_resultBuf.storage.data,debugStr) == 0){
+		if (DEBUG &&strcmp(ctx->resultBuf.data,debugStr) == 0){
 			printf(" ");
 		}
 	}
 
 	if (size != off)
 	{
-		decodeLogPrint(logErr,g_resultBuf.storage.data,sizeNotZero,curr_attrFake,size);
+		decodeLogPrint(logErr,ctx->resultBuf.data,sizeNotZero,curr_attrFake,size);
 		return "NoWayOut";
 	}
 
 	if (attrmiss)
 	{
-		for(int h=0;h<(addNum - nAttrInTuple);h++){
+		for(int h=0;h<(ctx->addNum - nAttrInTuple);h++){
 			if(ExportMode_decode == CSVform)
-				emitFieldValue("\\N");
+				emitFieldValue(ctx, "\\N");
 			else if (ExportMode_decode == SQLform)
-				emitFieldValue("NULL");
+				emitFieldValue(ctx, "NULL");
 		}
 	}
-	char *xman=return_out();
+	char *xman=return_out(ctx);
 	return xman;
 }
 
+/**
+ * decodeKernelEmit - Emit one integer or timestamp column of a row kernel
+ *
+ * @ctx:  Decode context
+ * @col:  Column of the plan's fixed prefix
+ * @data: Tuple data
+ * @size: Size of the tuple data
+ *
+ * Returns: PARSE_OK, or the negative result of the timestamp decoder
+ */
+static inline int decodeKernelEmit(decodeContext *ctx,const decodePlanCol *col,const char *data,unsigned int size)
+{
+	unsigned int used = 0;
+
+	switch (col->kind)
+	{
+		case DECODE_PLAN_INT16:
+			emitFieldInt32(ctx, *(const int16 *) (data + col->off));
+			return PARSE_OK;
+		case DECODE_PLAN_INT32:
+			emitFieldInt32(ctx, *(const int32 *) (data + col->off));
+			return PARSE_OK;
+		case DECODE_PLAN_INT64:
+			emitFieldInt64(ctx, *(const int64 *) (data + col->off));
+			return PARSE_OK;
+		case DECODE_PLAN_TIMESTAMP:
+			return timestamp_output(ctx, data + col->off, size - col->off, &used);
+		default:
+			return timestamptz_output(ctx, data + col->off, size - col->off, &used);
+	}
+}
+
+/*
+ * DECODE_ROW_KERNEL expands to a row decoder for one column shape: the
+ * plan's fixed prefix, each column emitted by EMIT_FIXED from
+ * data + col->off, followed when TEXT_TAIL is set by columns that all
+ * decode through parse_text_field. Tuples reaching a kernel have no NULLs
+ * and all of the table's attributes.
+ */
+#define DECODE_ROW_KERNEL(name, EMIT_FIXED, TEXT_TAIL) \
+static int name(decodeContext *ctx, const char *data, unsigned int size, \
+				int *failAt, unsigned int *left) \
+{ \
+	const decodePlan *plan = &ctx->plan; \
+	uint32 off = plan->nFixed > 0 ? plan->cols[plan->nFixed - 1].end : 0; \
+	\
+	if (size < off) \
+		return -1; \
+	for (int i = 0; i < plan->nFixed; i++) \
+	{ \
+		const decodePlanCol *col = &plan->cols[i]; \
+		ctx->currAtt = i; \
+		EMIT_FIXED; \
+	} \
+	for (int i = plan->nFixed; TEXT_TAIL && i < plan->nAtt; i++) \
+	{ \
+		unsigned int used = 0; \
+		ctx->currAtt = i; \
+		*failAt = i; \
+		*left = size - off; \
+		if (size <= off) \
+			return sizeLtZero; \
+		if (parse_text_field(ctx, data + off, size - off, &used) < 0) \
+			return resLtZero; \
+		off += used; \
+	} \
+	*failAt = plan->nAtt; \
+	*left = size - off; \
+	return off == size ? 0 : sizeNotZero; \
+}
+
+#define KERNEL_EMIT_INT32 \
+	emitFieldInt32(ctx, *(const int32 *) (data + col->off))
+
+#define KERNEL_EMIT_INT64 \
+	emitFieldInt64(ctx, *(const int64 *) (data + col->off))
+
+#define KERNEL_EMIT_MIXED \
+	do { \
+		if (decodeKernelEmit(ctx, col, data, size) < 0) \
+		{ \
+			*failAt = i; \
+			*left = size - col->off; \
+			return resLtZero; \
+		} \
+	} while (0)
+
+DECODE_ROW_KERNEL(decodeKernelInt32, KERNEL_EMIT_INT32, false)
+DECODE_ROW_KERNEL(decodeKernelInt64, KERNEL_EMIT_INT64, false)
+DECODE_ROW_KERNEL(decodeKernelMixed, KERNEL_EMIT_MIXED, false)
+DECODE_ROW_KERNEL(decodeKernelInt32Text, KERNEL_EMIT_INT32, true)
+DECODE_ROW_KERNEL(decodeKernelInt64Text, KERNEL_EMIT_INT64, true)
+DECODE_ROW_KERNEL(decodeKernelMixedText, KERNEL_EMIT_MIXED, true)
+
+#undef KERNEL_EMIT_MIXED
+#undef KERNEL_EMIT_INT64
+#undef KERNEL_EMIT_INT32
+#undef DECODE_ROW_KERNEL
+
+/**
+ * decodeKernelSelect - Pick the row kernel matching a compiled plan
+ *
+ * @plan:          Plan with its fixed prefix computed
+ * @array2Process: Array of decode functions for each attribute
+ *
+ * A kernel fits when every prefix column is an integer or timestamp and
+ * every column after it is text.
+ *
+ * Returns: Kernel, or NULL to keep the generic loop
+ */
+static int (*decodeKernelSelect(decodePlan *plan,decodeFunc *array2Process))
+	(decodeContext *, const char *, unsigned int, int *, unsigned int *)
+{
+	bool allInt32 = true, allInt64 = true;
+	bool tail = plan->nFixed < plan->nAtt;
+
+	if (plan->cols == NULL || plan->nAtt <= 0)
+		return NULL;
+	for (int i = 0; i < plan->nFixed; i++)
+	{
+		if (plan->cols[i].kind == DECODE_PLAN_HANDLER)
+			return NULL;
+		allInt32 &= plan->cols[i].kind == DECODE_PLAN_INT32;
+		allInt64 &= plan->cols[i].kind == DECODE_PLAN_INT64;
+	}
+	for (int i = plan->nFixed; i < plan->nAtt; i++)
+	{
+		if (array2Process[i] != parse_text_field)
+			return NULL;
+	}
+
+	if (plan->nFixed > 0 && allInt32)
+		return tail ? decodeKernelInt32Text : decodeKernelInt32;
+	if (plan->nFixed > 0 && allInt64)
+		return tail ? decodeKernelInt64Text : decodeKernelInt64;
+	return tail ? decodeKernelMixedText : decodeKernelMixed;
+}
+
+/**
+ * decodePlanCompile - Compute the fixed-offset prefix of a table
+ *
+ * @ctx:           Decode context whose plan is rebuilt
+ * @allDesc:       Array of attribute descriptors
+ * @array2Process: Array of decode functions for each attribute
+ *
+ * Walks the columns until the first one without a positive attlen, or
+ * decoded by No_op, which swallows the rest of the tuple.
+ */
+static void decodePlanCompile(decodeContext *ctx,pg_attributeDesc *allDesc,decodeFunc *array2Process)
+{
+	decodePlan *plan = &ctx->plan;
+	uint32 off = 0;
+
+	free(plan->cols);
+	memset(plan, 0, sizeof(decodePlan));
+	plan->desc = allDesc;
+	plan->funcs = array2Process;
+	plan->nAtt = ctx->addNum;
+	if (allDesc == NULL || ctx->addNum <= 0)
+		return;
+
+	plan->cols = (decodePlanCol *) malloc(ctx->addNum * sizeof(decodePlanCol));
+	if (plan->cols == NULL)
+		return;
+
+	for (int i = 0; i < ctx->addNum; i++)
+	{
+		decodePlanCol *col = &plan->cols[i];
+		int attlen = atoi(allDesc[i].attlen);
+		char attalign = allDesc[i].attalign[0];
+		decodeFunc fn = array2Process[i];
+
+		if (attlen <= 0 || fn == No_op ||
+			(attalign != 'c' && attalign != 's' && attalign != 'i' && attalign != 'd'))
+			break;
+
+		col->off = att_align_nominal(off, attalign);
+		col->end = col->off + attlen;
+		if (fn == serializeInt16 && attlen == sizeof(int16))
+			col->kind = DECODE_PLAN_INT16;
+		else if (fn == serializeInt32 && attlen == sizeof(int32))
+			col->kind = DECODE_PLAN_INT32;
+		else if (fn == serializeInt64 && attlen == sizeof(int64))
+			col->kind = DECODE_PLAN_INT64;
+		else if (fn == timestamp_output && attlen == sizeof(int64))
+			col->kind = DECODE_PLAN_TIMESTAMP;
+		else if (fn == timestamptz_output && attlen == sizeof(int64))
+			col->kind = DECODE_PLAN_TIMESTAMPTZ;
+		else
+			col->kind = DECODE_PLAN_HANDLER;
+		off = col->end;
+		plan->nFixed++;
+	}
+
+	plan->kernel = decodeKernelSelect(plan, array2Process);
+}
+
+/**
+ * decodePlanPrefix - Emit the fixed-offset prefix of a tuple
+ *
+ * @ctx:           Decode context holding a compiled plan
+ * @array2Process: Array of decode functions for each attribute
+ * @data:          Tuple data, MAXALIGNed
+ * @size:          Size of the tuple data
+ * @nulls:         Null bitmap, NULL when the tuple has no NULLs
+ * @bound:         Number of attributes present in the tuple
+ * @failAt:        Output, column whose decodeFunc failed, -1 otherwise
+ *
+ * Integer and timestamp columns are decoded at their offset directly;
+ * the others go through their decodeFunc. Stops before the first NULL
+ * column and before any column the tuple is too short for, leaving
+ * those to the caller.
+ *
+ * Returns: Number of columns emitted
+ */
+static int decodePlanPrefix(decodeContext *ctx,decodeFunc *array2Process,const char *data,unsigned int size,
+							bits8 *nulls,int bound,int *failAt)
+{
+	decodePlan *plan = &ctx->plan;
+	int n = Min(plan->nFixed, bound);
+	uint32 prev = 0;
+
+	*failAt = -1;
+	while (n > 0 && plan->cols[n - 1].end > size)
+		n--;
+	for (int i = 0; nulls != NULL && i < n; i++)
+	{
+		if (att_isnull(i, nulls))
+			n = i;
+	}
+
+	for (int i = 0; i < n; i++)
+	{
+		decodePlanCol *col = &plan->cols[i];
+		unsigned int used = 0;
+		int status;
+
+		ctx->currAtt = i;
+		if (col->kind == DECODE_PLAN_HANDLER)
+			status = array2Process[i](ctx, data + prev, size - prev, &used);
+		else
+			status = decodeKernelEmit(ctx, col, data, size);
+		if (status < 0)
+		{
+			*failAt = i;
+			return i;
+		}
+		prev = col->end;
+	}
+	return n;
+}
+
 /**
  * NodropDecodeExtend - Decode tuple without dropped columns
  *
+ * @ctx:           Decode context owning the result buffer and TOAST state
  * @allDesc:       Array of attribute descriptors
  * @array2Process: Array of decode functions for each attribute
  * @tupleData:     Raw tuple data buffer
@@ -3532,14 +4323,14 @@ char *dropDecodeExtend(pg_attributeDesc *allDesc,decodeFunc *array2Process,const
  *
  * Returns: Decoded tuple string or NULL on failure
  */
-char *NodropDecodeExtend(pg_attributeDesc *allDesc,decodeFunc *array2Process,const char *tupleData, unsigned int tupleSize,char *BOOTTYPE,FILE *logSucc,FILE *logErr)
+char *NodropDecodeExtend(decodeContext *ctx,pg_attributeDesc *allDesc,decodeFunc *array2Process,const char *tupleData, unsigned int tupleSize,char *BOOTTYPE,FILE *logSucc,FILE *logErr)
 {
 	#define PARSE_ABORT_SENTINEL "NoWayOut"
-	#define EMIT_CSV_NULL() emitFieldValue("\\N")
-	#define EMIT_SQL_NULL() emitFieldValue("NULL")
+	#define EMIT_CSV_NULL() emitFieldValue(ctx, "\\N")
+	#define EMIT_SQL_NULL() emitFieldValue(ctx, "NULL")
 
 	go = 0;
-	clean_out();
+	clean_out(ctx);
 
 	HeapTupleHeader tupleMetaBlock = (HeapTupleHeader) tupleData;
 	uint16 headerByteSpan = tupleMetaBlock->t_hoff;
@@ -3548,19 +4339,59 @@ char *NodropDecodeExtend(pg_attributeDesc *allDesc,decodeFunc *array2Process,con
 	unsigned int remainingPayloadBytes = tupleSize - headerByteSpan;
 
 	int embeddedFieldCount = HeapTupleHeaderGetNatts(tupleMetaBlock);
-	int effectiveFieldBound = (embeddedFieldCount < addNum) ? embeddedFieldCount : addNum;
-	bool hasTrailingDefaults = (embeddedFieldCount != addNum);
+	int effectiveFieldBound = (embeddedFieldCount < ctx->addNum) ? embeddedFieldCount : ctx->addNum;
+	bool hasTrailingDefaults = (embeddedFieldCount != ctx->addNum);
 
 	bits8 *nullityBitVector = tupleMetaBlock->t_bits;
 	uint16 infoMaskSnapshot = tupleMetaBlock->t_infomask;
 	bool nullCheckEnabled = (infoMaskSnapshot & HEAP_HASNULL) != 0;
 
 	int fieldOrdinal = 0;
+	decodePlan *plan = &ctx->plan;
+	if (plan->desc != allDesc || plan->funcs != (const void *) array2Process || plan->nAtt != ctx->addNum)
+		decodePlanCompile(ctx, allDesc, array2Process);
+
+	if (plan->kernel != NULL && !nullCheckEnabled && !hasTrailingDefaults && !go &&
+		((uintptr_t) payloadCursor & (MAXIMUM_ALIGNOF - 1)) == 0)
+	{
+		int failedField;
+		unsigned int leftBytes;
+		int kernelStatus = plan->kernel(ctx, payloadCursor, remainingPayloadBytes, &failedField, &leftBytes);
+
+		if (kernelStatus == 0)
+			return return_out(ctx);
+		if (kernelStatus > 0)
+		{
+			if (resTyp_decode == DELETEtyp)
+				decodeLogPrint(logErr, ctx->resultBuf.data, kernelStatus, failedField, leftBytes);
+			return PARSE_ABORT_SENTINEL;
+		}
+	}
+
+	if (plan->nFixed > 0 && !go && ((uintptr_t) payloadCursor & (MAXIMUM_ALIGNOF - 1)) == 0)
+	{
+		int failedField;
+		fieldOrdinal = decodePlanPrefix(ctx, array2Process, payloadCursor, remainingPayloadBytes,
+										nullCheckEnabled ? nullityBitVector : NULL,
+										effectiveFieldBound, &failedField);
+		if (failedField >= 0)
+		{
+			if (resTyp_decode == DELETEtyp)
+				decodeLogPrint(logErr, ctx->resultBuf.data, resLtZero, failedField, remainingPayloadBytes);
+			return PARSE_ABORT_SENTINEL;
+		}
+		if (fieldOrdinal > 0)
+		{
+			payloadCursor += plan->cols[fieldOrdinal - 1].end;
+			remainingPayloadBytes -= plan->cols[fieldOrdinal - 1].end;
+		}
+	}
+
 	while (fieldOrdinal < effectiveFieldBound)
 	{
 		unsigned int consumedByteCount = 0;
 		int decoderReturnCode;
-		global_curr_att = fieldOrdinal;
+		ctx->currAtt = fieldOrdinal;
 		if (nullCheckEnabled && att_isnull(fieldOrdinal, nullityBitVector))
 		{
 			switch (ExportMode_decode) {
@@ -3570,7 +4401,7 @@ char *NodropDecodeExtend(pg_attributeDesc *allDesc,decodeFunc *array2Process,con
 
 			if (go) {
 				printf("Field %d is null, %d bytes remaining\n", fieldOrdinal + 1, remainingPayloadBytes);
-				printf("Current parsed data: %s\n\n", g_resultBuf.storage.data);
+				printf("Current parsed data: %s\n\n", ctx->resultBuf.data);
 			}
 
 			fieldOrdinal++;
@@ -3580,23 +4411,23 @@ char *NodropDecodeExtend(pg_attributeDesc *allDesc,decodeFunc *array2Process,con
 		if (remainingPayloadBytes <= 0)
 		{
 			if (resTyp_decode == DELETEtyp)
-				decodeLogPrint(logErr, g_resultBuf.storage.data, sizeLtZero, fieldOrdinal, remainingPayloadBytes);
+				decodeLogPrint(logErr, ctx->resultBuf.data, sizeLtZero, fieldOrdinal, remainingPayloadBytes);
 			return PARSE_ABORT_SENTINEL;
 		}
 
-		decoderReturnCode = array2Process[fieldOrdinal](payloadCursor, remainingPayloadBytes, &consumedByteCount);
+		decoderReturnCode = array2Process[fieldOrdinal](ctx, payloadCursor, remainingPayloadBytes, &consumedByteCount);
 
 		if (decoderReturnCode < 0)
 		{
 			if (resTyp_decode == DELETEtyp)
-				decodeLogPrint(logErr, g_resultBuf.storage.data, resLtZero, fieldOrdinal, remainingPayloadBytes);
+				decodeLogPrint(logErr, ctx->resultBuf.data, resLtZero, fieldOrdinal, remainingPayloadBytes);
 			return PARSE_ABORT_SENTINEL;
 		}
 
 		payloadCursor += consumedByteCount;
 		remainingPayloadBytes -= consumedByteCount;
 
-		if (DEBUG && strcmp(g_resultBuf.storage.data, debugStr) == 0)
+		if (DEBUG && strcmp(ctx->resultBuf.data, debugStr) == 0)
 			printf(" ");
 
 		if (go)
@@ -3613,7 +4444,7 @@ char *NodropDecodeExtend(pg_attributeDesc *allDesc,decodeFunc *array2Process,con
 				sprintf(diagnosticBuffer, "Field %d parsed %d bytes, %d bytes remaining\n",
 					fieldOrdinal + 1, consumedByteCount, remainingPayloadBytes);
 			}
-			printf("Current parsed data: %s\n\n", g_resultBuf.storage.data);
+			printf("Current parsed data: %s\n\n", ctx->resultBuf.data);
 		}
 
 		fieldOrdinal++;
@@ -3622,13 +4453,13 @@ char *NodropDecodeExtend(pg_attributeDesc *allDesc,decodeFunc *array2Process,con
 	if (remainingPayloadBytes != 0)
 	{
 		if (resTyp_decode == DELETEtyp)
-			decodeLogPrint(logErr, g_resultBuf.storage.data, sizeNotZero, fieldOrdinal, remainingPayloadBytes);
+			decodeLogPrint(logErr, ctx->resultBuf.data, sizeNotZero, fieldOrdinal, remainingPayloadBytes);
 		return PARSE_ABORT_SENTINEL;
 	}
 
 	if (hasTrailingDefaults)
 	{
-		int deficitCount = addNum - embeddedFieldCount;
+		int deficitCount = ctx->addNum - embeddedFieldCount;
 		for (int padIdx = 0; padIdx < deficitCount; padIdx++)
 		{
 			switch (ExportMode_decode) {
@@ -3642,24 +4473,41 @@ char *NodropDecodeExtend(pg_attributeDesc *allDesc,decodeFunc *array2Process,con
 	#undef EMIT_CSV_NULL
 	#undef EMIT_SQL_NULL
 
-	return return_out();
+	return return_out(ctx);
 }
 
-char* xmanDecode(int dropExist,pg_attributeDesc *allDesc,decodeFunc *array2Process,const char *tupleData, unsigned int tupleSize,char *BOOTTYPE,FILE *logSucc,FILE *logErr)
+/**
+ * xmanDecodeCtx - Decode one tuple using an explicit decode context
+ *
+ * @ctx:       Decode context (see decodeContextNew)
+ * @dropExist: Non-zero if the table has dropped columns
+ *
+ * Other parameters as NodropDecodeExtend. The returned string lives in
+ * ctx's result buffer and stays valid until the next decode on ctx.
+ *
+ * Returns: Decoded tuple string or "NoWayOut" on failure
+ */
+char* xmanDecodeCtx(decodeContext *ctx,int dropExist,pg_attributeDesc *allDesc,decodeFunc *array2Process,const char *tupleData, unsigned int tupleSize,char *BOOTTYPE,FILE *logSucc,FILE *logErr)
 {
 	char *xman=NULL;
 	if(dropExist == 0){
-		xman=NodropDecodeExtend(allDesc,array2Process,tupleData,tupleSize,BOOTTYPE,logSucc,logErr);
+		xman=NodropDecodeExtend(ctx,allDesc,array2Process,tupleData,tupleSize,BOOTTYPE,logSucc,logErr);
 	}
 	else{
-		xman=dropDecodeExtend(allDesc,array2Process,tupleData,tupleSize,BOOTTYPE,logSucc,logErr);
+		xman=dropDecodeExtend(ctx,allDesc,array2Process,tupleData,tupleSize,BOOTTYPE,logSucc,logErr);
 	}
 
 	return xman;
 }
+
+char* xmanDecode(int dropExist,pg_attributeDesc *allDesc,decodeFunc *array2Process,const char *tupleData, unsigned int tupleSize,char *BOOTTYPE,FILE *logSucc,FILE *logErr)
+{
+	return xmanDecodeCtx(&defaultDecodeCtx,dropExist,allDesc,array2Process,tupleData,tupleSize,BOOTTYPE,logSucc,logErr);
+}
 int a=0;
 char* xmanDecodeDrop(decodeFunc *array2Process,const char *tupleData, unsigned int tupleSize,dropContext *dc,int *isToast)
 {
+	decodeContext *ctx = &defaultDecodeCtx;
 	setDropContext(dc);
 	HeapTupleHeader header = (HeapTupleHeader) tupleData;
 	const char *data = tupleData + header->t_hoff;
@@ -3688,11 +4536,11 @@ char* xmanDecodeDrop(decodeFunc *array2Process,const char *tupleData, unsigned i
 
 	int			curr_attr=0;
 	bool attrmiss = false;
-	clean_out();
+	clean_out(ctx);
 	parray *toids=parray_new();
 
 	int nAttrInTuple = HeapTupleHeaderGetNatts(header);
-	if(nAttrInTuple != dc->nAttr){
+	if(nAttrInTuple != ctx->dc->nAttr){
 		parray_free(toids);
 		return "NoWayOut";
 	}
@@ -3705,9 +4553,9 @@ char* xmanDecodeDrop(decodeFunc *array2Process,const char *tupleData, unsigned i
 		if ((header->t_infomask & HEAP_HASNULL) && att_isnull(curr_attr, header->t_bits))
 		{
 			if(ExportMode_decode == CSVform)
-				emitFieldValue("\\N");
+				emitFieldValue(ctx, "\\N");
 			else if (ExportMode_decode == SQLform)
-				emitFieldValue("NULL");
+				emitFieldValue(ctx, "NULL");
 			continue;
 		}
 
@@ -3716,33 +4564,33 @@ char* xmanDecodeDrop(decodeFunc *array2Process,const char *tupleData, unsigned i
 			parray_free(toids);
 			return "NoWayOut";
 		}
-		if(strcmp(dc->BOOTTYPE,CLASS_BOOTTYPE) == 0 && curr_attr == nattsNum){
+		if(strcmp(ctx->dc->BOOTTYPE,CLASS_BOOTTYPE) == 0 && curr_attr == nattsNum){
 			break;
 		}
-		else if(strcmp(dc->BOOTTYPE,ATTR_BOOTTYPE) == 0 && curr_attr == alignNum){
-			if(!isValidString(g_resultBuf.storage.data)){
+		else if(strcmp(ctx->dc->BOOTTYPE,ATTR_BOOTTYPE) == 0 && curr_attr == alignNum){
+			if(!isValidString(ctx->resultBuf.data)){
 				parray_free(toids);
 				return "NoWayOut";
 			}
 			break;
 		}
-		else if(strcmp(dc->BOOTTYPE,TYPE_BOOTTYPE) == 0 && curr_attr == typeStopNum){
-			if(!isValidString(g_resultBuf.storage.data)){
+		else if(strcmp(ctx->dc->BOOTTYPE,TYPE_BOOTTYPE) == 0 && curr_attr == typeStopNum){
+			if(!isValidString(ctx->resultBuf.data)){
 				parray_free(toids);
 				return "NoWayOut";
 			}
 			break;
 		}
-		else if(strcmp(dc->BOOTTYPE,SCHEMA_BOOTTYPE) == 0 && curr_attr == schStopNum){
-			if(!isValidString(g_resultBuf.storage.data)){
+		else if(strcmp(ctx->dc->BOOTTYPE,SCHEMA_BOOTTYPE) == 0 && curr_attr == schStopNum){
+			if(!isValidString(ctx->resultBuf.data)){
 				parray_free(toids);
 				return "NoWayOut";
 			}
 			break;
 		}
-		res = array2Process[curr_attr] (data, size, &AttrSize);
+		res = array2Process[curr_attr](ctx, data, size, &AttrSize);
 
-		if (DEBUG &&strcmp(g_resultBuf.storage.data,debugStr) == 0){
+		if (DEBUG &&strcmp(ctx->resultBuf.data,debugStr) == 0){
 			printf(" ");
 		}
 
@@ -3760,27 +4608,27 @@ char* xmanDecodeDrop(decodeFunc *array2Process,const char *tupleData, unsigned i
 		data += AttrSize;
 	}
 
-	if (size != 0 && strcmp(dc->BOOTTYPE,TABLE_BOOTTYPE) == 0)
+	if (size != 0 && strcmp(ctx->dc->BOOTTYPE,TABLE_BOOTTYPE) == 0)
 	{
 		parray_free(toids);
 		return "NoWayOut";
 	}
 
-	if(!is_valid_string(g_resultBuf.storage.data)){
+	if(!is_valid_string(ctx->resultBuf.data)){
 		parray_free(toids);
 		return "NoWayOut";
 	}
 
-	char *xman=return_out();
-	if(size == 0 && *isToast == 1 && strcmp(dc->BOOTTYPE,TABLE_BOOTTYPE) == 0){
+	char *xman=return_out(ctx);
+	if(size == 0 && *isToast == 1 && strcmp(ctx->dc->BOOTTYPE,TABLE_BOOTTYPE) == 0){
 		for (int j = 0; j < parray_num(toids); j++)
 		{
 			int val = (intptr_t)parray_get(toids,j);
-			harray_append(dc->toastOids,HARRAYINT,&val,val);
+			harray_append(ctx->dc->toastOids,HARRAYINT,&val,val);
 			char *toastOidPath = malloc(100);
 			char *valstr = malloc(20);
 			sprintf(valstr,"%d\n",val);
-			sprintf(toastOidPath,"%s/.toast/.toastoid",dc->csvPrefix);
+			sprintf(toastOidPath,"%s/.toast/.toastoid",ctx->dc->csvPrefix);
 			FILE *toastOidfp = fopen(toastOidPath,"a");
 			fputs(valstr,toastOidfp);
 			fclose(toastOidfp);
@@ -3794,12 +4642,13 @@ char* xmanDecodeDrop(decodeFunc *array2Process,const char *tupleData, unsigned i
 
 char *xmandecodeSys(pg_attributeDesc *allDesc,decodeFunc *array2Process,const char *tupleData, unsigned int tupleSize,char *BOOTTYPE,int addNumLocal)
 {
+	decodeContext *ctx = &defaultDecodeCtx;
 	go=0;
 	HeapTupleHeader header = (HeapTupleHeader) tupleData;
 	const char *data = tupleData + header->t_hoff;
 	unsigned int size = tupleSize - header->t_hoff;
 	int			curr_attr=0;
-	clean_out();
+	clean_out(ctx);
 
 	int nAttrInTuple = HeapTupleHeaderGetNatts(header);
 	int nAttr = Min(nAttrInTuple, addNumLocal);
@@ -3813,13 +4662,13 @@ char *xmandecodeSys(pg_attributeDesc *allDesc,decodeFunc *array2Process,const ch
 		if ((header->t_infomask & HEAP_HASNULL) && att_isnull(curr_attr, header->t_bits))
 		{
 			if(ExportMode_decode == CSVform)
-				emitFieldValue("\\N");
+				emitFieldValue(ctx, "\\N");
 			else if (ExportMode_decode == SQLform)
-				emitFieldValue("NULL");
+				emitFieldValue(ctx, "NULL");
 
 			if(go){
 				printf("Field %d is null, %d bytes remaining\n",curr_attr+1,size);
-				printf("Current parsed data: %s\n\n",g_resultBuf.storage.data);
+				printf("Current parsed data: %s\n\n",ctx->resultBuf.data);
 			}
 			continue;
 		}
@@ -3829,8 +4678,8 @@ char *xmandecodeSys(pg_attributeDesc *allDesc,decodeFunc *array2Process,const ch
 			return "NoWayOut";
 		}
 
-		global_curr_att = curr_attr;
-		res = array2Process[curr_attr] (data, size, &AttrSize);
+		ctx->currAtt = curr_attr;
+		res = array2Process[curr_attr](ctx, data, size, &AttrSize);
 
 		if (res < 0)
 		{
@@ -3846,18 +4695,20 @@ char *xmandecodeSys(pg_attributeDesc *allDesc,decodeFunc *array2Process,const ch
 		return "NoWayOut";
 	}
 
-	char *xman=return_out();
+	char *xman=return_out(ctx);
 	return xman;
 }
 
 static unsigned int blockVersion = 0;
 
 void resetArray2Process(decodeFunc *array2Process){
+    decodeContext *ctx = &defaultDecodeCtx;
     int i;
-    for (i = 0; i < addNum; i++) {
+    for (i = 0; i < ctx->addNum; i++) {
         array2Process[i] = NULL;
     }
-    addNum = 0;
+    ctx->addNum = 0;
+    ctx->plan.nAtt = -1;
 }
 
 void commaStrWriteIntoFIleAttr(char *str,FILE *file)
@@ -4092,7 +4943,7 @@ static struct varlena *toast_decompress_datum(struct varlena *attr)
 	}
 }
 
-struct varlena *toast_fetch_datumds(struct varlena *attr,Oid *toid)
+struct varlena *toast_fetch_datumds(decodeContext *ctx, struct varlena *attr,Oid *toid)
 {
 	struct varlena *result;
 	struct varatt_external toast_ptr;
@@ -4111,7 +4962,7 @@ struct varlena *toast_fetch_datumds(struct varlena *attr,Oid *toid)
 		printf("toast_fetch_datum shouldn't be called for non-ondisk datums\n");
 
 	VARATT_EXTERNAL_GET_POINTER(toast_ptr, attr);
-	if(!isToastDecoded){
+	if(!ctx->isToastDecoded){
 		*toid = toast_ptr.va_valueid;
 		return NULL;
 	}
@@ -4127,14 +4978,15 @@ struct varlena *toast_fetch_datumds(struct varlena *attr,Oid *toid)
 		#endif
 
 		char toastfilePath[MAXPGPATH]={0};
-		sprintf(toastfilePath, "%s/.toast/dbf", dc->csvPrefix);
-		harray *toastHash = dc->toastOids;
-		int detoastret = assembleToastByIndex(
+		sprintf(toastfilePath, "%s/.toast/dbf", ctx->dc->csvPrefix);
+		harray *toastHash = ctx->dc->toastOids;
+		int detoastret = assembleToastByIndex(ctx,
 			toast_ptr.va_valueid,
 			toast_ext_size,
 			toastData,
 			toastHash,
-			toastfilePath);
+			NULL,
+			decodeContextToastReader(ctx, toastfilePath));
 
 		if(detoastret == FAILURE_RET){
 			free(toastData);
@@ -4157,7 +5009,7 @@ struct varlena *toast_fetch_datumds(struct varlena *attr,Oid *toid)
 
 }
 
-struct varlena *detoast_attr(struct varlena *attr,Oid *oid)
+struct varlena *detoast_attr(decodeContext *ctx, struct varlena *attr,Oid *oid)
 {
 	if(!is_address_valid(attr)){
 		return NULL;
@@ -4167,7 +5019,7 @@ struct varlena *detoast_attr(struct varlena *attr,Oid *oid)
 		/*
 		 * This is an externally stored datum --- fetch it back from there
 		 */
-		attr = toast_fetch_datumds(attr,oid);
+		attr = toast_fetch_datumds(ctx, attr,oid);
 		if(attr == NULL){
 			return NULL;
 		}
@@ -4208,24 +5060,24 @@ struct varlena *detoast_attr(struct varlena *attr,Oid *oid)
 	return attr;
 }
 
-struct varlena *pg_detoast_datum(struct varlena *datum,Oid *toid)
+struct varlena *pg_detoast_datum(decodeContext *ctx, struct varlena *datum,Oid *toid)
 {
 	Size data_size = VARSIZE_ANY(datum);
 	if(data_size > BLCKSZ || data_size <= 0){
 		return NULL;
 	}
 	if (VARATT_IS_EXTENDED(datum))
-		return detoast_attr(datum,toid);
+		return detoast_attr(ctx, datum,toid);
 	else
 		return datum;
 }
 
-static int decode_bit(const char *bit_data, unsigned int data_capacity, unsigned int *size_read)
+static int decode_bit(decodeContext *ctx, const char *bit_data, unsigned int data_capacity, unsigned int *size_read)
 {
 	*size_read = VARSIZE_ANY(bit_data);
 
 	Oid oid_ref = 0;
-	VarBit *bit_val = (VarBit *)PG_DETOAST_DATUM(bit_data, &oid_ref);
+	VarBit *bit_val = (VarBit *)PG_DETOAST_DATUM(ctx, bit_data, &oid_ref);
 
 	if (bit_val == NULL)
 		return -1;
@@ -4260,7 +5112,7 @@ static int decode_bit(const char *bit_data, unsigned int data_capacity, unsigned
 	}
 
 	*dst_ptr = '\0';
-	emitFieldValue(output_str);
+	emitFieldValue(ctx, output_str);
 	return 0;
 }
 
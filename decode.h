@@ -23,9 +23,135 @@ void setExportMode_decode(int setting);
 
 void setlogLevel(int setting);
 
+void setIoMode_decode(int mode,int depth);
+
 void showSupportTypeCom();
 
-typedef int (*decodeFunc) (const char *tupleSingleAttr, unsigned int tupleSizeSingleAttr,unsigned int *sizeDecoded);
+/* Upper bound of TOAST blocks prefetched for one heap page */
+#define TOAST_PREFETCH_MAX_BLOCKS 4096
+
+/* One segment (base file, .1, .2, ...) of a TOAST relation */
+typedef struct toastSegment
+{
+	int			fd;					/* -1 until opened */
+	char	   *map;				/* iomode mmap: whole segment */
+	size_t		mapLen;
+} toastSegment;
+
+/*
+ * Open TOAST relation of the table being decoded. Segments are opened on
+ * first use and kept until the path changes or the unload ends; pages come
+ * straight from the mapping or from a pread of the last block used.
+ */
+typedef struct toastReader
+{
+	char		path[1100];			/* base segment path */
+	int			blockSize;
+	toastSegment *segs;				/* indexed by segment number */
+	int			nSegs;
+	char	   *page;				/* pread copy of (pageSeg, pageBlk) */
+	int			pageSeg;
+	BlockNumber	pageBlk;
+} toastReader;
+
+/* How the fixed-offset prefix of a decodePlan emits a column */
+#define DECODE_PLAN_HANDLER	0		/* through the column's decodeFunc */
+#define DECODE_PLAN_INT16	1
+#define DECODE_PLAN_INT32	2
+#define DECODE_PLAN_INT64	3
+#define DECODE_PLAN_TIMESTAMP	4
+#define DECODE_PLAN_TIMESTAMPTZ	5
+
+typedef struct decodePlanCol
+{
+	uint32		off;				/* aligned start in the tuple data */
+	uint32		end;				/* off + attlen */
+	uint8		kind;				/* DECODE_PLAN_* */
+} decodePlanCol;
+
+/*
+ * Column offsets of one table, compiled once from its pg_attributeDesc
+ * the way attcacheoff is: every column before the first varlena one sits
+ * at the same offset in all tuples that have no NULL before it.
+ */
+typedef struct decodePlan
+{
+	const pg_attributeDesc *desc;	/* descriptors it was compiled from */
+	const void *funcs;				/* array2Process it was compiled for */
+	int			nAtt;				/* addNum it was compiled for */
+	int			nFixed;				/* leading columns with a fixed offset */
+	decodePlanCol *cols;
+
+	/*
+	 * Row decoder specialized for the table's column shape, NULL when no
+	 * kernel fits. Used for tuples without NULLs; returns 0, a decode log
+	 * flag on failure, or -1 when the tuple is too short for the prefix.
+	 */
+	int			(*kernel) (struct decodeContext *ctx, const char *data, unsigned int size,
+						   int *failAt, unsigned int *left);
+} decodePlan;
+
+/*
+ * Last calendar day a date or timestamp column was converted to: values
+ * of the same day reuse its "YYYY-MM-DD" text and only format the time.
+ */
+typedef struct dayCache
+{
+	bool		valid;
+	bool		bc;					/* year <= 0, " BC" goes last */
+	int32		jd;					/* Julian day of text */
+	int			len;
+	char		text[16];
+} dayCache;
+
+/* Local day of timestamptz output, cached while its UTC offset holds */
+typedef struct tzDayCache
+{
+	bool		valid;
+	int64		start;				/* local midnight, usecs since 2000-01-01 UTC */
+	int64		end;				/* next local midnight */
+	int			tz;					/* seconds west of UTC, as EncodeTimezone takes */
+	dayCache	day;
+} tzDayCache;
+
+/*
+ * Per-worker decode state. Everything a decodeFunc writes while turning one
+ * tuple into text lives here, so independent contexts can decode in parallel.
+ */
+typedef struct decodeContext
+{
+	StringInfoData resultBuf;		/* text of the tuple being decoded */
+	int			fieldCount;			/* fields emitted into resultBuf */
+	bool		resultReady;		/* resultBuf has been initialized */
+	int			currAtt;			/* attribute currently being decoded */
+	int			addNum;				/* number of entries in array2Process */
+
+	toastIndex *toastIdx;			/* chunk_id -> toast tuple locations */
+	char		toastId[50];		/* toast relfilenode of current table */
+	char		CURDBPath[1024];	/* datafile directory for toast lookups */
+	char		CURDBPathforDB[1024];
+	int			isToastDecoded;
+	dropContext *dc;				/* dropscan state, NULL otherwise */
+	toastReader *toastRd;			/* TOAST segments of toastId */
+	aioQueue   *aio;				/* TOAST page reads, iomode async only */
+	pid_t		aioPid;				/* process that created aio */
+
+	parray	   *oldParray;			/* UPDATE old/new tuple field lists */
+	bool		oldParrayInitDown;
+	bool		oldParrayReturn;
+	parray	   *newParray;
+	bool		newParrayInitDown;
+	bool		newParrayReturn;
+
+	decodePlan	plan;				/* fixed-offset prefix of the table */
+	dayCache	dateDay;			/* last day of date_output */
+	dayCache	tsDay;				/* last day of timestamp_output */
+	tzDayCache	tstzDay;			/* last local day of timestamptz_output */
+
+	char		decompressionStorage[64 * 1024];	/* pglz/lz4 scratch */
+} decodeContext;
+
+typedef int (*decodeFunc) (decodeContext *ctx, const char *tupleSingleAttr, unsigned int tupleSizeSingleAttr,unsigned int *sizeDecoded);
 
 typedef void (*commaSeperFunc) (char *str,FILE *file);
 
@@ -221,10 +347,10 @@ void initCURDBPathforDB(char *filepath);
 
 void initToastId(char *toastnode);
 
-int decode_numeric_value(const char *input_buffer, unsigned int buffer_size, unsigned int *bytes_processed);
+int decode_numeric_value(decodeContext *ctx, const char *input_buffer, unsigned int buffer_size, unsigned int *bytes_processed);
 
 int
-parse_text_field(const char *raw_data, unsigned int buf_capacity, unsigned int *bytes_consumed);
+parse_text_field(decodeContext *ctx, const char *raw_data, unsigned int buf_capacity, unsigned int *bytes_consumed);
 
 int32 pglz_decompress(const char *source, int32 slen, char *dest,int32 rawsize, bool check_complete);
 
@@ -232,6 +358,14 @@ int AddList2Prcess(decodeFunc *array2Process,char *type,char *BOOTTYPE);
 
 void resetArray2Process(decodeFunc *array2Process);
 
+char* xmanDecodeCtx(decodeContext *ctx,int dropExist,pg_attributeDesc *allDesc,decodeFunc *array2Process,const char *tupleData, unsigned int tupleSize,char *BOOTTYPE,FILE *logSucc,FILE *logErr);
+
+decodeContext *decodeContextNew(void);
+
+void decodeContextFree(decodeContext *ctx);
+
+decodeContext *decodeContextDefault(void);
+
 char* xmanDecode(int dropExist,pg_attributeDesc *allDesc,decodeFunc *array2Process,const char *tupleData, unsigned int tupleSize,char *BOOTTYPE,FILE *logSucc,FILE *logErr);
 
 
@@ -240,7 +374,7 @@ void commaStrWriteIntoFileCLASS(char *str,FILE *file);
 
 void commaStrWriteIntoFIleAttr(char *str,FILE *file);
 
-#define PG_DETOAST_DATUM(datum,oid) pg_detoast_datum((struct varlena *) DatumGetPointer(datum),(Oid *)oid)
+#define PG_DETOAST_DATUM(ctx,datum,oid) pg_detoast_datum(ctx,(struct varlena *) DatumGetPointer(datum),(Oid *)oid)
 
 
 struct varlena *
@@ -250,9 +384,9 @@ struct varlena *
 lz4_decompress_datum(const struct varlena *value);
 
 struct varlena *
-detoast_attr(struct varlena *attr,Oid *toid);
+detoast_attr(decodeContext *ctx, struct varlena *attr,Oid *toid);
 
-struct varlena *pg_detoast_datum(struct varlena *datum,Oid *toid);
+struct varlena *pg_detoast_datum(decodeContext *ctx, struct varlena *datum,Oid *toid);
 
 
 char* xmanDecodeDrop(decodeFunc *array2Process,const char *tupleData, unsigned int tupleSize,dropContext *dc,int *isToast);
@@ -264,34 +398,36 @@ char *xmandecodeSys(pg_attributeDesc *allDesc,decodeFunc *array2Process,const ch
 
 Oid getErrToastOidNoths();
 
-int assembleToastByIndex(Oid toastOid,unsigned int toastExternalSize,char *toastData,harray *toastHash,char *toastfilePath);
+int assembleToastByIndex(decodeContext *ctx,Oid toastOid,unsigned int toastExternalSize,char *toastData,harray *toastHash,toastIndex *toastIdx,toastReader *rd);
+
+void setToastIndex(toastIndex *setting);
 
-void setToastHash(harray *setting);
+void prefetchToastPage(pg_attributeDesc *allDesc,int nDesc,const char *block);
 
 
-static int UnpackToastPayload(const char *packed, int32 packed_len, int (*consumer)(const char *, int));
+static int UnpackToastPayload(decodeContext *ctx, const char *packed, int32 packed_len, int (*consumer)(decodeContext *, const char *, int));
 
-static int uuid_output(const char *input_data, unsigned int data_length, unsigned int *consumed_bytes);
+static int uuid_output(decodeContext *ctx, const char *input_data, unsigned int data_length, unsigned int *consumed_bytes);
 
-static int name_output(const char *input_data, unsigned int data_length, unsigned int *consumed_bytes);
+static int name_output(decodeContext *ctx, const char *input_data, unsigned int data_length, unsigned int *consumed_bytes);
 
-static int bool_output(const char *input_data, unsigned int data_length, unsigned int *consumed_bytes);
+static int bool_output(decodeContext *ctx, const char *input_data, unsigned int data_length, unsigned int *consumed_bytes);
 
-static int decode_macaddr(const char *input_data, unsigned int data_length, unsigned int *consumed_bytes);
+static int decode_macaddr(decodeContext *ctx, const char *input_data, unsigned int data_length, unsigned int *consumed_bytes);
 
-static int decode_bit(const char *bit_data, unsigned int data_capacity, unsigned int *size_read);
+static int decode_bit(decodeContext *ctx, const char *bit_data, unsigned int data_capacity, unsigned int *size_read);
 
-static int No_op(const char *unused_data, unsigned int remaining_bytes, unsigned int *skipped);
+static int No_op(decodeContext *ctx, const char *unused_data, unsigned int remaining_bytes, unsigned int *skipped);
 
-static int dissectVarlena(const char *input_data, unsigned int data_length, unsigned int *consumed_bytes, int (*xman)(const char *, int));
+static int dissectVarlena(decodeContext *ctx, const char *input_data, unsigned int data_length, unsigned int *consumed_bytes, int (*xman)(decodeContext *, const char *, int));
 
-static int DeToast(const char *buffer,unsigned int buff_size,unsigned int* out_size,int (*xman)(const char *, int));
+static int DeToast(decodeContext *ctx, const char *buffer,unsigned int buff_size,unsigned int* out_size,int (*xman)(decodeContext *, const char *, int));
 
-static int extractToastedPayloadDs(const char *input, unsigned int input_len, unsigned int *consumed, int (*emit_value)(const char *, int));
+static int extractToastedPayloadDs(decodeContext *ctx, const char *input, unsigned int input_len, unsigned int *consumed, int (*emit_value)(decodeContext *, const char *, int));
 
-static int UnpackToastPayload(const char *packed, int32 packed_len, int (*consumer)(const char *, int));
+static int UnpackToastPayload(decodeContext *ctx, const char *packed, int32 packed_len, int (*consumer)(decodeContext *, const char *, int));
 
-static int dissectVarlenaText(const char *input_data, unsigned int data_length, unsigned int *consumed_bytes, int (*xman)(const char *, int));
+static int dissectVarlenaText(decodeContext *ctx, const char *input_data, unsigned int data_length, unsigned int *consumed_bytes, int (*xman)(decodeContext *, const char *, int));
 
 void freeOldParray();
 
@@ -100,6 +100,7 @@ void printUsage()
 
     printf("%s  **误操作数据恢复**%s\n",COLOR_helpRestore,C_RESET);
     printf("%s  scan <t1|manual>;                       │ 扫描误删表/从manual目录初始化元数据%s\n",COLOR_helpRestore,C_RESET);
+    printf("%s  scan <t1,t2,...|meta>;                  │ 单次读取WAL扫描多张表/当前模式下所有表，restore时一并恢复%s\n",COLOR_helpRestore,C_RESET);
     printf("%s  scan drop;                              │ 扫描被drop的表结构%s\n",COLOR_helpRestore,C_RESET);
     printf("%s  meta tab/sch <tabname/schema>;          │ 将指定的表结构/模式下的所有表结构自动填入tab.conifg中%s\n",COLOR_helpRestore,C_RESET);
     printf("%s  restore del/upd [<TxID>|all];           │ 按事务号/时间区间恢复数据%s\n",COLOR_helpRestore,C_RESET);
@@ -124,6 +125,11 @@ void printUsage()
     printf("%s  p|param exmode csv|sql;                 │ 设置导出格式（默认CSV）%s\n",COLOR_helpParam,C_RESET);
     printf("%s  p|param encoding utf8|gbk;              │ 设置字符编码（默认utf8）%s\n",COLOR_helpParam,C_RESET);
     printf("%s  p|param isomode on|off;                 │ 设置镜像保存模式（默认off）%s\n",COLOR_helpParam,C_RESET);
+    printf("%s  p|param workers <N>;                    │ 设置unload并行进程及WAL扫描线程数（默认1）%s\n",COLOR_helpParam,C_RESET);
+    printf("%s  p|param readchunk <MB>;                 │ 设置数据文件单次读取大小（默认8MB）%s\n",COLOR_helpParam,C_RESET);
+    printf("%s  p|param iomode buffered|mmap|async;     │ 设置数据文件读取方式（默认buffered）%s\n",COLOR_helpParam,C_RESET);
+    printf("%s  p|param iodepth <N>;                    │ 设置async模式并发读请求数（默认32）%s\n",COLOR_helpParam,C_RESET);
+    printf("%s  p|param fpwcache <MB|GB>;               │ 设置WAL恢复页面缓存大小（默认256MB，0关闭）%s\n",COLOR_helpParam,C_RESET);
     printf("%s  reset <参数名>|all;                     │ 重置指定参数|所有参数%s\n",COLOR_helpParam,C_RESET);
     printf("%s  show;                                   │ 查看所有参数状态%s\n",COLOR_helpParam,C_RESET);
     printf("%s  t;                                      │ 查看当前支持的数据类型%s\n",COLOR_helpParam,C_RESET);
@@ -163,6 +169,7 @@ void printUsage()
 
     printf("%s  **Accidental Operation Data Recovery**%s\n", COLOR_helpRestore, C_RESET);
     printf("%s  scan [t1|manual];                       │ Scan deleted/update records of tables/Init metadata from manual%s\n", COLOR_helpRestore, C_RESET);
+    printf("%s  scan [t1,t2,...|meta];                  │ Scan several tables/all tables of the schema in one WAL pass, restored together%s\n", COLOR_helpRestore, C_RESET);
     printf("%s  restore del/upd [<TxID>|all];           │ Restore data by transaction ID/time range%s\n", COLOR_helpRestore, C_RESET);
     printf("%s  add <filenode> <table> <columns>;       │ Manually add table info (e.g. add 12345 t1 varchar,...) [!] Datafile should be put into path 'restore/datafile'%s\n", COLOR_helpRestore, C_RESET);
     printf("%s  restore db <db> <path>;                 │ [Pro/Enterprise] Init customized database directory (e.g. restore db xmandb /home/...)%s\n", COLOR_helpRestore, C_RESET);
@@ -184,6 +191,11 @@ void printUsage()
     printf("%s  p|param restype delete|update;          │ Set recovery type (Delete/Update)%s\n", COLOR_helpParam, C_RESET);
     printf("%s  p|param exmode csv|sql;                 │ Set export format (default CSV)%s\n", COLOR_helpParam, C_RESET);
     printf("%s  p|param encoding utf8|gbk;              │ Set character encoding (default utf8)%s\n", COLOR_helpParam, C_RESET);
+    printf("%s  p|param workers <N>;                    │ Set number of unload processes and WAL scan threads (default 1)%s\n", COLOR_helpParam, C_RESET);
+    printf("%s  p|param readchunk <MB>;                 │ Set datafile read size per call (default 8MB)%s\n", COLOR_helpParam, C_RESET);
+    printf("%s  p|param iomode buffered|mmap|async;     │ Set datafile read method (default buffered)%s\n", COLOR_helpParam, C_RESET);
+    printf("%s  p|param iodepth <N>;                    │ Set reads in flight for async mode (default 32)%s\n", COLOR_helpParam, C_RESET);
+    printf("%s  p|param fpwcache <MB|GB>;               │ Set WAL restore page cache size (default 256MB, 0 off)%s\n", COLOR_helpParam, C_RESET);
     printf("%s  reset <parameter>|all;                  │ Reset specified parameter|all parameter%s\n", COLOR_helpParam, C_RESET);
     printf("%s  show;                                   │ Display all parameters%s\n", COLOR_helpParam, C_RESET);
     printf("%s  t;                                      │ Display all supported datatypes %s\n", COLOR_helpParam, C_RESET);
@@ -408,9 +420,11 @@ void infoTxScanResult(DELstruct *elem,char *resStr)
     char *oid = elem->datafile;
     char *toastoid = elem->toast;
     int rec = elem->delCount;
-    char *startLSN = elem->startLSN;
+    char startLSN[20];
     char *startwal = elem->startwal;
-    char *endLSN = elem->endLSN;
+    char endLSN[20];
+    lsnToStr(elem->startLSN,startLSN);
+    lsnToStr(elem->endLSN,endLSN);
     char *endwal = elem->endwal;
 
     #ifdef CN
@@ -488,9 +502,11 @@ void infoTimeScanResult(DELstruct *elem,char *resStr,TimestampTz *SrtTime,Timest
     char *endstmp = (char *)timestamptz_to_str_og(*EndTime);
     char *oid = elem->datafile;
     char *toastoid = elem->toast;
-    char *startLSN = elem->startLSN;
+    char startLSN[20];
     char *startwal = elem->startwal;
-    char *endLSN = elem->endLSN;
+    char endLSN[20];
+    lsnToStr(elem->startLSN,startLSN);
+    lsnToStr(elem->endLSN,endLSN);
     char *endwal = elem->endwal;
     int totalCount = elem->delCount;
 
@@ -22,6 +22,9 @@
 #include <stdint.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <sys/mman.h>
+#include <zlib.h>
+#include <lz4frame.h>
 
 // Forward declarations to fix implicit declaration warnings
 void PageInit(Page page, Size pageSize, Size specialSize);
@@ -47,6 +50,40 @@ char targetDatafile[50];
 char targetOldDatafile[50];
 char targetToastfile[50];
 char targetOldToastfile[50];
+static Oid targetDatafileOid;
+static Oid targetOldDatafileOid;
+static Oid targetToastfileOid;
+static Oid targetOldToastfileOid;
+
+/* A table of a scan or restore; a multi-table one has one per table */
+typedef struct walRestoreTarget
+{
+	TABstruct *tab;
+	Oid datafile;
+	Oid oldDatafile;
+	Oid toastfile;
+	Oid oldToastfile;
+	FILE *spool;		/* tuples kept for decoding after the pass */
+	char spoolPath[MAXPGPATH];
+	int nErr;
+	int heapDone;
+	int toastDone;
+} walRestoreTarget;
+
+/* A relfilenode of a target, sorted for walTargetRelFind */
+typedef struct walTargetRel
+{
+	Oid relfilenode;
+	int target;
+	int isToast;
+} walTargetRel;
+
+static walRestoreTarget *restoreTargets = NULL;
+static int nRestoreTargets = 0;
+static int restoreMulti = 0;
+static walTargetRel *targetRels = NULL;
+static int nTargetRels = 0;
+static FILE *restoreSpool = NULL;
 
 char currWalName[70];
 int FPIcount=0;
@@ -68,6 +105,7 @@ systemDropContext *sdcPgAttr = NULL;
 
 parray *Txs = NULL;
 harray *delElems = NULL;
+int walScanWorkers = 1;
 
 /**
  * setRestoreMode_there - Set restore mode
@@ -95,6 +133,104 @@ void setExportMode_there(int setting){
 void setResTyp_there(int setting){
 	resTyp_there = setting;
 }
+
+/**
+ * setWalScanWorkers_there - Set number of WAL scan threads
+ *
+ * @setting: Thread count, 1 scans serially
+ */
+void setWalScanWorkers_there(int setting){
+	walScanWorkers = setting < 1 ? 1 : setting;
+}
+
+static int walTargetRelCmp(const void *a,const void *b)
+{
+	Oid ra = ((const walTargetRel *) a)->relfilenode;
+	Oid rb = ((const walTargetRel *) b)->relfilenode;
+	return ra < rb ? -1 : ra > rb;
+}
+
+static void walTargetRelAdd(Oid relfilenode,int target,int isToast)
+{
+	if (relfilenode == 0)
+		return;
+	for (int i = 0; i < nTargetRels; i++)
+		if (targetRels[i].relfilenode == relfilenode)
+			return;
+	targetRels[nTargetRels].relfilenode = relfilenode;
+	targetRels[nTargetRels].target = target;
+	targetRels[nTargetRels].isToast = isToast;
+	nTargetRels++;
+}
+
+/**
+ * walTargetsIndex - Rebuild the relfilenode index of restoreTargets
+ */
+static void walTargetsIndex(void)
+{
+	free(targetRels);
+	nTargetRels = 0;
+	targetRels = (walTargetRel *) malloc(sizeof(walTargetRel) * 4 * (nRestoreTargets ? nRestoreTargets : 1));
+	for (int i = 0; i < nRestoreTargets; i++)
+	{
+		walRestoreTarget *t = &restoreTargets[i];
+		walTargetRelAdd(t->datafile,i,0);
+		walTargetRelAdd(t->oldDatafile,i,0);
+		walTargetRelAdd(t->toastfile,i,1);
+		walTargetRelAdd(t->oldToastfile,i,1);
+	}
+	qsort(targetRels,nTargetRels,sizeof(walTargetRel),walTargetRelCmp);
+}
+
+/**
+ * walTargetRelFind - Find the target a relfilenode belongs to
+ *
+ * @relfilenode: Relfilenode of a block reference
+ *
+ * Returns: Index entry, or NULL when no target owns the relation
+ */
+static inline walTargetRel *walTargetRelFind(Oid relfilenode)
+{
+	walTargetRel key;
+	if (relfilenode == 0 || nTargetRels == 0)
+		return NULL;
+	key.relfilenode = relfilenode;
+	return bsearch(&key,targetRels,nTargetRels,sizeof(walTargetRel),walTargetRelCmp);
+}
+
+static void walTargetSet(walRestoreTarget *t,TABstruct *tab,const char *datafile,const char *oldDatafile,
+						 const char *toastfile,const char *oldToastfile)
+{
+	memset(t,0,sizeof(walRestoreTarget));
+	t->tab = tab;
+	t->datafile = atoi(datafile);
+	t->oldDatafile = atoi(oldDatafile);
+	t->toastfile = atoi(toastfile);
+	t->oldToastfile = atoi(oldToastfile);
+}
+
+/**
+ * setRestoreTargets_there - Set the tables of a multi-table scan/restore
+ *
+ * @tabs: Tables, routed by relfilenode in a single pass over the WAL
+ * @n:    Number of tables, 0 for the single table given to pgGetTxforArch
+ */
+void setRestoreTargets_there(TABstruct **tabs,int n)
+{
+	free(restoreTargets);
+	restoreTargets = NULL;
+	nRestoreTargets = 0;
+	restoreMulti = n > 0;
+	if (!restoreMulti)
+		return;
+
+	restoreTargets = (walRestoreTarget *) malloc(sizeof(walRestoreTarget) * n);
+	for (int i = 0; i < n; i++)
+		walTargetSet(&restoreTargets[i],tabs[i],tabs[i]->filenode,tabs[i]->oid,
+					 tabs[i]->toastnode,tabs[i]->toastoid);
+	nRestoreTargets = n;
+	walTargetsIndex();
+}
 char FPWSegmentPath[100];
 
 parray *LsnBlkInfos = NULL;
@@ -107,29 +243,32 @@ typedef struct {
     off_t offset;
 } IndexEntry;
 
-/* Sub hash table node (stores index info for a single block) */
-typedef struct SubHashNode {
-    IndexEntry entry;
-    struct SubHashNode *next;
-} SubHashNode;
-
-/* Sub hash table (corresponds to all block indexes for a filenode) */
+/*
+ * Page store of one relfilenode: <filenode> holds the pages in arrival
+ * order, <filenode>.idx is a log of IndexEntry appended once per new
+ * block and compacted by FPWHashCleanup. Both files stay open while the
+ * store lives; slots maps a block number to its page in the data file.
+ */
 typedef struct {
-    SubHashNode **buckets;
-    int bucket_count;
-    int entry_count;
-    float load_factor;
+    char dir[100];          /* FPWSegmentPath when the store was opened */
+    RelFileNumber filenode;
+    int fd;                 /* data file, -1 until first used */
+    int idxFd;              /* index log, -1 until first append */
+    uint32 *slots;          /* page number + 1 by block, 0 if absent */
+    BlockNumber nSlots;
+    uint32 nPages;          /* pages in the data file */
+    uint64 nLogged;         /* entries in the index log */
     pthread_mutex_t lock;
-} SubHashTable;
+} FPWStore;
 
-/* Global hash table node (maps filenode to sub hash table) */
+/* Global hash table node (maps filenode to its page store) */
 typedef struct GlobalHashNode {
     RelFileNumber filenode;
-    SubHashTable *sub_table;
+    FPWStore *store;
     struct GlobalHashNode *next;
 } GlobalHashNode;
 
-/* Global hash table (manages all filenode sub hash tables) */
+/* Global hash table (manages all filenode page stores) */
 typedef struct {
     GlobalHashNode **buckets;
     int bucket_count;
@@ -156,153 +295,384 @@ static unsigned int hash_uint(unsigned int value, int bucket_count) {
 }
 
 /**
- * sub_hash_init - Initialize a sub hash table
+ * fpw_store_slot_set - Record the data file page of a block
  *
- * @initial_buckets: Initial number of buckets
- * @load_factor:     Load factor threshold for expansion
+ * @store: Page store
+ * @blk:   Block number
+ * @page:  Page number in the data file
  *
- * Returns: Pointer to new sub hash table, or NULL on failure
+ * Returns: 1 on success, 0 on allocation failure
  */
-static SubHashTable* sub_hash_init(int initial_buckets, float load_factor) {
-    SubHashTable *table = (SubHashTable*)malloc(sizeof(SubHashTable));
-    if (!table) return NULL;
-
-    table->bucket_count = (initial_buckets > 0) ? initial_buckets : 16;
-    table->entry_count = 0;
-    table->load_factor = (load_factor > 0) ? load_factor : 0.75f;
-    table->buckets = (SubHashNode**)calloc(table->bucket_count, sizeof(SubHashNode*));
-
-    if (!table->buckets) {
-        free(table);
-        return NULL;
+static int fpw_store_slot_set(FPWStore *store, BlockNumber blk, uint32 page) {
+    if (blk >= store->nSlots) {
+        BlockNumber n = store->nSlots ? store->nSlots : 64;
+        while (n <= blk)
+            n = (n > 0x7FFFFFFF) ? blk + 1 : n * 2;
+        uint32 *slots = (uint32*)realloc(store->slots, (size_t)n * sizeof(uint32));
+        if (!slots) return 0;
+        memset(slots + store->nSlots, 0, (size_t)(n - store->nSlots) * sizeof(uint32));
+        store->slots = slots;
+        store->nSlots = n;
     }
+    store->slots[blk] = page + 1;
+    return 1;
+}
 
-    pthread_mutex_init(&table->lock, NULL);
-    return table;
+/**
+ * fpw_store_find - Look up the data file offset of a block
+ *
+ * @store:  Page store
+ * @blk:    Block number
+ * @offset: Output offset in the data file
+ *
+ * Returns: 1 if the block is stored, 0 otherwise
+ */
+static int fpw_store_find(FPWStore *store, BlockNumber blk, off_t *offset) {
+    if (blk >= store->nSlots || store->slots[blk] == 0)
+        return 0;
+    *offset = (off_t)(store->slots[blk] - 1) * BLCKSZ;
+    return 1;
 }
 
 /**
- * sub_hash_expand - Expand sub hash table capacity
+ * fpw_store_open - Open the page store of a filenode
  *
- * @table: Sub hash table to expand
+ * @filenode: File node number
+ *
+ * Replays <filenode>.idx into the block map; later entries win. The data
+ * file itself is opened on first access.
  *
- * Doubles the bucket count and rehashes all entries.
+ * Returns: New store, or NULL on allocation failure
  */
-static void sub_hash_expand(SubHashTable *table) {
-    if (!table) return;
+static FPWStore* fpw_store_open(RelFileNumber filenode) {
+    char idx_path[MAXPGPATH];
+    FPWStore *store = (FPWStore*)calloc(1, sizeof(FPWStore));
+    if (!store) return NULL;
 
-    int new_buckets = table->bucket_count * 2;
-    SubHashNode **new_table = (SubHashNode**)calloc(new_buckets, sizeof(SubHashNode*));
-    if (!new_table) return;
+    strcpy(store->dir, FPWSegmentPath);
+    store->filenode = filenode;
+    store->fd = -1;
+    store->idxFd = -1;
+    pthread_mutex_init(&store->lock, NULL);
 
-    /* Rehash all entries to new buckets */
-    for (int i = 0; i < table->bucket_count; i++) {
-        SubHashNode *node = table->buckets[i];
-        while (node) {
-            SubHashNode *next = node->next;
-            unsigned int idx = hash_uint(node->entry.blk, new_buckets);
+    sprintf(idx_path, "%s/%u.idx", store->dir, filenode);
+    FILE *fp = fopen(idx_path, "rb");
+    if (fp) {
+        IndexEntry entries[256];
+        size_t n;
+        while ((n = fread(entries, sizeof(IndexEntry), 256, fp)) > 0) {
+            for (size_t i = 0; i < n; i++) {
+                uint32 page = (uint32)(entries[i].offset / BLCKSZ);
+                fpw_store_slot_set(store, entries[i].blk, page);
+                if (page + 1 > store->nPages)
+                    store->nPages = page + 1;
+            }
+            store->nLogged += n;
+        }
+        fclose(fp);
+    }
+    return store;
+}
+
+/**
+ * fpw_store_data - Get the data file descriptor of a store
+ *
+ * @store:  Page store (locked)
+ * @create: Create the data file if it does not exist
+ *
+ * Returns: Descriptor, or -1 if the file cannot be opened
+ */
+static int fpw_store_data(FPWStore *store, int create) {
+    char data_path[MAXPGPATH];
+    struct stat st;
+
+    if (store->fd >= 0)
+        return store->fd;
+    sprintf(data_path, "%s/%u", store->dir, store->filenode);
+    store->fd = open(data_path, O_RDWR | (create ? O_CREAT : 0), 0644);
+    if (store->fd >= 0 && fstat(store->fd, &st) == 0 &&
+        (uint32)(st.st_size / BLCKSZ) > store->nPages)
+        store->nPages = (uint32)(st.st_size / BLCKSZ);
+    return store->fd;
+}
 
-            node->next = new_table[idx];
-            new_table[idx] = node;
-            node = next;
+/**
+ * fpw_store_log - Append one entry to the index log of a store
+ *
+ * @store: Page store (locked)
+ * @entry: New block location
+ */
+static void fpw_store_log(FPWStore *store, const IndexEntry *entry) {
+    if (store->idxFd < 0) {
+        char idx_path[MAXPGPATH];
+        sprintf(idx_path, "%s/%u.idx", store->dir, store->filenode);
+        store->idxFd = open(idx_path, O_WRONLY | O_APPEND | O_CREAT, 0644);
+        if (store->idxFd < 0) {
+            printf("Cannot open index file %s for appending\n", idx_path);
+            return;
         }
     }
+    if (write(store->idxFd, entry, sizeof(IndexEntry)) == sizeof(IndexEntry))
+        store->nLogged++;
+}
+
+/*
+ * LRU cache of FPW pages in front of the page stores. Redo routines read,
+ * modify and write back the same hot pages over and over; with the cache
+ * each such round trip stays in memory and a page reaches its store only
+ * when it is evicted or the cache is flushed. Frames remember the data
+ * file offset reserved for them, so write-back needs no store lookup.
+ */
+typedef struct FPWCacheFrame {
+    FPWStore *store;
+    BlockNumber blk;
+    off_t offset;               /* location of blk in the store data file */
+    bool dirty;
+    struct FPWCacheFrame *prev; /* LRU list, head is most recently used */
+    struct FPWCacheFrame *next;
+    struct FPWCacheFrame *hnext;
+    char page[BLCKSZ];
+} FPWCacheFrame;
+
+static struct {
+    FPWCacheFrame **buckets;
+    uint32 nBuckets;            /* power of two */
+    uint64 nFrames;
+    FPWCacheFrame *head;
+    FPWCacheFrame *tail;
+} fpwCache;
+
+static uint64 fpwCacheBytes = (uint64)DEFAULT_FPW_CACHE_MB * 1024 * 1024;
+static pthread_mutex_t fpwCacheLock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline uint32 fpw_cache_bucket(FPWStore *store, BlockNumber blk) {
+    uint64 h = ((uint64)(uintptr_t)store >> 4) * 0x9E3779B97F4A7C15ULL ^ blk;
+    h ^= h >> 29;
+    h *= 0xBF58476D1CE4E5B9ULL;
+    h ^= h >> 32;
+    return (uint32)h & (fpwCache.nBuckets - 1);
+}
+
+static void fpw_cache_unlink(FPWCacheFrame *f) {
+    if (f->prev) f->prev->next = f->next; else fpwCache.head = f->next;
+    if (f->next) f->next->prev = f->prev; else fpwCache.tail = f->prev;
+    f->prev = f->next = NULL;
+}
+
+static void fpw_cache_push_front(FPWCacheFrame *f) {
+    f->prev = NULL;
+    f->next = fpwCache.head;
+    if (fpwCache.head) fpwCache.head->prev = f;
+    fpwCache.head = f;
+    if (!fpwCache.tail) fpwCache.tail = f;
+}
+
+static void fpw_cache_hash_remove(FPWCacheFrame *f) {
+    FPWCacheFrame **pp = &fpwCache.buckets[fpw_cache_bucket(f->store, f->blk)];
+    while (*pp && *pp != f)
+        pp = &(*pp)->hnext;
+    if (*pp)
+        *pp = f->hnext;
+}
+
+static FPWCacheFrame* fpw_cache_lookup(FPWStore *store, BlockNumber blk) {
+    if (fpwCache.nBuckets == 0)
+        return NULL;
+    FPWCacheFrame *f = fpwCache.buckets[fpw_cache_bucket(store, blk)];
+    while (f && (f->store != store || f->blk != blk))
+        f = f->hnext;
+    return f;
+}
 
-    free(table->buckets);
-    table->buckets = new_table;
-    table->bucket_count = new_buckets;
+/* Write a dirty frame back to its store */
+static void fpw_cache_write_back(FPWCacheFrame *f) {
+    if (!f->dirty)
+        return;
+    if (f->store->fd < 0 || pwrite(f->store->fd, f->page, BLCKSZ, f->offset) != BLCKSZ)
+        printf("Failed to write block %u to file %s/%u\n", f->blk, f->store->dir, f->store->filenode);
+    f->dirty = false;
 }
 
 /**
- * sub_hash_insert - Insert or update entry in sub hash table
+ * fpw_cache_frame - Get the frame of a block, claiming one if needed
+ *
+ * @store:  Page store of the block
+ * @blk:    Block number
+ * @offset: Data file offset reserved for the block
+ * @found:  Set to true if the block was already cached
  *
- * @table: Sub hash table
- * @entry: Index entry to insert
+ * A new frame is allocated while the cache is below its size limit,
+ * otherwise the least recently used frame is written back and reused.
+ * Caller holds fpwCacheLock.
  *
- * Inserts a new entry or updates existing one with same block number.
+ * Returns: Frame at the head of the LRU list, or NULL if caching is off
  */
-static void sub_hash_insert(SubHashTable *table, const IndexEntry *entry) {
-    if (!table || !entry) return;
+static FPWCacheFrame* fpw_cache_frame(FPWStore *store, BlockNumber blk, off_t offset, bool *found) {
+    FPWCacheFrame *f;
 
-    /* Check if expansion needed */
-    if ((float)table->entry_count / table->bucket_count >= table->load_factor) {
-        sub_hash_expand(table);
-    }
+    if (fpwCacheBytes < BLCKSZ)
+        return NULL;
 
-    unsigned int idx = hash_uint(entry->blk, table->bucket_count);
-    SubHashNode *current = table->buckets[idx];
+    f = fpw_cache_lookup(store, blk);
+    *found = (f != NULL);
+    if (f) {
+        fpw_cache_unlink(f);
+        fpw_cache_push_front(f);
+        return f;
+    }
 
-    /* Find and update existing entry */
-    while (current) {
-        if (current->entry.blk == entry->blk) {
-            current->entry.offset = entry->offset;
-            return;
+    if (fpwCache.nFrames >= fpwCache.nBuckets) {
+        uint32 n = fpwCache.nBuckets ? fpwCache.nBuckets * 2 : 1024;
+        FPWCacheFrame **buckets = (FPWCacheFrame**)calloc(n, sizeof(FPWCacheFrame*));
+        if (buckets) {
+            FPWCacheFrame **old = fpwCache.buckets;
+            fpwCache.buckets = buckets;
+            fpwCache.nBuckets = n;
+            for (FPWCacheFrame *g = fpwCache.head; g; g = g->next) {
+                uint32 b = fpw_cache_bucket(g->store, g->blk);
+                g->hnext = buckets[b];
+                buckets[b] = g;
+            }
+            free(old);
         }
-        current = current->next;
+        else if (fpwCache.nBuckets == 0)
+            return NULL;
     }
 
-    /* Insert new entry */
-    SubHashNode *new_node = (SubHashNode*)malloc(sizeof(SubHashNode));
-    if (new_node) {
-        new_node->entry = *entry;
-        new_node->next = table->buckets[idx];
-        table->buckets[idx] = new_node;
-        table->entry_count++;
+    if ((fpwCache.nFrames + 1) * BLCKSZ <= fpwCacheBytes &&
+        (f = (FPWCacheFrame*)malloc(sizeof(FPWCacheFrame))) != NULL) {
+        fpwCache.nFrames++;
+    }
+    else if ((f = fpwCache.tail) != NULL) {
+        fpw_cache_write_back(f);
+        fpw_cache_hash_remove(f);
+        fpw_cache_unlink(f);
     }
+    else
+        return NULL;
+
+    f->store = store;
+    f->blk = blk;
+    f->offset = offset;
+    f->dirty = false;
+    uint32 b = fpw_cache_bucket(store, blk);
+    f->hnext = fpwCache.buckets[b];
+    fpwCache.buckets[b] = f;
+    fpw_cache_push_front(f);
+    return f;
 }
 
 /**
- * sub_hash_lookup - Look up entry in sub hash table
+ * fpw_cache_evict - Write back and drop frames
  *
- * @table: Sub hash table
- * @blk:   Block number to find
+ * @store: Drop only frames of this store, or NULL for all
+ * @keep:  Frames to leave cached (only when store is NULL)
  *
- * Returns: Pointer to index entry, or NULL if not found
+ * Frames are dropped from the cold end of the LRU list.
  */
-static int sub_hash_find(SubHashTable *table, BlockNumber blk, off_t *offset) {
-    if (!table || !offset) return 0;
-
-    unsigned int idx = hash_uint(blk, table->bucket_count);
-    SubHashNode *current = table->buckets[idx];
-
-    while (current) {
-        if (current->entry.blk == blk) {
-            *offset = current->entry.offset;
-            return 1;
+static void fpw_cache_evict(FPWStore *store, uint64 keep) {
+    FPWCacheFrame *f = fpwCache.tail;
+
+    while (f && (store != NULL || fpwCache.nFrames > keep)) {
+        FPWCacheFrame *prev = f->prev;
+        if (store == NULL || f->store == store) {
+            fpw_cache_write_back(f);
+            fpw_cache_hash_remove(f);
+            fpw_cache_unlink(f);
+            free(f);
+            fpwCache.nFrames--;
         }
-        current = current->next;
+        f = prev;
+    }
+    if (fpwCache.nFrames == 0) {
+        free(fpwCache.buckets);
+        fpwCache.buckets = NULL;
+        fpwCache.nBuckets = 0;
     }
-    return 0;
 }
 
 /**
- * sub_hash_destroy - Free sub hash table memory
+ * FPWCacheFlush - Write every dirty cached FPW page to its store
  *
- * @table: Sub hash table to destroy
+ * Pages stay cached. Called at the end of each WAL restore pass so
+ * that the store files are complete before anything reads them directly.
  */
-static void sub_hash_destroy(SubHashTable *table) {
-    if (!table->buckets){
-		free(table);
-		return;
-	}
+void FPWCacheFlush() {
+    pthread_mutex_lock(&fpwCacheLock);
+    for (FPWCacheFrame *f = fpwCache.head; f; f = f->next)
+        fpw_cache_write_back(f);
+    pthread_mutex_unlock(&fpwCacheLock);
+}
 
-    for (int i = 0; i < table->bucket_count; i++) {
-        SubHashNode *node = table->buckets[i];
-        while (node) {
-            SubHashNode *temp = node;
-            node = node->next;
-            free(temp);
+/**
+ * setFpwCache_there - Set the FPW page cache size
+ *
+ * @bytes: Cache size in bytes, 0 disables the cache
+ *
+ * Shrinking writes back and drops the least recently used pages.
+ */
+void setFpwCache_there(uint64 bytes) {
+    pthread_mutex_lock(&fpwCacheLock);
+    fpwCacheBytes = bytes;
+    fpw_cache_evict(NULL, bytes / BLCKSZ);
+    pthread_mutex_unlock(&fpwCacheLock);
+}
+
+/**
+ * fpw_store_close - Compact the index log of a store and release it
+ *
+ * @store: Page store
+ *
+ * If the log holds stale or duplicate entries it is rewritten with one
+ * entry per block, in block order, and renamed over the old log.
+ */
+static void fpw_store_close(FPWStore *store) {
+    uint64 nBlocks = 0;
+
+    pthread_mutex_lock(&fpwCacheLock);
+    fpw_cache_evict(store, 0);
+    pthread_mutex_unlock(&fpwCacheLock);
+
+    for (BlockNumber blk = 0; blk < store->nSlots; blk++)
+        if (store->slots[blk] != 0)
+            nBlocks++;
+
+    if (nBlocks > 0 && nBlocks != store->nLogged) {
+        char idx_path[MAXPGPATH];
+        char tmp_path[MAXPGPATH + 8];
+        sprintf(idx_path, "%s/%u.idx", store->dir, store->filenode);
+        sprintf(tmp_path, "%s.tmp", idx_path);
+
+        FILE *fp = fopen(tmp_path, "wb");
+        if (fp) {
+            int ok = 1;
+            for (BlockNumber blk = 0; blk < store->nSlots && ok; blk++) {
+                IndexEntry entry;
+                if (!fpw_store_find(store, blk, &entry.offset))
+                    continue;
+                entry.blk = blk;
+                ok = fwrite(&entry, sizeof(IndexEntry), 1, fp) == 1;
+            }
+            if (fclose(fp) == 0 && ok)
+                rename(tmp_path, idx_path);
+            else
+                unlink(tmp_path);
         }
     }
-    free(table->buckets);
-    pthread_mutex_destroy(&table->lock);
-    free(table);
+
+    if (store->fd >= 0)
+        close(store->fd);
+    if (store->idxFd >= 0)
+        close(store->idxFd);
+    free(store->slots);
+    pthread_mutex_destroy(&store->lock);
+    free(store);
 }
 
 /**
  * global_hash_init - Initialize global hash table
  *
- * Creates the global hash table for mapping filenodes to sub tables.
+ * Creates the global hash table for mapping filenodes to page stores.
  */
 static void global_hash_init() {
     global_hash_table = (GlobalHashTable*)malloc(sizeof(GlobalHashTable));
@@ -325,115 +695,50 @@ static GlobalHashTable* get_global_hash_table() {
 }
 
 /**
- * get_sub_hash_table - Find or create sub hash table for filenode
+ * get_fpw_store - Find or open the page store of a filenode
  *
  * @filenode: File node number
  *
- * Returns: Pointer to sub hash table for this filenode
+ * Returns: Pointer to the page store for this filenode
  */
-static SubHashTable* get_sub_hash_table(RelFileNumber filenode) {
+static FPWStore* get_fpw_store(RelFileNumber filenode) {
     GlobalHashTable *global = get_global_hash_table();
     if (!global) return NULL;
 
     unsigned int idx = hash_uint(filenode, global->bucket_count);
-    SubHashTable *sub_table = NULL;
+    FPWStore *store = NULL;
 
     pthread_mutex_lock(&global->lock);
 
-    /* Find existing sub hash table */
+    /* Find existing store */
     GlobalHashNode *current = global->buckets[idx];
     while (current) {
         if (current->filenode == filenode) {
-            sub_table = current->sub_table;
+            store = current->store;
             break;
         }
         current = current->next;
     }
 
-    /* Create new sub hash table if not exists */
-    if (!sub_table) {
-        sub_table = sub_hash_init(16, 0.75f);
-        if (sub_table) {
+    /* Open store if not exists */
+    if (!store) {
+        store = fpw_store_open(filenode);
+        if (store) {
             GlobalHashNode *new_node = (GlobalHashNode*)malloc(sizeof(GlobalHashNode));
             if (new_node) {
                 new_node->filenode = filenode;
-                new_node->sub_table = sub_table;
+                new_node->store = store;
                 new_node->next = global->buckets[idx];
                 global->buckets[idx] = new_node;
             } else {
-                sub_hash_destroy(sub_table);
-                sub_table = NULL;
+                fpw_store_close(store);
+                store = NULL;
             }
         }
     }
 
     pthread_mutex_unlock(&global->lock);
-    return sub_table;
-}
-
-/* Sync sub hash table to disk index file */
-static void sync_sub_hash_to_disk(RelFileNumber filenode, SubHashTable *sub_table) {
-    if (!sub_table || sub_table->entry_count == 0) return;
-
-    char idx_path[MAXPGPATH];
-    sprintf(idx_path, "%s/%u.idx", FPWSegmentPath, filenode);
-    FILE *fp = fopen(idx_path, "wb");
-    if (!fp) return;
-
-    /* Collect all index entries */
-    IndexEntry *entries = (IndexEntry*)malloc(sub_table->entry_count * sizeof(IndexEntry));
-    if (entries) {
-        int pos = 0;
-        pthread_mutex_lock(&sub_table->lock);
-
-        for (int i = 0; i < sub_table->bucket_count; i++) {
-            SubHashNode *node = sub_table->buckets[i];
-            while (node) {
-                entries[pos++] = node->entry;
-                node = node->next;
-            }
-        }
-
-        pthread_mutex_unlock(&sub_table->lock);
-
-        /* Write to index file */
-        fwrite(entries, sizeof(IndexEntry), sub_table->entry_count, fp);
-        free(entries);
-    }
-    fclose(fp);
-}
-
-/* Load from disk index file to sub hash table */
-static void load_sub_hash_from_disk(RelFileNumber filenode, SubHashTable *sub_table) {
-    if (!sub_table) return;
-
-    char idx_path[MAXPGPATH];
-    sprintf(idx_path, "%s/%u.idx", FPWSegmentPath, filenode);
-    FILE *fp = fopen(idx_path, "rb");
-    if (!fp) return;
-
-    /* Get file size to calculate entry count */
-    fseek(fp, 0, SEEK_END);
-    long file_size = ftell(fp);
-    fseek(fp, 0, SEEK_SET);
-
-    int entry_count = file_size / sizeof(IndexEntry);
-    if (entry_count <= 0) {
-        fclose(fp);
-        return;
-    }
-
-    /* Read all index entries */
-    IndexEntry entry;
-    pthread_mutex_lock(&sub_table->lock);
-    for (int i = 0; i < entry_count; i++) {
-        if (fread(&entry, sizeof(IndexEntry), 1, fp) == 1) {
-            sub_hash_insert(sub_table, &entry);
-        }
-    }
-    pthread_mutex_unlock(&sub_table->lock);
-
-    fclose(fp);
+    return store;
 }
 
 /**
@@ -443,62 +748,52 @@ static void load_sub_hash_from_disk(RelFileNumber filenode, SubHashTable *sub_ta
  * @page:     Page data to write
  * @filenode: File node identifier
  *
- * Writes a full page to the FPW storage file, using hash table
- * indexing for efficient block lookup.
+ * New blocks get a page appended to the data file and logged in the
+ * index. The page is then kept dirty in the FPW cache, or written with
+ * pwrite right away if the cache is off.
  */
 void FPW2File(BlockNumber blk, char* page, RelFileNumber filenode) {
-    char data_path[MAXPGPATH];
-    FILE *fp = NULL;
-    SubHashTable *sub_table = NULL;
+    FPWStore *store = NULL;
     IndexEntry entry = {.blk = blk};
+    FPWCacheFrame *frame;
     off_t offset = 0;
-    int exists = 0;
+    bool cached;
+    int fd;
 
-    sub_table = get_sub_hash_table(filenode);
-    if (!sub_table) return;
+    store = get_fpw_store(filenode);
+    if (!store) return;
 
-    pthread_mutex_lock(&sub_table->lock);
-    if (sub_table->entry_count == 0) {
-        pthread_mutex_unlock(&sub_table->lock);
-        load_sub_hash_from_disk(filenode, sub_table);
-        pthread_mutex_lock(&sub_table->lock);
+    pthread_mutex_lock(&store->lock);
+    fd = fpw_store_data(store, 1);
+    if (fd < 0) {
+        pthread_mutex_unlock(&store->lock);
+        printf("Cannot open data file %s/%u for writing\n", store->dir, filenode);
+        return;
     }
 
-    exists = sub_hash_find(sub_table, blk, &offset);
-    pthread_mutex_unlock(&sub_table->lock);
-
-    sprintf(data_path, "%s/%u", FPWSegmentPath, filenode);
-
-    if (exists) {
-
-        fp = fopen(data_path, "r+b");
-        if (!fp) {
-            printf("Cannot open data file %s for writing\n", data_path);
-            return;
-        }
-        fseek(fp, offset, SEEK_SET);
-    } else {
-
-        fp = fopen(data_path, "a+b");
-        if (!fp) {
-            printf("Cannot open data file %s for appending\n", data_path);
+    if (!fpw_store_find(store, blk, &offset)) {
+        offset = (off_t)store->nPages * BLCKSZ;
+        if (!fpw_store_slot_set(store, blk, store->nPages)) {
+            pthread_mutex_unlock(&store->lock);
             return;
         }
-        fseek(fp, 0, SEEK_END);
-        offset = ftell(fp);
+        store->nPages++;
         entry.offset = offset;
+        fpw_store_log(store, &entry);
+    }
 
-        pthread_mutex_lock(&sub_table->lock);
-        sub_hash_insert(sub_table, &entry);
-        pthread_mutex_unlock(&sub_table->lock);
-
-        sync_sub_hash_to_disk(filenode, sub_table);
+    pthread_mutex_lock(&fpwCacheLock);
+    frame = fpw_cache_frame(store, blk, offset, &cached);
+    if (frame) {
+        memcpy(frame->page, page, BLCKSZ);
+        frame->dirty = true;
     }
+    pthread_mutex_unlock(&fpwCacheLock);
 
-    if (fwrite(page, 1, BLCKSZ, fp) != BLCKSZ) {
-        printf("Failed to write block %u to file %s\n", blk, data_path);
+    if (!frame && pwrite(fd, page, BLCKSZ, offset) != BLCKSZ) {
+        printf("Failed to write block %u to file %s/%u\n", blk, store->dir, filenode);
     }
-    fclose(fp);
+    pthread_mutex_unlock(&store->lock);
 }
 
 /**
@@ -508,33 +803,27 @@ void FPW2File(BlockNumber blk, char* page, RelFileNumber filenode) {
  * @page:     Buffer to store page data
  * @filenode: File node identifier
  *
- * Reads a full page from FPW storage file using hash table lookup.
+ * Reads a full page from the FPW cache, or from the page store of
+ * filenode and caches it.
  *
  * Returns: 1 on success, 0 if block not found
  */
 int FPWfromFile(BlockNumber blk, char* page, RelFileNumber filenode) {
-    char data_path[MAXPGPATH];
-    FILE *fp = NULL;
-    SubHashTable *sub_table = NULL;
+    FPWStore *store = NULL;
+    FPWCacheFrame *frame;
     off_t offset;
     int result = 0;
+    int fd;
 
     Assert(page != NULL);
 
-    sub_table = get_sub_hash_table(filenode);
-    if (!sub_table) return 0;
-
-    pthread_mutex_lock(&sub_table->lock);
-    if (sub_table->entry_count == 0) {
-        pthread_mutex_unlock(&sub_table->lock);
-        load_sub_hash_from_disk(filenode, sub_table);
-        pthread_mutex_lock(&sub_table->lock);
-    }
-
-    result = sub_hash_find(sub_table, blk, &offset);
-    pthread_mutex_unlock(&sub_table->lock);
+    store = get_fpw_store(filenode);
+    if (!store) return 0;
 
+    pthread_mutex_lock(&store->lock);
+    result = fpw_store_find(store, blk, &offset);
     if (!result){
+        pthread_mutex_unlock(&store->lock);
 		LsnBlkInfo *elem = (LsnBlkInfo*)malloc(sizeof(LsnBlkInfo));
 		strcpy(elem->LSN,lsn);
 		elem->blk = blk;
@@ -543,22 +832,33 @@ int FPWfromFile(BlockNumber blk, char* page, RelFileNumber filenode) {
 		return 0;
 	}
 
-    sprintf(data_path, "%s/%u", FPWSegmentPath, filenode);
-    fp = fopen(data_path, "rb");
-    if (!fp) {
-
-        return 0;
+    pthread_mutex_lock(&fpwCacheLock);
+    frame = fpw_cache_lookup(store, blk);
+    if (frame) {
+        fpw_cache_unlink(frame);
+        fpw_cache_push_front(frame);
+        memcpy(page, frame->page, BLCKSZ);
+        pthread_mutex_unlock(&fpwCacheLock);
+        pthread_mutex_unlock(&store->lock);
+        return 1;
     }
+    pthread_mutex_unlock(&fpwCacheLock);
 
-    if (fseek(fp, offset, SEEK_SET) == 0 &&
-        fread(page, 1, BLCKSZ, fp) == BLCKSZ) {
+    fd = fpw_store_data(store, 0);
+    if (fd >= 0 && pread(fd, page, BLCKSZ, offset) == BLCKSZ) {
+        bool cached;
         result = 1;
+        pthread_mutex_lock(&fpwCacheLock);
+        frame = fpw_cache_frame(store, blk, offset, &cached);
+        if (frame)
+            memcpy(frame->page, page, BLCKSZ);
+        pthread_mutex_unlock(&fpwCacheLock);
     } else {
 
         result = 0;
     }
+    pthread_mutex_unlock(&store->lock);
 
-    fclose(fp);
     return result;
 }
 
@@ -571,27 +871,22 @@ int FPWfromFile(BlockNumber blk, char* page, RelFileNumber filenode) {
  * Returns: true if block exists in FPW storage, false otherwise
  */
 bool FPWfileExist(BlockNumber blk, RelFileNumber filenode) {
-    SubHashTable *sub_table = get_sub_hash_table(filenode);
-    if (!sub_table) return false;
-
-    pthread_mutex_lock(&sub_table->lock);
-    if (sub_table->entry_count == 0) {
-        pthread_mutex_unlock(&sub_table->lock);
-        load_sub_hash_from_disk(filenode, sub_table);
-        pthread_mutex_lock(&sub_table->lock);
-    }
+    FPWStore *store = get_fpw_store(filenode);
+    if (!store) return false;
 
+    pthread_mutex_lock(&store->lock);
     off_t dummy;
-    bool exists = sub_hash_find(sub_table, blk, &dummy) ? true : false;
-    pthread_mutex_unlock(&sub_table->lock);
+    bool exists = fpw_store_find(store, blk, &dummy) ? true : false;
+    pthread_mutex_unlock(&store->lock);
 
     return exists;
 }
 
 /**
- * FPWHashCleanup - Clean up FPW hash tables on exit
+ * FPWHashCleanup - Close all FPW page stores
  *
- * Syncs all data to disk and frees all hash table memory.
+ * Writes back the cached pages, compacts every index log, closes the
+ * store files and frees all hash table memory.
  */
 void FPWHashCleanup() {
     GlobalHashTable *global = get_global_hash_table();
@@ -603,11 +898,7 @@ void FPWHashCleanup() {
         while (node) {
             GlobalHashNode *temp = node;
 
-            /* Sync final state to disk */
-            sync_sub_hash_to_disk(node->filenode, node->sub_table);
-
-            /* Destroy sub hash table */
-            sub_hash_destroy(node->sub_table);
+            fpw_store_close(node->store);
 
             node = node->next;
             free(temp);
@@ -623,6 +914,36 @@ void FPWHashCleanup() {
 	init_once = PTHREAD_ONCE_INIT;
 }
 
+/**
+ * walFileFindNext - Find the archived segment that follows a missing one
+ *
+ * @files: Archived segments, sorted
+ * @n:     Number of segments
+ * @fname: Segment the reader could not continue from
+ *
+ * Binary search on the log/segment part of the names, so the lookup
+ * stays cheap with tens of thousands of archived segments.
+ *
+ * Returns: -1 if fname itself is archived, otherwise the index of the
+ *          first later segment (0 if there is none)
+ */
+static int walFileFindNext(WALFILE *files,int n,const char *fname)
+{
+	int lo = 0;
+	int hi = n;
+
+	while (lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+		if (strcmp(files[mid].walnames + 8, fname + 8) <= 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo > 0 && strcmp(files[lo - 1].walnames + 8, fname + 8) == 0)
+		return -1;
+	return lo < n ? lo : 0;
+}
+
 /**
  * determineTimeMode - Determine time filtering mode
  *
@@ -817,86 +1138,379 @@ XLogReaderAllocate(int wal_segment_size, const char *waldir,
 	return state;
 }
 
+/*
+ * Archived segments may be compressed by archive_command. A compressed
+ * segment is inflated once into an anonymous file whose descriptor is
+ * handed out like that of a plain segment, so WALRead keeps using pread.
+ * The last few inflated segments are kept for readers that come back to
+ * them (restarts after a gap, parallel readers meeting at a boundary).
+ */
+static const char *walSegmentSuffixes[] = {"", ".gz", ".lz4"};
+
+#define WAL_SUFFIX_GZ  1
+#define WAL_SUFFIX_LZ4 2
+#define WAL_INFLATE_CHUNK (256 * 1024)
+
+typedef struct walInflated
+{
+	char path[MAXPGPATH];	/* compressed file, empty if the slot is free */
+	int64 srcSize;
+	int64 srcMtime;
+	int64 size;			/* inflated bytes */
+	int fd;
+	uint64 lastUse;
+} walInflated;
+
+static walInflated walInflateCache[WAL_INFLATE_CACHE_SEGS];
+static uint64 walInflateClock = 0;
+static pthread_mutex_t walInflateLock = PTHREAD_MUTEX_INITIALIZER;
+
 /**
- * open_file_in_directory - Open a file in specified directory
+ * walSegmentResolve - Find the file holding a segment
  *
  * @directory: Directory path
- * @fname:     File name to open
+ * @fname:     Segment file name, without suffix
+ * @path:      Output path of the file found, MAXPGPATH bytes
  *
- * Returns: File descriptor on success, -1 on failure
+ * Returns: 0 for a plain file, WAL_SUFFIX_GZ or WAL_SUFFIX_LZ4 for a
+ * compressed one, -1 if the segment is not there
  */
-int
-open_file_in_directory(const char *directory, const char *fname)
+int walSegmentResolve(const char *directory,const char *fname,char *path)
 {
-	int			fd = -1;
-	char		fpath[MAXPGPATH];
-
-	Assert(directory != NULL);
-
-	snprintf(fpath, MAXPGPATH, "%s/%s", directory, fname);
-	fd = open(fpath, O_RDONLY | PG_BINARY, 0);
+	struct stat st;
+	for (int i = 0; i < (int) (sizeof(walSegmentSuffixes) / sizeof(walSegmentSuffixes[0])); i++)
+	{
+		snprintf(path, MAXPGPATH, "%s/%s%s", directory, fname, walSegmentSuffixes[i]);
+		if (stat(path, &st) == 0 && S_ISREG(st.st_mode))
+			return i;
+	}
+	return -1;
+}
 
-	if (fd < 0){
-		#ifdef CN
-		printf("%sWAL日志 %s\"%s\"%s 未找到,跳过%s\n",COLOR_WARNING,COLOR_UNLOAD, fname,COLOR_WARNING,C_RESET);
-		#else
-		printf("%sWAL File %s\"%s\"%s Not Found, Skipped%s\n",COLOR_WARNING,COLOR_UNLOAD, fname,COLOR_WARNING,C_RESET);
-		#endif
+static int walInflateWrite(int fd,const char *buf,size_t len)
+{
+	while (len > 0)
+	{
+		ssize_t n = write(fd, buf, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return FAILURE_RET;
+		buf += n;
+		len -= n;
 	}
-	return fd;
+	return SUCCESS_RET;
 }
 
 /**
- * search_directory - Search for WAL files in directory
+ * walInflateGzip - Stream a gzip segment into a descriptor
  *
- * @directory: Directory to search
- * @fname:     Optional specific file name to find
+ * @path: Compressed segment
+ * @out:  Destination descriptor
  *
- * Returns: true if WAL file found and opened, false otherwise
+ * Returns: SUCCESS_RET or FAILURE_RET
  */
-bool search_directory(const char *directory, const char *fname)
+static int walInflateGzip(const char *path,int out)
 {
-	int			fd = -1;
-	DIR		   *xldir;
-
-	/* open file if valid filename is provided */
-	if (fname != NULL)
-		fd = open_file_in_directory(directory, fname);
+	gzFile gz = gzopen(path, "rb");
+	char *buf = malloc(WAL_INFLATE_CHUNK);
+	int n = -1;
 
-	/*
-	 * A valid file name is not passed, so search the complete directory.  If
-	 * we find any file whose name is a valid WAL file name then try to open
-	 * it.  If we cannot open it, bail out.
-	 */
-	else if ((xldir = opendir(directory)) != NULL)
+	if (gz && buf)
 	{
-		struct dirent *xlde;
-
-		while ((xlde = readdir(xldir)) != NULL)
-		{
-			if (IsXLogFileName(xlde->d_name))
-			{
-				fd = open_file_in_directory(directory, xlde->d_name);
-				fname = xlde->d_name;
+		gzbuffer(gz, WAL_INFLATE_CHUNK);
+		while ((n = gzread(gz, buf, WAL_INFLATE_CHUNK)) > 0)
+			if (!walInflateWrite(out, buf, n)){
+				n = -1;
 				break;
 			}
-		}
-
-		closedir(xldir);
 	}
+	if (gz)
+		gzclose(gz);
+	free(buf);
+	return n == 0 ? SUCCESS_RET : FAILURE_RET;
+}
 
-	/* set WalSegSz if file is successfully opened */
-	if (fd >= 0)
+/**
+ * walInflateLz4 - Stream an LZ4 frame segment into a descriptor
+ *
+ * @path: Compressed segment
+ * @out:  Destination descriptor
+ *
+ * Returns: SUCCESS_RET or FAILURE_RET
+ */
+static int walInflateLz4(const char *path,int out)
+{
+	FILE *fp = fopen(path, "rb");
+	char *src = malloc(WAL_INFLATE_CHUNK);
+	char *dst = malloc(WAL_INFLATE_CHUNK);
+	LZ4F_dctx *dctx = NULL;
+	int ok = fp && src && dst &&
+			 !LZ4F_isError(LZ4F_createDecompressionContext(&dctx, LZ4F_VERSION));
+	size_t hint = 1;
+	size_t nread;
+
+	while (ok && (nread = fread(src, 1, WAL_INFLATE_CHUNK, fp)) > 0)
 	{
-		PGAlignedXLogBlock buf;
-		int			r;
-
-		r = read(fd, buf.data, XLOG_BLCKSZ);
-		if (r == XLOG_BLCKSZ)
+		size_t pos = 0;
+		while (ok && pos < nread)
 		{
-			XLogLongPageHeader longhdr = (XLogLongPageHeader) buf.data;
-
-			WalSegSz = longhdr->xlp_seg_size;
+			size_t dstSize = WAL_INFLATE_CHUNK;
+			size_t srcSize = nread - pos;
+			hint = LZ4F_decompress(dctx, dst, &dstSize, src + pos, &srcSize, NULL);
+			if (LZ4F_isError(hint))
+				ok = 0;
+			else if (dstSize > 0)
+				ok = walInflateWrite(out, dst, dstSize);
+			pos += srcSize;
+		}
+	}
+	/* a complete frame leaves no input hint behind */
+	if (ok && (ferror(fp) || hint != 0))
+		ok = 0;
+
+	if (dctx)
+		LZ4F_freeDecompressionContext(dctx);
+	if (fp)
+		fclose(fp);
+	free(src);
+	free(dst);
+	return ok ? SUCCESS_RET : FAILURE_RET;
+}
+
+/**
+ * walInflateTarget - Create an anonymous file for an inflated segment
+ *
+ * Returns: Descriptor, or -1 on failure
+ */
+static int walInflateTarget(void)
+{
+	int fd = -1;
+	#if defined(__linux__) && defined(MFD_CLOEXEC)
+	fd = memfd_create("pdu-wal", MFD_CLOEXEC);
+	#endif
+	if (fd < 0){
+		FILE *tmp = tmpfile();
+		if (tmp){
+			fd = dup(fileno(tmp));
+			fclose(tmp);
+		}
+	}
+	return fd;
+}
+
+/**
+ * walInflateInsert - Add an inflated segment to the cache
+ *
+ * @path: Compressed segment
+ * @st:   Its stat
+ * @fd:   Descriptor of the inflated copy, owned by the cache afterwards
+ * @size: Inflated bytes
+ *
+ * Evicts the least recently used copies until the new one fits.
+ * Called with walInflateLock held.
+ *
+ * Returns: A descriptor for the caller
+ */
+static int walInflateInsert(const char *path,struct stat *st,int fd,int64 size)
+{
+	int64 cap = (int64) WAL_INFLATE_CACHE_MB * 1024 * 1024;
+	int64 used = size;
+	int slot = -1;
+
+	for (int i = 0; i < WAL_INFLATE_CACHE_SEGS; i++)
+		if (walInflateCache[i].path[0] != '\0')
+			used += walInflateCache[i].size;
+
+	for (;;)
+	{
+		int lru = -1, nUsed = 0;
+		for (int i = 0; i < WAL_INFLATE_CACHE_SEGS; i++)
+		{
+			if (walInflateCache[i].path[0] == '\0'){
+				if (slot == -1)
+					slot = i;
+				continue;
+			}
+			nUsed++;
+			if (lru == -1 || walInflateCache[i].lastUse < walInflateCache[lru].lastUse)
+				lru = i;
+		}
+		if (lru == -1 || (slot != -1 && used <= cap))
+			break;
+		used -= walInflateCache[lru].size;
+		close(walInflateCache[lru].fd);
+		walInflateCache[lru].path[0] = '\0';
+		slot = lru;
+	}
+
+	walInflated *e = &walInflateCache[slot];
+	strncpy(e->path, path, MAXPGPATH - 1);
+	e->path[MAXPGPATH - 1] = '\0';
+	e->srcSize = st->st_size;
+	e->srcMtime = st->st_mtime;
+	e->size = size;
+	e->fd = fd;
+	e->lastUse = ++walInflateClock;
+	return dup(fd);
+}
+
+/**
+ * walInflateOpen - Open the inflated copy of a compressed segment
+ *
+ * @path: Compressed segment
+ * @kind: WAL_SUFFIX_GZ or WAL_SUFFIX_LZ4
+ *
+ * Returns: Descriptor positioned at 0, or -1 on failure
+ */
+static int walInflateOpen(const char *path,int kind)
+{
+	struct stat st;
+	int fd = -1;
+
+	if (stat(path, &st) != 0)
+		return -1;
+
+	pthread_mutex_lock(&walInflateLock);
+	for (int i = 0; i < WAL_INFLATE_CACHE_SEGS; i++)
+	{
+		walInflated *e = &walInflateCache[i];
+		if (strcmp(e->path, path) == 0 && e->srcSize == st.st_size && e->srcMtime == st.st_mtime){
+			e->lastUse = ++walInflateClock;
+			fd = dup(e->fd);
+			break;
+		}
+	}
+	pthread_mutex_unlock(&walInflateLock);
+	if (fd >= 0)
+		return fd;
+
+	/* inflate outside the lock so parallel readers do not queue up */
+	int out = walInflateTarget();
+	if (out < 0)
+		return -1;
+	int ok = kind == WAL_SUFFIX_GZ ? walInflateGzip(path, out) : walInflateLz4(path, out);
+	off_t size = lseek(out, 0, SEEK_CUR);
+	if (!ok || size <= 0){
+		#ifdef CN
+		printf("%sWAL日志 %s\"%s\"%s 解压失败,跳过%s\n",COLOR_WARNING,COLOR_UNLOAD, path,COLOR_WARNING,C_RESET);
+		#else
+		printf("%sWAL File %s\"%s\"%s Decompression Failed, Skipped%s\n",COLOR_WARNING,COLOR_UNLOAD, path,COLOR_WARNING,C_RESET);
+		#endif
+		close(out);
+		return -1;
+	}
+	lseek(out, 0, SEEK_SET);
+
+	pthread_mutex_lock(&walInflateLock);
+	fd = walInflateInsert(path, &st, out, size);
+	pthread_mutex_unlock(&walInflateLock);
+	return fd;
+}
+
+/**
+ * walInflateCacheCleanup - Release the inflated segment copies
+ */
+void walInflateCacheCleanup()
+{
+	pthread_mutex_lock(&walInflateLock);
+	for (int i = 0; i < WAL_INFLATE_CACHE_SEGS; i++)
+		if (walInflateCache[i].path[0] != '\0'){
+			close(walInflateCache[i].fd);
+			walInflateCache[i].path[0] = '\0';
+		}
+	pthread_mutex_unlock(&walInflateLock);
+}
+
+/**
+ * open_file_in_directory - Open a file in specified directory
+ *
+ * @directory: Directory path
+ * @fname:     File name to open
+ *
+ * A segment archived as <fname>.gz or <fname>.lz4 is opened through its
+ * inflated copy.
+ *
+ * Returns: File descriptor on success, -1 on failure
+ */
+int
+open_file_in_directory(const char *directory, const char *fname)
+{
+	int			fd = -1;
+	char		fpath[MAXPGPATH];
+
+	Assert(directory != NULL);
+
+	snprintf(fpath, MAXPGPATH, "%s/%s", directory, fname);
+	fd = open(fpath, O_RDONLY | PG_BINARY, 0);
+
+	if (fd < 0){
+		int kind = walSegmentResolve(directory, fname, fpath);
+		if (kind > 0)
+			fd = walInflateOpen(fpath, kind);
+	}
+
+	if (fd < 0){
+		#ifdef CN
+		printf("%sWAL日志 %s\"%s\"%s 未找到,跳过%s\n",COLOR_WARNING,COLOR_UNLOAD, fname,COLOR_WARNING,C_RESET);
+		#else
+		printf("%sWAL File %s\"%s\"%s Not Found, Skipped%s\n",COLOR_WARNING,COLOR_UNLOAD, fname,COLOR_WARNING,C_RESET);
+		#endif
+	}
+	return fd;
+}
+
+/**
+ * search_directory - Search for WAL files in directory
+ *
+ * @directory: Directory to search
+ * @fname:     Optional specific file name to find
+ *
+ * Returns: true if WAL file found and opened, false otherwise
+ */
+bool search_directory(const char *directory, const char *fname)
+{
+	int			fd = -1;
+	DIR		   *xldir;
+
+	/* open file if valid filename is provided */
+	if (fname != NULL)
+		fd = open_file_in_directory(directory, fname);
+
+	/*
+	 * A valid file name is not passed, so search the complete directory.  If
+	 * we find any file whose name is a valid WAL file name then try to open
+	 * it.  If we cannot open it, bail out.
+	 */
+	else if ((xldir = opendir(directory)) != NULL)
+	{
+		struct dirent *xlde;
+
+		while ((xlde = readdir(xldir)) != NULL)
+		{
+			if (IsXLogFileName(xlde->d_name))
+			{
+				fd = open_file_in_directory(directory, xlde->d_name);
+				fname = xlde->d_name;
+				break;
+			}
+		}
+
+		closedir(xldir);
+	}
+
+	/* set WalSegSz if file is successfully opened */
+	if (fd >= 0)
+	{
+		PGAlignedXLogBlock buf;
+		int			r;
+
+		r = read(fd, buf.data, XLOG_BLCKSZ);
+		if (r == XLOG_BLCKSZ)
+		{
+			XLogLongPageHeader longhdr = (XLogLongPageHeader) buf.data;
+
+			WalSegSz = longhdr->xlp_seg_size;
 
 			if (!IsValidWalSegSize(WalSegSz))
 				printf("WAL segment size must be a power of two between 1 MB and 1 GB, but the WAL file \"%s\" header specifies %d byte",
@@ -1024,6 +1638,70 @@ void XLogDumpRecordLen(XLogReaderState *record, uint32 *rec_len, uint32 *fpi_len
 	*rec_len = XLogRecGetTotalLen(record) - *fpi_len;
 }
 
+/**
+ * XlogGiveMeTimeValue - Filter a commit time against the scan window
+ *
+ * @xact_time: Commit timestamp of the record
+ * @SrtTime:   Start time for filtering
+ * @EndTime:   End time for filtering
+ *
+ * Open bounds are widened to cover every commit seen.
+ *
+ * Returns: 1 to continue, 0 to skip record, -1 to exit processing
+ */
+int XlogGiveMeTimeValue(TimestampTz xact_time,TimestampTz *SrtTime,TimestampTz *EndTime){
+	if(timeMode == None){ /* None mode: no start/end defined, use WAL log times */
+		if(*SrtTime == 0 && *EndTime == 0){
+			*SrtTime = xact_time;
+			*EndTime = xact_time;
+			return 1;
+		}
+		else if(xact_time < *SrtTime){
+			*SrtTime = xact_time;
+			return 1;
+		}
+		else if(xact_time > *EndTime){
+			*EndTime = xact_time;
+			return 1;
+		}
+	}
+	else if(timeMode == FormmerHalf){ /* Former mode: start time is defined */
+		if(*EndTime == 0){
+			*EndTime = xact_time;
+			return 1;
+		}
+		else if(xact_time < *SrtTime){ /* Time < start time, skip this record */
+			return 0;
+		}
+		else if(xact_time > *EndTime){ /* Time > end time, update end time */
+			*EndTime = xact_time;
+			return 1;
+		}
+	}
+	else if(timeMode == LatterHalf){ /* Latter mode: end time is defined */
+		if(*SrtTime == 0){
+			*SrtTime = xact_time;
+			return 1;
+		}
+		else if(xact_time > *EndTime){ /* Time > end time, return -1 to exit */
+			return -1;
+		}
+		else if(xact_time < *SrtTime){ /* Time < start time, update start time */
+			*SrtTime = xact_time;
+			return 1;
+		}
+	}
+	else if(timeMode == FULL){
+		if(xact_time < *SrtTime){ /* Time < start time, skip this record */
+			return 0;
+		}
+		else if(xact_time > *EndTime){ /* Time > end time, return -1 to exit */
+			return -1;
+		}
+	}
+	return 1;
+}
+
 /**
  * XlogGiveMeTime - Extract and filter transaction time from XLog record
  *
@@ -1041,56 +1719,7 @@ int XlogGiveMeTime(XLogReaderState *record,TimestampTz *SrtTime,TimestampTz *End
 		if (info == XLOG_XACT_COMMIT || info == XLOG_XACT_COMMIT_PREPARED)
 		{
 			xl_xact_commit *xlrec = (xl_xact_commit *) rec;
-
-			if(timeMode == None){ /* None mode: no start/end defined, use WAL log times */
-				if(*SrtTime == 0 && *EndTime == 0){
-					*SrtTime = xlrec->xact_time;
-					*EndTime = xlrec->xact_time;
-					return 1;
-				}
-				else if(xlrec->xact_time < *SrtTime){
-					*SrtTime = xlrec->xact_time;
-					return 1;
-				}
-				else if(xlrec->xact_time > *EndTime){
-					*EndTime = xlrec->xact_time;
-					return 1;
-				}
-			}
-			else if(timeMode == FormmerHalf){ /* Former mode: start time is defined */
-				if(*EndTime == 0){
-					*EndTime = xlrec->xact_time;
-					return 1;
-				}
-				else if(xlrec->xact_time < *SrtTime){ /* Time < start time, skip this record */
-					return 0;
-				}
-				else if(xlrec->xact_time > *EndTime){ /* Time > end time, update end time */
-					*EndTime = xlrec->xact_time;
-					return 1;
-				}
-			}
-			else if(timeMode == LatterHalf){ /* Latter mode: end time is defined */
-				if(*SrtTime == 0){
-					*SrtTime = xlrec->xact_time;
-					return 1;
-				}
-				else if(xlrec->xact_time > *EndTime){ /* Time > end time, return -1 to exit */
-					return -1;
-				}
-				else if(xlrec->xact_time < *SrtTime){ /* Time < start time, update start time */
-					*SrtTime = xlrec->xact_time;
-					return 1;
-				}
-			}
-			else if(timeMode == FULL){
-				if(xlrec->xact_time < *SrtTime){ /* Time < start time, skip this record */
-					return 0;
-				}
-				else if(xlrec->xact_time > *EndTime){ /* Time > end time, return -1 to exit */
-					return -1;
-				}
-			}
+			return XlogGiveMeTimeValue(xlrec->xact_time,SrtTime,EndTime);
 		}
 	}
 	return 1;
@@ -2397,6 +3026,100 @@ char* restoreSysDrop(decodeFunc *array2Process,xl_heap_delete *del_xlrec,char *p
 	return xman;
 }
 
+/*
+ * A spooled tuple: its length, the new tuple length (0 for DELETE),
+ * then the old and new tuple.
+ */
+static void restoreSpoolWrite(FILE *spool,const char *tuple,uint32 len,const char *newTuple,uint32 newLen)
+{
+	uint32 lens[2] = {len, newLen};
+	fwrite(lens,sizeof(lens),1,spool);
+	fwrite(tuple,1,len,spool);
+	if (newLen)
+		fwrite(newTuple,1,newLen,spool);
+}
+
+/**
+ * restoreDELEmit - Decode a deleted tuple and write it out
+ *
+ * @array2Process: Decode function array
+ * @tuple:         Tuple as it was on the page
+ * @tuplelen:      Tuple length
+ * @tabname:       Table name
+ * @bootFile:      Output file handle
+ *
+ * Returns: CONTINUE_RET, or BREAK_RET when the tuple does not decode
+ */
+static int restoreDELEmit(decodeFunc *array2Process,const char *tuple,int tuplelen,char *tabname,FILE *bootFile)
+{
+	FILE *logSucc=fopen("log/logPathSucc.txt","a");
+	FILE *logErr=fopen("log/logPathErr.txt","a");
+	char *xman=xmanDecode(dropExist2,allDesc,(decodeFunc *)array2Process,tuple,tuplelen,TABLE_BOOTTYPE,logSucc,logErr);
+	if ( strcmp(xman,"NoWayOut") == 0 ){
+		fclose(logSucc);
+		fclose(logErr);
+		printf("\n%srestoreDEL时解析tuple数据failed%s\n",COLOR_ERROR,C_RESET);
+		FPIErrcount++;
+		return BREAK_RET;
+	}
+	else{
+		char *xmanret=NULL;
+		if(ExportMode_there == CSVform){
+			xmanret = xman;
+		}
+		else if (ExportMode_there == SQLform){
+			xmanret = xman2Insertxman(xman,tabname);
+		}
+		commaStrWriteIntoDecodeTab(xmanret,bootFile);
+		FPIcount++;
+		fclose(logSucc);
+		fclose(logErr);
+	}
+	infoRestoreRecs(FPIcount);
+	return CONTINUE_RET;
+}
+
+/**
+ * restoreUPDATEEmit - Decode the two versions of an updated tuple and write the UPDATE
+ *
+ * @allDesc:       Attribute descriptions
+ * @array2Process: Decode function array
+ * @oldTuple:      Tuple before the update
+ * @oldLen:        Its length
+ * @newTuple:      Tuple after the update
+ * @newLen:        Its length
+ * @tabname:       Table name
+ * @bootFile:      Output file handle
+ *
+ * Returns: CONTINUE_RET
+ */
+static int restoreUPDATEEmit(pg_attributeDesc *allDesc,decodeFunc *array2Process,const char *oldTuple,uint32 oldLen,
+							 const char *newTuple,uint32 newLen,char *tabname,FILE *bootFile)
+{
+	FILE *logSucc=fopen("log/logPathSucc.txt","a");
+	FILE *logErr=fopen("log/logPathErr.txt","a");
+	char *oldxman=xmanDecode(dropExist2,allDesc,array2Process,oldTuple,oldLen,TABLE_BOOTTYPE,logSucc,logErr);
+	char *newxman=xmanDecode(dropExist2,allDesc,array2Process,newTuple,newLen,TABLE_BOOTTYPE,logSucc,logErr);
+	fclose(logSucc);
+	fclose(logErr);
+
+	if ( strcmp(newxman,"NoWayOut") == 0 ||  strcmp(oldxman,"NoWayOut") == 0  ){
+		FPIErrcount++;
+		return CONTINUE_RET;
+	}
+	char *xmanret=xman2Updatexman((parray *)newxman,(parray *)oldxman,allDesc,tabname);
+	if(strcmp(xmanret,"NoWayOut") == 0){
+		FPIUpdateSame++;
+		return CONTINUE_RET;
+	}
+	commaStrWriteIntoDecodeTab(xmanret,bootFile);
+	free(xmanret);
+	xmanret=NULL;
+	FPIcount++;
+	infoRestoreRecs(FPIcount);
+	return CONTINUE_RET;
+}
+
 /**
  * restoreDEL - Restore deleted record from FPW
  *
@@ -2446,30 +3169,11 @@ int restoreDEL(parray *Tx_parray,FILE *bootFile,decodeFunc *array2Process,xl_hea
 			tuplelen = (Size)itemId->lp_len;
 		}
 
-		FILE *logSucc=fopen("log/logPathSucc.txt","a");
-		FILE *logErr=fopen("log/logPathErr.txt","a");
-		char *xman=xmanDecode(dropExist2,allDesc,(decodeFunc *)array2Process,(const char *)tupleHeader,tuplelen,TABLE_BOOTTYPE,logSucc,logErr);
-		if ( strcmp(xman,"NoWayOut") == 0 ){
-			fclose(logSucc);
-			fclose(logErr);
-			printf("\n%srestoreDEL时解析tuple数据failed%s\n",COLOR_ERROR,C_RESET);
-			FPIErrcount++;
-			return BREAK_RET;
-		}
-		else{
-			char *xmanret=NULL;
-			if(ExportMode_there == CSVform){
-				xmanret = xman;
-			}
-			else if (ExportMode_there == SQLform){
-				xmanret = xman2Insertxman(xman,tabname);
-			}
-			commaStrWriteIntoDecodeTab(xmanret,bootFile);
-			FPIcount++;
-			fclose(logSucc);
-			fclose(logErr);
+		if(restoreSpool){
+			restoreSpoolWrite(restoreSpool,(const char *)tupleHeader,tuplelen,NULL,0);
+			return CONTINUE_RET;
 		}
-		infoRestoreRecs(FPIcount);
+		return restoreDELEmit(array2Process,(const char *)tupleHeader,tuplelen,tabname,bootFile);
 	}
 	return CONTINUE_RET;
 }
@@ -2493,14 +3197,15 @@ int restoreDEL(parray *Tx_parray,FILE *bootFile,decodeFunc *array2Process,xl_hea
  */
 int restoreUPDATE(pg_attributeDesc *allDesc,XLogReaderState *record,parray *Tx_parray,FILE *bootFile,decodeFunc *array2Process,char *tabname,char *page,BlockNumber blk,bool hot_update,TransactionId currentTx,RelFileNumber filenode)
 {
-	char *xman=NULL;
 	ItemId	itemId = NULL;
 	HeapTupleHeader	tupleHeader = NULL;
 	int	tuplelen = 0;
 
 	if(txInTxArrayOrNot(currentTx,Tx_parray,restoreMode_there)){ /* If target tx and not toast round */
-		FILE *logSucc=fopen("log/logPathSucc.txt","a");
-		FILE *logErr=fopen("log/logPathErr.txt","a");
+		const char *oldTuple;
+		uint32		oldLen;
+		const char *newTuple;
+		uint32		newLen;
 		XLogRecPtr	lsn = record->EndRecPtr;
 		xl_heap_update *xlrec = (xl_heap_update *) XLogRecGetData(record);
 		RelFileNode rnode;
@@ -2586,8 +3291,8 @@ int restoreUPDATE(pg_attributeDesc *allDesc,XLogReaderState *record,parray *Tx_p
 		if (xlrec->flags & XLH_UPDATE_OLD_ALL_VISIBLE_CLEARED)
 			PageClearAllVisible(oldpage);
 
-		xman=xmanDecode(dropExist2,allDesc,array2Process,(const char *)htup,tuplelen,TABLE_BOOTTYPE,logSucc,logErr);
-		char *oldxman = xman;
+		oldTuple = (const char *)htup;
+		oldLen = tuplelen;
 
 		/* ============= End old data block processing ============= */
 
@@ -2604,8 +3309,6 @@ int restoreUPDATE(pg_attributeDesc *allDesc,XLogReaderState *record,parray *Tx_p
 				elem->blk = newblk;
 				ErrBlkNotFound(newblk,lsn);
 				parray_append(LsnBlkInfos,elem);
-				
-				freeOldParray();
 				FPIErrcount++;
 				return CONTINUE_RET;
 			}
@@ -2627,8 +3330,8 @@ int restoreUPDATE(pg_attributeDesc *allDesc,XLogReaderState *record,parray *Tx_p
 			}
 			tuplelen = (Size)newlp->lp_len;
 			newhtup = (HeapTupleHeader) PageGetItem(newpage, newlp);
-
-			xman=xmanDecode(dropExist2,allDesc,array2Process,(const char *)newhtup,tuplelen,TABLE_BOOTTYPE,logSucc,logErr);
+			newTuple = (const char *)newhtup;
+			newLen = tuplelen;
 		}
 		else{
 			/* Deal with new tuple */
@@ -2716,33 +3419,15 @@ int restoreUPDATE(pg_attributeDesc *allDesc,XLogReaderState *record,parray *Tx_p
 			HeapTupleHeaderSetXmax(htup, xlrec->new_xmax);
 			/* Make sure there is no forward chain link in t_ctid */
 			htup->t_ctid = newtid;
-			xman=xmanDecode(dropExist2,allDesc,array2Process,(const char *)htup,newlen,TABLE_BOOTTYPE,logSucc,logErr);
+			newTuple = (const char *)htup;
+			newLen = newlen;
 		}
-		char *newxman = xman;
-		if ( strcmp(newxman,"NoWayOut") == 0 ||  strcmp(oldxman,"NoWayOut") == 0  ){
-			fclose(logSucc);
-			fclose(logErr);
-			FPIErrcount++;
+
+		if(restoreSpool){
+			restoreSpoolWrite(restoreSpool,oldTuple,oldLen,newTuple,newLen);
 			return CONTINUE_RET;
 		}
-		else{
-			char *xmanret=xman2Updatexman((parray *)newxman,(parray *)oldxman,allDesc,tabname);
-			if(strcmp(xmanret,"NoWayOut") == 0){
-				FPIUpdateSame++;
-				return CONTINUE_RET;
-			}
-			else{
-				commaStrWriteIntoDecodeTab(xmanret,bootFile);
-				free(xmanret);
-				xmanret=NULL;
-				FPIcount++;
-			}
-		}
-
-		infoRestoreRecs(FPIcount);
-
-		fclose(logSucc);
-		fclose(logErr);
+		return restoreUPDATEEmit(allDesc,array2Process,oldTuple,oldLen,newTuple,newLen,tabname,bootFile);
 	}
 	return CONTINUE_RET;
 }
@@ -2764,7 +3449,6 @@ int XLogRecordRestoreFPWs(pg_attributeDesc *allDesc,XLogReaderState *record, con
 						  parray *Tx_parray,char tabname[50],FILE *bootFile)
 {
 	int			block_id;
-	XLogRecPtr	xl_prev = XLogRecGetPrev(record);
 	TransactionId currentTx = XLogRecGetXid(record);
 	RmgrId rmid = XLogRecGetRmid(record);
 	uint8		info = XLogRecGetInfo(record) & ~XLR_INFO_MASK;
@@ -2820,10 +3504,10 @@ int XLogRecordRestoreFPWs(pg_attributeDesc *allDesc,XLogReaderState *record, con
 				}
 				#endif
 
-				if(rnode.relNode != atoi(targetDatafile) && rnode.relNode != atoi(targetOldDatafile))
+				if(rnode.relNode != targetDatafileOid && rnode.relNode != targetOldDatafileOid)
 					return CONTINUE_RET;
 
-				if(	lsnIsReached(record->ReadRecPtr,xl_prev,elem->endLSN) )
+				if(	lsnIsReached(record->ReadRecPtr,elem->endLSN) )
 					return BREAK_RET;
 
 				if(fork != MAIN_FORKNUM)
@@ -2871,10 +3555,10 @@ int XLogRecordRestoreFPWs(pg_attributeDesc *allDesc,XLogReaderState *record, con
 			}
 			#endif
 
-			if(rnode.relNode != atoi(targetDatafile) && rnode.relNode != atoi(targetOldDatafile))
+			if(rnode.relNode != targetDatafileOid && rnode.relNode != targetOldDatafileOid)
 				return CONTINUE_RET;
 
-			if(	lsnIsReached(record->ReadRecPtr,xl_prev,elem->endLSN) )
+			if(	lsnIsReached(record->ReadRecPtr,elem->endLSN) )
 				return BREAK_RET;
 
 			if(fork != MAIN_FORKNUM)
@@ -2937,10 +3621,10 @@ int XLogRecordRestoreFPWs(pg_attributeDesc *allDesc,XLogReaderState *record, con
 			}
 			#endif
 
-			if(rnode.relNode != atoi(targetDatafile) && rnode.relNode != atoi(targetOldDatafile))
+			if(rnode.relNode != targetDatafileOid && rnode.relNode != targetOldDatafileOid)
 				return CONTINUE_RET;
 
-			if(	lsnIsReached(record->ReadRecPtr,xl_prev,elem->endLSN) )
+			if(	lsnIsReached(record->ReadRecPtr,elem->endLSN) )
 				return BREAK_RET;
 
 			if(fork != MAIN_FORKNUM)
@@ -3019,10 +3703,10 @@ int XLogRecordRestoreFPWs(pg_attributeDesc *allDesc,XLogReaderState *record, con
 
 		#endif
 
-		if(rnode.relNode != atoi(targetDatafile) && rnode.relNode != atoi(targetOldDatafile))
+		if(rnode.relNode != targetDatafileOid && rnode.relNode != targetOldDatafileOid)
 			return CONTINUE_RET;
 
-		if(	lsnIsReached(record->ReadRecPtr,xl_prev,elem->endLSN) )
+		if(	lsnIsReached(record->ReadRecPtr,elem->endLSN) )
 			return BREAK_RET;
 
 		if(fork != MAIN_FORKNUM)
@@ -3063,7 +3747,6 @@ int XLogRecordRestoreFPWsforTOAST(pg_attributeDesc *allDesc,XLogReaderState *rec
 						  parray *Tx_parray,char tabname[50],FILE *bootFile)
 {
 	int			block_id;
-	XLogRecPtr	xl_prev = XLogRecGetPrev(record);
 	TransactionId currentTx = XLogRecGetXid(record);
 	RmgrId rmid = XLogRecGetRmid(record);
 	uint8		info = XLogRecGetInfo(record) & ~XLR_INFO_MASK;
@@ -3113,13 +3796,13 @@ int XLogRecordRestoreFPWsforTOAST(pg_attributeDesc *allDesc,XLogReaderState *rec
 				// 			LSN_FORMAT_ARGS(record->ReadRecPtr),
 				#endif
 
-				if( rnode.relNode != atoi(targetToastfile) && rnode.relNode != atoi(targetOldToastfile))
+				if( rnode.relNode != targetToastfileOid && rnode.relNode != targetOldToastfileOid)
 					return CONTINUE_RET;
 
 				if(fork != MAIN_FORKNUM)
 					return CONTINUE_RET;
 
-				if(	lsnIsReached(record->ReadRecPtr,xl_prev,elem->endLSNforTOAST) )
+				if(	lsnIsReached(record->ReadRecPtr,elem->endLSNforTOAST) )
 					return BREAK_RET;
 
 				if ( XLogRecHasBlockImage(record, block_id) )
@@ -3151,13 +3834,13 @@ int XLogRecordRestoreFPWsforTOAST(pg_attributeDesc *allDesc,XLogReaderState *rec
 			// 		LSN_FORMAT_ARGS(record->ReadRecPtr),
 			#endif
 
-			if( rnode.relNode != atoi(targetToastfile) && rnode.relNode != atoi(targetOldToastfile))
+			if( rnode.relNode != targetToastfileOid && rnode.relNode != targetOldToastfileOid)
 				return CONTINUE_RET;
 
 			if(fork != MAIN_FORKNUM)
 				return CONTINUE_RET;
 
-			if(	lsnIsReached(record->ReadRecPtr,xl_prev,elem->endLSNforTOAST) )
+			if(	lsnIsReached(record->ReadRecPtr,elem->endLSNforTOAST) )
 				return BREAK_RET;
 
 			if ( XLogRecHasBlockImage(record, 0) )
@@ -3207,13 +3890,13 @@ int XLogRecordRestoreFPWsforTOAST(pg_attributeDesc *allDesc,XLogReaderState *rec
 			}
 			#endif
 
-			if( rnode.relNode != atoi(targetToastfile) && rnode.relNode != atoi(targetOldToastfile))
+			if( rnode.relNode != targetToastfileOid && rnode.relNode != targetOldToastfileOid)
 				return CONTINUE_RET;
 
 			if(fork != MAIN_FORKNUM)
 				return CONTINUE_RET;
 
-			if(	lsnIsReached(record->ReadRecPtr,xl_prev,elem->endLSNforTOAST) )
+			if(	lsnIsReached(record->ReadRecPtr,elem->endLSNforTOAST) )
 				return BREAK_RET;
 
 			if ( XLogRecHasBlockImage(record, block_id) )
@@ -3289,13 +3972,13 @@ int XLogRecordRestoreFPWsforTOAST(pg_attributeDesc *allDesc,XLogReaderState *rec
 
 		#endif
 
-		if( rnode.relNode != atoi(targetToastfile) && rnode.relNode != atoi(targetOldToastfile))
+		if( rnode.relNode != targetToastfileOid && rnode.relNode != targetOldToastfileOid)
 			return CONTINUE_RET;
 
 		if(fork != MAIN_FORKNUM)
 			return CONTINUE_RET;
 
-		if(	lsnIsReached(record->ReadRecPtr,xl_prev,elem->endLSNforTOAST) )
+		if(	lsnIsReached(record->ReadRecPtr,elem->endLSNforTOAST) )
 			return BREAK_RET;
 
 		if ( XLogRecHasBlockImage(record, 0) )
@@ -3342,9 +4025,10 @@ void xact_desc_pg_drop(TimestampTz *TimeFromRecord,Oid *datafileOid,Oid *toastOi
 	uint8		info = XLogRecGetInfo(record) & XLOG_XACT_OPMASK;
 	int			block_id = 0;
 	BlockNumber blk;
-	RelFileNode rnode;
+	RelFileNode rnode = {0};
 	ForkNumber	fork;
-	XlogRecGetBlkInfo(record,block_id, &blk,&rnode, &fork);
+	if (XLogRecHasBlockRef(record, block_id))
+		XlogRecGetBlkInfo(record,block_id, &blk,&rnode, &fork);
 	TransactionId currentTx = XLogRecGetXid(record);
 
 	bool writable = 0;
@@ -3673,104 +4357,141 @@ int XLogRecordRedoDropFPW(systemDropContext *sdc,XLogReaderState *record)
 	return CONTINUE_RET;
 }
 
-void XLogScanRecordForDisplay(XLogDumpConfig *config, XLogReaderState *record,parray *TxTime_parray)
+/**
+ * walScanDelHit - Account a DELETE/UPDATE record of a target table
+ *
+ * @tx:  Transaction id of the record
+ * @lsn: Start LSN of the record
+ *
+ * Opens the transaction's DELstruct on first sight and counts the row.
+ * currWalName must name the segment the record was read from.
+ */
+static void walScanDelHit(TransactionId tx,XLogRecPtr lsn)
+{
+	int txFound = harray_search(delElems,HARRAYDEL,tx);
+	if(txFound){
+		DELstruct *elem = harray_get(delElems,HARRAYDEL,tx);
+		elem->delCount++;
+	}
+	else{
+		DELstruct *elem = (DELstruct*)malloc(sizeof(DELstruct));
+		elem->startLSN = lsn;
+		elem->startLSNforTOAST = lsn;
+		strcpy(elem->startwal,currWalName);
+		elem->tx=tx;
+		elem->delCount=1;
+		if(elemforTime->startLSN == InvalidXLogRecPtr){
+			elemforTime->startLSN = elem->startLSN;
+			elemforTime->startLSNforTOAST = elem->startLSNforTOAST;
+			strcpy(elemforTime->startwal,elem->startwal);
+		}
+		harray_append(delElems,HARRAYDEL,elem,tx);
+	}
+}
+
+/**
+ * walScanCommit - Close a transaction seen by walScanDelHit
+ *
+ * @tx:   Transaction id of the commit record
+ * @time: Commit timestamp
+ * @lsn:  Start LSN of the commit record
+ *
+ * Commits of transactions that never touched the target table are ignored.
+ */
+static void walScanCommit(TransactionId tx,TimestampTz time,XLogRecPtr lsn)
+{
+	int txFound = harray_search(delElems,HARRAYDEL,tx);
+	if(!txFound)
+		return;
+
+	parray_append(Txs,(void *)(intptr_t)tx);
+	DELstruct *elem = harray_get(delElems,HARRAYDEL,tx);
+	elem->endLSN = lsn;
+	elem->endLSNforTOAST = lsn;
+	strcpy(elem->endwal,currWalName);
+	elem->txtime = time;
+
+	elemforTime->endLSN = elem->endLSN;
+	elemforTime->endLSNforTOAST = elem->endLSNforTOAST;
+	strcpy(elemforTime->endwal,elem->endwal);
+	elemforTime->txtime = elem->txtime;
+	elemforTime->delCount+=elem->delCount;
+}
+
+/**
+ * walScanRecordWanted - Cheap test whether the scan acts on a record
+ *
+ * @record: XLog reader state
+ * @rmid:   Resource manager of the record
+ *
+ * Looks only at the rmgr, the info bits and, for DROP scans, the
+ * relfilenode of block 0, so most records are dropped before anything
+ * is decoded.
+ *
+ * Returns: 1 if XLogScanRecordForDisplay has to look at the record
+ */
+static inline int walScanRecordWanted(XLogReaderState *record,RmgrId rmid)
+{
+	uint8		info = XLogRecGetInfo(record) & ~XLR_INFO_MASK;
+
+	if (rmid == TRANSACTION_redo){
+		uint8 op = XLogRecGetInfo(record) & XLOG_XACT_OPMASK;
+		return op == XLOG_XACT_COMMIT || op == XLOG_XACT_COMMIT_PREPARED;
+	}
+	if (delOrDrop == DROP){
+		BlockNumber blk;
+		RelFileNode rnode;
+		ForkNumber	fork;
+		if (!XLogRecHasBlockRef(record, 0))
+			return 0;
+		XlogRecGetBlkInfo(record, 0, &blk, &rnode, &fork);
+		return rnode.relNode == 1259 || rnode.relNode == 1249;
+	}
+	if (rmid != HEAP_redo)
+		return 0;
+	if (resTyp_there == DELETEtyp)
+		return info == XLOG_HEAP_DELETE;
+	if (resTyp_there == UPDATEtyp)
+		return isUpdate(info);
+	return 0;
+}
+
+void XLogScanRecordForDisplay(XLogDumpConfig *config, XLogReaderState *record,parray *TxTime_parray)
 {
-	const char *id;
 	RmgrId rmid = XLogRecGetRmid(record);
-	uint32		rec_len;
-	uint32		fpi_len;
-	RelFileNode rnode;
-	ForkNumber	forknum;
-	BlockNumber blk;
-	int			block_id=0;
-	uint8		info = XLogRecGetInfo(record);
-	XLogRecPtr	xl_prev = XLogRecGetPrev(record);
-	StringInfoData s;
+	TimestampTz TimeFromRecord = 0;
+	Oid datafileOid = 0;
+	Oid toastOid = 0;
 
-	XLogDumpRecordLen(record, &rec_len, &fpi_len);
-	#if PG_VERSION_NUM > 14
-	(void) XLogRecGetBlockTagExtended(record, block_id,&rnode, &forknum, &blk, NULL);
-	#else
-	XLogRecGetBlockTag(record, block_id,&rnode, &forknum, &blk);
-	#endif
-	sprintf(lsn,"%X/%08X",LSN_FORMAT_ARGS(record->ReadRecPtr));
+	if (!walScanRecordWanted(record, rmid))
+		return;
 
 	#if LSNDSP == 1
-	// XLogRecGetTotalLen(record),
-	// 		XLogRecGetXid(record),
-	// 		LSN_FORMAT_ARGS(record->ReadRecPtr),
+	sprintf(lsn,"%X/%08X",LSN_FORMAT_ARGS(record->ReadRecPtr));
 	if(strcmp(lsn,LSNSTR) == 0){
 		printf(" ");
 	}
 	#endif
 
-	char LSN[50];
-	sprintf(LSN,"%X/%08X",LSN_FORMAT_ARGS(record->ReadRecPtr),LSN_FORMAT_ARGS(xl_prev));
-
 	TransactionId tx = XLogRecGetXid(record);
 
-	Oid *datafileOid=NULL;
-	Oid *toastOid=NULL;
-	TimestampTz *TimeFromRecord = NULL;
-
-	TimeFromRecord= (TimestampTz *)malloc(sizeof(TimestampTz));
-	datafileOid = (Oid *)malloc(sizeof(Oid));
-	toastOid = (Oid *)malloc(sizeof(Oid));
-	memset(datafileOid,0,sizeof(Oid));
-	memset(TimeFromRecord,0,sizeof(TimestampTz));
-	memset(toastOid,0,sizeof(Oid));
-
 	if (delOrDrop == DROP){
-		xact_desc_pg_drop(TimeFromRecord,datafileOid,toastOid,record,rmid,TxTime_parray);
+		xact_desc_pg_drop(&TimeFromRecord,&datafileOid,&toastOid,record,rmid,TxTime_parray);
 	}
-	else{
-		if(rmid == TRANSACTION_redo || rmid == HEAP_redo){
-			if (delOrDrop == DEL && resTyp_there == DELETEtyp){
-				xact_desc_pg_del(TimeFromRecord,datafileOid,record,rmid);
-			}
-			else if (delOrDrop == DEL && resTyp_there == UPDATEtyp){
-				xact_desc_pg_upd(TimeFromRecord,datafileOid,record,rmid);
-			}
-
-			if(delOrDrop == DEL && ( *datafileOid == atoi(targetDatafile) || *datafileOid == atoi(targetOldDatafile))){
+	else if (delOrDrop == DEL){
+		if (resTyp_there == DELETEtyp){
+			xact_desc_pg_del(&TimeFromRecord,&datafileOid,record,rmid);
+		}
+		else if (resTyp_there == UPDATEtyp){
+			xact_desc_pg_upd(&TimeFromRecord,&datafileOid,record,rmid);
+		}
 
-					int txFound = harray_search(delElems,HARRAYDEL,tx);
-				if(txFound){
-					DELstruct *elem = harray_get(delElems,HARRAYDEL,tx);
-					elem->delCount++;
-				}
-				else{
-					DELstruct *elem = (DELstruct*)malloc(sizeof(DELstruct));
-					strcpy(elem->startLSN,LSN);
-					strcpy(elem->startLSNforTOAST,LSN);
-					strcpy(elem->startwal,currWalName);
-					elem->tx=tx;
-					elem->delCount=1;
-					if(strcmp(elemforTime->startLSN,"") == 0){
-						strcpy(elemforTime->startLSN,elem->startLSN);
-						strcpy(elemforTime->startLSNforTOAST,elem->startLSNforTOAST);
-						strcpy(elemforTime->startwal,elem->startwal);
-					}
-					harray_append(delElems,HARRAYDEL,elem,tx);
-				}
-			}
-			else if(delOrDrop == DEL && *TimeFromRecord != 0){
-				int txFound = harray_search(delElems,HARRAYDEL,tx);
-				if(txFound){
-					parray_append(Txs,(void *)(intptr_t)tx);
-					DELstruct *elem = harray_get(delElems,HARRAYDEL,tx);
-					strcpy(elem->endLSN,LSN);
-					strcpy(elem->endLSNforTOAST,LSN);
-					strcpy(elem->endwal,currWalName);
-					elem->txtime = *TimeFromRecord;
-
-					strcpy(elemforTime->endLSN,elem->endLSN);
-					strcpy(elemforTime->endLSNforTOAST,elem->endLSNforTOAST);
-					strcpy(elemforTime->endwal,elem->endwal);
-					elemforTime->txtime = elem->txtime;
-					elemforTime->delCount+=elem->delCount;
-				}
-			}
+		walTargetRel *hit = walTargetRelFind(datafileOid);
+		if(hit && !hit->isToast){
+			walScanDelHit(tx,record->ReadRecPtr);
+		}
+		else if(TimeFromRecord != 0){
+			walScanCommit(tx,TimeFromRecord,record->ReadRecPtr);
 		}
 	}
 }
@@ -4470,6 +5191,9 @@ restart:
 		state->DecodeRecPtr = RecPtr;
 	}
 
+	if (state->verify_crc && !ValidXLogRecord(state, record, RecPtr))
+		goto err;
+
 	/*
 	 * Special processing if it's an XLOG SWITCH record
 	 */
@@ -5014,6 +5738,9 @@ restart:
 		state->ReadRecPtr = RecPtr;
 	}
 
+	if (state->verify_crc && !ValidXLogRecord(state, record, RecPtr))
+		goto err;
+
 	/*
 	 * Special processing if it's an XLOG SWITCH record
 	 */
@@ -5162,153 +5889,1443 @@ err:
 	return InvalidXLogRecPtr;
 }
 
-parray *pgGetTxforArch(parray **TxTime_parray_ptr,
-				TimestampTz *SrtTime,TimestampTz *EndTime,
-				WALFILE *archDirFiles,int archWaldirNum,
-				char *start_fname_pg,char *end_fname_pg,
-				char waldir[1024],int flag,
-				char datafile[50],char oldDatafile[50],
-				char toastfile[50],char oldToastfile[50],
-				char tabname[50],parray *Tx_parray,
-				int FPICntClean,decodeFunc *array2Process,
-				TABstruct *taboid)
-{
-	int nAttr;
-
-	if(flag != DROP){
-		nAttr = atoi(taboid->nattr);
-		allDesc = (pg_attributeDesc*)malloc(nAttr*sizeof(pg_attributeDesc));
-		dropExist2 = getPgAttrDesc(taboid,allDesc);
-		initToastId(taboid->toastnode);
-		memset(FPWSegmentPath,0,100);
-		if(strcmp(datafile,"0") == 0 && strcmp(oldDatafile,"0") == 0){
-			isToastRound = 1;
-			strcpy(FPWSegmentPath,"restore/datafile");
-		}
-		else{
-			isToastRound = 0;
-			strcpy(FPWSegmentPath,"restore/.fpw");
-		}
-	}
-	else{
-		sdcPgClass = initSystemDropContext("pg_class");
-		sdcPgAttr = initSystemDropContext("pg_attribute");
-		isToastRound = 0;
-		strcpy(FPWSegmentPath,"restore/.fpw");
-	}
+/*
+ * WAL summaries: one sidecar file per archived segment under
+ * WAL_SUMMARY_DIR, named after the segment. It lists the relfilenodes
+ * the segment's records touch and its commits and aborts, so a later
+ * scan or restore can step over segments that never touch its table.
+ * A summary covers the records that start in the segment and is only
+ * trusted while the segment keeps the size and mtime it was built from.
+ */
+#define WAL_SUMMARY_DIR ".walsum"
+#define WAL_SUMMARY_MAGIC 0x4D535750
+#define WAL_SUMMARY_VERSION 1
 
-	FPIcount = 0;
-	FPIErrcount = 0;
-	FPIUpdateSame = 0;
-	char bootfilename[500]={0};
-	determineTimeMode(SrtTime,EndTime);
+#define WALSUM_XACT_ABORT 0x01
 
-	char suffix[10];
-	char filetyp[10];
-	memset(suffix,0,10);
-	memset(filetyp,0,10);
-	if(ExportMode_there == CSVform && resTyp_there == DELETEtyp)
-		strcpy(suffix,".csv");
-	else if((ExportMode_there == SQLform && resTyp_there == DELETEtyp) || resTyp_there == UPDATEtyp)
-		strcpy(suffix,".sql");
+typedef struct walSummaryHeader
+{
+	uint32 magic;
+	uint32 version;
+	int64 segSize;
+	int64 segMtime;
+	XLogRecPtr firstLsn;
+	XLogRecPtr lastLsn;
+	uint32 nRecords;
+	uint32 nRels;
+	uint32 nXacts;
+	uint32 pad;
+} walSummaryHeader;
+
+/* Per relfilenode record counts, sorted by relfilenode on disk */
+typedef struct walSummaryRel
+{
+	Oid relfilenode;
+	uint32 nRecords;	/* records with a block reference to it */
+	uint32 nDelete;		/* heap deletes, as xact_desc_pg_del sees them */
+	uint32 nUpdate;		/* heap updates, as xact_desc_pg_upd sees them */
+} walSummaryRel;
+
+/* A commit or abort, in WAL order */
+typedef struct walSummaryXact
+{
+	XLogRecPtr lsn;
+	TimestampTz time;
+	TransactionId xid;
+	uint8 flags;		/* WALSUM_XACT_ABORT */
+	uint8 segDelta;		/* segment the record ends in, minus its own */
+	uint16 pad;
+} walSummaryXact;
+
+typedef struct walSummary
+{
+	walSummaryHeader hdr;
+	walSummaryRel *rels;
+	walSummaryXact *xacts;
+} walSummary;
 
-	if(resTyp_there == DELETEtyp)
-		strcpy(filetyp,"del");
-	else if(resTyp_there == UPDATEtyp)
-		strcpy(filetyp,"upd");
+/* Summary under construction while a segment is read */
+typedef struct walSummaryBuild
+{
+	XLogSegNo segno;
+	TimeLineID tli;
+	int valid;			/* reading began at the segment's first record */
+	walSummaryHeader hdr;
+	walSummaryRel *rels;	/* open addressing on relfilenode, 0 is empty */
+	uint32 capRels;
+	walSummaryXact *xacts;
+	uint32 capXacts;
+} walSummaryBuild;
 
-	FILE *bootFile;
-	if(flag == DELRESTORE && restoreMode_there == TxRestore && isToastRound == 0){
-		DELstruct *elem = parray_get(Tx_parray,0);
-		sprintf(bootfilename,"restore/public/%s_%d%s",tabname,elem->tx,suffix);
-		bootFile = fopen(bootfilename,"w");
-        #ifdef CN
-        char *item="▌ 事务号恢复模式";
-        #else
-        char *item="▌ Tx Restore Mode [Displayed by Tx groups]";
-        #endif
-        infoRestoreMode(item);
-	}
-	else if(flag == DELRESTORE && restoreMode_there == periodRestore && isToastRound == 0){
-		char *srttimeStr=(char *)timestamptz_to_str(*SrtTime);
-		char *endtimeStr=(char *)timestamptz_to_str(*EndTime);
-		sprintf(bootfilename,"restore/public/%s_%s_%s_%s%s",tabname,filetyp,srttimeStr,endtimeStr,suffix);
-		bootFile = fopen(bootfilename,"w");
-        #ifdef CN
-        char *item="▌ 时间区间恢复模式";
-        #else
-        char *item="▌ Time Range Restore Mode [Displayed all within Time Range]";
-        #endif
-        infoRestoreMode(item);
-	}
+/**
+ * walSummarySegStat - Size and mtime of an archived segment
+ *
+ * @waldir: Archive directory
+ * @fname:  Segment file name
+ * @size:   Output size
+ * @mtime:  Output modification time
+ *
+ * Returns: SUCCESS_RET, or FAILURE_RET if the segment cannot be stat'ed
+ */
+static int walSummarySegStat(const char *waldir,const char *fname,int64 *size,int64 *mtime)
+{
+	char path[MAXPGPATH];
+	struct stat st;
+
+	if (walSegmentResolve(waldir, fname, path) < 0 || stat(path, &st) != 0)
+		return FAILURE_RET;
+	*size = st.st_size;
+	*mtime = st.st_mtime;
+	return SUCCESS_RET;
+}
 
-	char *FPIPath = "restore/datafile";
-	memset(targetDatafile,0,50);
-	memset(targetOldDatafile,0,50);
-	memset(targetToastfile,0,50);
-	memset(targetOldToastfile,0,50);
+/**
+ * walSummaryLoad - Read the summary of a segment
+ *
+ * @waldir: Archive directory
+ * @fname:  Segment file name
+ * @sum:    Output summary, release with walSummaryFree
+ *
+ * Returns: SUCCESS_RET, or FAILURE_RET when there is no summary or it
+ * was built from a different copy of the segment
+ */
+static int walSummaryLoad(const char *waldir,const char *fname,walSummary *sum)
+{
+	char path[MAXPGPATH];
+	int64 size, mtime;
+	FILE *fp;
+
+	memset(sum, 0, sizeof(walSummary));
+	if (!walSummarySegStat(waldir, fname, &size, &mtime))
+		return FAILURE_RET;
+
+	snprintf(path, MAXPGPATH, "%s/%s", WAL_SUMMARY_DIR, fname);
+	fp = fopen(path, "rb");
+	if (!fp)
+		return FAILURE_RET;
+
+	if (fread(&sum->hdr, sizeof(walSummaryHeader), 1, fp) != 1 ||
+		sum->hdr.magic != WAL_SUMMARY_MAGIC ||
+		sum->hdr.version != WAL_SUMMARY_VERSION ||
+		sum->hdr.segSize != size || sum->hdr.segMtime != mtime){
+		fclose(fp);
+		return FAILURE_RET;
+	}
+
+	sum->rels = malloc(Max(sum->hdr.nRels, 1) * sizeof(walSummaryRel));
+	sum->xacts = malloc(Max(sum->hdr.nXacts, 1) * sizeof(walSummaryXact));
+	if (!sum->rels || !sum->xacts ||
+		fread(sum->rels, sizeof(walSummaryRel), sum->hdr.nRels, fp) != sum->hdr.nRels ||
+		fread(sum->xacts, sizeof(walSummaryXact), sum->hdr.nXacts, fp) != sum->hdr.nXacts){
+		fclose(fp);
+		free(sum->rels);
+		free(sum->xacts);
+		memset(sum, 0, sizeof(walSummary));
+		return FAILURE_RET;
+	}
+	fclose(fp);
+	return SUCCESS_RET;
+}
 
-	strcpy(targetDatafile,datafile);
-	strcpy(targetOldDatafile,oldDatafile);
-	strcpy(targetToastfile,toastfile);
-	strcpy(targetOldToastfile,oldToastfile);
+static void walSummaryFree(walSummary *sum)
+{
+	free(sum->rels);
+	free(sum->xacts);
+	sum->rels = NULL;
+	sum->xacts = NULL;
+}
 
-	delOrDrop = flag;
-    earliestTimeLocal_pg = NULL;
+/**
+ * walSummaryRelFind - Look up a relfilenode in a loaded summary
+ *
+ * @sum:         Summary
+ * @relfilenode: Relfilenode to find
+ *
+ * Returns: Its counts, or NULL if the segment never touches it
+ */
+static walSummaryRel *walSummaryRelFind(walSummary *sum,Oid relfilenode)
+{
+	uint32 lo = 0, hi = sum->hdr.nRels;
+	while (lo < hi)
+	{
+		uint32 mid = lo + (hi - lo) / 2;
+		if (sum->rels[mid].relfilenode < relfilenode)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo < sum->hdr.nRels && sum->rels[lo].relfilenode == relfilenode)
+		return &sum->rels[lo];
+	return NULL;
+}
 
-    *TxTime_parray_ptr = parray_new();
-    parray *TxTime_parray = *TxTime_parray_ptr;
+/**
+ * walSummaryBuildReset - Start summarizing a segment
+ *
+ * @b:     Builder
+ * @segno: Segment the next records start in
+ * @tli:   Timeline of the segment
+ * @valid: Whether the first record of the segment is the next one read
+ */
+static void walSummaryBuildReset(walSummaryBuild *b,XLogSegNo segno,TimeLineID tli,int valid)
+{
+	if (b->rels)
+		memset(b->rels, 0, b->capRels * sizeof(walSummaryRel));
+	memset(&b->hdr, 0, sizeof(walSummaryHeader));
+	b->segno = segno;
+	b->tli = tli;
+	b->valid = valid;
+}
 
-	elemforTime = (DELstruct*)malloc(sizeof(DELstruct));
-	elemforTimeINIT(elemforTime);
+static void walSummaryBuildFree(walSummaryBuild *b)
+{
+	free(b->rels);
+	free(b->xacts);
+	memset(b, 0, sizeof(walSummaryBuild));
+}
 
-	if(flag != DELRESTORE){
-		if(Txs && delElems){
-			parray_free(Txs);
-			harray_free(delElems);
-			Txs=NULL;
-			delElems=NULL;
+/**
+ * walSummaryBuildRel - Find or insert a relfilenode in a builder
+ *
+ * @b:           Builder
+ * @relfilenode: Relfilenode, not 0
+ *
+ * Returns: Its counters, or NULL when out of memory
+ */
+static walSummaryRel *walSummaryBuildRel(walSummaryBuild *b,Oid relfilenode)
+{
+	if ((b->hdr.nRels + 1) * 2 > b->capRels)
+	{
+		uint32 cap = b->capRels ? b->capRels * 2 : 64;
+		walSummaryRel *rels = calloc(cap, sizeof(walSummaryRel));
+		if (!rels)
+			return NULL;
+		for (uint32 i = 0; i < b->capRels; i++)
+		{
+			if (b->rels[i].relfilenode == 0)
+				continue;
+			uint32 h = (b->rels[i].relfilenode * 2654435761U) & (cap - 1);
+			while (rels[h].relfilenode != 0)
+				h = (h + 1) & (cap - 1);
+			rels[h] = b->rels[i];
 		}
-
-		Txs = parray_new();
-		delElems = harray_new(HARRAYDEL);
+		free(b->rels);
+		b->rels = rels;
+		b->capRels = cap;
 	}
-	if(LsnBlkInfos){
-		parray_free(LsnBlkInfos);
-		LsnBlkInfos = NULL;
+
+	uint32 h = (relfilenode * 2654435761U) & (b->capRels - 1);
+	while (b->rels[h].relfilenode != 0 && b->rels[h].relfilenode != relfilenode)
+		h = (h + 1) & (b->capRels - 1);
+	if (b->rels[h].relfilenode == 0){
+		b->rels[h].relfilenode = relfilenode;
+		b->hdr.nRels++;
 	}
-	LsnBlkInfos = parray_new();
+	return &b->rels[h];
+}
 
-	XLogReaderState *xlogreader_state;
-	XLogDumpPrivate private;
-	char	   *directory = NULL;
+/**
+ * walSummaryBuildAdd - Account one record starting in the builder's segment
+ *
+ * @b:      Builder
+ * @record: Reader positioned on the record
+ *
+ * Returns: SUCCESS_RET, or FAILURE_RET when out of memory
+ */
+static int walSummaryBuildAdd(walSummaryBuild *b,XLogReaderState *record)
+{
+	RmgrId rmid = XLogRecGetRmid(record);
 
-	int			fd;
-	XLogSegNo	segno;
-	char	   *errormsg;
+	if (b->hdr.nRecords == 0)
+		b->hdr.firstLsn = record->ReadRecPtr;
+	b->hdr.lastLsn = record->ReadRecPtr;
+	b->hdr.nRecords++;
 
-	XLogRecord *record;
-	XLogRecPtr	first_record;
+	for (int block_id = 0; block_id <= XLogRecMaxBlockId(record); block_id++)
+	{
+		RelFileNode rnode;
+		ForkNumber	forknum;
+		BlockNumber blk;
 
-	XLogDumpConfig config;
+		if (!XLogRecHasBlockRef(record, block_id))
+			continue;
+		#if PG_VERSION_NUM > 14
+		(void) XLogRecGetBlockTagExtended(record, block_id,&rnode, &forknum, &blk, NULL);
+		#else
+		XLogRecGetBlockTag(record, block_id,&rnode, &forknum, &blk);
+		#endif
+		if (rnode.relNode == 0)
+			continue;
+		walSummaryRel *rel = walSummaryBuildRel(b, rnode.relNode);
+		if (!rel)
+			return FAILURE_RET;
+		rel->nRecords++;
+	}
+
+	if (rmid == HEAP_redo){
+		TimestampTz time = 0;
+		Oid delOid = 0, updOid = 0;
+		xact_desc_pg_del(&time,&delOid,record,rmid);
+		xact_desc_pg_upd(&time,&updOid,record,rmid);
+		if (delOid != 0){
+			walSummaryRel *rel = walSummaryBuildRel(b, delOid);
+			if (!rel)
+				return FAILURE_RET;
+			rel->nDelete++;
+		}
+		if (updOid != 0){
+			walSummaryRel *rel = walSummaryBuildRel(b, updOid);
+			if (!rel)
+				return FAILURE_RET;
+			rel->nUpdate++;
+		}
+	}
+	else if (rmid == TRANSACTION_redo){
+		uint8 info = XLogRecGetInfo(record) & XLOG_XACT_OPMASK;
+		uint8 flags;
+		TimestampTz time;
 
-	memset(&private, 0, sizeof(XLogDumpPrivate));
-	private.timeline = 1;
-	private.startptr = InvalidXLogRecPtr;
-	private.endptr = InvalidXLogRecPtr;
-	private.endptr_reached = false;
+		if (info == XLOG_XACT_COMMIT || info == XLOG_XACT_COMMIT_PREPARED){
+			time = ((xl_xact_commit *) XLogRecGetData(record))->xact_time;
+			flags = 0;
+		}
+		else if (info == XLOG_XACT_ABORT || info == XLOG_XACT_ABORT_PREPARED){
+			time = ((xl_xact_abort *) XLogRecGetData(record))->xact_time;
+			flags = WALSUM_XACT_ABORT;
+		}
+		else
+			return SUCCESS_RET;
 
-	PGAlignedXLogBlock buf;
-	int			r;
+		if (b->hdr.nXacts == b->capXacts)
+		{
+			uint32 cap = b->capXacts ? b->capXacts * 2 : 256;
+			walSummaryXact *xacts = realloc(b->xacts, cap * sizeof(walSummaryXact));
+			if (!xacts)
+				return FAILURE_RET;
+			b->xacts = xacts;
+			b->capXacts = cap;
+		}
+		walSummaryXact *x = &b->xacts[b->hdr.nXacts++];
+		x->lsn = record->ReadRecPtr;
+		x->time = time;
+		x->xid = XLogRecGetXid(record);
+		x->flags = flags;
+		x->segDelta = (uint8)(record->seg.ws_segno - b->segno);
+		x->pad = 0;
+	}
+	return SUCCESS_RET;
+}
 
-	fd = open_file_in_directory(waldir, start_fname_pg);
-	XLogLongPageHeader longhdr = NULL;
-	char		fpath[MAXPGPATH];
+static int walSummaryRelCmp(const void *a,const void *b)
+{
+	Oid x = ((const walSummaryRel *) a)->relfilenode;
+	Oid y = ((const walSummaryRel *) b)->relfilenode;
+	return (x > y) - (x < y);
+}
 
-	snprintf(fpath, MAXPGPATH, "%s/%s", waldir, start_fname_pg);
-	FILE *fp = fopen(fpath,"rb");
-	r = fread(buf.data,1,BLCKSZ,fp);
-	if (r == XLOG_BLCKSZ)
+/**
+ * walSummaryBuildWrite - Store the summary of a fully read segment
+ *
+ * @b:      Builder, whose segment's last record has been read
+ * @waldir: Archive directory
+ *
+ * Writes to a temporary name and renames it into place so concurrent
+ * scans never see a partial file. Failures only cost the summary.
+ */
+static void walSummaryBuildWrite(walSummaryBuild *b,const char *waldir)
+{
+	char fname[MAXPGPATH];
+	char path[MAXPGPATH];
+	char tmppath[MAXPGPATH];
+	FILE *fp;
+	uint32 n = 0;
+
+	if (!b->valid || b->hdr.nRecords == 0)
+		return;
+
+	XLogFileName(fname, b->tli, b->segno, WalSegSz);
+	if (!walSummarySegStat(waldir, fname, &b->hdr.segSize, &b->hdr.segMtime))
+		return;
+	b->hdr.magic = WAL_SUMMARY_MAGIC;
+	b->hdr.version = WAL_SUMMARY_VERSION;
+
+	for (uint32 i = 0; i < b->capRels; i++)
+		if (b->rels[i].relfilenode != 0)
+			b->rels[n++] = b->rels[i];
+	qsort(b->rels, n, sizeof(walSummaryRel), walSummaryRelCmp);
+
+	createDir(WAL_SUMMARY_DIR);
+	snprintf(path, MAXPGPATH, "%s/%s", WAL_SUMMARY_DIR, fname);
+	snprintf(tmppath, MAXPGPATH, "%s.%d.%lx.tmp", path, (int) getpid(), (unsigned long) pthread_self());
+	fp = fopen(tmppath, "wb");
+	if (fp){
+		int ok = fwrite(&b->hdr, sizeof(walSummaryHeader), 1, fp) == 1 &&
+				 fwrite(b->rels, sizeof(walSummaryRel), n, fp) == n &&
+				 fwrite(b->xacts, sizeof(walSummaryXact), b->hdr.nXacts, fp) == b->hdr.nXacts;
+		if (fclose(fp) == 0 && ok)
+			rename(tmppath, path);
+		else
+			unlink(tmppath);
+	}
+	/* the table was compacted in place */
+	memset(b->rels, 0, b->capRels * sizeof(walSummaryRel));
+	b->hdr.nRels = 0;
+}
+
+/**
+ * walSummaryNextFile - First archived segment after a given one
+ *
+ * @files: Archived segments, sorted
+ * @n:     Number of segments
+ * @fname: Segment name
+ *
+ * Returns: Index of the first segment sorting after fname, or n
+ */
+static int walSummaryNextFile(WALFILE *files,int n,const char *fname)
+{
+	int lo = 0, hi = n;
+	while (lo < hi)
+	{
+		int mid = lo + (hi - lo) / 2;
+		if (strcmp(files[mid].walnames + 8, fname + 8) <= 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/**
+ * walSummaryRestoreSkip - Step a restore over a segment by its summary
+ *
+ * @waldir:  Archive directory
+ * @fname:   Segment the restore just entered
+ * @SrtTime: Start time for filtering
+ * @EndTime: End time for filtering
+ *
+ * A segment with no record on the target data or TOAST files leaves
+ * the restore untouched apart from the time filter, which is fed the
+ * segment's commits instead.
+ *
+ * Returns: 1 when the segment can be skipped, 0 when it has to be read,
+ * -1 when the time filter ends the restore inside it
+ */
+static int walSummaryRestoreSkip(const char *waldir,const char *fname,
+								 TimestampTz *SrtTime,TimestampTz *EndTime)
+{
+	walSummary sum;
+	int ret = 1;
+
+	if (!walSummaryLoad(waldir, fname, &sum))
+		return 0;
+	for (int i = 0; i < nTargetRels; i++)
+		if (walSummaryRelFind(&sum, targetRels[i].relfilenode)){
+			walSummaryFree(&sum);
+			return 0;
+		}
+
+	for (uint32 i = 0; i < sum.hdr.nXacts; i++)
+		if (!(sum.xacts[i].flags & WALSUM_XACT_ABORT) &&
+			XlogGiveMeTimeValue(sum.xacts[i].time,SrtTime,EndTime) == -1){
+			ret = -1;
+			break;
+		}
+	walSummaryFree(&sum);
+	return ret;
+}
+
+#define WALSCAN_EVENT_DEL    0
+#define WALSCAN_EVENT_COMMIT 1
+
+/* A record a scan worker kept, replayed in LSN order by walScanReplay */
+typedef struct walScanEvent
+{
+	XLogRecPtr lsn;
+	XLogSegNo segno;	/* segment the reader had open, names currWalName */
+	TimestampTz time;
+	TransactionId tx;
+	TimeLineID tli;
+	int kind;
+} walScanEvent;
+
+/*
+ * One thread of a parallel scan. It starts records in files [first,last)
+ * and reads on past last to finish a record that straddles the boundary;
+ * the next worker's XLogFindNextRecord skips that continuation.
+ */
+typedef struct walScanWorker
+{
+	pthread_t thread;
+	int started;
+	WALFILE *files;
+	int first;
+	int last;
+	XLogRecPtr rangeEnd;
+	XLogRecPtr endptr;
+	char *waldir;
+	TimestampTz srtTime;
+	TimestampTz endTime;
+	int sawCommit;
+	int halted;
+	walScanEvent *events;
+	int nEvents;
+	int capEvents;
+} walScanWorker;
+
+/* Records starting past this LSN can never be replayed */
+static XLogRecPtr walScanStopPtr;
+
+/**
+ * walScanStopAt - Publish an LSN beyond which no worker needs to read
+ *
+ * @lsn: LSN at which the replay is known to stop
+ */
+static void walScanStopAt(XLogRecPtr lsn)
+{
+	XLogRecPtr cur = __atomic_load_n(&walScanStopPtr, __ATOMIC_ACQUIRE);
+	while (lsn < cur &&
+		   !__atomic_compare_exchange_n(&walScanStopPtr, &cur, lsn, false,
+										__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+		;
+}
+
+/**
+ * walScanAddEvent - Append a record to a worker's event list
+ *
+ * @w:     Scan worker
+ * @lsn:   Start LSN of the record
+ * @segno: Segment the reader had open after reading it
+ * @tli:   Timeline of that segment
+ * @kind:  WALSCAN_EVENT_DEL or WALSCAN_EVENT_COMMIT
+ * @tx:    Transaction id of the record
+ * @time:  Commit time, 0 for DEL events
+ *
+ * Returns: SUCCESS_RET, or FAILURE_RET when out of memory
+ */
+static int walScanAddEvent(walScanWorker *w,XLogRecPtr lsn,XLogSegNo segno,TimeLineID tli,
+						   int kind,TransactionId tx,TimestampTz time)
+{
+	if (w->nEvents == w->capEvents)
+	{
+		int cap = w->capEvents ? w->capEvents * 2 : 1024;
+		walScanEvent *grown = realloc(w->events, cap * sizeof(walScanEvent));
+		if (!grown)
+			return FAILURE_RET;
+		w->events = grown;
+		w->capEvents = cap;
+	}
+	walScanEvent *ev = &w->events[w->nEvents++];
+	ev->lsn = lsn;
+	ev->segno = segno;
+	ev->tli = tli;
+	ev->time = time;
+	ev->tx = tx;
+	ev->kind = kind;
+	return SUCCESS_RET;
+}
+
+/**
+ * walScanCommitStops - Whether the replay ends at a commit
+ *
+ * @w:    Scan worker
+ * @time: Commit time
+ *
+ * XlogGiveMeTimeValue ends the scan on a commit past a fixed end time,
+ * but in LatterHalf mode only once an earlier commit set the start.
+ *
+ * Returns: 1 when no later record can be replayed, else 0
+ */
+static int walScanCommitStops(walScanWorker *w,TimestampTz time)
+{
+	int stop = 0;
+	if (timeMode == FULL)
+		stop = time >= w->srtTime && time > w->endTime;
+	else if (timeMode == LatterHalf)
+		stop = w->sawCommit && time > w->endTime;
+	w->sawCommit = 1;
+	return stop;
+}
+
+/**
+ * walScanClassify - Keep the records XLogScanRecordForDisplay acts on
+ *
+ * @w:      Scan worker
+ * @record: Reader positioned on the record
+ *
+ * Keeps DELETE/UPDATE records of the target table and every commit,
+ * since the time filter and the transaction bookkeeping depend on
+ * what earlier ranges saw and can only be applied at replay.
+ *
+ * Returns: 1 when no later record can be replayed, -1 when out of
+ * memory, else 0
+ */
+static int walScanClassify(walScanWorker *w,XLogReaderState *record)
+{
+	RmgrId rmid = XLogRecGetRmid(record);
+	TransactionId tx = XLogRecGetXid(record);
+
+	if (rmid == HEAP_redo){
+		TimestampTz time = 0;
+		Oid datafileOid = 0;
+		if (resTyp_there == DELETEtyp)
+			xact_desc_pg_del(&time,&datafileOid,record,rmid);
+		else if (resTyp_there == UPDATEtyp)
+			xact_desc_pg_upd(&time,&datafileOid,record,rmid);
+		walTargetRel *hit = walTargetRelFind(datafileOid);
+		if (hit && !hit->isToast){
+			if (!walScanAddEvent(w,record->ReadRecPtr,record->seg.ws_segno,
+								 ((XLogDumpPrivate *) record->private_data)->timeline,
+								 WALSCAN_EVENT_DEL,tx,0))
+				return -1;
+		}
+		return 0;
+	}
+	if (rmid != TRANSACTION_redo)
+		return 0;
+
+	uint8 info = XLogRecGetInfo(record) & XLOG_XACT_OPMASK;
+	if (info != XLOG_XACT_COMMIT && info != XLOG_XACT_COMMIT_PREPARED)
+		return 0;
+
+	xl_xact_commit *xlrec = (xl_xact_commit *) XLogRecGetData(record);
+	TimestampTz time = xlrec->xact_time;
+	if (!walScanAddEvent(w,record->ReadRecPtr,record->seg.ws_segno,
+						 ((XLogDumpPrivate *) record->private_data)->timeline,
+						 WALSCAN_EVENT_COMMIT,tx,time))
+		return -1;
+	return walScanCommitStops(w,time);
+}
+
+/**
+ * walScanSummaryMisses - Whether a summary shows nothing for the worker
+ *
+ * @w:   Scan worker
+ * @sum: Summary of a segment
+ *
+ * Returns: 1 when the segment has no DELETE/UPDATE of a target table
+ */
+static int walScanSummaryMisses(walScanWorker *w,walSummary *sum)
+{
+	for (int i = 0; i < nTargetRels; i++)
+	{
+		walSummaryRel *rel;
+		if (targetRels[i].isToast)
+			continue;
+		rel = walSummaryRelFind(sum,targetRels[i].relfilenode);
+		if (!rel)
+			continue;
+		if (resTyp_there == DELETEtyp && rel->nDelete != 0)
+			return 0;
+		if (resTyp_there == UPDATEtyp && rel->nUpdate != 0)
+			return 0;
+	}
+	return 1;
+}
+
+/**
+ * walScanFromSummary - Take a segment's commits from its summary
+ *
+ * @w:   Scan worker
+ * @cur: Index of the segment in w->files
+ *
+ * Returns: 1 when the summary covered the segment, 0 when it has to be
+ * read, -1 when the scan ends inside it
+ */
+static int walScanFromSummary(walScanWorker *w,int cur)
+{
+	walSummary sum;
+	TimeLineID tli;
+	XLogSegNo segno;
+	int ret = 1;
+
+	if (!walSummaryLoad(w->waldir, w->files[cur].walnames, &sum))
+		return 0;
+	if (!walScanSummaryMisses(w, &sum)){
+		walSummaryFree(&sum);
+		return 0;
+	}
+
+	XLogFromFileName(w->files[cur].walnames, &tli, &segno, WalSegSz);
+	for (uint32 i = 0; i < sum.hdr.nXacts && ret == 1; i++)
+	{
+		walSummaryXact *x = &sum.xacts[i];
+		if (x->flags & WALSUM_XACT_ABORT)
+			continue;
+		if (x->lsn > __atomic_load_n(&walScanStopPtr, __ATOMIC_ACQUIRE))
+			ret = -1;
+		else if (!walScanAddEvent(w,x->lsn,segno + x->segDelta,tli,WALSCAN_EVENT_COMMIT,x->xid,x->time)){
+			printf("out of memory");
+			w->halted = 1;
+			ret = -1;
+		}
+		else if (walScanCommitStops(w,x->time)){
+			walScanStopAt(x->lsn);
+			ret = -1;
+		}
+	}
+	walSummaryFree(&sum);
+	return ret;
+}
+
+/**
+ * walScanSummaryUsable - Whether a segment can be taken from its summary
+ *
+ * @w:   Scan worker
+ * @cur: Index of the segment in w->files
+ */
+static int walScanSummaryUsable(walScanWorker *w,int cur)
+{
+	walSummary sum;
+	int usable;
+
+	if (!walSummaryLoad(w->waldir, w->files[cur].walnames, &sum))
+		return 0;
+	usable = walScanSummaryMisses(w, &sum);
+	walSummaryFree(&sum);
+	return usable;
+}
+
+/**
+ * walScanWorkerMain - Scan the files of one worker
+ *
+ * @arg: walScanWorker
+ *
+ * Segments whose summary shows no DELETE/UPDATE of the target only
+ * contribute their commits; the others are read, and summarized once
+ * read from their first record to the first record of the next.
+ * Follows pgGetTxforArch: a read failure in a missing segment resumes at
+ * the next archived file, one in a present segment ends the whole scan.
+ */
+static void *walScanWorkerMain(void *arg)
+{
+	walScanWorker *w = arg;
+	walSummaryBuild build;
+	XLogSegNo rangeEndSeg;
+	int cur = w->first;
+
+	memset(&build, 0, sizeof(walSummaryBuild));
+	XLByteToSeg(w->rangeEnd, rangeEndSeg, WalSegSz);
+
+	while (cur < w->last)
+	{
+		XLogDumpPrivate private;
+		XLogSegNo segno;
+		char *errormsg;
+		int next = w->last;
+
+		int fromSummary = walScanFromSummary(w, cur);
+		if (fromSummary == -1)
+			break;
+		if (fromSummary == 1){
+			cur++;
+			continue;
+		}
+
+		memset(&private, 0, sizeof(XLogDumpPrivate));
+		private.timeline = 1;
+		XLogFromFileName(w->files[cur].walnames, &private.timeline, &segno, WalSegSz);
+		XLogSegNoOffsetToRecPtr(segno, 0, WalSegSz, private.startptr);
+		private.endptr = w->endptr;
+
+		XLogReaderState *state =
+			XLogReaderAllocate(WalSegSz, w->waldir,
+							   XL_ROUTINE(.page_read = WALDumpReadPage,
+										  .segment_open = WALDumpOpenSegment,
+										  .segment_close = WALDumpCloseSegment),
+							   &private);
+		if (!state){
+			printf("out of memory");
+			w->halted = 1;
+			break;
+		}
+
+		if (XLogRecPtrIsInvalid(XLogFindNextRecord(state, private.startptr))){
+			XLogReaderFree(state);
+			cur++;
+			continue;
+		}
+		walSummaryBuildReset(&build, segno, private.timeline, 1);
+
+		for (;;)
+		{
+			XLogRecord *record = XLogReadRecord(state, &errormsg);
+			if (!record)
+			{
+				char fname[MAXPGPATH];
+				XLogFileName(fname, state->seg.ws_tli, state->seg.ws_segno, WalSegSz);
+				if (state->seg.ws_segno >= rangeEndSeg)
+					break;
+				if (walFileFindNext(w->files + w->first, w->last - w->first, fname) == -1){
+					w->halted = 1;
+					walScanStopAt(private.startptr);
+					break;
+				}
+				for (next = cur + 1; next < w->last; next++)
+					if (strcmp(w->files[next].walnames + 8, fname + 8) > 0)
+						break;
+				break;
+			}
+
+			XLogSegNo recSeg;
+			int newSeg = 0;
+			XLByteToSeg(state->ReadRecPtr, recSeg, WalSegSz);
+			if (recSeg != build.segno){
+				int contiguous = recSeg == build.segno + 1;
+				if (contiguous)
+					walSummaryBuildWrite(&build, w->waldir);
+				walSummaryBuildReset(&build, recSeg, private.timeline, contiguous);
+				newSeg = 1;
+			}
+
+			if (state->ReadRecPtr >= w->rangeEnd ||
+				state->ReadRecPtr > __atomic_load_n(&walScanStopPtr, __ATOMIC_ACQUIRE))
+				break;
+
+			if (newSeg){
+				char fname[MAXPGPATH];
+				XLogFileName(fname, private.timeline, recSeg, WalSegSz);
+				int idx = walSummaryNextFile(w->files, w->last, fname) - 1;
+				if (idx > cur && strcmp(w->files[idx].walnames + 8, fname + 8) == 0){
+					cur = idx;
+					if (walScanSummaryUsable(w, cur)){
+						next = cur;
+						break;
+					}
+				}
+			}
+
+			if (!walSummaryBuildAdd(&build, state))
+				build.valid = 0;
+
+			int stop = walScanClassify(w, state);
+			if (stop == -1){
+				printf("out of memory");
+				w->halted = 1;
+			}
+			if (stop){
+				walScanStopAt(state->ReadRecPtr);
+				break;
+			}
+		}
+		XLogReaderFree(state);
+		if (w->halted)
+			break;
+		cur = next;
+	}
+	walSummaryBuildFree(&build);
+	return NULL;
+}
+
+/**
+ * walScanReplay - Apply one worker's events to the scan results
+ *
+ * @w:       Scan worker, already joined
+ * @SrtTime: Start time for filtering
+ * @EndTime: End time for filtering
+ *
+ * Runs the same steps the serial loop runs per record, so Txs, delElems
+ * and elemforTime come out as they would from one reader.
+ *
+ * Returns: SUCCESS_RET to go on with the next worker, FAILURE_RET to stop
+ */
+static int walScanReplay(walScanWorker *w,TimestampTz *SrtTime,TimestampTz *EndTime)
+{
+	for (int i = 0; i < w->nEvents; i++)
+	{
+		walScanEvent *ev = &w->events[i];
+
+		memset(currWalName,0,70);
+		XLogFileName(currWalName,ev->tli,ev->segno,WalSegSz);
+
+		if (ev->kind == WALSCAN_EVENT_DEL){
+			walScanDelHit(ev->tx,ev->lsn);
+			continue;
+		}
+
+		int timeres = XlogGiveMeTimeValue(ev->time,SrtTime,EndTime);
+		if (timeres == 0)
+			continue;
+		else if (timeres == -1)
+			return FAILURE_RET;
+
+		if (ev->time != 0 && (resTyp_there == DELETEtyp || resTyp_there == UPDATEtyp))
+			walScanCommit(ev->tx,ev->time,ev->lsn);
+	}
+	return w->halted ? FAILURE_RET : SUCCESS_RET;
+}
+
+/**
+ * walScanParallel - Scan archived WAL for DELETE/UPDATE with several threads
+ *
+ * @archDirFiles:  Archived segments, sorted
+ * @archWaldirNum: Number of archived segments
+ * @start_fname:   First segment to scan
+ * @end_fname:     Last segment to scan
+ * @waldir:        Archive directory
+ * @endptr:        End of the last segment
+ * @SrtTime:       Start time for filtering
+ * @EndTime:       End time for filtering
+ *
+ * Splits the archived files between start_fname and end_fname into
+ * walScanWorkers contiguous ranges, each read by its own XLogReaderState,
+ * then replays the kept records range by range. A single range is read
+ * on the calling thread.
+ *
+ * Returns: SUCCESS_RET when the scan was done, FAILURE_RET when none of
+ * the files are archived and the caller should scan serially
+ */
+static int walScanParallel(WALFILE *archDirFiles,int archWaldirNum,
+						   char *start_fname,char *end_fname,char *waldir,
+						   XLogRecPtr endptr,TimestampTz *SrtTime,TimestampTz *EndTime)
+{
+	int lo = 0, hi = archWaldirNum;
+	while (lo < archWaldirNum && strcmp(archDirFiles[lo].walnames + 8, start_fname + 8) < 0)
+		lo++;
+	while (hi > lo && strcmp(archDirFiles[hi - 1].walnames + 8, end_fname + 8) > 0)
+		hi--;
+
+	int nFiles = hi - lo;
+	int nWorkers = Min(walScanWorkers, nFiles);
+	if (nWorkers < 1)
+		return FAILURE_RET;
+
+	walScanWorker *workers = calloc(nWorkers, sizeof(walScanWorker));
+	if (!workers)
+		return FAILURE_RET;
+
+	walScanStopPtr = endptr;
+	for (int k = 0; k < nWorkers; k++)
+	{
+		walScanWorker *w = &workers[k];
+		w->files = archDirFiles;
+		w->first = lo + (int)((int64)k * nFiles / nWorkers);
+		w->last = lo + (int)((int64)(k + 1) * nFiles / nWorkers);
+		w->endptr = endptr;
+		w->waldir = waldir;
+		w->srtTime = *SrtTime;
+		w->endTime = *EndTime;
+		if (k == nWorkers - 1)
+			w->rangeEnd = endptr;
+		else{
+			TimeLineID tli;
+			XLogSegNo segno;
+			XLogFromFileName(archDirFiles[w->last].walnames, &tli, &segno, WalSegSz);
+			XLogSegNoOffsetToRecPtr(segno, 0, WalSegSz, w->rangeEnd);
+		}
+	}
+
+	for (int k = 0; k < nWorkers; k++)
+	{
+		workers[k].started = nWorkers > 1 &&
+			pthread_create(&workers[k].thread, NULL, walScanWorkerMain, &workers[k]) == 0;
+		if (!workers[k].started)
+			walScanWorkerMain(&workers[k]);
+	}
+
+	int go = SUCCESS_RET;
+	for (int k = 0; k < nWorkers; k++)
+	{
+		if (workers[k].started)
+			pthread_join(workers[k].thread, NULL);
+		if (go)
+			go = walScanReplay(&workers[k],SrtTime,EndTime);
+		free(workers[k].events);
+	}
+	free(workers);
+	return SUCCESS_RET;
+}
+
+/* One thread of walVerifyArchive, it checks files [first,last) */
+typedef struct walVerifyWorker
+{
+	pthread_t thread;
+	int started;
+	WALFILE *files;
+	int first;
+	int last;
+	char *waldir;
+	int segsz;
+	XLogRecPtr *badLsn;	/* per file, first record whose CRC fails */
+	int nSegs;
+	uint64 nRecords;
+} walVerifyWorker;
+
+/**
+ * walVerifyWorkerMain - Check the record CRCs of one worker's files
+ *
+ * @arg: walVerifyWorker
+ *
+ * Each file is read from its first record to the last record starting in
+ * it, so a record straddling into the next segment is checked once. A
+ * file that cannot be read is left to the continuity check.
+ */
+static void *walVerifyWorkerMain(void *arg)
+{
+	walVerifyWorker *w = arg;
+
+	for (int cur = w->first; cur < w->last; cur++)
+	{
+		XLogDumpPrivate private;
+		XLogSegNo segno;
+		XLogRecPtr segEnd;
+		char *errormsg;
+
+		memset(&private, 0, sizeof(XLogDumpPrivate));
+		private.timeline = 1;
+		XLogFromFileName(w->files[cur].walnames, &private.timeline, &segno, w->segsz);
+		XLogSegNoOffsetToRecPtr(segno, 0, w->segsz, private.startptr);
+		XLogSegNoOffsetToRecPtr(segno + 1, 0, w->segsz, segEnd);
+		private.endptr = segEnd + w->segsz;
+
+		XLogReaderState *state =
+			XLogReaderAllocate(w->segsz, w->waldir,
+							   XL_ROUTINE(.page_read = WALDumpReadPage,
+										  .segment_open = WALDumpOpenSegment,
+										  .segment_close = WALDumpCloseSegment),
+							   &private);
+		if (!state){
+			printf("out of memory");
+			break;
+		}
+		state->verify_crc = true;
+
+		if (!XLogRecPtrIsInvalid(XLogFindNextRecord(state, private.startptr))){
+			XLogRecord *record;
+			while ((record = XLogReadRecord(state, &errormsg)) != NULL){
+				if (state->ReadRecPtr >= segEnd)
+					break;
+				w->nRecords++;
+			}
+		}
+		w->badLsn[cur] = state->crc_failed;
+		w->nSegs++;
+		XLogReaderFree(state);
+	}
+	return NULL;
+}
+
+/**
+ * walVerifyArchive - Check the CRC of every record in archived WAL
+ *
+ * @files:  Archived segments, sorted
+ * @nFiles: Number of archived segments
+ * @waldir: Archive directory
+ * @segsz:  WAL segment size
+ *
+ * Splits the files into walScanWorkers contiguous ranges checked in
+ * parallel, then prints the first corrupt LSN of each timeline.
+ *
+ * Returns: Number of timelines with a corrupt record, -1 when out of memory
+ */
+int walVerifyArchive(WALFILE *files,int nFiles,char *waldir,int segsz)
+{
+	int nWorkers = Min(walScanWorkers, nFiles);
+	if (nWorkers < 1)
+		return 0;
+
+	walVerifyWorker *workers = calloc(nWorkers, sizeof(walVerifyWorker));
+	XLogRecPtr *badLsn = calloc(nFiles, sizeof(XLogRecPtr));
+	int *badIdx = malloc(nFiles * sizeof(int));
+	if (!workers || !badLsn || !badIdx){
+		free(workers);
+		free(badLsn);
+		free(badIdx);
+		return -1;
+	}
+
+	for (int k = 0; k < nWorkers; k++)
+	{
+		walVerifyWorker *w = &workers[k];
+		w->files = files;
+		w->first = (int)((int64)k * nFiles / nWorkers);
+		w->last = (int)((int64)(k + 1) * nFiles / nWorkers);
+		w->waldir = waldir;
+		w->segsz = segsz;
+		w->badLsn = badLsn;
+	}
+
+	for (int k = 0; k < nWorkers; k++)
+	{
+		workers[k].started = nWorkers > 1 &&
+			pthread_create(&workers[k].thread, NULL, walVerifyWorkerMain, &workers[k]) == 0;
+		if (!workers[k].started)
+			walVerifyWorkerMain(&workers[k]);
+	}
+
+	int nSegs = 0;
+	uint64 nRecords = 0;
+	for (int k = 0; k < nWorkers; k++)
+	{
+		if (workers[k].started)
+			pthread_join(workers[k].thread, NULL);
+		nSegs += workers[k].nSegs;
+		nRecords += workers[k].nRecords;
+	}
+
+	/* first corrupt record of each timeline, kept in badLsn of its first file */
+	int nBad = 0;
+	for (int i = 0; i < nFiles; i++)
+	{
+		TimeLineID tli, seen;
+		XLogSegNo segno;
+		int t;
+
+		if (XLogRecPtrIsInvalid(badLsn[i]))
+			continue;
+		XLogFromFileName(files[i].walnames, &tli, &segno, segsz);
+		for (t = 0; t < nBad; t++){
+			XLogFromFileName(files[badIdx[t]].walnames, &seen, &segno, segsz);
+			if (seen == tli)
+				break;
+		}
+		if (t == nBad)
+			badIdx[nBad++] = i;
+		else if (badLsn[i] < badLsn[badIdx[t]])
+			badIdx[t] = i;
+	}
+	for (int t = 0; t < nBad; t++)
+	{
+		TimeLineID tli;
+		XLogSegNo segno;
+		char lsn[MAXFNAMELEN];
+		int i = badIdx[t];
+
+		XLogFromFileName(files[i].walnames, &tli, &segno, segsz);
+		lsnToStr(badLsn[i],lsn);
+		#ifdef CN
+		printf("%s时间线 %u 首个CRC校验失败的记录: %s (%s)%s\n",COLOR_ERROR,tli,lsn,files[i].walnames,C_RESET);
+		#else
+		printf("%sTimeline %u first record failing CRC: %s (%s)%s\n",COLOR_ERROR,tli,lsn,files[i].walnames,C_RESET);
+		#endif
+	}
+	if (nBad == 0){
+		#ifdef CN
+		printf("%sCRC校验通过，共%d个WAL文件，%lu条记录%s\n",COLOR_SUCC,nSegs,(unsigned long)nRecords,C_RESET);
+		#else
+		printf("%sCRC check passed, %d WAL files, %lu records%s\n",COLOR_SUCC,nSegs,(unsigned long)nRecords,C_RESET);
+		#endif
+	}
+
+	free(badIdx);
+	free(badLsn);
+	free(workers);
+	return nBad;
+}
+
+/**
+ * restoreOpenBootFile - Open the output file of a restored table
+ *
+ * @tabname:      Table name
+ * @Tx_parray:    Transactions restored
+ * @SrtTime:      Start of the time range
+ * @EndTime:      End of the time range
+ * @bootfilename: Output, path of the file
+ */
+static FILE *restoreOpenBootFile(char *tabname,parray *Tx_parray,TimestampTz *SrtTime,TimestampTz *EndTime,char *bootfilename)
+{
+	char suffix[10];
+	char filetyp[10];
+	memset(suffix,0,10);
+	memset(filetyp,0,10);
+	if(ExportMode_there == CSVform && resTyp_there == DELETEtyp)
+		strcpy(suffix,".csv");
+	else if((ExportMode_there == SQLform && resTyp_there == DELETEtyp) || resTyp_there == UPDATEtyp)
+		strcpy(suffix,".sql");
+
+	if(resTyp_there == DELETEtyp)
+		strcpy(filetyp,"del");
+	else if(resTyp_there == UPDATEtyp)
+		strcpy(filetyp,"upd");
+
+	if(restoreMode_there == TxRestore){
+		DELstruct *elem = parray_get(Tx_parray,0);
+		sprintf(bootfilename,"restore/public/%s_%d%s",tabname,elem->tx,suffix);
+	}
+	else{
+		char *srttimeStr=(char *)timestamptz_to_str(*SrtTime);
+		char *endtimeStr=(char *)timestamptz_to_str(*EndTime);
+		sprintf(bootfilename,"restore/public/%s_%s_%s_%s%s",tabname,filetyp,srttimeStr,endtimeStr,suffix);
+	}
+	return fopen(bootfilename,"w");
+}
+
+/**
+ * walRestoreRoute - Hand a record to the target its block 0 belongs to
+ *
+ * @record:        XLog reader state
+ * @array2Process: Decode function array
+ * @Tx_parray:     Transactions restored
+ *
+ * Points the single-table restore state at the owning table and runs
+ * XLogRecordRestoreFPWs or its TOAST counterpart, each relation keeping
+ * its own FPW store; deleted and updated tuples go to the table's spool
+ * for restoreTargetReplay.
+ *
+ * Returns: BREAK_RET once every target has passed its end LSN
+ */
+static int walRestoreRoute(XLogReaderState *record,decodeFunc *array2Process,parray *Tx_parray)
+{
+	BlockNumber blk;
+	RelFileNode rnode;
+	ForkNumber	fork;
+	walTargetRel *rel;
+	walRestoreTarget *t;
+	int errs = FPIErrcount;
+	int ret;
+
+	if (!XLogRecHasBlockRef(record, 0))
+		return CONTINUE_RET;
+	XlogRecGetBlkInfo(record, 0, &blk, &rnode, &fork);
+	if ((rel = walTargetRelFind(rnode.relNode)) == NULL)
+		return CONTINUE_RET;
+	t = &restoreTargets[rel->target];
+	if (rel->isToast ? t->toastDone : t->heapDone)
+		return CONTINUE_RET;
+
+	targetDatafileOid = t->datafile;
+	targetOldDatafileOid = t->oldDatafile;
+	targetToastfileOid = t->toastfile;
+	targetOldToastfileOid = t->oldToastfile;
+	restoreSpool = t->spool;
+	strcpy(FPWSegmentPath, rel->isToast ? "restore/datafile" : "restore/.fpw");
+
+	if (rel->isToast)
+		ret = XLogRecordRestoreFPWsforTOAST(NULL,record,FPWSegmentPath,array2Process,Tx_parray,t->tab->tab,NULL);
+	else
+		ret = XLogRecordRestoreFPWs(NULL,record,FPWSegmentPath,array2Process,Tx_parray,t->tab->tab,NULL);
+	t->nErr += FPIErrcount - errs;
+	if (ret != BREAK_RET)
+		return CONTINUE_RET;
+
+	if (rel->isToast)
+		t->toastDone = 1;
+	else
+		t->heapDone = 1;
+	for (int i = 0; i < nRestoreTargets; i++){
+		t = &restoreTargets[i];
+		if (!t->heapDone || (!t->toastDone && (t->toastfile || t->oldToastfile)))
+			return CONTINUE_RET;
+	}
+	return BREAK_RET;
+}
+
+/**
+ * restoreTargetReplay - Decode the tuples a multi-table restore spooled for one table
+ *
+ * @i:             Index of the table in the setRestoreTargets_there list
+ * @array2Process: Decode functions of the table
+ * @Tx_parray:     Transactions restored
+ * @SrtTime:       Start of the time range
+ * @EndTime:       End of the time range
+ *
+ * Runs once the pass is over and the table's TOAST index is loaded, so
+ * each tuple is decoded exactly as restoreDEL/restoreUPDATE would have.
+ */
+void restoreTargetReplay(int i,decodeFunc *array2Process,parray *Tx_parray,TimestampTz *SrtTime,TimestampTz *EndTime)
+{
+	walRestoreTarget *t = &restoreTargets[i];
+	char bootfilename[500]={0};
+	union
+	{
+		HeapTupleHeaderData hdr;
+		char		data[MaxHeapTupleSize];
+	}			oldTuple, newTuple;
+	uint32 lens[2];
+
+	if (!restoreMulti || i >= nRestoreTargets || t->spool == NULL)
+		return;
+
+	allDesc = (pg_attributeDesc*)malloc(atoi(t->tab->nattr)*sizeof(pg_attributeDesc));
+	dropExist2 = getPgAttrDesc(t->tab,allDesc);
+	initToastId(t->tab->toastnode);
+	FPIcount = 0;
+	FPIErrcount = t->nErr;
+	FPIUpdateSame = 0;
+
+	FILE *bootFile = restoreOpenBootFile(t->tab->tab,Tx_parray,SrtTime,EndTime,bootfilename);
+	infoRestoreRecs(FPIcount);
+	rewind(t->spool);
+	while (fread(lens,sizeof(lens),1,t->spool) == 1)
+	{
+		if (lens[0] > sizeof(oldTuple) || lens[1] > sizeof(newTuple) ||
+			fread(oldTuple.data,1,lens[0],t->spool) != lens[0] ||
+			fread(newTuple.data,1,lens[1],t->spool) != lens[1])
+			break;
+		if (lens[1] == 0){
+			if (restoreDELEmit(array2Process,oldTuple.data,lens[0],t->tab->tab,bootFile) == BREAK_RET)
+				break;
+		}
+		else{
+			setExportMode_decode(SQLform);
+			restoreUPDATEEmit(allDesc,array2Process,oldTuple.data,lens[0],newTuple.data,lens[1],t->tab->tab,bootFile);
+			setExportMode_decode(CSVform);
+		}
+	}
+	fclose(bootFile);
+	fclose(t->spool);
+	t->spool = NULL;
+	unlink(t->spoolPath);
+	infoRestoreResult(t->tab->tab,FPIcount+FPIErrcount,FPIcount,FPIErrcount,FPIUpdateSame,bootfilename,resTyp_there);
+
+	free(allDesc);
+	allDesc = NULL;
+}
+
+parray *pgGetTxforArch(parray **TxTime_parray_ptr,
+				TimestampTz *SrtTime,TimestampTz *EndTime,
+				WALFILE *archDirFiles,int archWaldirNum,
+				char *start_fname_pg,char *end_fname_pg,
+				char waldir[1024],int flag,
+				char datafile[50],char oldDatafile[50],
+				char toastfile[50],char oldToastfile[50],
+				char tabname[50],parray *Tx_parray,
+				int FPICntClean,decodeFunc *array2Process,
+				TABstruct *taboid)
+{
+	int nAttr;
+
+	if(flag != DROP){
+		nAttr = atoi(taboid->nattr);
+		allDesc = (pg_attributeDesc*)malloc(nAttr*sizeof(pg_attributeDesc));
+		dropExist2 = getPgAttrDesc(taboid,allDesc);
+		initToastId(taboid->toastnode);
+		memset(FPWSegmentPath,0,100);
+		if(strcmp(datafile,"0") == 0 && strcmp(oldDatafile,"0") == 0){
+			isToastRound = 1;
+			strcpy(FPWSegmentPath,"restore/datafile");
+		}
+		else{
+			isToastRound = 0;
+			strcpy(FPWSegmentPath,"restore/.fpw");
+		}
+	}
+	else{
+		sdcPgClass = initSystemDropContext("pg_class");
+		sdcPgAttr = initSystemDropContext("pg_attribute");
+		isToastRound = 0;
+		strcpy(FPWSegmentPath,"restore/.fpw");
+	}
+
+	FPIcount = 0;
+	FPIErrcount = 0;
+	FPIUpdateSame = 0;
+	char bootfilename[500]={0};
+	determineTimeMode(SrtTime,EndTime);
+
+	FILE *bootFile = NULL;
+	if(flag == DELRESTORE && isToastRound == 0 && !restoreMulti)
+		bootFile = restoreOpenBootFile(tabname,Tx_parray,SrtTime,EndTime,bootfilename);
+
+	if(flag == DELRESTORE && restoreMode_there == TxRestore && isToastRound == 0){
+        #ifdef CN
+        char *item="▌ 事务号恢复模式";
+        #else
+        char *item="▌ Tx Restore Mode [Displayed by Tx groups]";
+        #endif
+        infoRestoreMode(item);
+	}
+	else if(flag == DELRESTORE && restoreMode_there == periodRestore && isToastRound == 0){
+        #ifdef CN
+        char *item="▌ 时间区间恢复模式";
+        #else
+        char *item="▌ Time Range Restore Mode [Displayed all within Time Range]";
+        #endif
+        infoRestoreMode(item);
+	}
+
+	char *FPIPath = "restore/datafile";
+	memset(targetDatafile,0,50);
+	memset(targetOldDatafile,0,50);
+	memset(targetToastfile,0,50);
+	memset(targetOldToastfile,0,50);
+
+	strcpy(targetDatafile,datafile);
+	strcpy(targetOldDatafile,oldDatafile);
+	strcpy(targetToastfile,toastfile);
+	strcpy(targetOldToastfile,oldToastfile);
+	targetDatafileOid = atoi(targetDatafile);
+	targetOldDatafileOid = atoi(targetOldDatafile);
+	targetToastfileOid = atoi(targetToastfile);
+	targetOldToastfileOid = atoi(targetOldToastfile);
+
+	if(!restoreMulti){
+		free(restoreTargets);
+		restoreTargets = (walRestoreTarget *) malloc(sizeof(walRestoreTarget));
+		walTargetSet(restoreTargets,taboid,datafile,oldDatafile,toastfile,oldToastfile);
+		nRestoreTargets = 1;
+		walTargetsIndex();
+	}
+	else if(flag == DELRESTORE){
+		for (int i = 0; i < nRestoreTargets; i++){
+			walRestoreTarget *t = &restoreTargets[i];
+			sprintf(t->spoolPath,"restore/.fpw/%u.spool",t->datafile);
+			t->spool = fopen(t->spoolPath,"w+b");
+			t->nErr = 0;
+			t->heapDone = t->spool == NULL;
+			t->toastDone = t->spool == NULL;
+			if(t->spool == NULL){
+				#ifdef CN
+				printf("%s无法创建%s，跳过表<%s>%s\n",COLOR_ERROR,t->spoolPath,t->tab->tab,C_RESET);
+				#else
+				printf("%sCould not create %s, skipping table <%s>%s\n",COLOR_ERROR,t->spoolPath,t->tab->tab,C_RESET);
+				#endif
+			}
+		}
+	}
+
+	delOrDrop = flag;
+    earliestTimeLocal_pg = NULL;
+
+    *TxTime_parray_ptr = parray_new();
+    parray *TxTime_parray = *TxTime_parray_ptr;
+
+	elemforTime = (DELstruct*)malloc(sizeof(DELstruct));
+	elemforTimeINIT(elemforTime);
+
+	if(flag != DELRESTORE){
+		if(Txs && delElems){
+			parray_free(Txs);
+			harray_free(delElems);
+			Txs=NULL;
+			delElems=NULL;
+		}
+
+		Txs = parray_new();
+		delElems = harray_new(HARRAYDEL);
+	}
+	if(LsnBlkInfos){
+		parray_free(LsnBlkInfos);
+		LsnBlkInfos = NULL;
+	}
+	LsnBlkInfos = parray_new();
+
+	XLogReaderState *xlogreader_state;
+	XLogDumpPrivate private;
+	char	   *directory = NULL;
+
+	int			fd;
+	XLogSegNo	segno;
+	char	   *errormsg;
+
+	XLogRecord *record;
+	XLogRecPtr	first_record;
+
+	XLogDumpConfig config;
+
+	memset(&private, 0, sizeof(XLogDumpPrivate));
+	private.timeline = 1;
+	private.startptr = InvalidXLogRecPtr;
+	private.endptr = InvalidXLogRecPtr;
+	private.endptr_reached = false;
+
+	PGAlignedXLogBlock buf;
+	int			r;
+
+	fd = open_file_in_directory(waldir, start_fname_pg);
+	XLogLongPageHeader longhdr = NULL;
+
+	r = fd >= 0 ? pg_pread(fd, buf.data, XLOG_BLCKSZ, 0) : -1;
+	if (r == XLOG_BLCKSZ)
 	{
 		longhdr = (XLogLongPageHeader) buf.data;
 		WalSegSz = longhdr->xlp_seg_size;
@@ -5341,6 +7358,12 @@ parray *pgGetTxforArch(parray **TxTime_parray_ptr,
 	if (endsegno < segno)
 		printf("Are StartFile and EndFile reversed?\n");
 
+	int scanned = 0;
+	XLogSegNo lastSeg = 0;
+	if(flag == DEL)
+		scanned = walScanParallel(archDirFiles,archWaldirNum,start_fname_pg,end_fname_pg,
+								  waldir,private.endptr,SrtTime,EndTime);
+
 	xlogreader_state =
 		XLogReaderAllocate(WalSegSz, waldir,
 						   XL_ROUTINE(.page_read = WALDumpReadPage,
@@ -5352,12 +7375,13 @@ parray *pgGetTxforArch(parray **TxTime_parray_ptr,
 		return TxTime_parray;
 	}
 
-	first_record = XLogFindNextRecord(xlogreader_state, private.startptr);
+	if(!scanned)
+		first_record = XLogFindNextRecord(xlogreader_state, private.startptr);
 	if( isToastRound == 0 && flag == DELRESTORE){
 		infoRestoreRecs(FPIcount);
 	}
 
-	for (;;)
+	while (!scanned)
 	{
 		/* try to read the next record */
 		record = XLogReadRecord(xlogreader_state, &errormsg);
@@ -5370,27 +7394,15 @@ parray *pgGetTxforArch(parray **TxTime_parray_ptr,
 			if(strcmp(fname,end_fname_pg) == 0){
 				break;
 			}
-			int matchJ = 0;
-			for(int j=0;j<archWaldirNum;j++){
-					if(strcmp(archDirFiles[j].walnames+8,fname+8) > 0){
-					matchJ = j;
-					break;
-				}
-				else if(strcmp(archDirFiles[j].walnames+8,fname+8) == 0){
-					matchJ = -1;
-					break;
-				}
-			}
+			int matchJ = walFileFindNext(archDirFiles,archWaldirNum,fname);
 
 			if(matchJ != -1){
 				char		fpath[MAXPGPATH];
-				snprintf(fpath, MAXPGPATH, "%s/%s", waldir, fname);
-				int fd = open(fpath, O_RDONLY | PG_BINARY, 0);
-				while(fd < 0 && strcmp(fname+8,archDirFiles[matchJ].walnames+8) <= 0){
+				int found = walSegmentResolve(waldir, fname, fpath) >= 0;
+				while(!found && strcmp(fname+8,archDirFiles[matchJ].walnames+8) <= 0){
 					seg.ws_segno++;
 					XLogFileName(fname, seg.ws_tli, seg.ws_segno,WalSegSz);
-					snprintf(fpath, MAXPGPATH, "%s/%s", waldir, fname);
-					fd = open(fpath, O_RDONLY | PG_BINARY, 0);
+					found = walSegmentResolve(waldir, fname, fpath) >= 0;
 				}
 
 				if(strcmp(fname+8,archDirFiles[archWaldirNum-1].walnames+8) < 0){
@@ -5417,6 +7429,35 @@ parray *pgGetTxforArch(parray **TxTime_parray_ptr,
 		memset(currWalName,0,70);
 		XLogFileName(currWalName,private.timeline,xlogreader_state->seg.ws_segno,WalSegSz);
 
+		XLogSegNo recSeg;
+		XLByteToSeg(xlogreader_state->ReadRecPtr, recSeg, WalSegSz);
+		if(flag == DELRESTORE && recSeg != lastSeg){
+			char fname[MAXPGPATH];
+			lastSeg = recSeg;
+			XLogFileName(fname,private.timeline,recSeg,WalSegSz);
+			int skip = walSummaryRestoreSkip(waldir,fname,SrtTime,EndTime);
+			if(skip == -1){
+				break;
+			}
+			else if(skip == 1){
+				int next = walSummaryNextFile(archDirFiles,archWaldirNum,fname);
+				if(next >= archWaldirNum || strcmp(archDirFiles[next].walnames+8,end_fname_pg+8) > 0){
+					break;
+				}
+				XLogFromFileName(archDirFiles[next].walnames, &private.timeline, &segno, WalSegSz);
+				XLogSegNoOffsetToRecPtr(segno, 0, WalSegSz, private.startptr);
+				XLogReaderFree(xlogreader_state);
+				xlogreader_state =
+					XLogReaderAllocate(WalSegSz, waldir,
+									XL_ROUTINE(.page_read = WALDumpReadPage,
+												.segment_open = WALDumpOpenSegment,
+												.segment_close = WALDumpCloseSegment),
+									&private);
+				first_record = XLogFindNextRecord(xlogreader_state, private.startptr);
+				continue;
+			}
+		}
+
 		int timeres = XlogGiveMeTime(xlogreader_state,SrtTime,EndTime);
 		if( timeres == 0 ){
 			continue;
@@ -5425,7 +7466,12 @@ parray *pgGetTxforArch(parray **TxTime_parray_ptr,
 			break;
 		}
 
-		if(flag == DELRESTORE){
+		if(flag == DELRESTORE && restoreMulti){
+			if( walRestoreRoute(xlogreader_state,array2Process,Tx_parray) == BREAK_RET ){
+				break;
+			}
+		}
+		else if(flag == DELRESTORE){
 			if(isToastRound == 0){
 				if( XLogRecordRestoreFPWs(allDesc,xlogreader_state, FPIPath,array2Process,Tx_parray,tabname,bootFile) == BREAK_RET ){
 					break;
@@ -5453,11 +7499,19 @@ parray *pgGetTxforArch(parray **TxTime_parray_ptr,
 		delElems = NULL;
 	}
 
+	FPWCacheFlush();
+
 	if(flag == DELRESTORE && isToastRound == 0){
-		fclose(bootFile);
+		if(restoreMulti){
+			restoreSpool = NULL;
+			strcpy(FPWSegmentPath,"restore/.fpw");
+		}
+		else{
+			fclose(bootFile);
+			infoRestoreResult(tabname,FPIcount+FPIErrcount,FPIcount,FPIErrcount,FPIUpdateSame,bootfilename,resTyp_there);
+		}
 		if(elemforTime != NULL)
 			free(elemforTime);
-		infoRestoreResult(tabname,FPIcount+FPIErrcount,FPIcount,FPIErrcount,FPIUpdateSame,bootfilename,resTyp_there);
 		FPWHashCleanup();
 	}
 
@@ -33,6 +33,10 @@ XLogReaderAllocate(int wal_segment_size, const char *waldir,
 int
 open_file_in_directory(const char *directory, const char *fname);
 
+int walSegmentResolve(const char *directory,const char *fname,char *path);
+
+void walInflateCacheCleanup();
+
 
 bool search_directory(const char *directory, const char *fname);
 
@@ -70,6 +74,14 @@ void setExportMode_there(int setting);
 
 void setResTyp_there(int setting);
 
+void setWalScanWorkers_there(int setting);
+
+int walVerifyArchive(WALFILE *files,int nFiles,char *waldir,int segsz);
+
+void setRestoreTargets_there(TABstruct **tabs,int n);
+
+void restoreTargetReplay(int i,decodeFunc *array2Process,parray *Tx_parray,TimestampTz *SrtTime,TimestampTz *EndTime);
+
 int restoreUPDATE(pg_attributeDesc *allDesc,XLogReaderState *record,parray *Tx_parray,FILE *bootFile,decodeFunc *array2Process,char *tabname,char *page,BlockNumber blk,bool hot_update,TransactionId currentTx);
 
 void xact_desc_pg_drop(TimestampTz *TimeFromRecord,Oid *datafileOid,Oid *toastOid, XLogReaderState *record,RmgrId rmid,parray *TxTime_parray);
@@ -84,4 +96,8 @@ int FPWfromFile(BlockNumber blk, char* page, RelFileNumber filenode);
 
 void FPWHashCleanup();
 
+void FPWCacheFlush();
+
+void setFpwCache_there(uint64 bytes);
+
 int XLogRecordRedoDropFPW(systemDropContext *sdc,XLogReaderState *record);
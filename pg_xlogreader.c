@@ -16,6 +16,7 @@
 #include <time.h>
 #include <stdint.h>
 #include <stdatomic.h>
+#include <pthread.h>
 
 /**
  * XLogReaderValidatePageHeader - Validate WAL page header
@@ -212,6 +213,147 @@ bool ValidXLogRecordHeader(XLogReaderState *state, XLogRecPtr RecPtr,
 	return true;
 }
 
+/* Reflected Castagnoli polynomial */
+#define CRC32C_POLY 0x82F63B78
+
+static uint32 crc32cTable[8][256];
+static pg_crc32c (*crc32cImpl)(pg_crc32c crc, const void *data, size_t len);
+static pthread_once_t crc32cOnce = PTHREAD_ONCE_INIT;
+
+/**
+ * crc32cSb8 - CRC-32C by table lookup, eight bytes per step
+ *
+ * @crc:  Running CRC
+ * @data: Bytes to add
+ * @len:  Number of bytes
+ */
+static pg_crc32c crc32cSb8(pg_crc32c crc, const void *data, size_t len)
+{
+	const unsigned char *p = data;
+
+	while (len >= 8)
+	{
+		uint32 lo = crc ^ ((uint32) p[0] | (uint32) p[1] << 8 |
+						   (uint32) p[2] << 16 | (uint32) p[3] << 24);
+		uint32 hi = (uint32) p[4] | (uint32) p[5] << 8 |
+					(uint32) p[6] << 16 | (uint32) p[7] << 24;
+
+		crc = crc32cTable[7][lo & 0xFF] ^ crc32cTable[6][(lo >> 8) & 0xFF] ^
+			  crc32cTable[5][(lo >> 16) & 0xFF] ^ crc32cTable[4][lo >> 24] ^
+			  crc32cTable[3][hi & 0xFF] ^ crc32cTable[2][(hi >> 8) & 0xFF] ^
+			  crc32cTable[1][(hi >> 16) & 0xFF] ^ crc32cTable[0][hi >> 24];
+		p += 8;
+		len -= 8;
+	}
+	while (len-- > 0)
+		crc = crc32cTable[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+	return crc;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+/**
+ * crc32cSse42 - CRC-32C with the SSE 4.2 crc32 instruction
+ *
+ * @crc:  Running CRC
+ * @data: Bytes to add
+ * @len:  Number of bytes
+ */
+__attribute__((target("sse4.2")))
+static pg_crc32c crc32cSse42(pg_crc32c crc, const void *data, size_t len)
+{
+	const unsigned char *p = data;
+	uint64 c = crc;
+
+	while (len >= 8)
+	{
+		uint64 v;
+		memcpy(&v, p, 8);
+		c = __builtin_ia32_crc32di(c, v);
+		p += 8;
+		len -= 8;
+	}
+	crc = (uint32) c;
+	while (len-- > 0)
+		crc = __builtin_ia32_crc32qi(crc, *p++);
+	return crc;
+}
+#endif
+
+/**
+ * crc32cInit - Build the lookup tables and pick an implementation
+ */
+static void crc32cInit(void)
+{
+	for (int i = 0; i < 256; i++)
+	{
+		uint32 c = i;
+		for (int k = 0; k < 8; k++)
+			c = (c & 1) ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+		crc32cTable[0][i] = c;
+	}
+	for (int i = 0; i < 256; i++)
+		for (int t = 1; t < 8; t++)
+			crc32cTable[t][i] = crc32cTable[0][crc32cTable[t - 1][i] & 0xFF] ^
+								(crc32cTable[t - 1][i] >> 8);
+
+	crc32cImpl = crc32cSb8;
+#if defined(__x86_64__) && defined(__GNUC__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse4.2"))
+		crc32cImpl = crc32cSse42;
+#endif
+}
+
+/**
+ * pg_comp_crc32c - Add bytes to a running CRC-32C
+ *
+ * @crc:  Running CRC, from INIT_CRC32C
+ * @data: Bytes to add
+ * @len:  Number of bytes
+ *
+ * Uses the crc32 instruction when the CPU has SSE 4.2, tables otherwise.
+ *
+ * Returns: Updated CRC
+ */
+pg_crc32c pg_comp_crc32c(pg_crc32c crc, const void *data, size_t len)
+{
+	pthread_once(&crc32cOnce, crc32cInit);
+	return crc32cImpl(crc, data, len);
+}
+
+/**
+ * ValidXLogRecord - Check the CRC of a whole XLog record
+ *
+ * @state:  XLog reader state, receives the error message and crc_failed
+ * @record: Record, xl_tot_len contiguous bytes
+ * @recptr: Start LSN of the record
+ *
+ * The CRC covers the record data first and then the header up to xl_crc,
+ * the order the server computes it in.
+ *
+ * Returns: true if the stored CRC matches, false otherwise
+ */
+bool ValidXLogRecord(XLogReaderState *state, XLogRecord *record, XLogRecPtr recptr)
+{
+	pg_crc32c crc;
+
+	INIT_CRC32C(crc);
+	COMP_CRC32C(crc, ((char *) record) + SizeOfXLogRecord, record->xl_tot_len - SizeOfXLogRecord);
+	COMP_CRC32C(crc, (char *) record, offsetof(XLogRecord, xl_crc));
+	FIN_CRC32C(crc);
+
+	if (!EQ_CRC32C(record->xl_crc, crc))
+	{
+		if (XLogRecPtrIsInvalid(state->crc_failed))
+			state->crc_failed = recptr;
+		snprintf(state->errormsg_buf, MAX_ERRORMSG_LEN,
+				 "incorrect resource manager data checksum in record at %X/%X",
+				 LSN_FORMAT_ARGS(recptr));
+		return false;
+	}
+	return true;
+}
+
 #if PG_VERSION_NUM > 14
 /**
  * ResetDecoder - Reset the XLog decoder state (PG > 14)
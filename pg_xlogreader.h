@@ -129,6 +129,15 @@ typedef uint16 RepOriginId;
 typedef uint32 TransactionId;
 #define XLR_MAX_BLOCK_ID			32
 typedef uint32 pg_crc32c;
+
+/* CRC-32C (Castagnoli), as computed over WAL records by the server */
+#define INIT_CRC32C(crc) ((crc) = 0xFFFFFFFF)
+#define COMP_CRC32C(crc, data, len) ((crc) = pg_comp_crc32c((crc), (data), (len)))
+#define FIN_CRC32C(crc) ((crc) ^= 0xFFFFFFFF)
+#define EQ_CRC32C(c1, c2) ((c1) == (c2))
+
+pg_crc32c pg_comp_crc32c(pg_crc32c crc, const void *data, size_t len);
+
 typedef uint8 RmgrId;
 typedef struct XLogRecord
 {
@@ -245,6 +254,10 @@ struct XLogReaderState
 	char	   *errormsg_buf;
 	bool		errormsg_deferred;
 	bool		nonblocking;
+
+	/* check xl_crc of every record read, first mismatch goes to crc_failed */
+	bool		verify_crc;
+	XLogRecPtr	crc_failed;
 };
 
 #else
@@ -316,6 +329,10 @@ struct XLogReaderState
 	XLogRecPtr	abortedRecPtr;
 	XLogRecPtr	missingContrecPtr;
 	XLogRecPtr	overwrittenRecPtr;
+
+	/* check xl_crc of every record read, first mismatch goes to crc_failed */
+	bool		verify_crc;
+	XLogRecPtr	crc_failed;
 };
 #endif
 /* Get a new XLogReader */
@@ -333,6 +350,8 @@ bool ValidXLogRecordHeader(XLogReaderState *state, XLogRecPtr RecPtr,
 					  XLogRecPtr PrevRecPtr, XLogRecord *record,
 					  bool randAccess);
 
+bool ValidXLogRecord(XLogReaderState *state, XLogRecord *record, XLogRecPtr recptr);
+
 /* Free an XLogReader */
 extern void XLogReaderFree(XLogReaderState *state);
 
@@ -472,6 +491,13 @@ typedef struct xl_xact_commit
 	/* xl_xact_origin follows if XINFO_HAS_ORIGIN, stored unaligned! */
 } xl_xact_commit;
 
+typedef struct xl_xact_abort
+{
+	TimestampTz xact_time;		/* time of abort */
+
+	/* xl_xact_xinfo and the optional parts follow as for a commit */
+} xl_xact_abort;
+
 typedef struct
 {
 	int8		id;				/* cache ID --- must be first */
@@ -28,6 +28,14 @@ void pgGetTxforArch();
 void setRestoreMode_there(int setting);
 void setExportMode_there(int setting);
 void setResTyp_there(int setting);
+void setWalScanWorkers_there(int setting);
+void walInflateCacheCleanup();
+int walSegmentResolve(const char *directory,const char *fname,char *path);
+int open_file_in_directory(const char *directory, const char *fname);
+void setFpwCache_there(uint64 bytes);
+void setRestoreTargets_there(TABstruct **tabs,int n);
+void restoreTargetReplay(int i,decodeFunc *array2Process,parray *Tx_parray,TimestampTz *SrtTime,TimestampTz *EndTime);
+int walVerifyArchive(WALFILE *files,int nFiles,char *waldir,int segsz);
 
 static struct timespec start_time;
 
@@ -78,6 +86,9 @@ int isDropScanned = 0;
 int isTxScanned = 0;
 int isPeriodScanned = 0;
 
+TABstruct **scanTabs = NULL;
+int nScanTabs = 0;
+
 int isSingleDB = 0;
 int SCANCount = 0;
 
@@ -93,6 +104,12 @@ off_t dropScanSrtOff = 0;
 int isoMode = 0;
 int blkInterval = 5;
 int itemspercsv = 100;
+int unloadWorkers = NUM_THREADS;
+int readChunkMB = DEFAULT_READ_CHUNK_MB;
+int ioMode = IOMODE_BUFFERED;
+int ioDepth = AIO_DEFAULT_DEPTH;
+int fpwCacheMB = DEFAULT_FPW_CACHE_MB;
+int showDecodeLive = 1;
 harray *dupPages=NULL;
 uint32 BIGJUMP_GENIDX;
 uint32 BIG_JUMP;
@@ -118,6 +135,7 @@ char resStr[10]="删除";
 char resStr[10]="deleted";
 #endif
 int dropExist1;
+int nAllDesc=0;
 
 harray *toastTaboid_harray = NULL;
 long long ISOFILE_SIZE = 0;
@@ -177,7 +195,7 @@ char *CUR_DBDIR=NULL;
 char *CUR_SCH=NULL;
 
 TABstruct *taboid;
-harray *toastHash;
+toastIndex *toastIdx;
 int tabSize=0;
 TABSIZEstruct *tabVol;
 SCHstruct *schoid;
@@ -224,6 +242,465 @@ TimestampTz str_to_timestamptz_og(const char *time_str) {
 #include <linux/fs.h>
 #include <fcntl.h>
 #include <linux/fiemap.h>
+#include <sys/wait.h>
+
+/**
+ * buildAttr2Process - Resolve decode functions for a column type list
+ *
+ * @attr2Decode: Comma-separated list of attribute types
+ * @BOOTTYPE:    Boot type identifier
+ *
+ * Fills attr2Process with one decode function per column and selects
+ * the seperFunc2Use writer matching BOOTTYPE.
+ *
+ * Returns: SUCCESS_RET on success, FAILURE_RET on unsupported datatype
+ */
+static int buildAttr2Process(char attr2Decode[],char *BOOTTYPE)
+{
+    resetArray2Process(attr2Process);
+
+    char *attr2DecodeTMP = (char *)malloc((strlen(attr2Decode)+1)*sizeof(char));
+    strcpy(attr2DecodeTMP,attr2Decode);
+    int nAttr=0;
+
+    char *attrChars[MAX_COL_NUM];
+
+    for (int i = 0; i < MAX_COL_NUM; i++) {
+        attrChars[i] = (char *)malloc(20);
+    }
+    char temp[50];
+    char *token = strtok(attr2DecodeTMP, ",");
+    while (token != NULL) {
+        if (nAttr >= MAX_COL_NUM) {
+            printf("Exceeded attrChars array capacity\n");
+            break;
+        }
+        memset(temp,0,sizeof(temp));
+        strncpy(temp, token, sizeof(temp) - 1);
+        strcpy(attrChars[nAttr],temp);
+        nAttr++;
+        token = strtok(NULL, ",");
+    }
+
+    int ret = SUCCESS_RET;
+    int a;
+    for (a=0;a<nAttr;a++){
+        char typ[100];
+        memset(typ,0,100);
+        getStdTyp(attrChars[a],typ);
+        if(!AddList2Prcess(attr2Process,typ,BOOTTYPE)){
+            ret = FAILURE_RET;
+            break;
+        }
+    }
+    for (int i = 0; i < MAX_COL_NUM; i++) {
+        free(attrChars[i]);
+    }
+    free(attr2DecodeTMP);
+
+    if(!strcmp(BOOTTYPE,DB_BOOTTYPE)){
+        seperFunc2Use=&commaStrWriteIntoFileDB;
+    }
+    else if(!strcmp(BOOTTYPE,SCHEMA_BOOTTYPE) || !strcmp(BOOTTYPE,TYPE_BOOTTYPE)){
+        seperFunc2Use=&commaStrWriteIntoFileSCH_TYP;
+    }
+    else if(!strcmp(BOOTTYPE,CLASS_BOOTTYPE)){
+        seperFunc2Use=&commaStrWriteIntoFileCLASS;
+    }
+    else if(!strcmp(BOOTTYPE,ATTR_BOOTTYPE)){
+        seperFunc2Use=&commaStrWriteIntoFIleAttr;
+    }
+    else if(!strcmp(BOOTTYPE,TABLE_BOOTTYPE)) {
+        seperFunc2Use=commaStrWriteIntoDecodeTab;
+    }
+    return ret;
+}
+
+/**
+ * decodePageItems - Decode all visible tuples of one heap page
+ *
+ * @block:        Page image
+ * @nPages:       Page number, used for diagnostics only
+ * @allDesc:      Attribute descriptors (TABLE_BOOTTYPE only)
+ * @bootFileName: Output name, also table name for SQL export
+ * @BOOTTYPE:     Boot type identifier
+ * @bootFile:     Destination file for decoded rows
+ * @logSucc:      Success log file
+ * @logErr:       Error log file
+ * @st:           Counters updated with the page result
+ *
+ * Returns: 0 if the page is empty or corrupted, 1 otherwise
+ */
+static int decodePageItems(char *block,int nPages,pg_attributeDesc *allDesc,char *bootFileName,char *BOOTTYPE,
+                            FILE *bootFile,FILE *logSucc,FILE *logErr,readItemsStat *st)
+{
+    Page page = (Page) block;
+    unsigned int x;
+    unsigned int itemSize;
+    unsigned int itemOffset;
+    unsigned int itemFlags;
+    ItemId		itemId;
+    int	maxOffset;
+
+    maxOffset = PageGetMaxOffsetNumber(page);
+
+    if (maxOffset == 0)
+    {
+        #ifdef EN
+        printf("\n\t|-Block %d Empty Page Or Page Corruptted, Skipped\n",nPages);
+        #else
+        printf("\n\t|-块号%d 空页面或页面已损坏 ,已跳过\n",nPages);
+        #endif
+        return 0;
+    }
+
+    if(allDesc != NULL)
+        prefetchToastPage(allDesc,nAllDesc,block);
+
+    bool all_visible = PageIsAllVisible(page);
+    for(x= 1 ; x < maxOffset+1 ; x++){
+
+        itemId = PageGetItemId(page, x);
+
+        itemFlags = (unsigned int) ItemIdGetFlags(itemId);
+        itemSize = (unsigned int) ItemIdGetLength(itemId);
+        itemOffset = (unsigned int) ItemIdGetOffset(itemId);
+
+        HeapTupleHeader header = (HeapTupleHeader) &block[itemOffset];
+
+        if (itemFlags == LP_NORMAL){
+            bool		valid;
+            if (all_visible)
+                valid = true;
+            else
+                valid = HeapTupleSatisfiesVisibility(header);
+
+            if( !valid ){
+                continue;
+            }
+
+            char *xman=xmanDecode(dropExist1,allDesc,attr2Process,&block[itemOffset],itemSize,BOOTTYPE,logSucc,logErr);
+            st->datafileExist=1;
+
+            if(strcmp(BOOTTYPE,DB_BOOTTYPE) == 0 && strcmp(xman,"NoWayOut") != 0){
+
+                char *target =  get_field('\t',xman,2) ;
+
+                if(strcmp(target, "template1") == 0 ||
+                    strcmp(target, "template0") == 0 ||
+                    strcmp(target, "security") == 0)
+                {
+                    continue;
+                }
+
+            }
+
+            if ( strcmp(xman,"NoWayOut") == 0 ){
+                st->nItemsErr++;
+                st->failExist = 1;
+                continue;
+            }
+            else{
+                char *xmanret=NULL;
+                if(exmode == CSVform){
+                    xmanret = xman;
+                }
+                else if (exmode == SQLform){
+                    xmanret = xman2Insertxman(xman,bootFileName);
+                }
+                seperFunc2Use(xmanret,bootFile);
+                st->nItemsSucc++;
+            }
+        }
+    }
+    return 1;
+}
+
+/**
+ * splitSegmentUnits - Split a relation into parallel work units
+ *
+ * @filename: Path of the first segment of the relation
+ * @nUnits:   Output number of units
+ *
+ * Walks filename, filename.1 ... and cuts every segment into ranges of
+ * at most PARALLEL_UNIT_SIZE bytes. Units are returned in file order so
+ * their shards can be concatenated back into the sequential output.
+ *
+ * Returns: Unit array, or NULL when the relation is too small to split
+ */
+static readItemsArgs *splitSegmentUnits(char *filename,int *nUnits)
+{
+    char segName[1024];
+    struct stat st;
+    off_t total = 0;
+    int n = 0;
+    int hundred;
+
+    for(hundred=0;hundred<NUM1G;hundred++){
+        if ( hundred == 0 )
+            sprintf(segName,"%s",filename);
+        else
+            sprintf(segName,"%s.%d",filename,hundred);
+        if (stat(segName, &st) != 0)
+            break;
+        total += st.st_size;
+        n += st.st_size > PARALLEL_UNIT_SIZE ? (int)((st.st_size + PARALLEL_UNIT_SIZE - 1) / PARALLEL_UNIT_SIZE) : 1;
+    }
+
+    if (total < MIN_SIZE_FOR_THREADING || n < 2)
+        return NULL;
+
+    readItemsArgs *units = (readItemsArgs *)malloc(n * sizeof(readItemsArgs));
+    int u = 0;
+    for(hundred=0;hundred<NUM1G && u<n;hundred++){
+        if ( hundred == 0 )
+            sprintf(segName,"%s",filename);
+        else
+            sprintf(segName,"%s.%d",filename,hundred);
+        if (stat(segName, &st) != 0)
+            break;
+        off_t off = 0;
+        do{
+            readItemsArgs *unit = &units[u++];
+            memset(unit,0,sizeof(readItemsArgs));
+            unit->filename = strdup(segName);
+            unit->hundred = hundred;
+            unit->start_offset = off;
+            off += PARALLEL_UNIT_SIZE;
+            unit->end_offset = off < st.st_size ? off : st.st_size;
+        }while(off < st.st_size && u < n);
+    }
+    *nUnits = u;
+    return units;
+}
+
+/**
+ * readItemsWorker - Decode work units until none are left
+ *
+ * @units:     Work unit array
+ * @nUnits:    Number of units
+ * @stats:     Per-unit counters, shared with the parent
+ * @nextUnit:  Shared cursor of the next unclaimed unit
+ * @allDesc:   Attribute descriptors
+ * @result:    Final output path, shards are written as <result>.part<N>
+ * @bootFileName: Table name
+ * @logSucc:   Success log file
+ * @logErr:    Error log file
+ */
+static void readItemsWorker(readItemsArgs *units,int nUnits,readItemsStat *stats,int *nextUnit,pg_attributeDesc *allDesc,
+                            char *result,char *bootFileName,FILE *logSucc,FILE *logErr)
+{
+    char *block;
+    char shardPath[MAXPGPATH+20];
+
+    for(;;){
+        int u = __sync_fetch_and_add(nextUnit,1);
+        if (u >= nUnits)
+            break;
+
+        readItemsArgs *unit = &units[u];
+        readItemsStat *st = &stats[u];
+        seqReader rd;
+        if (seqReaderOpen(&rd,unit->filename,-1,unit->start_offset,unit->end_offset,
+                          (size_t)readChunkMB * 1024 * 1024,1,ioMode,ioDepth) != SUCCESS_RET)
+        {
+            char err1[2048];
+            #ifdef EN
+            sprintf(err1,"\nFAIL TO OPEN TABLE <%s> DATAFILE <%s> ,PLEASE CHECKOUT DATAFILE\n",
+                bootFileName,unit->filename);
+            #else
+            sprintf(err1,"\n无法打开表 <%s> 的数据文件 <%s> ,请检查数据文件是否存在\n",
+                bootFileName,unit->filename);
+            #endif
+            fputs(err1,logErr);
+            st->openFailed = 1;
+            st->done = 1;
+            continue;
+        }
+        sprintf(shardPath,"%s.part%d",result,u);
+        FILE *shard = fopen(shardPath, "w");
+        if (!shard)
+        {
+            char err1[1050];
+            sprintf(err1,"\nFailed to open target csv file <%s>, please check\n",
+                shardPath);
+            fputs(err1,logErr);
+            st->openFailed = 1;
+            st->done = 1;
+            seqReaderClose(&rd);
+            continue;
+        }
+
+        while ((block = seqReaderNext(&rd, BLCKSZ)) != NULL)
+        {
+            decodePageItems(block,st->nPages,allDesc,bootFileName,TABLE_BOOTTYPE,shard,logSucc,logErr,st);
+            st->nPages++;
+        }
+        fclose(shard);
+        seqReaderClose(&rd);
+        st->done = 1;
+    }
+}
+
+/**
+ * readItemsParallel - Decode a table with a pool of worker processes
+ *
+ * @units:        Work units from splitSegmentUnits
+ * @nUnits:       Number of units
+ * @allDesc:      Attribute descriptors
+ * @bootFileName: Table name
+ * @result:       Output file path
+ * @logSucc:      Success log file
+ * @logErr:       Error log file
+ *
+ * Forks up to unloadWorkers children which pull units from a shared
+ * cursor, each unit being decoded into its own shard file. Once all
+ * children exit the shards are concatenated in unit order, so the output
+ * is identical to the sequential path. Worker processes are used because
+ * the decoder keeps its row state in process globals.
+ *
+ * Returns: Same codes as readItems
+ */
+static int readItemsParallel(readItemsArgs *units,int nUnits,pg_attributeDesc *allDesc,char *bootFileName,
+                              char *result,FILE *logSucc,FILE *logErr)
+{
+    size_t sharedLen = nUnits * sizeof(readItemsStat) + sizeof(int);
+    int sharedMapped = 1;
+    char *shared = mmap(NULL, sharedLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED) {
+        shared = malloc(sharedLen);
+        sharedMapped = 0;
+    }
+    memset(shared, 0, sharedLen);
+    readItemsStat *stats = (readItemsStat *)shared;
+    int *nextUnit = (int *)(shared + nUnits * sizeof(readItemsStat));
+
+    int nWorkers = Min(unloadWorkers, nUnits);
+    pid_t *pids = (pid_t *)malloc(nWorkers * sizeof(pid_t));
+    int nForked = 0;
+
+    fflush(stdout);
+    fflush(logSucc);
+    fflush(logErr);
+    for (int w = 0; sharedMapped && w < nWorkers; w++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            readItemsWorker(units,nUnits,stats,nextUnit,allDesc,result,bootFileName,logSucc,logErr);
+            fflush(stdout);
+            fflush(logSucc);
+            fflush(logErr);
+            _exit(0);
+        }
+        else if (pid < 0) {
+            break;
+        }
+        pids[nForked++] = pid;
+    }
+
+    if (nForked == 0) {
+        readItemsWorker(units,nUnits,stats,nextUnit,allDesc,result,bootFileName,logSucc,logErr);
+    }
+    else {
+        int alive = nForked;
+        while (alive > 0) {
+            int nPages = 0, nItemsSucc = 0;
+            for (int u = 0; u < nUnits; u++) {
+                nPages += stats[u].nPages;
+                nItemsSucc += stats[u].nItemsSucc;
+            }
+            if (showDecodeLive) {
+                infoDecodeLive(bootFileName,nPages,nItemsSucc);
+                fflush(stdout);
+            }
+
+            for (int w = 0; w < nForked; w++) {
+                int status;
+                if (pids[w] > 0 && waitpid(pids[w], &status, WNOHANG) == pids[w]) {
+                    pids[w] = 0;
+                    alive--;
+                }
+            }
+            if (alive > 0)
+                usleep(200000);
+        }
+    }
+    free(pids);
+
+    FILE *bootFile = fopen(result, "w");
+    if (!bootFile)
+    {
+        char err1[1050];
+        sprintf(err1,"\nFailed to open target csv file <%s>, please check\n",
+            result);
+        printf("%s",err1);
+        fputs(err1,logErr);
+    }
+
+    char shardPath[MAXPGPATH+20];
+    char *copyBuf = (char *)malloc(1024 * 1024);
+    readItemsStat total;
+    memset(&total, 0, sizeof(total));
+    for (int u = 0; u < nUnits; u++) {
+        readItemsStat *st = &stats[u];
+
+        if (!st->done) {
+            char err1[2048];
+            sprintf(err1,"\nWorker exited before finishing <%s> range %lld-%lld\n",
+                units[u].filename,(long long)units[u].start_offset,(long long)units[u].end_offset);
+            fputs(err1,logErr);
+            total.failExist = 1;
+        }
+
+        sprintf(shardPath,"%s.part%d",result,u);
+        FILE *shard = fopen(shardPath, "r");
+        if (shard) {
+            size_t n;
+            while (bootFile && (n = fread(copyBuf, 1, 1024 * 1024, shard)) > 0)
+                fwrite(copyBuf, 1, n, bootFile);
+            fclose(shard);
+            unlink(shardPath);
+        }
+
+        total.nPages += st->nPages;
+        total.nItemsSucc += st->nItemsSucc;
+        total.nItemsErr += st->nItemsErr;
+        total.failExist |= st->failExist;
+        total.datafileExist |= st->datafileExist;
+        total.openFailed |= st->openFailed;
+
+        if (u == nUnits - 1 || units[u + 1].hundred != units[u].hundred) {
+            int nTotal=total.nItemsErr+total.nItemsSucc;
+            char succ1[1050];
+            #ifdef EN
+            sprintf(succ1,"<%s>-<%s> Completed\n\t|-%d Pages , %d Records Decoded IN TOTAL.SUCCESS: %d ;FAILED: %d\n\t|-File Path: %s\n",
+                            bootFileName,units[u].filename,total.nPages,nTotal,total.nItemsSucc,total.nItemsErr,result);
+            #else
+            sprintf(succ1,"\n\t|-表 %s(%s) 解析完成\n\t|-%d 个数据页 ,共计 %d 条数据. 成功 %d 条; 失败 %d 条\n\t|-文件路径: %s\n\n",
+                bootFileName,units[u].filename,total.nPages,nTotal,total.nItemsSucc,total.nItemsErr,result);
+            #endif
+            infoUnlodResult(bootFileName,units[u].filename,total.nPages,nTotal,total.nItemsSucc,total.nItemsErr,result);
+            if(total.failExist == 0)
+                fputs(succ1,logSucc);
+        }
+    }
+    free(copyBuf);
+    if (bootFile)
+        fclose(bootFile);
+
+    if (sharedMapped)
+        munmap(shared, sharedLen);
+    else
+        free(shared);
+
+    if(!total.datafileExist){
+        unlink(result);
+        return FAILOPEN_RET;
+    }
+    if(total.failExist || total.openFailed || !bootFile){
+        return FAILURE_RET;
+    }
+    return SUCCESS_RET;
+}
 
 /**
  * readItems - Read and decode tuples from PostgreSQL data file
@@ -238,25 +715,23 @@ TimestampTz str_to_timestamptz_og(const char *time_str) {
  *
  * Reads a PostgreSQL heap data file page by page, decodes each tuple
  * according to the table schema, and writes results to output file.
+ * User tables larger than MIN_SIZE_FOR_THREADING are handed to
+ * readItemsParallel when param workers is above one.
  *
  * Returns: SUCCESS_RET on success, FAILURE_RET on failure
  */
 int readItems(TABstruct *taboid,char *filename,char attr2Decode[],char *bootFileName,char *BOOTTYPE,char *logPathSucc,char *logPathErr)
 {
-    unsigned int pageSize;
-    unsigned int keepDumping=1;
-    unsigned int bytesToFormat;
+    char *block;
     FILE *bootFile;
-    int nItemsSucc=0;
-    int nItemsErr=0;
-    int nPages=0;
-    int nCurPageItems=0;
-    int failExistflag=0;
+    readItemsStat st;
     char filenameFINNAL[1024]="";
     pg_attributeDesc *allDesc=NULL;
-    int datafileExist = 0;
     char result[MAXPGPATH];
 
+    memset(&st,0,sizeof(st));
+    memset(result,0,MAXPGPATH);
+
     FILE *logSucc=fopen(logPathSucc,"a");
     FILE *logErr=fopen(logPathErr,"a");
 
@@ -264,6 +739,31 @@ int readItems(TABstruct *taboid,char *filename,char attr2Decode[],char *bootFile
         int nAttr = atoi(taboid->nattr);
         allDesc = (pg_attributeDesc*)malloc(nAttr*sizeof(pg_attributeDesc));
         dropExist1 = getPgAttrDesc(taboid,allDesc);
+        nAllDesc = nAttr;
+    }
+
+    if(strcmp(BOOTTYPE,TABLE_BOOTTYPE) == 0 && unloadWorkers > 1 &&
+       (exmode == CSVform || exmode == SQLform)){
+        int nUnits = 0;
+        readItemsArgs *units = splitSegmentUnits(filename,&nUnits);
+        if(units != NULL){
+            int ret;
+            if(!buildAttr2Process(attr2Decode,BOOTTYPE)){
+                ret = FAILURE_RET;
+            }
+            else{
+                sprintf(result,"%s/%s/%s%s",CUR_DB,CUR_SCH,bootFileName,exmode == CSVform ? ".csv" : ".sql");
+                ret = readItemsParallel(units,nUnits,allDesc,bootFileName,result,logSucc,logErr);
+            }
+            for(int u=0;u<nUnits;u++)
+                free(units[u].filename);
+            free(units);
+            free(allDesc);
+            fclose(logSucc);
+            fclose(logErr);
+            dropExist1=0;
+            return ret;
+        }
     }
 
     int hundred;
@@ -275,9 +775,8 @@ int readItems(TABstruct *taboid,char *filename,char attr2Decode[],char *bootFile
             sprintf(filenameFINNAL,"%s.%d",filename,hundred);
         }
         if (access(filenameFINNAL, F_OK) != -1) {
-            keepDumping = 1;
-            FILE *fp;
-            fp = fopen(filenameFINNAL, "rb");
+            seqReader rd;
+            int openRet = seqReaderOpen(&rd,filenameFINNAL,-1,0,-1,(size_t)readChunkMB * 1024 * 1024,1,ioMode,ioDepth);
 
             #if DROPDEBUG == 1
             int fd = open(filenameFINNAL, O_RDONLY);
@@ -301,7 +800,7 @@ int readItems(TABstruct *taboid,char *filename,char attr2Decode[],char *bootFile
             off_t currOffset = 0;
             #endif
 
-            if (!fp)
+            if (openRet == FAILOPEN_RET)
             {
                 char err1[2048];
                 #ifdef EN
@@ -315,20 +814,14 @@ int readItems(TABstruct *taboid,char *filename,char attr2Decode[],char *bootFile
                 dropExist1=0;
                 return FAILURE_RET;
             }
-            pageSize = BLCKSZ;
-
-            BlockNumber	currentBlockNo = 0;
-            char *block = (char *)malloc(pageSize);
-            memset(block,0,pageSize);
-
-            if (!block)
+            else if (openRet != SUCCESS_RET)
             {
-                printf("\nFAILED TO ALLOCATE SIZE OF <%d> BYTES\n",
-                    pageSize);
+                printf("\nFAILED TO ALLOCATE SIZE OF <%d> MB\n",
+                    readChunkMB);
+                dropExist1=0;
+                return FAILURE_RET;
             }
 
-            resetArray2Process(attr2Process);
-
             memset(result,0,MAXPGPATH);
             if(exmode == CSVform)
                 sprintf(result,"%s/%s/%s%s",CUR_DB,CUR_SCH,bootFileName,".csv");
@@ -355,221 +848,76 @@ int readItems(TABstruct *taboid,char *filename,char attr2Decode[],char *bootFile
                 dropExist1=0;
                 return FAILURE_RET;
             }
-            char *attr2DecodeTMP = (char *)malloc((strlen(attr2Decode)+1)*sizeof(char));
-            strcpy(attr2DecodeTMP,attr2Decode);
-            int nAttr=0;
-
-            char *attrChars[MAX_COL_NUM];
-
-            for (int i = 0; i < MAX_COL_NUM; i++) {
-                attrChars[i] = (char *)malloc(20);
-            }
-            char temp[50];
-            char *token = strtok(attr2DecodeTMP, ",");
-            while (token != NULL) {
-                if (nAttr >= MAX_COL_NUM) {
-                    printf("Exceeded attrChars array capacity\n");
-                }
-                strncpy(temp, token, sizeof(temp) - 1);
-                strcpy(attrChars[nAttr],temp);
-                nAttr++;
-                token = strtok(NULL, ",");
-            }
-
-            int a;
-            for (a=0;a<nAttr;a++){
-                char ret[100];
-                memset(ret,0,100);
-                getStdTyp(attrChars[a],ret);
-                if(!AddList2Prcess(attr2Process,ret,BOOTTYPE)){
-                    dropExist1=0;
-                    return FAILURE_RET;
-                }
-            }
-            for (int i = 0; i < MAX_COL_NUM; i++) {
-                free(attrChars[i]);
-            }
-
-            if(!strcmp(BOOTTYPE,DB_BOOTTYPE)){
-                seperFunc2Use=&commaStrWriteIntoFileDB;
-            }
-            else if(!strcmp(BOOTTYPE,SCHEMA_BOOTTYPE) || !strcmp(BOOTTYPE,TYPE_BOOTTYPE)){
-                seperFunc2Use=&commaStrWriteIntoFileSCH_TYP;
-            }
-            else if(!strcmp(BOOTTYPE,CLASS_BOOTTYPE)){
-                seperFunc2Use=&commaStrWriteIntoFileCLASS;
-            }
-            else if(!strcmp(BOOTTYPE,ATTR_BOOTTYPE)){
-                seperFunc2Use=&commaStrWriteIntoFIleAttr;
-            }
-            else if(!strcmp(BOOTTYPE,TABLE_BOOTTYPE)) {
-                seperFunc2Use=commaStrWriteIntoDecodeTab;
+            if(!buildAttr2Process(attr2Decode,BOOTTYPE)){
+                dropExist1=0;
+                return FAILURE_RET;
             }
-            while(keepDumping){
+            for(;;){
 
                 #if DROPDEBUG == 1
-                off_t current_logical = ftello(fp);
-                if (current_logical == -1) {
-                    perror("ftello");
-                    break;
-                }
+                off_t current_logical = rd.bufOff + rd.bufPos;
                 currOffset = logical_to_physical(current_logical, fiemap);
                 #endif
 
                 #if DROPDEBUG == 0
-                if(strcmp(BOOTTYPE,TABLE_BOOTTYPE) == 0){
-                    infoDecodeLive(bootFileName,nPages,nItemsSucc);
+                if(strcmp(BOOTTYPE,TABLE_BOOTTYPE) == 0 && showDecodeLive){
+                    infoDecodeLive(bootFileName,st.nPages,st.nItemsSucc);
                     fflush(stdout);
                 }
                 #endif
 
-                bytesToFormat = fread(block, 1, pageSize, fp);
-                if (bytesToFormat == 0)
+                block = seqReaderNext(&rd, BLCKSZ);
+                if (block == NULL)
                 {
-                    keepDumping = 0;
+                    break;
                 }
                 else{
-                    Page page = (Page) block;
-                    PageHeader	p = (PageHeader) page;
-                    uint16		pagesizeCheck = 0;
-
-                    /*
-                    * Don't verify page data unless the page passes basic non-zero test
-                    */
-                    if (!PageIsNew(page) && strcmp(BOOTTYPE,TABLE_BOOTTYPE) == 0)
-                    {
-                        pagesizeCheck = p->pd_pagesize_version;
-                    }
-
-                    unsigned int x;
-                    unsigned int i;
-                    unsigned int itemSize;
-                    unsigned int itemOffset;
-                    unsigned int itemFlags;
-                    ItemId		itemId;
-                    int	maxOffset;
-
-                    maxOffset = PageGetMaxOffsetNumber(page);
-
-                    if (maxOffset == 0)
+                    if (!decodePageItems(block,st.nPages,allDesc,bootFileName,BOOTTYPE,bootFile,logSucc,logErr,&st))
                     {
-                        #ifdef EN
-                        printf("\n\t|-Block %d Empty Page Or Page Corruptted, Skipped\n",nPages);
-                        #else
-                        printf("\n\t|-块号%d 空页面或页面已损坏 ,已跳过\n",nPages);
-                        #endif
-                        nPages++;
+                        st.nPages++;
                         continue;
                     }
-
-                    bool all_visible = PageIsAllVisible(page);
-                    for(x= 1 ; x < maxOffset+1 ; x++){
-
-                        itemId = PageGetItemId(page, x);
-
-                        itemFlags = (unsigned int) ItemIdGetFlags(itemId);
-                        itemSize = (unsigned int) ItemIdGetLength(itemId);
-                        itemOffset = (unsigned int) ItemIdGetOffset(itemId);
-
-                        HeapTupleHeader header = (HeapTupleHeader) &block[itemOffset];
-
-                        TransactionId xmax = HeapTupleHeaderGetRawXmax(header);
-                        TransactionId xmin = HeapTupleHeaderGetRawXmin(header);
-
-                        if (itemFlags == LP_NORMAL){
-                            unsigned int processed_size = 0;
-
-                            bool		valid;
-                            if (all_visible)
-                                valid = true;
-                            else
-                                valid = HeapTupleSatisfiesVisibility(header);
-
-                            if( !valid ){
-                                continue;
-                            }
-
-                            char *xman=xmanDecode(dropExist1,allDesc,attr2Process,&block[itemOffset],itemSize,BOOTTYPE,logSucc,logErr);
-                            datafileExist=1;
-
-                            if(strcmp(BOOTTYPE,DB_BOOTTYPE) == 0 && strcmp(xman,"NoWayOut") != 0){
-
-                                char *target =  get_field('\t',xman,2) ;
-
-                                if(strcmp(target, "template1") == 0 || 
-                                    strcmp(target, "template0") == 0 ||
-                                    strcmp(target, "security") == 0)
-                                {
-                                    continue;
-                                }
-
-                            }
-
-                            if ( strcmp(xman,"NoWayOut") == 0 ){
-                                nItemsErr++;
-                                failExistflag = 1;
-                                continue;
-                            }
-                            else{
-                                char *xmanret=NULL;
-                                if(exmode == CSVform){
-                                    xmanret = xman;
-                                }
-                                else if (exmode == SQLform){
-                                    xmanret = xman2Insertxman(xman,bootFileName);
-                                }
-                                seperFunc2Use(xmanret,bootFile);
-                                nItemsSucc++;
-
-                                nCurPageItems++;
-
-                            }
-                        }
-                    }
                     #if DROPDEBUG == 1
                     FILE *a = fopen("unloaddropscan.txt","a");
                     char content[1000] = {0};
-                    printf("Offset:%-10lld data page:%d records count:%d total records:%d byte offset from last page:%-10lld\n",currOffset,nPages,maxOffset,nItemsSucc,currOffset-lastMatchedOffset);
-                    sprintf(content,"Offset:%-10lld data page:%d records count:%d total records:%d byte offset from last page:%-10lld\n",currOffset,nPages,maxOffset,nItemsSucc,currOffset-lastMatchedOffset);
+                    printf("Offset:%-10lld data page:%d records count:%d total records:%d byte offset from last page:%-10lld\n",currOffset,st.nPages,PageGetMaxOffsetNumber((Page)block),st.nItemsSucc,currOffset-lastMatchedOffset);
+                    sprintf(content,"Offset:%-10lld data page:%d records count:%d total records:%d byte offset from last page:%-10lld\n",currOffset,st.nPages,PageGetMaxOffsetNumber((Page)block),st.nItemsSucc,currOffset-lastMatchedOffset);
                     lastMatchedOffset=currOffset;
                     fputs(content,a);
                     fclose(a);
                     #endif
-                    nPages++;
-                    currentBlockNo++;
+                    st.nPages++;
                 }
             }
 
             if (strcmp(BOOTTYPE,TABLE_BOOTTYPE) == 0){
-                int nTotal=nItemsErr+nItemsSucc;
+                int nTotal=st.nItemsErr+st.nItemsSucc;
                 char succ1[1050];
                 #ifdef EN
                 sprintf(succ1,"<%s>-<%s> Completed\n\t|-%d Pages , %d Records Decoded IN TOTAL.SUCCESS: %d ;FAILED: %d\n\t|-File Path: %s\n",
-                                bootFileName,filenameFINNAL,nPages,nTotal,nItemsSucc,nItemsErr,result);
+                                bootFileName,filenameFINNAL,st.nPages,nTotal,st.nItemsSucc,st.nItemsErr,result);
                 #else
                 sprintf(succ1,"\n\t|-表 %s(%s) 解析完成\n\t|-%d 个数据页 ,共计 %d 条数据. 成功 %d 条; 失败 %d 条\n\t|-文件路径: %s\n\n",
-                    bootFileName,filenameFINNAL,nPages,nTotal,nItemsSucc,nItemsErr,result);
+                    bootFileName,filenameFINNAL,st.nPages,nTotal,st.nItemsSucc,st.nItemsErr,result);
                 #endif
-                infoUnlodResult(bootFileName,filenameFINNAL,nPages,nTotal,nItemsSucc,nItemsErr,result);
-                if(failExistflag == 0)
+                infoUnlodResult(bootFileName,filenameFINNAL,st.nPages,nTotal,st.nItemsSucc,st.nItemsErr,result);
+                if(st.failExist == 0)
                     fputs(succ1,logSucc);
             }
-            free(block);
             fclose(bootFile);
-            fclose(fp);
-            free(attr2DecodeTMP);
+            seqReaderClose(&rd);
         } else {
             break;
         }
     }
     fclose(logSucc);
     fclose(logErr);
-    if(!datafileExist){
+    if(!st.datafileExist){
         unlink(result);
         dropExist1=0;
         return FAILOPEN_RET;
     }
-    if(failExistflag){
+    if(st.failExist){
         dropExist1=0;
         return FAILURE_RET;
     }
@@ -1001,17 +1349,21 @@ parray* bootDropContextforISO()
 }
 
 /**
- * toastBootstrap - Initialize TOAST table metadata
+ * toastBootstrap - Build the TOAST chunk index of a table
  *
- * @toastmeta: Path to TOAST metadata file
+ * @toastmeta: Directory holding the TOAST indexes
  * @toastnode: TOAST table node identifier
  *
- * Loads TOAST table chunk information for large value reconstruction.
+ * Scans every segment of the TOAST relation once and writes
+ * <toastmeta>/<toastnode> as a binary index sorted by (valueid, chunkseq),
+ * which unload and restore then map instead of rescanning the relation.
  */
 void toastBootstrap(char *toastmeta,char *toastnode)
 {
     char taostFilenameFINNAL[MAXPGPATH]={0};
     char metatoastFilename[100];
+    FILE *metatoastFp = NULL;
+    int toastIsEmpty = 1;
 
     snprintf(metatoastFilename, sizeof(metatoastFilename), "%s/%s", toastmeta, toastnode);
     unlink(metatoastFilename);
@@ -1022,32 +1374,37 @@ void toastBootstrap(char *toastmeta,char *toastnode)
         else{
             sprintf(taostFilenameFINNAL,"%s/%s.%d",CUR_DBDIR,toastnode,hundred);
         }
-        if (access(taostFilenameFINNAL, F_OK) != -1) {
-            FILE *toastRelFp = fopen(taostFilenameFINNAL, "rb");
-            if (toastRelFp == NULL) {
-            } else {
-                FILE *metatoastFp = fopen(metatoastFilename, "a");
-                if (metatoastFp == NULL) {
-                    perror("Failed to create metatoast file");
-                    fclose(toastRelFp);
-                } else {
-                    unsigned int toastRelBlkSize = determinePageDimension(toastRelFp);
-                    fseek(toastRelFp, 0, SEEK_SET);
-                    int toastIsEmpty = getToastHash(toastRelFp, toastRelBlkSize, metatoastFp, hundred);
-
-                    fclose(toastRelFp);
+        if (access(taostFilenameFINNAL, F_OK) == -1) {
+            break;
+        }
+        FILE *toastRelFp = fopen(taostFilenameFINNAL, "rb");
+        if (toastRelFp == NULL) {
+            continue;
+        }
+        if (metatoastFp == NULL) {
+            metatoastFp = fopen(metatoastFilename, "wb");
+            if (metatoastFp == NULL || toastIndexWriteHeader(metatoastFp) != SUCCESS_RET) {
+                perror("Failed to create metatoast file");
+                if (metatoastFp != NULL)
                     fclose(metatoastFp);
-
-                    if (toastIsEmpty) {
-                        if (unlink(metatoastFilename) != 0) {
-                            perror("Failed to delete metatoast file");
-                        }
-                    }
-                }
+                fclose(toastRelFp);
+                unlink(metatoastFilename);
+                return;
             }
         }
-        else{
-            break;
+        unsigned int toastRelBlkSize = determinePageDimension(toastRelFp);
+        fseek(toastRelFp, 0, SEEK_SET);
+        if (!getToastIndex(toastRelFp, toastRelBlkSize, metatoastFp, hundred))
+            toastIsEmpty = 0;
+        fclose(toastRelFp);
+    }
+
+    if (metatoastFp == NULL)
+        return;
+    if (fclose(metatoastFp) != 0 || toastIsEmpty ||
+        toastIndexFinish(metatoastFilename) != SUCCESS_RET) {
+        if (unlink(metatoastFilename) != 0) {
+            perror("Failed to delete metatoast file");
         }
     }
 }
@@ -1363,15 +1720,14 @@ void bootstrap_abnormal(){
                         strcpy(schtaboid[k1].filenode,taboidTMP[j1].filenode);
 
                         if(strcmp(taboidTMP[j1].toastoid,"0") != 0){
-                            unsigned int toast2searchIndex = hash(toastTaboid_harray,taboidTMP[j1].toastoid,toastTaboid_harray->allocated);
-                            Node* node = toastTaboid_harray->table[toast2searchIndex];
-                            while (node != NULL) {
-                                TABstruct* onatoastoid = (TABstruct*)node->data;
+                            harrayIter it;
+                            TABstruct* onatoastoid;
+                            harray_iter_init(&it,toastTaboid_harray,strtoull(taboidTMP[j1].toastoid,NULL,10));
+                            while ((onatoastoid = (TABstruct*)harray_iter_next(&it)) != NULL) {
                                 if(strcmp(onatoastoid->oid,taboidTMP[j1].toastoid) == 0){
                                     strcpy(schtaboid[k1].toastnode,onatoastoid->filenode);
                                     strcpy(schtaboid[k1].toastoid,onatoastoid->oid);
                                 }
-                                node = node->next;
                             }
                         }
                         else{
@@ -1555,15 +1911,14 @@ void bootstrap(){
                         strcpy(schtaboid[k1].filenode,taboidTMP[j1].filenode);
 
                         if(strcmp(taboidTMP[j1].toastoid,"0") != 0){
-                            unsigned int toast2searchIndex = hash(toastTaboid_harray,taboidTMP[j1].toastoid,toastTaboid_harray->allocated);
-                            Node* node = toastTaboid_harray->table[toast2searchIndex];
-                            while (node != NULL) {
-                                TABstruct* onatoastoid = (TABstruct*)node->data;
+                            harrayIter it;
+                            TABstruct* onatoastoid;
+                            harray_iter_init(&it,toastTaboid_harray,strtoull(taboidTMP[j1].toastoid,NULL,10));
+                            while ((onatoastoid = (TABstruct*)harray_iter_next(&it)) != NULL) {
                                 if(strcmp(onatoastoid->oid,taboidTMP[j1].toastoid) == 0){
                                     strcpy(schtaboid[k1].toastnode,onatoastoid->filenode);
                                     strcpy(schtaboid[k1].toastoid,onatoastoid->oid);
                                 }
-                                node = node->next;
                             }
                         }
                         else{
@@ -2153,28 +2508,110 @@ void DESC(char *former,char *latter){
 
 }
 
-#if defined(__linux__)
 /**
- * allocate_start_end_to_parray - Load WAL file list from directory
+ * walFileArrayGrow - Make room in a WAL file list
  *
- * @directory1: Path to WAL directory
- * @array:      Output array for WAL file names
+ * @array: List to grow, may point to NULL
+ * @cap:   Current capacity, updated
+ * @need:  Number of entries required
+ *
+ * Returns: 1 on success, 0 on allocation failure
+ */
+static int walFileArrayGrow(WALFILE **array,int *cap,int need)
+{
+    if (need <= *cap)
+        return 1;
+    int newCap = *cap > 0 ? *cap * 2 : 1024;
+    while (newCap < need)
+        newCap *= 2;
+    WALFILE *grown = (WALFILE*)realloc(*array,sizeof(WALFILE)*newCap);
+    if (grown == NULL) {
+        printf("\nFAILED TO ALLOCATE SIZE OF <%zu> BYTES \n",sizeof(WALFILE)*newCap);
+        return 0;
+    }
+    *array = grown;
+    *cap = newCap;
+    return 1;
+}
+
+/**
+ * walArchiveEntry - Accept a directory entry as a WAL segment
  *
- * Scans directory for WAL files and populates array.
+ * @name:    Directory entry name
+ * @size:    File size in bytes
+ * @minSize: Smallest plain segment worth listing
+ * @segname: Output segment name without compression suffix
  *
- * Returns: Number of WAL files found
+ * Segments compressed by archive_command (.gz, .lz4) are listed under
+ * their plain name whatever their size; pg_walgettx inflates them.
+ *
+ * Returns: 1 if the entry is a segment, else 0
  */
-int allocate_start_end_to_parray(char *directory1,WALFILE *array) {
-    DIR *dir1;
-    struct dirent *entry1;
-    int arraySize=0;
-    dir1 = opendir(directory1);
-    if (dir1 == NULL) {
-        ErrorArchPathNotExist(directory1);
-        exit(1);
+static int walArchiveEntry(const char *name,long long size,long long minSize,char *segname)
+{
+    size_t len = strlen(name);
+    if (IsXLogFileName(name)){
+        if (size <= minSize)
+            return 0;
+        strcpy(segname,name);
+        return 1;
     }
-    else{
-        while ((entry1 = readdir(dir1)) != NULL) {
+    if (len <= XLOG_FNAME_LEN ||
+        (strcmp(name + XLOG_FNAME_LEN, ".gz") != 0 && strcmp(name + XLOG_FNAME_LEN, ".lz4") != 0))
+        return 0;
+    memcpy(segname,name,XLOG_FNAME_LEN);
+    segname[XLOG_FNAME_LEN] = '\0';
+    return size > 0 && IsXLogFileName(segname);
+}
+
+/**
+ * walFileArrayDedup - Drop segments listed twice
+ *
+ * @array: Sorted segment names
+ * @n:     Number of names
+ *
+ * A segment present both plain and compressed is listed once.
+ *
+ * Returns: Number of names left
+ */
+static int walFileArrayDedup(WALFILE *array,int n)
+{
+    int kept = 0;
+    for (int i = 0; i < n; i++)
+    {
+        if (kept > 0 && strcmp(array[kept-1].walnames,array[i].walnames) == 0)
+            continue;
+        if (kept != i)
+            array[kept] = array[i];
+        kept++;
+    }
+    return kept;
+}
+
+#if defined(__linux__)
+/**
+ * allocate_start_end_to_parray - Load WAL file list from directory
+ *
+ * @directory1: Path to WAL directory
+ * @array:      Output array for WAL file names, grown with realloc
+ *
+ * Scans directory for WAL files and populates array, however many
+ * segments the directory holds.
+ *
+ * Returns: Number of WAL files found
+ */
+int allocate_start_end_to_parray(char *directory1,WALFILE **array) {
+    DIR *dir1;
+    struct dirent *entry1;
+    int arraySize=0;
+    int arrayCap=0;
+    dir1 = opendir(directory1);
+    if (dir1 == NULL) {
+        ErrorArchPathNotExist(directory1);
+        exit(1);
+    }
+    else{
+        while ((entry1 = readdir(dir1)) != NULL) {
 
             if (entry1->d_type == 8) {
                 char fullPath[1024];
@@ -2186,15 +2623,21 @@ int allocate_start_end_to_parray(char *directory1,WALFILE *array) {
                     continue;
                 }
 
-                if (file_stat.st_size > 1048576 && IsXLogFileName(entry1->d_name)){
-                    strcpy(array[arraySize].walnames,entry1->d_name);
+                char segname[50];
+                if (walArchiveEntry(entry1->d_name,file_stat.st_size,1048576,segname)){
+                    if (!walFileArrayGrow(array,&arrayCap,arraySize+1))
+                        break;
+                    strcpy((*array)[arraySize].walnames,segname);
                     arraySize++;
                 }
             }
         }
     }
 
-    qsort(array,arraySize,sizeof(WALFILE), compare_walfile);
+    if (arraySize > 0){
+        qsort(*array,arraySize,sizeof(WALFILE), compare_walfile);
+        arraySize = walFileArrayDedup(*array,arraySize);
+    }
 
     closedir(dir1);
     return arraySize;
@@ -2204,16 +2647,18 @@ int allocate_start_end_to_parray(char *directory1,WALFILE *array) {
  * allocate_start_end_to_parray - Load WAL file list from directory
  *
  * @directory1: Path to WAL directory
- * @array:      Output array for WAL file names
+ * @array:      Output array for WAL file names, grown with realloc
  *
- * Scans directory for WAL files and populates array.
+ * Scans directory for WAL files and populates array, however many
+ * segments the directory holds.
  *
  * Returns: Number of WAL files found
  */
-int allocate_start_end_to_parray(char *directory1, WALFILE *array) {
+int allocate_start_end_to_parray(char *directory1, WALFILE **array) {
     WIN32_FIND_DATA findData;
     HANDLE hFind = INVALID_HANDLE_VALUE;
     int arraySize = 0;
+    int arrayCap = 0;
 
     char searchPath[1024];
     sprintf(searchPath, "%s\\*", directory1);
@@ -2248,8 +2693,11 @@ int allocate_start_end_to_parray(char *directory1, WALFILE *array) {
                 fileSize.HighPart = file_info.nFileSizeHigh;
                 fileSize.LowPart = file_info.nFileSizeLow;
 
-                if (fileSize.QuadPart > 10485760 && IsXLogFileName(findData.cFileName)) {
-                    strcpy(array[arraySize].walnames, findData.cFileName);
+                char segname[50];
+                if (walArchiveEntry(findData.cFileName, fileSize.QuadPart, 10485760, segname)) {
+                    if (!walFileArrayGrow(array, &arrayCap, arraySize + 1))
+                        break;
+                    strcpy((*array)[arraySize].walnames, segname);
                     arraySize++;
                 }
             }
@@ -2258,7 +2706,10 @@ int allocate_start_end_to_parray(char *directory1, WALFILE *array) {
 
     FindClose(hFind);
 
-    qsort(array, arraySize, sizeof(WALFILE), compare_walfile);
+    if (arraySize > 0) {
+        qsort(*array, arraySize, sizeof(WALFILE), compare_walfile);
+        arraySize = walFileArrayDedup(*array, arraySize);
+    }
 
     return arraySize;
 }
@@ -2268,12 +2719,13 @@ int allocate_start_end_to_parray(char *directory1, WALFILE *array) {
  * initWalScan - Initialize WAL scanning parameters
  *
  * @flag:                Scan mode flag
- * @archDirFiles_array:  Archive directory file list
- * @walDirFiles_array:   WAL directory file list
+ * @archDirFiles_array:  Archive directory file list, allocated here
+ * @walDirFiles_array:   WAL directory file list, allocated here
  *
- * Sets up WAL file lists for transaction scanning.
+ * Sets up WAL file lists for transaction scanning. The caller frees
+ * both lists.
  */
-void initWalScan(int flag,WALFILE *archDirFiles_array,WALFILE *walDirFiles_array){
+void initWalScan(int flag,WALFILE **archDirFiles_array,WALFILE **walDirFiles_array){
 
     nWal = 0;
     TxXman_harray = NULL;
@@ -2307,8 +2759,12 @@ void printLsnT()
         char ret1[60];
         char ret2[60];
 
-        sprintf(ret1,"         %s",elem->startLSNforTOAST);
-        sprintf(ret2,"         %s",elem->endLSNforTOAST);
+        char startLsn[20];
+        char endLsn[20];
+        lsnToStr(elem->startLSNforTOAST,startLsn);
+        lsnToStr(elem->endLSNforTOAST,endLsn);
+        sprintf(ret1,"         %s",startLsn);
+        sprintf(ret2,"         %s",endLsn);
 
         printfParam("startlsnt",ret1);
         printfParam("endlsnt",ret2);
@@ -2319,6 +2775,71 @@ void printLsnT()
     }
 }
 
+/**
+ * restoreAttr2Process - Fill attr2Process from a table's type list
+ *
+ * @typ: Comma-separated column types, or xman to leave it empty
+ *
+ * Returns: SUCCESS_RET, or FAILURE_RET on an unsupported type
+ */
+static int restoreAttr2Process(char *typ)
+{
+    resetArray2Process(attr2Process);
+    if(strcmp(typ,"xman") != 0){
+        char *attr2DecodeTMP = (char *)malloc((strlen(typ)+1)*sizeof(char));
+        strcpy(attr2DecodeTMP,typ);
+        int nAttr=0;
+        char *attrChars[MAX_COL_NUM];
+        for (int i = 0; i < MAX_COL_NUM; i++) {
+            attrChars[i] = (char *)malloc(20);
+        }
+        char temp[50];
+        char *token = strtok(attr2DecodeTMP, ",");
+        while (token != NULL) {
+            if (nAttr >= 1024) {
+                printf("ExceededattrCharsarray capacity\n");
+            }
+            strncpy(temp, token, sizeof(temp) - 1);
+            strcpy(attrChars[nAttr],temp);
+            nAttr++;
+            token = strtok(NULL, ",");
+        }
+
+        int a;
+        for (a=0;a<nAttr;a++){
+            char ret[100];
+            memset(ret,0,100);
+            getStdTyp(attrChars[a],ret);
+            if(!AddList2Prcess(attr2Process,ret,TABLE_BOOTTYPE)){
+                return FAILURE_RET;
+            }
+        }
+        for (int i = 0; i < MAX_COL_NUM; i++) {
+            free(attrChars[i]);
+        }
+    }
+    return SUCCESS_RET;
+}
+
+/**
+ * restoreToastInit - Load the TOAST index a WAL restore rebuilt
+ *
+ * @toastnode: TOAST relfilenode of the restored table
+ */
+static void restoreToastInit(char *toastnode)
+{
+    char DBDIRcopy[MAXPGPATH]={0};
+    strcpy(DBDIRcopy,CUR_DBDIR);
+    strcpy(CUR_DBDIR,"restore/datafile");
+    toastBootstrap("restore/toastmeta",toastnode);
+    strcpy(CUR_DBDIR,DBDIRcopy);
+    toastIndexClose(toastIdx);
+    toastIdx = NULL;
+    initToastIndex("restore",toastnode);
+    initToastId(toastnode);
+    setToastIndex(toastIdx);
+}
+
 /**
  * execGetTx - Execute transaction retrieval from WAL
  *
@@ -2361,6 +2882,11 @@ int execGetTx(parray *GetTxRetAll,WALFILE *archDirFiles,WALFILE *walDirFiles,int
     parray *GetTxRetFromWal=NULL;
     parray *GetTxRetFromArch=NULL;
 
+    if(archWaldirNum == 0){
+        ErrorArchivePath(initArchPath);
+        exit(1);
+    }
+
     if(strlen(manualSrtWal) > 0 && strlen(manualEndWal) == 0){
         if(IsXLogFileName(manualSrtWal)){
             strcpy(start_archfilename,manualSrtWal);
@@ -2447,17 +2973,10 @@ int execGetTx(parray *GetTxRetAll,WALFILE *archDirFiles,WALFILE *walDirFiles,int
         infoRestoreMode(item);
     }
 
-    int walDiff=countFilesBetween(start_archfilename,end_archfilename);
-    if(walDiff+2 > 250){
-        #ifdef CN
-        printf("%s当前的WAL文件区间的文件个数为%d,超过250个 ,建议设置参数startwal与endwal ,本次不执行%s\n",COLOR_WARNING,walDiff+2,C_RESET);
-        #else
-        printf("%sWAL file number in current file range is %d, which is over 250, parameter <startwal> and <endwal> are recommended ,quit executing this time%s\n",COLOR_WARNING,walDiff,C_RESET);
-        #endif
-        return FAILURE_RET;
+    if(pgwalWaldirNum > 0){
+        strcpy(start_walfilename,walDirFiles[0].walnames);
+        strcpy(end_walfilename,walDirFiles[pgwalWaldirNum-1].walnames);
     }
-    strcpy(start_walfilename,walDirFiles[0].walnames);
-    strcpy(end_walfilename,walDirFiles[pgwalWaldirNum-1].walnames);
 
     if(flag == DELRESTORE){
         int startWalDiff=countFilesBetween(start_archfilename,startwal);
@@ -2489,59 +3008,37 @@ int execGetTx(parray *GetTxRetAll,WALFILE *archDirFiles,WALFILE *walDirFiles,int
         }
     }
 
-    resetArray2Process(attr2Process);
-    if(strcmp(typ,"xman") != 0){
-        char *attr2DecodeTMP = (char *)malloc((strlen(typ)+1)*sizeof(char));
-        strcpy(attr2DecodeTMP,typ);
-        int nAttr=0;
-        char *attrChars[MAX_COL_NUM];
-        for (int i = 0; i < MAX_COL_NUM; i++) {
-            attrChars[i] = (char *)malloc(20);
-        }
-        char temp[50];
-        char *token = strtok(attr2DecodeTMP, ",");
-        while (token != NULL) {
-            if (nAttr >= 1024) {
-                printf("ExceededattrCharsarray capacity\n");
-            }
-            strncpy(temp, token, sizeof(temp) - 1);
-            strcpy(attrChars[nAttr],temp);
-            nAttr++;
-            token = strtok(NULL, ",");
-        }
+    if(!restoreAttr2Process(typ)){
+        return FAILURE_RET;
+    }
 
-        int a;
-        for (a=0;a<nAttr;a++){
-            char ret[100];
-            memset(ret,0,100);
-            getStdTyp(attrChars[a],ret);
-            if(!AddList2Prcess(attr2Process,ret,TABLE_BOOTTYPE)){
-                return FAILURE_RET;
+    if(flag == DELRESTORE && nScanTabs > 1){
+        /* One pass routes every scanned table; decoding follows per table */
+        pgGetTxforArch(&GetTxRetFromArch,SrtTime,EndTime,archDirFiles,archWaldirNum,
+                start_archfilename,end_archfilename,archivedir,
+                flag,datafile,oldDatafile,toastfile,oldToastfile,tabname,
+                TxForRestore,1,attr2Process,taboid);
+        for (int i = 0; i < nScanTabs; i++){
+            if(!restoreAttr2Process(scanTabs[i]->typ)){
+                continue;
             }
-        }
-        for (int i = 0; i < MAX_COL_NUM; i++) {
-            free(attrChars[i]);
+            restoreToastInit(scanTabs[i]->toastnode);
+            restoreTargetReplay(i,attr2Process,TxForRestore,SrtTime,EndTime);
         }
     }
-
-    if(flag == DELRESTORE){
+    else{
+        if(flag == DELRESTORE){
+            pgGetTxforArch(&GetTxRetFromArch,SrtTime,EndTime,archDirFiles,archWaldirNum,
+                    start_archfilename,end_archfilename,archivedir,
+                    flag,"0","0",toastfile,oldToastfile,tabname,
+                    TxForRestore,1,attr2Process,taboid);
+            restoreToastInit(taboid->toastnode);
+        }
         pgGetTxforArch(&GetTxRetFromArch,SrtTime,EndTime,archDirFiles,archWaldirNum,
                 start_archfilename,end_archfilename,archivedir,
-                flag,"0","0",toastfile,oldToastfile,tabname,
+                flag,datafile,oldDatafile,toastfile,oldToastfile,tabname,
                 TxForRestore,1,attr2Process,taboid);
-        char DBDIRcopy[MAXPGPATH]={0};
-        strcpy(DBDIRcopy,CUR_DBDIR);
-        strcpy(CUR_DBDIR,"restore/datafile");
-        toastBootstrap("restore/toastmeta",taboid->toastnode);
-        strcpy(CUR_DBDIR,DBDIRcopy);
-        int toastInitRet = initToastHash("restore",taboid->toastnode);
-        initToastId(taboid->toastnode);
-        setToastHash(toastHash);
-    }
-    pgGetTxforArch(&GetTxRetFromArch,SrtTime,EndTime,archDirFiles,archWaldirNum,
-            start_archfilename,end_archfilename,archivedir,
-            flag,datafile,oldDatafile,toastfile,oldToastfile,tabname,
-            TxForRestore,1,attr2Process,taboid);
+    }
 
     if(GetTxRetFromArch != NULL && parray_num(GetTxRetFromArch) > 0 && flag != DELRESTORE){
         int x;
@@ -2565,10 +3062,75 @@ int execGetTx(parray *GetTxRetAll,WALFILE *archDirFiles,WALFILE *walDirFiles,int
     if (GetTxRetFromWal != NULL) {
         parray_free(GetTxRetFromWal);
     }
+    walInflateCacheCleanup();
 
     return SUCCESS_RET;
 }
 
+/**
+ * scanTargetsResolve - Resolve the tables of a scan
+ *
+ * @arg: A table name, a comma-separated list of tables, or meta for
+ *       every table of the current schema
+ * @n:   Output, number of tables
+ *
+ * The tables are kept in scanTabs for the restore that follows.
+ *
+ * Returns: Tables, NULL after reporting an unknown name
+ */
+static TABstruct **scanTargetsResolve(char *arg,int *n)
+{
+    TABstruct **tabs = (TABstruct **)malloc(sizeof(TABstruct *) * (tabSize > 0 ? tabSize : 1));
+    int found = 0;
+
+    for (int i = 0; i < tabSize; i++){
+        if(strcmp(taboid[i].tab,arg) == 0){
+            tabs[found++] = &taboid[i];
+            break;
+        }
+    }
+    if(found == 0 && strcmp(arg,"meta") == 0){
+        for (int i = 0; i < tabSize; i++)
+            tabs[found++] = &taboid[i];
+    }
+    else if(found == 0 && strchr(arg,',') != NULL){
+        char *list = strdup(arg);
+        char *saveptr = NULL;
+        for (char *name = strtok_r(list,",",&saveptr); name != NULL; name = strtok_r(NULL,",",&saveptr)){
+            int matched = 0;
+            trim_char(name,' ');
+            for (int i = 0; i < tabSize && !matched; i++){
+                if(strcmp(taboid[i].tab,name) == 0){
+                    int dup = 0;
+                    for (int j = 0; j < found; j++)
+                        dup |= tabs[j] == &taboid[i];
+                    if(!dup)
+                        tabs[found++] = &taboid[i];
+                    matched = 1;
+                }
+            }
+            if(!matched){
+                ErrorTabNotExist(name);
+                free(list);
+                free(tabs);
+                return NULL;
+            }
+        }
+        free(list);
+    }
+
+    if(found == 0){
+        ErrorTabNotExist(arg);
+        free(tabs);
+        return NULL;
+    }
+    free(scanTabs);
+    scanTabs = tabs;
+    nScanTabs = found;
+    *n = found;
+    return tabs;
+}
+
 /**
  * SCAN - Scan for deleted/truncated table records
  *
@@ -2579,10 +3141,10 @@ int execGetTx(parray *GetTxRetAll,WALFILE *archDirFiles,WALFILE *walDirFiles,int
  */
 void SCAN(char *former,char *latter)
 {
-    WALFILE *walDirFiles_array = (WALFILE*)malloc(sizeof(WALFILE)*2048);
-    WALFILE *archDirFiles_array = (WALFILE*)malloc(sizeof(WALFILE)*2048);
+    WALFILE *walDirFiles_array = NULL;
+    WALFILE *archDirFiles_array = NULL;
 
-    initWalScan(SCANINIT,archDirFiles_array,walDirFiles_array);
+    initWalScan(SCANINIT,&archDirFiles_array,&walDirFiles_array);
     unloadTimer("start");
     if ( !taboid ){
         warningUseDBFirst();
@@ -2659,24 +3221,28 @@ void SCAN(char *former,char *latter)
 
     }
     else{
+        int nTabs = 0;
+        TABstruct **tabs = scanTargetsResolve(latter,&nTabs);
+        if( tabs != NULL ){
+            TABstruct *tab = tabs[0];
+            char label[50];
+            snprintf(label,sizeof(label),"%s",nTabs > 1 ? latter : tab->tab);
+            char pgFilePath[1024]="";
+            sprintf(pgFilePath, "%s/%s", CUR_DBDIR,tab->filenode);
+            #ifdef EN
+            printf("\n%sScanning %s%s%s %sRecords for table<%s>...%s\n\n",C_WHITE2,COLOR_ERROR,resStr,C_RESET,C_WHITE2,label,C_RESET);
+            #else
+            printf("\n%s正在扫描表<%s>的%s%s%s记录...%s\n\n",C_WHITE2,label,COLOR_ERROR,resStr,C_RESET,C_RESET);
+            #endif
+            setRestoreTargets_there(nTabs > 1 ? tabs : NULL,nTabs > 1 ? nTabs : 0);
 
-        for ( i = 0; i < tabSize; i++ ) {
-            if( strcmp( taboid[i].tab,latter) == 0 ){
-                char pgFilePath[1024]="";
-                sprintf(pgFilePath, "%s/%s", CUR_DBDIR,taboid[i].filenode);
-                #ifdef EN
-                printf("\n%sScanning %s%s%s %sRecords for table<%s>...%s\n\n",C_WHITE2,COLOR_ERROR,resStr,C_RESET,C_WHITE2,taboid[i].tab,C_RESET);
-                #else
-                printf("\n%s正在扫描表<%s>的%s%s%s记录...%s\n\n",C_WHITE2,taboid[i].tab,COLOR_ERROR,resStr,C_RESET,C_RESET);
-                #endif
-
-                if(! execGetTx(GetTxRetAll,archDirFiles_array,walDirFiles_array,DEL,taboid[i].filenode,taboid[i].oid,taboid[i].toastnode,taboid[i].toastoid,taboid[i].tab,"xman",0,&taboid[i])){
-                    return;
-                }
-                free(walDirFiles_array);
-                free(archDirFiles_array);
-                walDirFiles_array = NULL;
-                archDirFiles_array = NULL;
+            if(! execGetTx(GetTxRetAll,archDirFiles_array,walDirFiles_array,DEL,tab->filenode,tab->oid,tab->toastnode,tab->toastoid,tab->tab,"xman",0,tab)){
+                return;
+            }
+            free(walDirFiles_array);
+            free(archDirFiles_array);
+            walDirFiles_array = NULL;
+            archDirFiles_array = NULL;
 
 /*--------------------------------------------------------------------------
 | 时间戳：2000-01-01 08:00:00.000000 CST | Transaction号：15698 | 待Recoveryrecords数：1012 |
@@ -2694,74 +3260,69 @@ void SCAN(char *former,char *latter)
 | 时间戳：2025-02-24 16:54:43.196302 CST | Transaction号：15698 | 待Recoveryrecords数：36048 |
 --------------------------------------------------------------------------*/
 
-                if(parray_num(GetTxRetAll) > 1){
-                    for (int x = 0; x < parray_num(GetTxRetAll); x++) {
-                        DELstruct *elem = parray_get(GetTxRetAll,x);
-                        if(elem->txtime != 0 && parray_num(GetTxRetAll) > 1){
-                            for (int f = 0; f < parray_num(GetTxRetAll); f++){
-                                DELstruct *elemInner = parray_get(GetTxRetAll,f);
-                                if(elem->tx == elemInner->tx && elem->txtime != elemInner->txtime){
-                                    elem->delCount = elem->delCount+elemInner->delCount;
-                                }
+            if(parray_num(GetTxRetAll) > 1){
+                for (int x = 0; x < parray_num(GetTxRetAll); x++) {
+                    DELstruct *elem = parray_get(GetTxRetAll,x);
+                    if(elem->txtime != 0 && parray_num(GetTxRetAll) > 1){
+                        for (int f = 0; f < parray_num(GetTxRetAll); f++){
+                            DELstruct *elemInner = parray_get(GetTxRetAll,f);
+                            if(elem->tx == elemInner->tx && elem->txtime != elemInner->txtime){
+                                elem->delCount = elem->delCount+elemInner->delCount;
                             }
                         }
                     }
                 }
+            }
 
-                while(! ifTxArrayAllWithTime(GetTxRetAll) ){
-                    cleanNoTimeTxArray(GetTxRetAll);
-                }
+            while(! ifTxArrayAllWithTime(GetTxRetAll) ){
+                cleanNoTimeTxArray(GetTxRetAll);
+            }
 
-                if(restoreMode == TxRestore){
-                    *SrtTime=0;
-                    *EndTime=0;
-                }
+            if(restoreMode == TxRestore){
+                *SrtTime=0;
+                *EndTime=0;
+            }
 
-                if(parray_num(GetTxRetAll) == 0){
-                    #ifdef CN
-                    printf("\n%s现有wal日志中未发现表<%s>的%s记录%s\n\n",COLOR_WARNING,taboid[i].tab,resStr,C_RESET);
-                    #else
-                    printf("\n%sNO %s records detected for table <%s> from the given wal files.%s\n\n",COLOR_WARNING,resStr,taboid[i].tab,C_RESET);
-                    #endif
-                    return;
-                }
+            if(parray_num(GetTxRetAll) == 0){
+                #ifdef CN
+                printf("\n%s现有wal日志中未发现表<%s>的%s记录%s\n\n",COLOR_WARNING,label,resStr,C_RESET);
+                #else
+                printf("\n%sNO %s records detected for table <%s> from the given wal files.%s\n\n",COLOR_WARNING,resStr,label,C_RESET);
+                #endif
+                return;
+            }
 
-                if(restoreMode == TxRestore){
-                    for (int j = 0; j < parray_num(GetTxRetAll); j++) {
-                        DELstruct *elem = parray_get(GetTxRetAll,j);
-                        strcpy(elem->tabname,taboid[i].tab);
-                        strcpy(elem->datafile,taboid[i].filenode);
-                        strcpy(elem->oldDatafile,taboid[i].oid);
-                        strcpy(elem->toast,taboid[i].toastnode);
-                        strcpy(elem->oldToast,taboid[i].toastoid);
-                        strcpy(elem->typ,taboid[i].typ);
-                        elem->taboid = &taboid[i];
-                        infoTxScanResult(elem,resStr);
-                    }
-                    isTxScanned = 1;
-                    isPeriodScanned = 0;
+            if(restoreMode == TxRestore){
+                for (int j = 0; j < parray_num(GetTxRetAll); j++) {
+                    DELstruct *elem = parray_get(GetTxRetAll,j);
+                    strcpy(elem->tabname,label);
+                    strcpy(elem->datafile,tab->filenode);
+                    strcpy(elem->oldDatafile,tab->oid);
+                    strcpy(elem->toast,tab->toastnode);
+                    strcpy(elem->oldToast,tab->toastoid);
+                    strcpy(elem->typ,tab->typ);
+                    elem->taboid = tab;
+                    infoTxScanResult(elem,resStr);
                 }
-                else if (restoreMode == periodRestore){
-                    DELstruct *elem = parray_get(GetTxRetAll,0);
-                    strcpy(elem->tabname,taboid[i].tab);
-                    strcpy(elem->datafile,taboid[i].filenode);
-                    strcpy(elem->oldDatafile,taboid[i].oid);
-                    strcpy(elem->toast,taboid[i].toastnode);
-                    strcpy(elem->oldToast,taboid[i].toastoid);
-                    strcpy(elem->typ,taboid[i].typ);
-                    elem->taboid = &taboid[i];
-                    infoTimeScanResult(elem,resStr,SrtTime,EndTime);
-                    isTxScanned = 0;
-                    isPeriodScanned = 1;
-                }
-                InfoStartwalMeaning();
-                isDelScanned = 1;
-                matched = 1;
-                break;
+                isTxScanned = 1;
+                isPeriodScanned = 0;
             }
-        }
-        if(matched != 1){
-            ErrorTabNotExist(latter);
+            else if (restoreMode == periodRestore){
+                DELstruct *elem = parray_get(GetTxRetAll,0);
+                strcpy(elem->tabname,label);
+                strcpy(elem->datafile,tab->filenode);
+                strcpy(elem->oldDatafile,tab->oid);
+                strcpy(elem->toast,tab->toastnode);
+                strcpy(elem->oldToast,tab->toastoid);
+                strcpy(elem->typ,tab->typ);
+                elem->taboid = tab;
+                infoTimeScanResult(elem,resStr,SrtTime,EndTime);
+                isTxScanned = 0;
+                isPeriodScanned = 1;
+            }
+            InfoStartwalMeaning();
+            isDelScanned = 1;
+            matched = 1;
         }
     }
     unloadTimer("end");
@@ -2866,10 +3427,10 @@ void RESTORE(char *former,char *latter,char *third,char *fourth)
             return;
         }
 
-        WALFILE *walDirFiles_array = (WALFILE*)malloc(sizeof(WALFILE)*2048);
-        WALFILE *archDirFiles_array = (WALFILE*)malloc(sizeof(WALFILE)*2048);
+        WALFILE *walDirFiles_array = NULL;
+        WALFILE *archDirFiles_array = NULL;
 
-        initWalScan(RESTOREINIT,archDirFiles_array,walDirFiles_array);
+        initWalScan(RESTOREINIT,&archDirFiles_array,&walDirFiles_array);
 
         TransactionId txForDel=atoi(txRequested);
         if ( !taboid ){
@@ -2883,6 +3444,7 @@ void RESTORE(char *former,char *latter,char *third,char *fourth)
         initCURDBPath("restore/datafile");
         initCURDBPathforDB(CURDBFullPath);
         DELstruct *elem=parray_get(GetTxRetAll,0);
+        setRestoreTargets_there(nScanTabs > 1 ? scanTabs : NULL,nScanTabs > 1 ? nScanTabs : 0);
 
         if(! execGetTx(GetTxRetAll,archDirFiles_array,walDirFiles_array,DELRESTORE,
                         elem->datafile,elem->oldDatafile,elem->toast,elem->oldToast,elem->tabname,elem->typ,txForDel,elem->taboid)){
@@ -3081,15 +3643,15 @@ int unloadTAB(char *tabname){
             sprintf(logPathErr,"log/%s_%s_%s_%s_%s",CUR_DB,CUR_SCH,"unload",tabname,"err.txt");
 
             initToastId(taboid[i].toastnode);
-            int toastInitRet = initToastHash(CUR_DB,taboid[i].toastnode);
+            int toastInitRet = initToastIndex(CUR_DB,taboid[i].toastnode);
             unloadTimer("start");
 
             setlogLevel(xmanDecodeLog);
-            setToastHash(toastHash);
+            setToastIndex(toastIdx);
             readRet = readItems(&taboid[i],pgFilePath,taboid[i].typ,taboid[i].tab,TABLE_BOOTTYPE,logPathSucc,logPathErr);
-            if(toastHash != NULL){
-                harray_free(toastHash);
-            }
+            toastIndexClose(toastIdx);
+            toastIdx = NULL;
+            setToastIndex(NULL);
 
             if (readRet == FAILURE_RET){
                 if(toastInitRet == FAILURE_RET){
@@ -3111,6 +3673,215 @@ int unloadTAB(char *tabname){
     return 0;
 }
 
+/**
+ * unloadTabJob - Unload one table of the current schema
+ *
+ * @i:           Index into taboid
+ * @logPathSucc: Success log file path
+ * @logPathErr:  Error log file path
+ *
+ * Loads the TOAST index of the table, decodes its data file and releases
+ * the index again. Runs either in-process or inside a scheduler child.
+ *
+ * Returns: readItems return code
+ */
+static int unloadTabJob(int i,char *logPathSucc,char *logPathErr)
+{
+    char pgFilePath[600]="";
+    sprintf(pgFilePath, "%s/%s",CUR_DBDIR,taboid[i].filenode);
+
+    initToastId(taboid[i].toastnode);
+    int toastInitRet = initToastIndex(CUR_DB,taboid[i].toastnode);
+
+    setToastIndex(toastIdx);
+    setlogLevel(readItemLog);
+    int readRet = readItems(&taboid[i],pgFilePath,taboid[i].typ,taboid[i].tab,TABLE_BOOTTYPE,logPathSucc,logPathErr);
+    toastIndexClose(toastIdx);
+    toastIdx = NULL;
+    setToastIndex(NULL);
+    if(readRet == FAILURE_RET && toastInitRet == FAILURE_RET){
+        ErrorToastNoExist((Oid)atoi(taboid[i].toastnode));
+    }
+    return readRet;
+}
+
+/**
+ * unloadTabDone - Record the outcome of one table unload
+ *
+ * @i:          Index into taboid
+ * @readRet:    readItems return code
+ * @rec:        Resume file path
+ * @logPathErr: Error log file path
+ * @nErr:       Failed table counter
+ * @nNodata:    Empty table counter
+ *
+ * Failed tables go to the error log, finished and empty tables are
+ * appended to the .rec resume file so they are skipped next time.
+ */
+static void unloadTabDone(int i,int readRet,char *rec,char *logPathErr,int *nErr,int *nNodata)
+{
+    if (readRet == FAILURE_RET){
+        char err3[1024];
+        FILE *logErr = fopen(logPathErr,"a");
+        #ifdef EN
+        sprintf(err3,"FAIL PARSING TABLE <%s>,DATAFILE<%s/%s>\n",taboid[i].tab,CUR_DBDIR,taboid[i].filenode);
+        #else
+        sprintf(err3,"表 <%s> 解析失败,对应的数据文件路径为 <%s/%s>\n",taboid[i].tab,CUR_DBDIR,taboid[i].filenode);
+        #endif
+        (*nErr)++;
+        if(logErr){
+            fputs(err3,logErr);
+            fclose(logErr);
+        }
+        return;
+    }
+
+    if(readRet == FAILOPEN_RET)
+        (*nNodata)++;
+
+    FILE *recFp = fopen(rec,"a");
+    if(recFp){
+        fputs(taboid[i].filenode,recFp);
+        fputs("\n",recFp);
+        fclose(recFp);
+    }
+}
+
+/**
+ * orderTabsBySize - Order tables of the current schema largest first
+ *
+ * @order: Output array of tabSize taboid indexes
+ *
+ * Reuses getTabSize, which also refreshes tabVol for \dt.
+ */
+static void orderTabsBySize(int *order)
+{
+    char *used = (char *)calloc(tabSize > 0 ? tabSize : 1, 1);
+    int n = 0;
+
+    free(tabVol);
+    tabVol = (TABSIZEstruct *)malloc((tabSize > 0 ? tabSize : 1) * sizeof(TABSIZEstruct));
+    getTabSize(tabVol);
+
+    for(int k = 0; k < tabSize; k++){
+        for(int i = 0; i < tabSize; i++){
+            if(!used[i] && strcmp(tabVol[k].tab,taboid[i].tab) == 0){
+                used[i] = 1;
+                order[n++] = i;
+                break;
+            }
+        }
+    }
+    for(int i = 0; i < tabSize && n < tabSize; i++){
+        if(!used[i])
+            order[n++] = i;
+    }
+    free(used);
+}
+
+/**
+ * unloadTabsScheduled - Unload every table of the current schema
+ *
+ * @rec:         Resume file path
+ * @logPathSucc: Success log file path
+ * @logPathErr:  Error log file path
+ * @nErr:        Output failed table counter
+ * @nNodata:     Output empty table counter
+ *
+ * Tables already listed in the .rec file are skipped, the rest run
+ * largest first. With param workers above one, up to that many tables
+ * are decoded at once in child processes; the parent alone appends to
+ * .rec and the logs as each child exits, so the resume file stays
+ * consistent if the unload is interrupted.
+ */
+static void unloadTabsScheduled(char *rec,char *logPathSucc,char *logPathErr,int *nErr,int *nNodata)
+{
+    harray *unloadHash = harray_new(HARRAYINT);
+    if(access(rec, F_OK) == 0){
+        initUnloadHash(rec,unloadHash);
+    }
+
+    int *order = (int *)malloc((tabSize > 0 ? tabSize : 1) * sizeof(int));
+    orderTabsBySize(order);
+
+    int nJobs = 0;
+    for(int k = 0; k < tabSize; k++){
+        int filenodeOid = atoi(taboid[order[k]].filenode);
+        if(!harray_search(unloadHash,HARRAYINT,filenodeOid)){
+            order[nJobs++] = order[k];
+        }
+    }
+    harray_free(unloadHash);
+
+    int nWorkers = Min(unloadWorkers, nJobs);
+    if(nWorkers <= 1){
+        for(int k = 0; k < nJobs; k++){
+            int readRet = unloadTabJob(order[k],logPathSucc,logPathErr);
+            unloadTabDone(order[k],readRet,rec,logPathErr,nErr,nNodata);
+        }
+        free(order);
+        return;
+    }
+
+    pid_t *pids = (pid_t *)malloc(nWorkers * sizeof(pid_t));
+    int *slotJob = (int *)malloc(nWorkers * sizeof(int));
+    int running = 0;
+    int next = 0;
+    for(int w = 0; w < nWorkers; w++)
+        pids[w] = 0;
+
+    while(next < nJobs || running > 0){
+        for(int w = 0; w < nWorkers && next < nJobs; w++){
+            if(pids[w] != 0)
+                continue;
+            fflush(stdout);
+            pid_t pid = fork();
+            if(pid == 0){
+                unloadWorkers = 1;
+                showDecodeLive = 0;
+                int readRet = unloadTabJob(order[next],logPathSucc,logPathErr);
+                fflush(stdout);
+                _exit(readRet == SUCCESS_RET ? 0 : (readRet == FAILOPEN_RET ? 2 : 1));
+            }
+            else if(pid < 0){
+                /* Out of processes, decode in-process instead */
+                int readRet = unloadTabJob(order[next],logPathSucc,logPathErr);
+                unloadTabDone(order[next],readRet,rec,logPathErr,nErr,nNodata);
+                next++;
+                continue;
+            }
+            pids[w] = pid;
+            slotJob[w] = order[next++];
+            running++;
+        }
+        if(running == 0)
+            continue;
+
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if(pid <= 0)
+            break;
+        for(int w = 0; w < nWorkers; w++){
+            if(pids[w] != pid)
+                continue;
+            int readRet = FAILURE_RET;
+            if(WIFEXITED(status)){
+                if(WEXITSTATUS(status) == 0)
+                    readRet = SUCCESS_RET;
+                else if(WEXITSTATUS(status) == 2)
+                    readRet = FAILOPEN_RET;
+            }
+            unloadTabDone(slotJob[w],readRet,rec,logPathErr,nErr,nNodata);
+            pids[w] = 0;
+            running--;
+            break;
+        }
+    }
+    free(pids);
+    free(slotJob);
+    free(order);
+}
+
 /**
  * unloadSCH - Export all tables in schema
  *
@@ -3121,7 +3892,6 @@ int unloadTAB(char *tabname){
  * Returns: SUCCESS_RET on success, FAILURE_RET on failure
  */
 int unloadSCH(char *schemaname){
-    int i;
     if(strcmp(CUR_DB,"restore") == 0){
         #ifdef CN
         printf("restore库不支持此操作\n");
@@ -3132,7 +3902,6 @@ int unloadSCH(char *schemaname){
     }
     for(int j = 0;j<schemasize;j++){
         if( strcmp(schemaname,schoid[j].nspname) == 0 ){
-            harray *unloadHash = harray_new(HARRAYINT);
             char schPath[100];
             sprintf(schPath,"%s/%s",CUR_DB,schemaname);
             createDir(schPath);
@@ -3143,13 +3912,6 @@ int unloadSCH(char *schemaname){
 
             char rec[100]={0};
             sprintf(rec,"%s/%s/.rec",CUR_DB,CUR_SCH);
-            FILE *recExist = fopen(rec,"r");
-            FILE *recFp = NULL;
-            char *recMode = NULL;
-            if(recExist){
-                fclose(recExist);
-                initUnloadHash(rec,unloadHash);
-            }
 
             char logPathSucc[100];
             sprintf(logPathSucc,"log/%s_%s_%s_%s",CUR_DB,"unload_schema",CUR_SCH,"succ.txt");
@@ -3169,58 +3931,7 @@ int unloadSCH(char *schemaname){
             int nErr=0;
             int nNodata=0;
             unloadTimer("start");
-            for ( i = 0; i < tabSize; i++ ) {
-                recFp = fopen(rec,"a");
-                int filenodeOid = atoi(taboid[i].filenode);
-                if(harray_search(unloadHash,HARRAYINT,filenodeOid)){
-                    continue;
-                }
-                int readRet;
-                char pgFilePath[600]="";
-                if(isSingleDB){
-                    sprintf(pgFilePath, "%s/%s", CUR_DBDIR,taboid[i].filenode);
-                }else{
-                    sprintf(pgFilePath, "%s/%s",CUR_DBDIR,taboid[i].filenode);
-                }
-                initToastId(taboid[i].toastnode);
-                int toastInitRet = initToastHash(CUR_DB,taboid[i].toastnode);
-
-                setToastHash(toastHash);
-                setlogLevel(readItemLog);
-                readRet = readItems(&taboid[i],pgFilePath,taboid[i].typ,taboid[i].tab,TABLE_BOOTTYPE,logPathSucc,logPathErr);
-                if(toastHash != NULL){
-                    harray_free(toastHash);
-                }
-
-                if (readRet == FAILURE_RET){
-                    if(toastInitRet == FAILURE_RET){
-                        ErrorToastNoExist((Oid)atoi(taboid[i].toastnode));
-                    }
-                    char err3[1024];
-                    FILE *logErr = fopen(logPathErr,"a");
-                    #ifdef EN
-                    sprintf(err3,"FAIL PARSING TABLE <%s>,DATAFILE<%s>\n",taboid[i].tab,pgFilePath);
-                    #else
-                    sprintf(err3,"表 <%s> 解析失败,对应的数据文件路径为 <%s>\n",taboid[i].tab,pgFilePath);
-                    #endif
-                    nErr++;
-                    fputs(err3,logErr);
-                    fclose(logErr);
-                    fclose(recFp);
-                }
-                else if(readRet == FAILOPEN_RET){
-                    nNodata++;
-                    fputs(taboid[i].filenode,recFp);
-                    fputs("\n",recFp);
-                    fclose(recFp);
-                }
-                else if(readRet == SUCCESS_RET){
-                    fputs(taboid[i].filenode,recFp);
-                    fputs("\n",recFp);
-                    fclose(recFp);
-                }
-
-            }
+            unloadTabsScheduled(rec,logPathSucc,logPathErr,&nErr,&nNodata);
             FILE *logSucc = fopen(logPathSucc,"a");
             unloadTimer("end");
             infoUSchSucc(schemaname,tabSize,nNodata,nErr,logPathErr,logPathSucc);
@@ -3251,19 +3962,36 @@ int unloadSCH(char *schemaname){
  * Returns: SUCCESS_RET on success, FAILURE_RET on failure
  */
 int unloadDB(char *databasename){
-    for(int i=0;i<dosize;i++){
-        if(strcmp(databasename,databaseoid[i].database) == 0){
+    for(int d=0;d<dosize;d++){
+        if(strcmp(databasename,databaseoid[d].database) == 0){
             char CUR_DB_copy[100];
             char CUR_SCH_copy[100];
+            char CURDBFullPath_copy[550];
+            char *CUR_DBDIR_copy = CUR_DBDIR;
             strcpy(CUR_DB_copy,CUR_DB);
             strcpy(CUR_SCH_copy,CUR_SCH);
+            strcpy(CURDBFullPath_copy,CURDBFullPath);
 
             strcpy(CUR_DB,databasename);
+            CUR_DBDIR=databaseoid[d].dbpath;
+            if(strncmp(CUR_DBDIR,"xman",4) == 0)
+                CUR_DBDIR=CUR_DBDIR+4;
+            memset(CURDBFullPath,0,550);
+            sprintf(CURDBFullPath,"%s",CUR_DBDIR);
+            initCURDBPath(CURDBFullPath);
 
             char DBSchemaFile[MiddleAllocSize];
             sprintf(DBSchemaFile, "%s/%s/%s", CUR_DB, "meta",SCHEMA_BOOT);
             schoid=bootSCHStruct(DBSchemaFile);
             schemasize=getLineNum(DBSchemaFile);
+
+            char logPathSucc[100];
+            sprintf(logPathSucc,"log/%s_%s_%s","unload_db",CUR_DB,"succ.txt");
+            char logPathErr[100];
+            sprintf(logPathErr,"log/%s_%s_%s","unload_db",CUR_DB,"err.txt");
+            unlink(logPathSucc);
+            unlink(logPathErr);
+
             for(int j=0;j<schemasize;j++){
                 if(schemaInDefaultSHCS(schoid[j].nspname)){
                     continue;
@@ -3273,12 +4001,8 @@ int unloadDB(char *databasename){
                 sprintf(schPath,"%s/%s",CUR_DB,CUR_SCH);
                 createDir(schPath);
 
-                char logPathSucc[100];
-                sprintf(logPathSucc,"log/%s_%s_%s","unload_db",CUR_DB,"succ.txt");
-                char logPathErr[100];
-                sprintf(logPathErr,"log/%s_%s_%s","unload_db",CUR_DB,"err.txt");
-                unlink(logPathSucc);
-                unlink(logPathErr);
+                char rec[100]={0};
+                sprintf(rec,"%s/%s/.rec",CUR_DB,CUR_SCH);
 
                 char DBClassFile[MiddleAllocSize];
                 sprintf(DBClassFile, "%s/%s/%s_%s", CUR_DB,"meta",CUR_SCH, TABLE_BOOT);
@@ -3290,41 +4014,29 @@ int unloadDB(char *databasename){
                 tabSize=getLineNum(DBClassFile);
                 int nErr=0;
                 int nNodata=0;
-                for ( i = 0; i < tabSize; i++ ) {
-                    char pgFilePath[600]="";
-                    sprintf(pgFilePath, "%s%s%s/%s",CUR_DBDIR,taboid[i].filenode);
-                    initToastId(taboid[i].toastnode);
-                    setlogLevel(readItemLog);
-                    int readRet = readItems(&taboid[i],pgFilePath,taboid[i].typ,taboid[i].tab,TABLE_BOOTTYPE,logPathSucc,logPathErr);
-                    if (readRet == FAILURE_RET){
-                        char err3[1024];
-                        FILE *logErr = fopen(logPathErr,"a");
-                        sprintf(err3,"FAIL PARSING TABLE <%s>,DATAFILE<%s>\n",taboid[i].tab,pgFilePath);
-                        nErr++;
-                        fputs(err3,logErr);
-                        fclose(logErr);
-                    }
-                    else if(readRet == FAILOPEN_RET){
-                        nNodata++;
-                    }
-                }
+                unloadTabsScheduled(rec,logPathSucc,logPathErr,&nErr,&nNodata);
                 FILE *logSucc = fopen(logPathSucc,"a");
 
-                char succ2[100];
+                char succ2[500];
                 #ifdef EN
-                sprintf(succ2,"\n\nSCHEMA <%s> CONTAINS %d TABLES ,SUCCESS NUMBER:%d ,NODATA NUMBER:%d ,FAILED NUMBER: %d  \nLOG DIR:log/%s \n",CUR_SCH,tabSize,tabSize-nErr,nNodata,nErr,logPathErr);
+                sprintf(succ2,"\n\nSCHEMA <%s> CONTAINS %d TABLES ,SUCCESS NUMBER:%d ,NODATA NUMBER:%d ,FAILED NUMBER: %d  \nLOG DIR:%s \n",CUR_SCH,tabSize,tabSize-nErr,nNodata,nErr,logPathErr);
                 #else
                 sprintf(succ2,"\n\n模式<%s>共 %d 张表。成功：%d, 无数据：%d, 失败 %d \n日志路径:%s \n",CUR_SCH,tabSize,tabSize-nErr,nNodata,nErr,logPathErr);
                 #endif
                 printf("%s",succ2);
-                fputs(succ2,logSucc);
-                fclose(logSucc);
+                if(logSucc){
+                    fputs(succ2,logSucc);
+                    fclose(logSucc);
+                }
                 unloadCOPY(CUR_SCH);
                 unloadSCHDDL();
 
             }
             strcpy(CUR_DB,CUR_DB_copy);
             strcpy(CUR_SCH,CUR_SCH_copy);
+            CUR_DBDIR=CUR_DBDIR_copy;
+            strcpy(CURDBFullPath,CURDBFullPath_copy);
+            initCURDBPath(CURDBFullPath);
             return 1;
         }
     }
@@ -3655,76 +4367,85 @@ char* getinput() {
     }
 }
 
-int getToastHash(FILE *fp,unsigned int blockSize,FILE *destfp,int hundred)
+/**
+ * getToastIndex - Append the chunk locations of one TOAST segment
+ *
+ * @fp:        TOAST relation segment
+ * @blockSize: Page size of the segment
+ * @destfp:    Index file, entries are appended unsorted
+ * @hundred:   Segment number
+ *
+ * Returns: 1 if the segment holds no TOAST tuples, 0 otherwise
+ */
+int getToastIndex(FILE *fp,unsigned int blockSize,FILE *destfp,int hundred)
 {
-    unsigned int keepDumping=1;
-    unsigned int bytesToFormat;
     int toastIsEmpty=1;
-    FILE *bootFile;
-    int nItems=0;
     int nPages=0;
-    keepDumping = 1;
-	int result = -1;
     BlockNumber	currentBlockNo = 0;
-    char *block = (char *)malloc(blockSize);
-    if (!block)
+    char *block;
+    seqReader rd;
+
+    /* Heap pages are always BLCKSZ; don't let a zeroed header pick the read size */
+    if (blockSize != BLCKSZ)
+        blockSize = BLCKSZ;
+    /*
+     * No drop-behind here: the chunks indexed now are read back by
+     * assembleToastByIndex while the owning table is decoded.
+     */
+    if (seqReaderOpen(&rd,NULL,fileno(fp),0,-1,(size_t)readChunkMB * 1024 * 1024,0,ioMode,ioDepth) != SUCCESS_RET)
     {
-        printf("\nFAILED TO ALLOCATE SIZE OF <%d> BYTES \n",
-            blockSize);
+        printf("\nFAILED TO ALLOCATE SIZE OF <%d> MB \n",
+            readChunkMB);
+        return toastIsEmpty;
     }
 
-    while(keepDumping){
-
-        bytesToFormat = fread(block, 1, blockSize, fp);
+    while((block = seqReaderNext(&rd, blockSize)) != NULL){
         nPages++;
-        if (bytesToFormat == 0)
-        {
-            keepDumping = 0;
-        }
-        else{
-            Page page = (Page) block;
+        Page page = (Page) block;
 
-            unsigned int x;
-            unsigned int i;
-            unsigned int itemSize;
-            unsigned int itemOffset;
-            unsigned int itemFlags;
-            ItemId		itemId;
-            int	maxOffset;
+        unsigned int x;
+        unsigned int i;
+        unsigned int itemSize;
+        unsigned int itemOffset;
+        unsigned int itemFlags;
+        ItemId		itemId;
+        int	maxOffset;
 
-            maxOffset = PageGetMaxOffsetNumber(page);
+        maxOffset = PageGetMaxOffsetNumber(page);
 
-            if (maxOffset == 0)
-            {
-				continue;
-            }
-            for(x= 1 ; x < maxOffset+1 ; x++){
-                itemId = PageGetItemId(page, x);
-                itemFlags = (unsigned int) ItemIdGetFlags(itemId);
-                itemSize = (unsigned int) ItemIdGetLength(itemId);
-                itemOffset = (unsigned int) ItemIdGetOffset(itemId);
-
-				uint32			chunkId=10086;
-				uint32			toastOid=0;
-				unsigned int	chunkSize = 0;
-                if(itemFlags == LP_NORMAL){
-                    int ret = ToastChunkforOid(&block[itemOffset], itemSize, &chunkId,&toastOid);
-                    if(ret == -1)
-                        break;
-                    char destInfo[100]={0};
-
-                    if(toastOid > 0 && chunkId >= 0)
-                    {
-                        sprintf(destInfo,"%d\t%d\t%d\t%d\t%d\n",toastOid,chunkId,currentBlockNo,itemOffset,hundred);
-                        fputs(destInfo,destfp);
-                    }
-                    toastIsEmpty=0;
+        if (maxOffset == 0)
+        {
+			continue;
+        }
+        for(x= 1 ; x < maxOffset+1 ; x++){
+            itemId = PageGetItemId(page, x);
+            itemFlags = (unsigned int) ItemIdGetFlags(itemId);
+            itemSize = (unsigned int) ItemIdGetLength(itemId);
+            itemOffset = (unsigned int) ItemIdGetOffset(itemId);
+
+			uint32			chunkId=10086;
+			uint32			toastOid=0;
+			unsigned int	chunkSize = 0;
+            if(itemFlags == LP_NORMAL){
+                int ret = ToastChunkforOid(&block[itemOffset], itemSize, &chunkId,&toastOid);
+                if(ret == -1)
+                    break;
+                if(toastOid > 0)
+                {
+                    toastIndexEntry entry;
+                    entry.valueid = toastOid;
+                    entry.chunkseq = chunkId;
+                    entry.blk = currentBlockNo;
+                    entry.off = (uint16)itemOffset;
+                    entry.suffix = (uint16)hundred;
+                    fwrite(&entry,sizeof(entry),1,destfp);
                 }
-			}
+                toastIsEmpty=0;
+            }
 		}
         currentBlockNo++;
 	}
-    free(block);
+    seqReaderClose(&rd);
     return toastIsEmpty;
 }
 
@@ -3772,40 +4493,24 @@ int ToastChunkforOid(const char *tuple_data,unsigned int tuple_size,uint32 *chun
 
 }
 
-int initToastHash(char *CUR_DB,char *toastnode)
+/**
+ * initToastIndex - Open the TOAST chunk index of a table
+ *
+ * @CUR_DB:    Database directory holding toastmeta
+ * @toastnode: TOAST table node identifier
+ *
+ * Sets toastIdx to the mapped index, or NULL if the table has none.
+ *
+ * Returns: SUCCESS_RET on success, FAILURE_RET if no index exists
+ */
+int initToastIndex(char *CUR_DB,char *toastnode)
 {
     char metaToastPath[100];
     sprintf(metaToastPath,"%s/toastmeta/%s",CUR_DB,toastnode);
-    int numLines = 0;
-    FILE *file = fileGetLines(metaToastPath,&numLines);
-    toastHash = NULL;
-    if(file == NULL){
+    toastIdx = toastIndexOpen(metaToastPath);
+    if(toastIdx == NULL){
         return FAILURE_RET;
     }
-
-    toastHash = harray_new(HARRAYTOAST);
-
-    int i;
-    for (i = 0; i < numLines; i++) {
-        chunkInfo *elem = malloc(sizeof(chunkInfo));
-        char chunkId[20];
-        char toastOid[20];
-        char blk[20];
-        char toff[20];
-        char suffix[20];
-        if (fscanf(file, "%s\t%s\t%s\t%s\t%s\n",toastOid,chunkId,blk,toff,suffix) != 5) {
-            printf("Error Reading File %s\n",metaToastPath);
-            exit(1);
-        }
-        elem->toid=atoi(toastOid);
-        elem->chunkid=atoi(chunkId);
-        elem->blk=atoi(blk);
-        elem->toff=atoi(toff);
-        elem->suffix=atoi(suffix);
-        harray_append(toastHash,HARRAYTOAST,elem,elem->toid);
-    }
-
-    fclose(file);
     return SUCCESS_RET;
 }
 
@@ -3945,11 +4650,11 @@ void CHECKWAL()
 {
     char waldir[MAXPGPATH] = {0};
     XLogSegNo	segno;
-    int WalSegSz;
+    int WalSegSz = 0;
     int r;
     cleanDir("restore/ckwal");
-    WALFILE *walDirFiles_array = (WALFILE*)malloc(sizeof(WALFILE)*2048);
-    WALFILE *archDirFiles_array = (WALFILE*)malloc(sizeof(WALFILE)*2048);
+    WALFILE *walDirFiles_array = NULL;
+    WALFILE *archDirFiles_array = NULL;
     XLogLongPageHeader longhdr = NULL;
     XLogDumpPrivate private;
 	memset(&private, 0, sizeof(XLogDumpPrivate));
@@ -3957,7 +4662,7 @@ void CHECKWAL()
 	private.startptr = InvalidXLogRecPtr;
 	private.endptr = InvalidXLogRecPtr;
 	private.endptr_reached = false;
-    initWalScan(RESTOREINIT,archDirFiles_array,walDirFiles_array);
+    initWalScan(RESTOREINIT,&archDirFiles_array,&walDirFiles_array);
     PGAlignedXLogBlock buf;
 
     int isMess = 0;
@@ -3965,9 +4670,14 @@ void CHECKWAL()
 
         char destPath[MAXPGPATH]={0};
         char		fpath[MAXPGPATH];
-        snprintf(fpath, MAXPGPATH, "%s/%s", initArchPath, archDirFiles_array[j].walnames);
-        FILE *fp = fopen(fpath,"rb");
-        r = fread(buf.data,1,BLCKSZ,fp);
+        if (walSegmentResolve(initArchPath, archDirFiles_array[j].walnames, fpath) < 0)
+            continue;
+        /* compressed segments keep their suffix when copied */
+        const char *suffix = fpath + strlen(initArchPath) + 1 + strlen(archDirFiles_array[j].walnames);
+        int fd = open_file_in_directory(initArchPath, archDirFiles_array[j].walnames);
+        r = fd >= 0 ? pread(fd, buf.data, XLOG_BLCKSZ, 0) : -1;
+        if (fd >= 0)
+            close(fd);
         if (r == XLOG_BLCKSZ)
         {
             longhdr = (XLogLongPageHeader) buf.data;
@@ -3985,7 +4695,7 @@ void CHECKWAL()
         }
         if(isMess){
             sprintf(waldir,"restore/ckwal");
-            sprintf(destPath,"%s/%s",waldir,ptrfName);
+            sprintf(destPath,"%s/%s%s",waldir,ptrfName,suffix);
             int ret = copyFile(fpath,destPath);
             if(ret == EXIT_FAILURE){
                 return;
@@ -3994,7 +4704,7 @@ void CHECKWAL()
         }
         else{
             sprintf(waldir,"restore/ckwal");
-            sprintf(destPath,"%s/%s",waldir,archDirFiles_array[j].walnames);
+            sprintf(destPath,"%s/%s%s",waldir,archDirFiles_array[j].walnames,suffix);
             int ret = copyFile(fpath,destPath);
             if(ret == EXIT_FAILURE){
                 return;
@@ -4006,6 +4716,9 @@ void CHECKWAL()
     if(!isMess){
         cleanDir("restore/ckwal");
     }
+    if(WalSegSz > 0 && walVerifyArchive(archDirFiles_array,archWaldirNum,initArchPath,WalSegSz) == -1){
+        printf("out of memory");
+    }
     free(walDirFiles_array);
     free(archDirFiles_array);
     walDirFiles_array = NULL;
@@ -4100,6 +4813,114 @@ void setItmsPerCsv(char *third)
     }
 }
 
+void setUnloadWorkers(char *third)
+{
+    int val = atoi(third);
+    if( val < 1 || val > MAX_UNLOAD_WORKERS )
+    {
+        #ifdef CN
+        printf("%s非法数值%s\n",COLOR_WARNING,C_RESET);
+        #else
+        printf("%sInvalid Values%s\n",COLOR_WARNING,C_RESET);
+        #endif
+    }
+    else{
+        unloadWorkers = val;
+        setWalScanWorkers_there(unloadWorkers);
+        SHOW_PARAM();
+    }
+}
+
+void setReadChunk(char *third)
+{
+    int val = atoi(third);
+    if( val < 1 || val > MAX_READ_CHUNK_MB )
+    {
+        #ifdef CN
+        printf("%s非法数值%s\n",COLOR_WARNING,C_RESET);
+        #else
+        printf("%sInvalid Values%s\n",COLOR_WARNING,C_RESET);
+        #endif
+    }
+    else{
+        readChunkMB = val;
+        SHOW_PARAM();
+    }
+}
+
+void setIoMode(char *third)
+{
+    if(strcmp(third,"buffered") != 0 && strcmp(third,"mmap") != 0 && strcmp(third,"async") != 0)
+    {
+        #ifdef CN
+        printf("%s请设置为buffered/mmap/async%s\n",COLOR_WARNING,C_RESET);
+        #else
+        printf("%sOnly buffered/mmap/async can be set%s\n",COLOR_WARNING,C_RESET);
+        #endif
+    }
+    else{
+        if(strcmp(third,"mmap") == 0)
+            ioMode = IOMODE_MMAP;
+        else if(strcmp(third,"async") == 0)
+            ioMode = IOMODE_ASYNC;
+        else
+            ioMode = IOMODE_BUFFERED;
+        setIoMode_decode(ioMode,ioDepth);
+        SHOW_PARAM();
+    }
+}
+
+void setIoDepth(char *third)
+{
+    int val = atoi(third);
+    if( val < 1 || val > AIO_MAX_DEPTH )
+    {
+        #ifdef CN
+        printf("%s非法数值%s\n",COLOR_WARNING,C_RESET);
+        #else
+        printf("%sInvalid Values%s\n",COLOR_WARNING,C_RESET);
+        #endif
+    }
+    else{
+        ioDepth = val;
+        setIoMode_decode(ioMode,ioDepth);
+        SHOW_PARAM();
+    }
+}
+
+/**
+ * setFpwCache - Set the FPW page cache size of WAL restore
+ *
+ * @third: Size such as 512MB, 2GB or 512 (MB); 0 disables the cache
+ */
+void setFpwCache(char *third)
+{
+    char *unit = NULL;
+    long long val = strtoll(third,&unit,10);
+    if(unit == third || val < 0){
+        val = -1;
+    }
+    else if(strcasecmp(unit,"GB") == 0 || strcasecmp(unit,"G") == 0){
+        val *= 1024;
+    }
+    else if(*unit != '\0' && strcasecmp(unit,"MB") != 0 && strcasecmp(unit,"M") != 0){
+        val = -1;
+    }
+    if( val < 0 || val > MAX_FPW_CACHE_MB )
+    {
+        #ifdef CN
+        printf("%s非法数值%s\n",COLOR_WARNING,C_RESET);
+        #else
+        printf("%sInvalid Values%s\n",COLOR_WARNING,C_RESET);
+        #endif
+    }
+    else{
+        fpwCacheMB = (int)val;
+        setFpwCache_there((uint64)fpwCacheMB * 1024 * 1024);
+        SHOW_PARAM();
+    }
+}
+
 void setTime(char *third,char *fourth,int flag){
     if(restoreMode == TxRestore){
         #ifdef CN
@@ -4197,12 +5018,16 @@ void setEncoding(char *third){
 
 void setEndLsnT(char *third)
 {
+    uint64 lsn;
+    if(!lsnFromStr(third,&lsn)){
+        printf("%sInvalid Values%s\n",COLOR_WARNING,C_RESET);
+        return;
+    }
     int elemNumber = parray_num(GetTxRetAll);
     if(elemNumber != 0){
         for(int i=0;i<elemNumber;i++){
             DELstruct *elem = parray_get(GetTxRetAll,i);
-            memset(elem->endLSNforTOAST,0,50);
-            strncpy(elem->endLSNforTOAST,third,50);
+            elem->endLSNforTOAST = lsn;
         }
         SHOW_PARAM();
     }
@@ -4213,12 +5038,16 @@ void setEndLsnT(char *third)
 
 void setStartLsnT(char *third)
 {
+    uint64 lsn;
+    if(!lsnFromStr(third,&lsn)){
+        printf("%sInvalid Values%s\n",COLOR_WARNING,C_RESET);
+        return;
+    }
     int elemNumber = parray_num(GetTxRetAll);
     if(elemNumber != 0){
         for(int i=0;i<elemNumber;i++){
             DELstruct *elem = parray_get(GetTxRetAll,i);
-            memset(elem->startLSNforTOAST,0,50);
-            strncpy(elem->startLSNforTOAST,third,50);
+            elem->startLSNforTOAST = lsn;
         }
         SHOW_PARAM();
     }
@@ -4353,6 +5182,21 @@ void SHOW_PARAM()
     char itmsPerCsvStr[10]={0};
     sprintf(itmsPerCsvStr,"              %d",itemspercsv);
     printfParam("itmpcsv(Items Per Csv)",itmsPerCsvStr);
+    char workersStr[50]={0};
+    sprintf(workersStr,"              %d",unloadWorkers);
+    printfParam("workers(Unload Workers)",workersStr);
+    char readChunkStr[50]={0};
+    sprintf(readChunkStr,"              %dMB",readChunkMB);
+    printfParam("readchunk(Read Chunk Size)",readChunkStr);
+    char *ioModeStr= ioMode == IOMODE_MMAP ? "              mmap":
+                     ioMode == IOMODE_ASYNC ? "              async":"              buffered";
+    printfParam("iomode(Datafile IO Mode)",ioModeStr);
+    char ioDepthStr[50]={0};
+    sprintf(ioDepthStr,"              %d",ioDepth);
+    printfParam("iodepth(Async IO Depth)",ioDepthStr);
+    char fpwCacheStr[50]={0};
+    sprintf(fpwCacheStr,"              %dMB",fpwCacheMB);
+    printfParam("fpwcache(FPW Page Cache)",fpwCacheStr);
     char *isoModeStr= isoMode ? "              on":"              off";
     printfParam("isomode",isoModeStr);
     printf("%s└─────────────────────────────────────────────────────────────────┘%s\n",COLOR_PARAM,C_RESET);
@@ -4407,6 +5251,21 @@ void SET_PARAM(char *former,char *latter,char *third,char *fourth)
         case 13:
             setItmsPerCsv(third);
             break;
+        case 14:
+            setUnloadWorkers(third);
+            break;
+        case 15:
+            setReadChunk(third);
+            break;
+        case 16:
+            setIoMode(third);
+            break;
+        case 17:
+            setIoDepth(third);
+            break;
+        case 18:
+            setFpwCache(third);
+            break;
         default:
             break;
         }
@@ -4446,6 +5305,14 @@ void RESET_ALL(){
     #endif
     dropScanSrtOff = 0;
     isoMode = 0;
+    unloadWorkers = NUM_THREADS;
+    setWalScanWorkers_there(unloadWorkers);
+    readChunkMB = DEFAULT_READ_CHUNK_MB;
+    ioMode = IOMODE_BUFFERED;
+    ioDepth = AIO_DEFAULT_DEPTH;
+    setIoMode_decode(ioMode,ioDepth);
+    fpwCacheMB = DEFAULT_FPW_CACHE_MB;
+    setFpwCache_there((uint64)fpwCacheMB * 1024 * 1024);
 
     SHOW_PARAM();
 
@@ -4509,6 +5376,25 @@ void RESET_PARAM(char *former,char *latter,char *third)
         case 11:
             isoMode = 0;
             break;
+        case 14:
+            unloadWorkers = NUM_THREADS;
+            setWalScanWorkers_there(unloadWorkers);
+            break;
+        case 15:
+            readChunkMB = DEFAULT_READ_CHUNK_MB;
+            break;
+        case 16:
+            ioMode = IOMODE_BUFFERED;
+            setIoMode_decode(ioMode,ioDepth);
+            break;
+        case 17:
+            ioDepth = AIO_DEFAULT_DEPTH;
+            setIoMode_decode(ioMode,ioDepth);
+            break;
+        case 18:
+            fpwCacheMB = DEFAULT_FPW_CACHE_MB;
+            setFpwCache_there((uint64)fpwCacheMB * 1024 * 1024);
+            break;
         default:
             break;
         }
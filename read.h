@@ -127,7 +127,7 @@ void setTime(char *third,char *fourth,int flag);
 void SHOW_PARAM();
 
 
-int getToastHash(FILE *fp,unsigned int blockSize,FILE *destfp,int hundred);
+int getToastIndex(FILE *fp,unsigned int blockSize,FILE *destfp,int hundred);
 
 parray* bootDropContext();
 
@@ -144,11 +144,11 @@ void dropScanIdx(parray *dcs,int isToastRound);
 
 void dropScanNoIdx(parray *dcs,int isToastRound);
 
-int initToastHash(char *CUR_DB,char *toastnode);
+int initToastIndex(char *CUR_DB,char *toastnode);
 
 bool HeapTupleSatisfiesVisibility(HeapTupleHeader tuple);
 
-void initWalScan(int flag,WALFILE *archDirFiles_array,WALFILE *walDirFiles_array);
+void initWalScan(int flag,WALFILE **archDirFiles_array,WALFILE **walDirFiles_array);
 
 void bootforDropScan(char *CUR_DB);
 
@@ -36,6 +36,7 @@
 #include <linux/fiemap.h>
 #include <inttypes.h> 
 #include <regex.h>
+#include "async_io.h"
 
 
 #define MAXDATELEN		128
@@ -538,24 +539,48 @@ typedef struct
 	char walnames[50];
 } WALFILE;
 
-typedef struct Node {
-    void* data;
-    struct Node* next;
-} Node;
+/*
+ * harray - integer-keyed multimap
+ *
+ * Open addressing over a flat entry array. Slots are probed in groups of
+ * HARRAY_GROUP; each slot has a control byte holding 7 bits of the key's
+ * hash (or HARRAY_EMPTY), so a whole group is filtered with one vector
+ * compare before any key is touched. Duplicate keys are allowed and are
+ * walked with harrayIter. Nothing is ever deleted, so no tombstones.
+ */
+#define HARRAY_GROUP 16
+#define HARRAY_EMPTY 0x80
+
+typedef struct {
+    uint64 key;
+    void *data;		/* NULL for HARRAYINT/HARRAYLLINT, the key is the value */
+} harrayEntry;
 
 typedef struct {
-    Node** table;
-    int allocated;
+    unsigned char *ctrl;
+    harrayEntry *entries;
+    int allocated;	/* slots, power of two and a multiple of HARRAY_GROUP */
     int used;
+    int flag;
 } harray;
 
+typedef struct {
+    const harray *h;
+    uint64 key;
+    uint32 group;
+    uint32 step;
+    uint32 match;	/* slots of the current group whose tag matches */
+    unsigned char tag;
+    int lastGroup;	/* current group has an empty slot, stop after it */
+} harrayIter;
+
 /* Delete operation structure */
 typedef struct
 {
-	char startLSN[50];
-	char endLSN[50];
-	char startLSNforTOAST[50];
-	char endLSNforTOAST[50];
+	uint64 startLSN;			/* XLogRecPtr, lsnToStr for display */
+	uint64 endLSN;
+	uint64 startLSNforTOAST;
+	uint64 endLSNforTOAST;
 	TransactionId tx;
 	int delCount;
 	TimestampTz txtime;
@@ -592,6 +617,74 @@ typedef struct {
 	int hundred;
 } readItemsArgs;
 
+typedef struct {
+	int nPages;
+	int nItemsSucc;
+	int nItemsErr;
+	int failExist;
+	int datafileExist;
+	int openFailed;
+	int done;
+} readItemsStat;
+
+/*
+ * Sequential page reader: pulls a byte range of a relation segment in
+ * large aligned chunks and hands it out one page at a time.
+ */
+typedef struct {
+	int fd;
+	int ownFd;			/* fd was opened by seqReaderOpen */
+	int dropBehind;		/* POSIX_FADV_DONTNEED consumed chunks */
+	int ioMode;			/* IOMODE_BUFFERED, IOMODE_MMAP or IOMODE_ASYNC */
+	char *map;			/* IOMODE_MMAP: mapping of [mapOff, endOff) */
+	size_t mapLen;
+	off_t mapOff;
+	aioQueue *aio;		/* IOMODE_ASYNC: ranges read ahead of the consumer */
+	aioRequest *slots;
+	int nSlots;
+	int head;			/* slot holding the range being consumed */
+	int curSlot;		/* -1 until the first range is consumed */
+	size_t slotSize;
+	off_t submitOff;	/* file offset of the next range to queue */
+	char *cur;			/* buffer the current pages come from */
+	char *buf;
+	size_t bufSize;
+	size_t bufLen;		/* valid bytes in buf */
+	size_t bufPos;		/* next unread byte in buf */
+	off_t bufOff;		/* file offset of buf[0] */
+	off_t nextOff;		/* file offset of the next chunk */
+	off_t endOff;		/* stop reading here, -1 for EOF */
+} seqReader;
+
+/*
+ * On-disk TOAST chunk index (toastmeta/<toastnode>): a header followed by
+ * fixed-size entries sorted by (valueid, chunkseq), mapped and searched in
+ * place instead of being parsed into a hash.
+ */
+#define TOAST_INDEX_MAGIC 0x58444954	/* "TIDX" */
+#define TOAST_INDEX_VERSION 1
+
+typedef struct toastIndexHeader {
+	uint32 magic;
+	uint32 version;
+	uint64 count;		/* number of entries, set once sorted */
+} toastIndexHeader;
+
+typedef struct toastIndexEntry {
+	uint32 valueid;		/* chunk_id of the toast tuple */
+	uint32 chunkseq;	/* chunk_seq of the toast tuple */
+	uint32 blk;			/* block within segment suffix */
+	uint16 off;			/* lp_off of the tuple in blk */
+	uint16 suffix;		/* segment number, 0 for the base file */
+} toastIndexEntry;
+
+typedef struct toastIndex {
+	char *map;			/* mapped file, NULL for a legacy text index */
+	size_t mapLen;
+	toastIndexEntry *entries;
+	uint64 count;
+} toastIndex;
+
 typedef struct TypeSolution {
     char **types; // Array of type names for each column
     int **cur_off; // Array of type names for each column
@@ -603,7 +696,9 @@ typedef struct TypeSolution {
 
 #define MAX_COL_NUM_DROPSCAN 500
 
-typedef int (*decodeFuncs) (const char *tupleSingleAttr, unsigned int tupleSizeSingleAttr,unsigned int *sizeDecoded);
+struct decodeContext;
+
+typedef int (*decodeFuncs) (struct decodeContext *ctx, const char *tupleSingleAttr, unsigned int tupleSizeSingleAttr,unsigned int *sizeDecoded);
 
 typedef struct dropContext
 {
@@ -668,8 +763,6 @@ typedef struct LsnBlkInfo
 
 
 
-unsigned int hash(harray* harray, char *val, int allocatedVal);
-
 harray *harray_new(int flag);
 
 void harray_append(harray* harray, int flag, void *elem, uint64 val);
@@ -682,6 +775,10 @@ size_t harray_num(const harray *array);
 
 void harray_free(harray* harray);
 
+void harray_iter_init(harrayIter *it, const harray *harray, uint64 key);
+
+void *harray_iter_next(harrayIter *it);
+
 
 int getLineNum(char *filename);
 
@@ -796,13 +893,15 @@ bool shortCMDMatched(char *cmd);
 
 void elemforTimeINIT(DELstruct *elem);
 
-int compare_prefix(const char *a, int a_len, const char *b, int b_len);
-
-int compare_hex(const char *s1, const char *s2);
+int lsnFromStr(const char *str,uint64 *lsn);
 
-bool compareHexStrings(const char *a, const char *b);
+void lsnToStr(uint64 lsn,char *buf);
 
-bool lsnIsReached(uint64 pre,uint64 suff,char *endLSN);
+/* Whether a record at lsn lies past endLSN */
+static inline bool lsnIsReached(uint64 lsn,uint64 endLSN)
+{
+	return lsn > endLSN;
+}
 
 void loadTbspc(DBstruct *databaseoid,int dbsize,char *PGDATA);
 
@@ -866,7 +965,7 @@ systemDropContext* initSystemDropContext(char *flag);
 
 char* read_last_non_empty_line(const char* filename);
 
-void *harray_get(harray* harray, int flag , uint32 val);
+void *harray_get(harray* harray, int flag , uint64 val);
 
 bool unwantedCol(char *colname);
 
@@ -894,6 +993,22 @@ int is_file_larger_than(const char *filename, long long n_bytes);
 
 void setup_crash_handlers(void);
 
+int seqReaderOpen(seqReader *r,const char *path,int fd,off_t start,off_t end,size_t chunkSize,int dropBehind,int ioMode,int ioDepth);
+
+char *seqReaderNext(seqReader *r,size_t pageSize);
+
+void seqReaderClose(seqReader *r);
+
+int toastIndexWriteHeader(FILE *fp);
+
+int toastIndexFinish(const char *path);
+
+toastIndex *toastIndexOpen(const char *path);
+
+uint64 toastIndexFind(const toastIndex *idx,uint32 valueid,uint64 *nEntries);
+
+void toastIndexClose(toastIndex *idx);
+
 #endif /* TOOLS_H */
 
 